@@ -0,0 +1,100 @@
+// Lexer throughput: tokenizes a large source built from .axo files and
+// reports MB/s and tokens/s.
+//
+//     lexer_bench [--size MB] [--repeat N] [file.axo ...]
+//
+// The files (by default every workload in bench/) are concatenated and
+// repeated until the source is at least --size MB, then tokenized --repeat
+// times after one warmup pass. The median run is reported.
+
+#include "include/lexer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef AXO_BENCH_DIR
+#define AXO_BENCH_DIR "bench"
+#endif
+
+namespace {
+
+std::vector<std::string> defaultFiles()
+{
+    std::vector<std::string> files;
+    if (DIR* dir = opendir(AXO_BENCH_DIR)) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".axo") == 0) {
+                files.push_back(std::string(AXO_BENCH_DIR) + "/" + name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    double sizeMB = 32;
+    int repeat = 10;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            sizeMB = std::atof(argv[++i]);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) files = defaultFiles();
+
+    std::string corpus;
+    for (const auto& file : files) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            std::fprintf(stderr, "cannot read %s\n", file.c_str());
+            return 1;
+        }
+        std::stringstream text;
+        text << in.rdbuf();
+        corpus += text.str();
+        corpus += '\n';
+    }
+    if (corpus.empty()) {
+        std::fprintf(stderr, "no input files\n");
+        return 1;
+    }
+
+    std::string source;
+    size_t target = static_cast<size_t>(sizeMB * 1024 * 1024);
+    source.reserve(target + corpus.size());
+    while (source.size() < target) source += corpus;
+
+    size_t tokens = 0;
+    std::vector<double> seconds;
+    for (int run = 0; run <= repeat; ++run) {
+        Lexer lexer(source);  // copies the source, which is not lexing
+        auto start = std::chrono::steady_clock::now();
+        tokens = lexer.tokenize().size();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run > 0) seconds.push_back(elapsed.count());  // the first run is warmup
+    }
+    std::sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+
+    double mb = source.size() / (1024.0 * 1024.0);
+    std::printf("%.1f MB, %zu tokens: %.1f ms, %.0f MB/s, %.1f M tokens/s\n",
+                mb, tokens, median * 1000, mb / median, tokens / median / 1e6);
+    return 0;
+}
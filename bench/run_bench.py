@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Run the bench/ workloads and report timings as JSON.
+
+Each workload runs `--warmup` times untimed, then `--repeat` times timed, on
+every engine given. The report has the median and p95 wall time plus the peak
+resident set size of each workload, so runs from different builds can be
+compared directly.
+
+    python3 bench/run_bench.py --compiler build/compiler --output bench.json
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import subprocess
+import sys
+import threading
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def workloads(selected):
+    names = sorted(f[:-4] for f in os.listdir(BENCH_DIR) if f.endswith(".axo"))
+    if selected:
+        unknown = set(selected) - set(names)
+        if unknown:
+            sys.exit("unknown workload(s): " + ", ".join(sorted(unknown)))
+        names = [n for n in names if n in selected]
+    return names
+
+
+def run_once(command, timeout):
+    """Returns (milliseconds, peak RSS in KiB, exit status) of one run."""
+    start = time.perf_counter()
+    proc = subprocess.Popen(command, cwd=BENCH_DIR, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    timer = threading.Timer(timeout, proc.kill)
+    timer.start()
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = (time.perf_counter() - start) * 1000.0
+    timer.cancel()
+    proc.returncode = os.waitstatus_to_exitcode(status)  # already reaped; keep Popen from waiting again
+    # ru_maxrss is in KiB on Linux and in bytes on macOS
+    rss = usage.ru_maxrss // 1024 if sys.platform == "darwin" else usage.ru_maxrss
+    return elapsed, rss, proc.returncode
+
+
+def percentile(sorted_values, fraction):
+    """Nearest-rank percentile of an already sorted list."""
+    rank = max(1, math.ceil(fraction * len(sorted_values)))
+    return sorted_values[rank - 1]
+
+
+def median(sorted_values):
+    mid = len(sorted_values) // 2
+    if len(sorted_values) % 2:
+        return sorted_values[mid]
+    return (sorted_values[mid - 1] + sorted_values[mid]) / 2
+
+
+def bench(compiler, name, engine, warmup, repeat, timeout):
+    command = [compiler, "--engine=" + engine, name + ".axo"]
+    for _ in range(warmup):
+        run_once(command, timeout)
+
+    times, peak_rss = [], 0
+    for _ in range(repeat):
+        elapsed, rss, code = run_once(command, timeout)
+        if code != 0:
+            return {"bench": name, "engine": engine, "error": "exit status %s" % code}
+        times.append(elapsed)
+        peak_rss = max(peak_rss, rss)
+
+    times.sort()
+    return {
+        "bench": name,
+        "engine": engine,
+        "runs": repeat,
+        "median_ms": round(median(times), 3),
+        "p95_ms": round(percentile(times, 0.95), 3),
+        "min_ms": round(times[0], 3),
+        "max_ms": round(times[-1], 3),
+        "peak_rss_kb": peak_rss,
+    }
+
+
+def git_revision():
+    try:
+        out = subprocess.run(["git", "rev-parse", "--short", "HEAD"], cwd=BENCH_DIR,
+                             capture_output=True, text=True, check=True)
+        return out.stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--compiler", required=True, help="path to the compiler executable")
+    parser.add_argument("--engines", default="tree,vm", help="comma-separated engines (default: tree,vm)")
+    parser.add_argument("--warmup", type=int, default=2, help="untimed runs per workload (default: 2)")
+    parser.add_argument("--repeat", type=int, default=10, help="timed runs per workload (default: 10)")
+    parser.add_argument("--timeout", type=float, default=120.0, help="seconds before a run is killed")
+    parser.add_argument("--output", help="write the JSON report here instead of stdout")
+    parser.add_argument("workloads", nargs="*", help="workloads to run (default: all)")
+    args = parser.parse_args()
+
+    if args.repeat < 1:
+        sys.exit("--repeat must be at least 1")
+    compiler = os.path.abspath(args.compiler)
+    engines = [e for e in args.engines.split(",") if e]
+
+    results = []
+    for name in workloads(args.workloads):
+        for engine in engines:
+            result = bench(compiler, name, engine, args.warmup, args.repeat, args.timeout)
+            results.append(result)
+            if "error" in result:
+                print("%-14s %-5s %s" % (name, engine, result["error"]), file=sys.stderr)
+            else:
+                print("%-14s %-5s median %9.2f ms  p95 %9.2f ms  rss %7d KiB"
+                      % (name, engine, result["median_ms"], result["p95_ms"], result["peak_rss_kb"]),
+                      file=sys.stderr)
+
+    report = {
+        "date": datetime.datetime.now(datetime.timezone.utc).isoformat(timespec="seconds"),
+        "revision": git_revision(),
+        "compiler": compiler,
+        "machine": platform.machine(),
+        "system": platform.system(),
+        "warmup": args.warmup,
+        "repeat": args.repeat,
+        "results": results,
+    }
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+        print("wrote " + args.output, file=sys.stderr)
+    else:
+        print(text)
+    return 1 if any("error" in r for r in results) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
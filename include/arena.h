@@ -0,0 +1,53 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for memory that is freed all at once. Allocation only moves
+// a pointer inside the current block; nothing is returned to the heap before
+// the arena itself is destroyed.
+class Arena {
+public:
+    static constexpr std::size_t kBlockSize = 64 * 1024;
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t))
+    {
+        std::size_t offset = (used + align - 1) & ~(align - 1);
+        if (offset + size > capacity) {
+            return allocateBlock(size, align);
+        }
+        used = offset + size;
+        return block + offset;
+    }
+
+    // The arena AST nodes are allocated from on this thread, or null for the heap
+    static Arena* current();
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* block = nullptr;
+    std::size_t used = 0;
+    std::size_t capacity = 0;
+
+    void* allocateBlock(std::size_t size, std::size_t align);
+};
+
+// Makes `arena` current on this thread for the lifetime of the scope
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena* arena);
+    ~ArenaScope();
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena* saved;
+};
+
+#endif // ARENA_H
@@ -1,26 +1,60 @@
 #ifndef AST_H
 #define AST_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <variant>
+#include "arena.h"
 #include "operators.h"
+#include "types.h"
+#include "value.h"
+
+struct NativeFunction;
+
+// How a statement finished: normally, or by leaving its loop or function
+enum class Completion { Normal, Return, Break, Continue };
+
+// What a function body reaches outside itself, filled in by the Resolver: the
+// names it (or a function nested in it) looks up at runtime, and whether it
+// runs imports. A spawned program's context copies only these.
+struct Captures {
+    std::vector<std::string> names;
+    bool imports = false;
+};
 
 class ASTNode {
 public:
     virtual ~ASTNode() = default;
     virtual std::string accept(class ASTVisitor* visitor) = 0;
+    // Execute as a statement; only nodes that can leave early override this
+    virtual Completion acceptExec(class ExecVisitor* visitor);
+
+    int line = 0;  // source line, set for functions, programs and loops (0 when unknown)
+
+    // Nodes come from Arena::current() while one is set (the parser sets the
+    // Program's arena) and from the heap otherwise. Deleting an arena node
+    // only runs its destructor; the memory goes when the arena does.
+    static void* operator new(std::size_t size);
+    static void operator delete(void* p) noexcept;
 };
 
 // Expressions
-class Expression : public ASTNode {};
+class Expression : public ASTNode {
+public:
+    // Evaluate straight to a runtime Value (no string round-trip)
+    virtual Value acceptValue(class ValueVisitor* visitor) = 0;
+};
 
 class IntegerLiteral : public Expression {
 public:
     int value;
     IntegerLiteral(int val) : value(val) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class FloatLiteral : public Expression {
@@ -28,6 +62,7 @@ public:
     float value;
     FloatLiteral(float val) : value(val) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class StringLiteral : public Expression {
@@ -35,6 +70,20 @@ public:
     std::string value;
     StringLiteral(const std::string& val) : value(val) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
+};
+
+// A string with ${...} interpolations, split up once by the parser
+class TemplateLiteral : public Expression {
+public:
+    struct Part {
+        std::string text;                  // literal text, or the source of `expr`
+        std::unique_ptr<Expression> expr;  // null for literal text
+    };
+    std::vector<Part> parts;
+    size_t literalLength = 0;  // total length of the literal parts
+    std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class BooleanLiteral : public Expression {
@@ -42,13 +91,19 @@ public:
     bool value;
     BooleanLiteral(bool val) : value(val) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class Identifier : public Expression {
 public:
     std::string name;
+    // Bound by the Resolver: `depth` scopes out from the innermost one, at
+    // `slot`. A negative depth means the name is looked up at runtime.
+    int depth = -1;
+    int slot = -1;
     Identifier(const std::string& n) : name(n) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class BinaryOp : public Expression {
@@ -62,6 +117,7 @@ public:
         : left(std::move(l)), op(o), right(std::move(r)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class UnaryOp : public Expression {
@@ -73,6 +129,7 @@ public:
         : op(o), operand(std::move(e)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class FunctionCall : public Expression {
@@ -81,10 +138,13 @@ public:
     std::string name;
     std::unique_ptr<Expression> callee;
     std::vector<std::unique_ptr<Expression>> args;
+    // Set by the parser when the callee names a builtin
+    const NativeFunction* builtin = nullptr;
     
     FunctionCall(const std::string& n) : name(n) {}
     FunctionCall(std::unique_ptr<Expression> c) : callee(std::move(c)) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class ArrayLiteral : public Expression {
@@ -92,13 +152,18 @@ public:
     std::vector<std::unique_ptr<Expression>> elements;
     ArrayLiteral() = default;
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class ObjectLiteral : public Expression {
 public:
     std::vector<std::pair<std::string, std::unique_ptr<Expression>>> fields;
+    // The shape of the objects it builds, found on first use; Shape::empty()
+    // for a literal with fields means none fits (repeated or too many keys)
+    std::atomic<const Shape*> shape{nullptr};
     ObjectLiteral() = default;
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class Block;  // Forward declaration added
@@ -106,13 +171,16 @@ class Block;  // Forward declaration added
 class FunctionExpression : public Expression {
 public:
     std::vector<std::pair<std::string, std::string>> params; // name, type
+    std::vector<const TypeDescriptor*> paramTypes;  // params[i].second, compiled
     std::string returnType;
     std::unique_ptr<Block> body;
+    Captures captures;
     
     FunctionExpression(const std::string& rt, std::unique_ptr<Block> b)
         : returnType(rt), body(std::move(b)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class IndexAccess : public Expression {
@@ -123,16 +191,19 @@ public:
     IndexAccess(std::unique_ptr<Expression> obj, std::unique_ptr<Expression> idx)
         : object(std::move(obj)), index(std::move(idx)) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class FieldAccess : public Expression {
 public:
     std::unique_ptr<Expression> object;
     std::string field;
-    
+    FieldCache cache;
+
     FieldAccess(std::unique_ptr<Expression> obj, const std::string& f)
         : object(std::move(obj)), field(f) {}
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class IndexAssignment : public Expression {
@@ -146,6 +217,7 @@ public:
         : object(std::move(obj)), index(std::move(idx)), value(std::move(val)) {}
 
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class FieldAssignment : public Expression {
@@ -153,11 +225,13 @@ public:
     std::unique_ptr<Expression> object;
     std::string field;
     std::unique_ptr<Expression> value;
+    FieldCache cache;
 
     FieldAssignment(std::unique_ptr<Expression> obj, const std::string& f, std::unique_ptr<Expression> val)
         : object(std::move(obj)), field(f), value(std::move(val)) {}
 
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 // Statements
@@ -173,18 +247,23 @@ public:
 class Block : public Statement {
 public:
     std::vector<std::unique_ptr<ASTNode>> statements;
+    int numSlots = 0;  // resolved declarations in this block's scope
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class VariableDeclaration : public Statement {
 public:
     std::string name;
     std::string type;
+    const TypeDescriptor* declaredType;  // `type`, compiled
     std::unique_ptr<Expression> initializer;
+    bool isConst = false;
+    int slot = -1;  // slot in the enclosing scope, or -1 to define by name
     
     VariableDeclaration(const std::string& n, const std::string& t, 
                         std::unique_ptr<Expression> init = nullptr)
-        : name(n), type(t), initializer(std::move(init)) {}
+        : name(n), type(t), declaredType(TypeDescriptor::get(t)), initializer(std::move(init)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
 };
@@ -193,11 +272,14 @@ class Assignment : public Expression {
 public:
     std::string name;
     std::unique_ptr<Expression> value;
+    int depth = -1;  // target bound by the Resolver, as for Identifier
+    int slot = -1;
     
     Assignment(const std::string& n, std::unique_ptr<Expression> v)
         : name(n), value(std::move(v)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class IfStatement : public Statement {
@@ -212,6 +294,7 @@ public:
           elseBlock(std::move(elseBlk)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class WhileStatement : public Statement {
@@ -223,6 +306,7 @@ public:
         : condition(std::move(cond)), body(std::move(b)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class ForStatement : public Statement {
@@ -231,6 +315,7 @@ public:
     std::unique_ptr<Expression> condition;
     std::unique_ptr<Expression> update;
     std::unique_ptr<Block> body;
+    int numSlots = 0;  // resolved declarations in the loop scope (the init clause)
     
     ForStatement(std::unique_ptr<ASTNode> i, std::unique_ptr<Expression> c,
                  std::unique_ptr<Expression> u, std::unique_ptr<Block> b)
@@ -238,6 +323,7 @@ public:
           body(std::move(b)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class ReturnStatement : public Statement {
@@ -248,14 +334,18 @@ public:
         : value(std::move(v)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class FunctionDeclaration : public ASTNode {
 public:
     std::string name;
     std::vector<std::pair<std::string, std::string>> params; // name, type
+    std::vector<const TypeDescriptor*> paramTypes;  // params[i].second, compiled
     std::string returnType;
     std::unique_ptr<Block> body;
+    int slot = -1;  // slot of the function's name in the enclosing scope, or -1
+    Captures captures;
     
     FunctionDeclaration(const std::string& n, const std::string& rt,
                         std::unique_ptr<Block> b)
@@ -268,7 +358,9 @@ class ProgramDeclaration : public ASTNode {
 public:
     std::string name;
     std::vector<std::pair<std::string, std::string>> params; // name, type
+    std::vector<const TypeDescriptor*> paramTypes;  // params[i].second, compiled
     std::unique_ptr<Block> body;
+    Captures captures;
     
     ProgramDeclaration(const std::string& n, std::unique_ptr<Block> b)
         : name(n), body(std::move(b)) {}
@@ -284,6 +376,20 @@ public:
         : expression(std::move(expr)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
+};
+
+// `spawn name(args)`: starts a program on the thread pool and evaluates to
+// its task handle without waiting for it
+class SpawnExpression : public Expression {
+public:
+    std::unique_ptr<FunctionCall> call;
+
+    SpawnExpression(std::unique_ptr<FunctionCall> c)
+        : call(std::move(c)) {}
+
+    std::string accept(class ASTVisitor* visitor) override;
+    Value acceptValue(class ValueVisitor* visitor) override;
 };
 
 class ImportDeclaration : public ASTNode {
@@ -323,9 +429,10 @@ class TypeDeclaration : public ASTNode {
 public:
     std::string name;
     std::string typeSpec;
+    const TypeDescriptor* descriptor;  // `typeSpec`, compiled
     
     TypeDeclaration(const std::string& n, const std::string& spec)
-        : name(n), typeSpec(spec) {}
+        : name(n), typeSpec(spec), descriptor(TypeDescriptor::get(spec)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
 };
@@ -354,18 +461,21 @@ public:
           catchBlock(std::move(catchBlk)), finallyBlock(std::move(finallyBlk)) {}
     
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class BreakStatement : public Statement {
 public:
     BreakStatement() = default;
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class ContinueStatement : public Statement {
 public:
     ContinueStatement() = default;
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class CaseClause : public ASTNode {
@@ -380,22 +490,47 @@ public:
     std::string accept(class ASTVisitor* visitor) override;
 };
 
+// Where a switch whose case values are all literals starts running, found
+// without evaluating or printing any case. Cases match when they print the
+// same as the discriminant, so every key is a case value as printed; ints
+// are also indexed by value.
+struct SwitchTable {
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    bool linear = false;         // some case value is not a literal: try them in order
+    uint32_t fallback = kNone;   // index of the first default clause
+    int low = 0;                 // `dense[i]` is the clause for the int low + i
+    std::vector<uint32_t> dense;
+    std::unordered_map<int, uint32_t> ints;  // used instead of `dense` when the values are sparse
+    std::unordered_map<std::string, uint32_t> texts;
+};
+
 class SwitchStatement : public Statement {
 public:
     std::unique_ptr<Expression> discriminant;
     std::vector<std::unique_ptr<CaseClause>> cases;
+    // Built on the first run; owned by the statement
+    std::atomic<const SwitchTable*> table{nullptr};
     
     SwitchStatement(std::unique_ptr<Expression> disc)
         : discriminant(std::move(disc)) {}
+    ~SwitchStatement() override { delete table.load(std::memory_order_acquire); }
     
     std::string accept(class ASTVisitor* visitor) override;
+    Completion acceptExec(class ExecVisitor* visitor) override;
 };
 
 class WhenStatement : public Statement {
 public:
     std::unique_ptr<Expression> condition;
     std::unique_ptr<Block> body;
+    // Variables whose assignment wakes the watcher. When none are listed the
+    // Resolver fills in the names the condition reads and sets `inferred`;
+    // `polled` is set instead if the condition calls user code, which may
+    // read anything.
     std::vector<std::string> dependencies;
+    bool inferred = false;
+    bool polled = false;
     
     WhenStatement(std::unique_ptr<Expression> cond, std::unique_ptr<Block> b, std::vector<std::string> deps = {})
         : condition(std::move(cond)), body(std::move(b)), dependencies(std::move(deps)) {}
@@ -405,7 +540,10 @@ public:
 
 class Program : public ASTNode {
 public:
+    // Holds the parsed nodes; declared first so it outlives them
+    std::unique_ptr<Arena> arena = std::make_unique<Arena>();
     std::vector<std::unique_ptr<ASTNode>> declarations;
+    int optimized = 0;  // the highest level the Optimizer has run at
     
     std::string accept(class ASTVisitor* visitor) override;
 };
@@ -418,6 +556,7 @@ public:
     virtual std::string visit(IntegerLiteral* node) = 0;
     virtual std::string visit(FloatLiteral* node) = 0;
     virtual std::string visit(StringLiteral* node) = 0;
+    virtual std::string visit(TemplateLiteral* node) = 0;
     virtual std::string visit(BooleanLiteral* node) = 0;
     virtual std::string visit(Identifier* node) = 0;
     virtual std::string visit(BinaryOp* node) = 0;
@@ -440,6 +579,7 @@ public:
     virtual std::string visit(FunctionDeclaration* node) = 0;
     virtual std::string visit(ProgramDeclaration* node) = 0;
     virtual std::string visit(AwaitExpression* node) = 0;
+    virtual std::string visit(SpawnExpression* node) = 0;
     virtual std::string visit(ExpressionStatement* node) = 0;
     virtual std::string visit(ImportDeclaration* node) = 0;
     virtual std::string visit(UseDeclaration* node) = 0;
@@ -455,4 +595,48 @@ public:
     virtual std::string visit(Program* node) = 0;
 };
 
+// Statement visitor that reports return, break and continue as a Completion
+// instead of unwinding the C++ stack. A returned value is left with the visitor.
+class ExecVisitor {
+public:
+    virtual ~ExecVisitor() = default;
+
+    virtual Completion exec(ASTNode* node) = 0;  // statements that always complete normally
+    virtual Completion exec(Block* node) = 0;
+    virtual Completion exec(IfStatement* node) = 0;
+    virtual Completion exec(WhileStatement* node) = 0;
+    virtual Completion exec(ForStatement* node) = 0;
+    virtual Completion exec(ReturnStatement* node) = 0;
+    virtual Completion exec(TryStatement* node) = 0;
+    virtual Completion exec(BreakStatement* node) = 0;
+    virtual Completion exec(ContinueStatement* node) = 0;
+    virtual Completion exec(SwitchStatement* node) = 0;
+};
+
+// Expression visitor that evaluates nodes directly to a Value
+class ValueVisitor {
+public:
+    virtual ~ValueVisitor() = default;
+    
+    virtual Value visitValue(IntegerLiteral* node) = 0;
+    virtual Value visitValue(FloatLiteral* node) = 0;
+    virtual Value visitValue(StringLiteral* node) = 0;
+    virtual Value visitValue(TemplateLiteral* node) = 0;
+    virtual Value visitValue(BooleanLiteral* node) = 0;
+    virtual Value visitValue(Identifier* node) = 0;
+    virtual Value visitValue(BinaryOp* node) = 0;
+    virtual Value visitValue(UnaryOp* node) = 0;
+    virtual Value visitValue(FunctionCall* node) = 0;
+    virtual Value visitValue(ArrayLiteral* node) = 0;
+    virtual Value visitValue(ObjectLiteral* node) = 0;
+    virtual Value visitValue(FunctionExpression* node) = 0;
+    virtual Value visitValue(IndexAccess* node) = 0;
+    virtual Value visitValue(FieldAccess* node) = 0;
+    virtual Value visitValue(IndexAssignment* node) = 0;
+    virtual Value visitValue(FieldAssignment* node) = 0;
+    virtual Value visitValue(Assignment* node) = 0;
+    virtual Value visitValue(AwaitExpression* node) = 0;
+    virtual Value visitValue(SpawnExpression* node) = 0;
+};
+
 #endif // AST_H
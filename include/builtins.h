@@ -0,0 +1,89 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "value.h"
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Interpreter;
+class TypeDescriptor;
+class FunctionCall;
+
+// One call of a native function, with its arguments already evaluated
+struct NativeCall {
+    Interpreter &interp;
+    std::vector<Value> &args;
+    // Variable passed as the first argument (empty name and null type when it
+    // was not a plain identifier), for functions that change an array in place
+    const std::string &arrayName;
+    const TypeDescriptor *arrayType;
+};
+
+// A function implemented in C++ and callable from scripts
+struct NativeFunction {
+    static constexpr int kVariadic = -1;
+
+    std::string name;
+    int arity = kVariadic;
+    std::string usage;  // appended to arity errors, e.g. "read(filepath)"
+    std::function<Value(NativeCall &)> fn;
+    bool takesArrayVariable = false;  // fill in NativeCall::arrayName/arrayType
+    // Gives way to a function of the same name declared by the script (see
+    // BuiltinBinder). Set on builtins added after scripts could already use
+    // their names for functions of their own.
+    bool shadowable = false;
+
+    // Checks the argument count, then runs the function
+    Value call(Interpreter &interp, std::vector<Value> &args, const std::string &arrayName = "",
+               const TypeDescriptor *arrayType = nullptr) const;
+};
+
+// Builtins by name. The parser binds each call to a registered name to its
+// entry, so calls skip the name lookup at runtime and builtins win over user
+// functions of the same name, shadowable ones excepted. Host functions
+// therefore have to be added before the scripts that call them are parsed.
+class BuiltinRegistry {
+public:
+    // The standard builtins plus everything the host added
+    static BuiltinRegistry &global();
+
+    // Adds a function or replaces the one with the same name. Entries are
+    // never removed, so the returned pointer stays valid.
+    const NativeFunction *add(NativeFunction function);
+    const NativeFunction *add(const std::string &name, int arity, std::function<Value(std::vector<Value> &)> fn);
+
+    const NativeFunction *find(const std::string &name) const;
+
+    // Marks registered builtins shadowable
+    void yieldToScripts(std::initializer_list<const char *> names);
+
+private:
+    BuiltinRegistry();
+
+    std::unordered_map<std::string, std::unique_ptr<NativeFunction>> functions;
+};
+
+// Binds the calls of one source file to builtins. A shadowable builtin gives
+// way to a function, program or named import of the same name anywhere in
+// the file, so those calls are only unbound by finish(), once all of it has
+// been read; unbound calls then find the script's function at runtime.
+class BuiltinBinder {
+public:
+    void bind(FunctionCall *call, const std::string &name);
+    void declare(const std::string &name) { declared.insert(name); }
+    // Takes over the calls of a nested binder (template interpolations)
+    void adopt(BuiltinBinder &nested);
+    void finish();
+
+private:
+    std::vector<FunctionCall *> shadowable;
+    std::unordered_set<std::string> declared;
+};
+
+#endif // BUILTINS_H
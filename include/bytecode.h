@@ -0,0 +1,121 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ast.h"
+#include "value.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bytecode for the stack VM. Every instruction is fixed width: an opcode plus
+// up to three integer operands whose meaning depends on the opcode.
+enum class OpCode : uint8_t {
+    CONST,          // push constants[a]
+    POP,            // discard top of stack
+    LOAD_LOCAL,     // push slot a of the current frame
+    STORE_LOCAL,    // slot a = top; b = var info to type-check, or -1; c = 1 pops the value afterwards
+    DEFINE_LOCAL,   // slot a = pop; b = var info whose declared type the value must match, or -1
+    LOAD_GLOBAL,    // push global a
+    STORE_GLOBAL,   // global a = top; c = 1 pops the value afterwards
+    DEFINE_GLOBAL,  // global a = pop with var info b; c = 1 when the initializer must be type-checked
+    TYPEOF_LOCAL,   // push typeof slot a using the declared type in var info b
+    TYPEOF_GLOBAL,  // push typeof global a using its declared type
+    ADD, SUB, MUL, DIV, MOD,
+    EQ, NE, LT, GT, LE, GE,
+    ADD_CONST, SUB_CONST, MUL_CONST,  // like ADD ... GE, with constants[a] as the right operand
+    DIV_CONST, MOD_CONST,
+    EQ_CONST, NE_CONST, LT_CONST, GT_CONST, LE_CONST, GE_CONST,
+    AND, OR,        // both operands are already evaluated (no short-circuit, like the tree walker)
+    NEG, NOT, TYPEOF,
+    JUMP,           // ip = a
+    JUMP_IF_FALSE,  // pop; if falsy ip = a
+    JUMP_IF_NOT_EQ, JUMP_IF_NOT_NE,  // compare and branch in one step: pop two,
+    JUMP_IF_NOT_LT, JUMP_IF_NOT_GT,  // ip = a unless the comparison holds
+    JUMP_IF_NOT_LE, JUMP_IF_NOT_GE,
+    JUMP_IF_NOT_EQ_CONST, JUMP_IF_NOT_NE_CONST,  // pop one and compare it with constants[b];
+    JUMP_IF_NOT_LT_CONST, JUMP_IF_NOT_GT_CONST,  // ip = a unless the comparison holds
+    JUMP_IF_NOT_LE_CONST, JUMP_IF_NOT_GE_CONST,
+    MAKE_ARRAY,     // pop a values into a new array
+    MAKE_OBJECT,    // pop a values into a new object, keys from keyLists[b] and shape keyShapes[b]
+    GET_INDEX,      // pop index, pop object; push object[index]
+    SET_INDEX,      // pop value, index, object; b = var ref of the array variable, or -1
+    GET_FIELD,      // pop object; push object.<constants[a]>, looked up through fieldCaches[b]
+    SET_FIELD,      // pop value, object; object.<constants[a]> = value, through fieldCaches[b]
+    CALL,           // call the function value below the a arguments on the stack
+    CALL_FUNC,      // call the named function in function slot a with b arguments
+    CALL_BUILTIN,   // call builtinCalls[a] with b arguments
+    DEFINE_FUNC,    // function slot a = protos[b]
+    DEFINE_TYPE,    // typeRegistry[constants[a]] = constants[b]
+    CONCAT,         // pop a values and push their string concatenation
+    PUSH_HANDLER,   // on a runtime error until POP_HANDLER, unwind to here and jump to a
+    POP_HANDLER,
+    RETURN,         // return top of stack to the caller
+    HALT
+};
+
+struct Instruction {
+    OpCode op;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+// A compiled function body (index 0 of a BytecodeProgram is the top-level script)
+struct FunctionProto {
+    std::string name;
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    size_t numParams = 0;
+    size_t numSlots = 0;  // parameters first, then block locals
+    size_t maxStack = 0;  // operand stack high-water mark, used to size frames
+};
+
+// Name and declared type of a variable, referenced by the instructions that need them
+struct VarInfo {
+    std::string name;
+    const TypeDescriptor* type;
+};
+
+// Where a variable named in a builtin call or an index assignment lives
+struct VarRef {
+    bool isGlobal = false;
+    int slot = -1;
+    int info = -1;  // VarInfo index for locals; globals carry their own type at runtime
+};
+
+struct BuiltinCall {
+    const NativeFunction* fn = nullptr;
+    int argc = 0;
+    int arrayVar = -1;  // VarRef index of the array variable a builtin changes in place, or -1
+};
+
+struct BytecodeProgram {
+    std::vector<std::unique_ptr<FunctionProto>> protos;
+    std::unordered_map<const ASTNode*, FunctionProto*> protoFor;  // FunctionDeclaration / FunctionExpression
+    std::vector<std::string> globalNames;
+    std::vector<std::string> functionNames;
+    std::vector<VarInfo> varInfos;
+    std::vector<VarRef> varRefs;
+    std::vector<BuiltinCall> builtinCalls;
+    std::vector<std::vector<std::string>> keyLists;
+    std::vector<const Shape*> keyShapes;  // of objects with keyLists[i], or nullptr when none fits
+    std::vector<const FieldCache*> fieldCaches;  // those of the FieldAccess / FieldAssignment nodes
+};
+
+// Compiles a Program AST to bytecode. Returns nullptr when the program uses
+// something the VM does not support (imports, programs, try/catch, switch,
+// when, ...) or relies on dynamic scoping; callers then fall back to the
+// tree-walking Interpreter.
+class BytecodeCompiler {
+public:
+    std::unique_ptr<BytecodeProgram> compile(Program* program);
+    const std::string& unsupportedReason() const { return reason; }
+
+private:
+    class Impl;
+    std::string reason;
+};
+
+#endif // BYTECODE_H
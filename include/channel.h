@@ -0,0 +1,81 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include "value.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Bounded queue that programs pass values through. Any number of programs may
+// send and receive on one channel. The ring of slots is a bounded MPMC queue
+// in which every slot carries a turn counter saying whether the next send or
+// the next receive may use it, so sends and receives that don't have to wait
+// take no lock; with one sender and one receiver, neither compare-and-swap
+// ever contends. Only a sender that finds the channel full, or a receiver
+// that finds it empty, goes to sleep; the other side wakes it up after its
+// next receive or send.
+//
+// Values are copied when they are sent, so the receiver shares no mutable
+// state with the sender. Channels themselves are passed by reference.
+class Channel {
+public:
+    explicit Channel(size_t capacity);
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    size_t capacity() const { return slotCount; }
+    bool closed() const { return isClosed.load(); }
+
+    // Blocks while the channel is full; throws once it is closed
+    void send(const Value& value);
+    // Blocks while the channel is empty; false once it is closed and drained
+    bool recv(Value& out);
+    // Never blocks; false if the channel is empty
+    bool tryRecv(Value& out);
+    // Wakes every waiting sender and receiver; values already sent can still
+    // be received
+    void close();
+
+    // Receives from whichever channel has a value first, preferring earlier
+    // ones. Returns its index, or -1 once every channel is closed and drained.
+    static int select(const std::vector<Channel*>& channels, Value& out);
+
+private:
+    // A sleeping sender or receiver; one waiter may be on several channels
+    struct Waiter {
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool signaled = false;
+
+        void signal();
+        void wait();  // until signaled, then clears the signal
+    };
+
+    struct Slot {
+        std::atomic<size_t> turn;
+        Value value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t slotCount;
+    alignas(64) std::atomic<size_t> sendPosition{0};
+    alignas(64) std::atomic<size_t> recvPosition{0};
+    std::atomic<bool> isClosed{false};
+
+    std::mutex waitersMutex;
+    std::vector<Waiter*> senders;
+    std::vector<Waiter*> receivers;
+    std::atomic<size_t> sleepingSenders{0};
+    std::atomic<size_t> sleepingReceivers{0};
+
+    bool push(Value& value);  // moves from value on success
+    bool pop(Value& out);
+    void enlist(std::vector<Waiter*>& list, std::atomic<size_t>& count, Waiter* waiter);
+    void delist(std::vector<Waiter*>& list, std::atomic<size_t>& count, Waiter* waiter);
+    void wake(std::vector<Waiter*>& list, std::atomic<size_t>& count);
+};
+
+#endif // CHANNEL_H
@@ -0,0 +1,78 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Arrays and objects are reference counted, which frees them as soon as the
+// last Value holding them goes away, but never frees a cycle (an object whose
+// field points back at its parent). The heap keeps track of every array and
+// object so a collector can find such cycles and break them.
+//
+// A collection works out, for every tracked container, how many of its
+// references come from other containers. One referenced from anywhere else (a
+// variable, an argument, a task result, the C++ stack) is a root; whatever
+// cannot be reached from a root can only be held by other unreachable
+// containers, so their contents are cleared and the reference counts free
+// them. Nothing reachable is touched or moved.
+//
+// Collections run at statement boundaries on the interpreter thread once
+// enough containers have been allocated since the last one, and only while no
+// spawned program or async I/O operation is running (those are the other
+// threads that touch containers). Scripts can also force one with gc().
+class HeapObject {
+public:
+    enum class Kind : uint8_t { Array, Object };
+    Kind heapKind() const { return kind; }
+
+protected:
+    explicit HeapObject(Kind kind);
+    // A copy is a new container; assigning contents keeps the registration
+    HeapObject(const HeapObject& other) : HeapObject(other.kind) {}
+    HeapObject& operator=(const HeapObject&) { return *this; }
+    ~HeapObject();
+
+private:
+    friend class Heap;
+    Kind kind;
+    bool gcReachable = false;             // scratch for collections
+    uint32_t slot = 0;                    // index in the registry's list
+    struct Registry* registry = nullptr;  // of the thread that created it
+    long gcRefs = 0;                      // scratch for collections
+};
+
+class Heap {
+public:
+    struct Stats {
+        uint64_t collections = 0;
+        uint64_t allocated = 0;     // containers ever created
+        uint64_t freed = 0;         // containers freed by collections
+        size_t objects = 0;         // containers alive now
+        uint64_t lastPauseUs = 0;
+        uint64_t maxPauseUs = 0;
+        uint64_t totalPauseUs = 0;
+    };
+
+    // Set once enough has been allocated; checked at every statement boundary
+    static bool due() { return collectionDue.load(std::memory_order_relaxed); }
+    // Collects now unless another thread may be using containers; returns
+    // how many containers were freed
+    static size_t collect();
+    static Stats stats();
+
+    // Spawned programs and async I/O operations count as running from the
+    // time they are submitted until everything they used has been released
+    static void enterMutator() { mutators.fetch_add(1, std::memory_order_acq_rel); }
+    static void leaveMutator() { mutators.fetch_sub(1, std::memory_order_acq_rel); }
+
+private:
+    friend class HeapObject;
+    static std::atomic<bool> collectionDue;
+    static std::atomic<int> mutators;
+
+    static void track(HeapObject* object);
+    static void untrack(HeapObject* object);
+};
+
+#endif // HEAP_H
@@ -2,6 +2,10 @@
 #define INTERPRETER_H
 
 #include "ast.h"
+#include "value.h"
+#include "types.h"
+#include "scheduler.h"
+#include <cstdint>
 #include <unordered_map>
 #include <memory>
 #include <string>
@@ -12,64 +16,56 @@
 #include <unordered_set>
 #include <vector>
 #include <thread>
-#include <future>
-#include <mutex>
+#include <exception>
 
 // Forward declaration for JIT
 class LLVMJITCompiler;
-
-// Forward declarations
-class ArrayValue;
-class ObjectValue;
-
-// Value type supports int, float, string, bool, array, object, and function refs
-using Value = std::variant<int, float, std::string, bool, 
-                           std::shared_ptr<ArrayValue>, 
-                           std::shared_ptr<ObjectValue>,
-                           class FunctionDeclaration*,
-                           class FunctionExpression*>;
-
-// Array: ordered collection of Values
-class ArrayValue {
-public:
-    std::vector<Value> elements;
-    ArrayValue() = default;
-    explicit ArrayValue(const std::vector<Value>& elems) : elements(elems) {}
-};
-
-// Object: key-value map
-class ObjectValue {
-public:
-    std::unordered_map<std::string, Value> fields;
-    ObjectValue() = default;
-};
+class Profiler;
+class BuiltinRegistry;
+class ModuleCache;
 
 struct Variable {
     Value value;
-    std::string type;
+    const TypeDescriptor* type;
     bool isConst;
     
-    Variable(const Value& v = 0, const std::string& t = "int", bool c = false)
-        : value(v), type(t), isConst(c) {}
+    Variable(Value v = 0, const TypeDescriptor* t = TypeDescriptor::defaultType(), bool c = false)
+        : value(std::move(v)), type(t), isConst(c) { type->adopt(value); }
+    Variable(Value v, const std::string& t, bool c = false)
+        : Variable(std::move(v), TypeDescriptor::get(t), c) {}
 };
 
+// Scoped variable storage. Each scope is a flat array of slots; the Resolver
+// hands out slot numbers for locals, and everything else (globals, imports,
+// names reached through dynamic scoping) is found by name.
 class Environment {
 public:
-    void define(const std::string& name, const Variable& var);
-    Variable get(const std::string& name) const;
+    void define(const std::string& name, Variable var);
+    void defineSlot(int slot, const std::string& name, Variable var);
+    Variable& get(const std::string& name);
+    const Variable& get(const std::string& name) const;
+    Variable& at(int depth, int slot, const std::string& name);
     void set(const std::string& name, const Value& value);
+    void setAt(int depth, int slot, const std::string& name, const Value& value);
     bool has(const std::string& name) const;
-    void pushScope();
+    Variable* find(const std::string& name);  // nullptr when undefined
+    const Variable* find(const std::string& name) const;
+    // Where a variable lives (its scope and slot), for indexing by variable.
+    // kNoVariable when undefined. A key is reused once its scope is popped.
+    static constexpr uint64_t kNoVariable = ~uint64_t(0);
+    uint64_t keyOf(const std::string& name) const;
+    uint64_t keyOf(int depth, int slot) const;
+    void pushScope(size_t numSlots = 0);
     void popScope();
     
 private:
-    std::vector<std::unordered_map<std::string, Variable>> scopes;
-};
-
-class ReturnException : public std::exception {
-public:
-    Value value;
-    ReturnException(const Value& v) : value(v) {}
+    struct Scope {
+        std::vector<Variable> slots;
+        std::vector<std::string> names;  // empty until the slot is defined
+    };
+    std::vector<Scope> scopes;  // entries past `depth` are kept to reuse their storage
+    size_t depth = 0;
+    std::unordered_map<std::string, size_t> globalIndex;  // name -> slot of the outermost scope
 };
 
 class ThrowException : public std::exception {
@@ -78,28 +74,43 @@ public:
     ThrowException(const Value& v) : value(v) {}
 };
 
-class BreakException : public std::exception {
-public:
-    BreakException() = default;
-};
-
-class ContinueException : public std::exception {
+class Interpreter : public ASTVisitor, public ValueVisitor, public ExecVisitor {
 public:
-    ContinueException() = default;
-};
-
-class Interpreter : public ASTVisitor {
-public:
-    std::unordered_map<std::string, std::string> typeRegistry;  // Store custom type definitions
+    std::unordered_map<std::string, const TypeDescriptor*> typeRegistry;  // `type` declarations by name
     
     Interpreter();
     ~Interpreter();
     
     void interpret(Program* program);
+
+    // How far programs are rewritten before they run (see optimizer.h); 0
+    // runs them as parsed. interpret() optimizes on its own; the VM and
+    // --dump-ast call optimize() first.
+    void setOptimizationLevel(int level) { optimizationLevel = level; }
+    void optimize(Program* program);
+
+    // Keeps compiled code in `dir` across runs. `source` is the entry script's
+    // text; together with the imported sources it keys the cached objects.
+    void enableJITCache(const std::string& dir, const std::string& source);
+
+    // Runs every function and loop on the tree walker, as --no-jit asks
+    void disableJIT();
+
+    // Keeps imported modules parsed in `dir` across runs (see module_cache.h)
+    void enableModuleCache(const std::string& dir);
+
+    // Counts and times every call and loop from now on (see profiler.h).
+    // The profile lives as long as the interpreter.
+    Profiler& enableProfiling();
+    Profiler* getProfiler() const { return profiler.get(); }
+
+    // Throws (after printing a diagnostic) when an initializer does not match its declared type
+    void checkInitializerType(const std::string& name, const TypeDescriptor* type, const Value& value);
     
     std::string visit(IntegerLiteral* node) override;
     std::string visit(FloatLiteral* node) override;
     std::string visit(StringLiteral* node) override;
+    std::string visit(TemplateLiteral* node) override;
     std::string visit(BooleanLiteral* node) override;
     std::string visit(Identifier* node) override;
     std::string visit(BinaryOp* node) override;
@@ -122,6 +133,7 @@ public:
     std::string visit(FunctionDeclaration* node) override;
     std::string visit(ProgramDeclaration* node) override;
     std::string visit(AwaitExpression* node) override;
+    std::string visit(SpawnExpression* node) override;
     std::string visit(ExpressionStatement* node) override;
     std::string visit(Program* node) override;
     std::string visit(ImportDeclaration* node) override;
@@ -135,43 +147,121 @@ public:
     std::string visit(CaseClause* node) override;
     std::string visit(SwitchStatement* node) override;
     std::string visit(WhenStatement* node) override;
+
+    Completion exec(ASTNode* node) override;
+    Completion exec(Block* node) override;
+    Completion exec(IfStatement* node) override;
+    Completion exec(WhileStatement* node) override;
+    Completion exec(ForStatement* node) override;
+    Completion exec(ReturnStatement* node) override;
+    Completion exec(TryStatement* node) override;
+    Completion exec(BreakStatement* node) override;
+    Completion exec(ContinueStatement* node) override;
+    Completion exec(SwitchStatement* node) override;
+
+    Value visitValue(IntegerLiteral* node) override;
+    Value visitValue(FloatLiteral* node) override;
+    Value visitValue(StringLiteral* node) override;
+    Value visitValue(TemplateLiteral* node) override;
+    Value visitValue(BooleanLiteral* node) override;
+    Value visitValue(Identifier* node) override;
+    Value visitValue(BinaryOp* node) override;
+    Value visitValue(UnaryOp* node) override;
+    Value visitValue(FunctionCall* node) override;
+    Value visitValue(ArrayLiteral* node) override;
+    Value visitValue(ObjectLiteral* node) override;
+    Value visitValue(FunctionExpression* node) override;
+    Value visitValue(IndexAccess* node) override;
+    Value visitValue(FieldAccess* node) override;
+    Value visitValue(IndexAssignment* node) override;
+    Value visitValue(FieldAssignment* node) override;
+    Value visitValue(Assignment* node) override;
+    Value visitValue(AwaitExpression* node) override;
+    Value visitValue(SpawnExpression* node) override;
     
 private:
+    friend class VM;  // shares the operator, truthiness and formatting helpers
+    friend class BuiltinRegistry;  // registers the standard builtins
+    friend class LLVMJITCompiler;  // looks up functions and variables when tiering up
+    friend class Session;  // runs fragments and host calls against one long-lived interpreter
+    friend class Optimizer;  // folds constants by the same operator rules
+
+    // `when` watchers are indexed by the variables they depend on. Writing a
+    // variable only queues its watchers; their conditions are evaluated once
+    // per batch, between statements (see runPendingWhens).
     struct PendingWhen {
-        Expression* condition;
-        Block* body;
-        std::vector<std::string> dependencies;
-        std::unordered_map<std::string, Value> lastValues;
-        bool lastConditionState = false;
+        WhenStatement* node;
+        std::vector<uint64_t> keys;  // dependencies that were defined when registered
+        bool queued = false;
+        bool fired = false;
     };
-    std::vector<PendingWhen> pendingWhens;
-    void checkPendingWhens(const std::string& changedVar = "");
+    using WhenPtr = std::shared_ptr<PendingWhen>;  // a running batch keeps fired watchers alive
+    std::vector<WhenPtr> pendingWhens;
+    std::unordered_map<uint64_t, std::vector<WhenPtr>> whenWatchers;         // variable key -> watchers
+    std::unordered_map<std::string, std::vector<WhenPtr>> whenAwaitedNames;  // dependencies not defined yet
+    std::vector<WhenPtr> queuedWhens;
+    std::vector<WhenPtr> polledWhens;  // conditions that call user code run every batch
+    void queueWhen(const WhenPtr& pw);
+    void notifyChanged(uint64_t key);
+    void notifyChanged(Identifier* id);
+    void notifyDefined(const std::string& name);
+    bool whensDue() const { return !queuedWhens.empty() || !polledWhens.empty(); }
+    void runPendingWhens();
+    void removeWhen(const WhenPtr& pw);
     Environment environment;
     std::unordered_map<std::string, FunctionDeclaration*> functions;
     std::unordered_map<std::string, ProgramDeclaration*> programs;
-    std::unordered_map<std::string, std::future<void>> runningPrograms;
-    std::mutex programsMutex;
-    std::unordered_set<std::string> importedFiles;
+    std::vector<std::shared_ptr<ProgramTask>> spawnedTasks;  // not known to be finished yet
+    std::unordered_map<std::string, uint64_t> importedFiles;  // path -> hash of its source, 0 while it is loading
     std::unordered_map<std::string, std::unordered_map<std::string, Value>> moduleExports;  // Store exports per module
     std::unordered_map<std::string, Value> moduleDefaultExports;  // Store default exports per module
     std::string currentModulePath;  // Track current module being processed
+    int optimizationLevel = 1;
     std::unordered_map<std::string, std::unique_ptr<Program>> importedASTs;  // Keep imported ASTs alive
-    Value lastValue;  // Store last evaluated complex value (array, object)
-    Variable lastVariable;  // Store last accessed variable for typeof operations
-    std::string lastVariableName;  // Store last accessed variable name
+    std::shared_ptr<ModuleCache> moduleCache;  // null unless enableModuleCache() was called
+    std::unordered_map<std::string, std::string> resolvedImports;  // importing directory + '\0' + path -> resolved path
+    struct PreloadedModule {
+        std::unique_ptr<Program> program;
+        uint64_t sourceHash = 0;
+        std::exception_ptr error;  // rethrown when the import runs
+    };
+    std::unordered_map<std::string, PreloadedModule> preloadedModules;  // parsed but not imported yet
     std::unique_ptr<LLVMJITCompiler> jitCompiler;  // JIT compiler for loop optimization
+    std::unique_ptr<Profiler> profiler;  // null unless enableProfiling() was called
+
+    static void registerBuiltins(BuiltinRegistry& registry);  // defined in builtins.cpp
+
+    Interpreter(const Interpreter& parent, const Captures& captures, ValueCopier& copier);
+    ProgramDeclaration* calledProgram(FunctionCall* call);
+    std::shared_ptr<ProgramTask> spawnProgram(ProgramDeclaration* prog, FunctionCall* call);
+    void runTask(ProgramTask& task, ProgramDeclaration* prog, std::vector<Value> args);
     
     Value evaluate(Expression* expr);
+    Variable& lookup(Identifier* id);
+    void evaluateArgs(FunctionCall* call, std::vector<Value>& args);
+    class CallArgs;
+    std::vector<std::vector<Value>> spareArgs;  // argument vectors of finished calls, kept for reuse
+    // Moves the arguments out of `args` into the callee's slots
+    Value callFunction(const std::vector<std::pair<std::string, std::string>>& params,
+                       const std::vector<const TypeDescriptor*>& paramTypes, Block* body, std::vector<Value>& args);
+    Value callFunction(FunctionDeclaration* func, std::vector<Value>& args);
+    Value callFunction(FunctionExpression* func, std::vector<Value>& args);
+    Value callFunction(FunctionDeclaration* func, std::vector<Value>&& args) { return callFunction(func, args); }
+    Value callFunction(FunctionExpression* func, std::vector<Value>&& args) { return callFunction(func, args); }
+    Value returnValue;  // set by the statement that completed with Completion::Return
     void execute(Statement* stmt);
-    void executeBlock(Block* block);
-    void checkPendingWhens();
+    Completion executeBlock(Block* block);
+    const SwitchTable* switchTable(SwitchStatement* node);
     
     Value performBinaryOp(const Value& left, BinaryOperator op, const Value& right);
     Value performUnaryOp(UnaryOperator op, const Value& operand);
     bool isTruthy(const Value& v);
     std::string valueToString(const Value& v);
-    std::string getTypeOfValue(const Value& v);
-    std::string resolveImportPath(const std::string& requestedPath);
+    std::string getTypeOfValue(const Value& v, const std::string& declaredType = "");
+    std::string resolveImportPath(const std::string& requestedPath, const std::string& fromModule);
+    std::string findImportPath(const std::string& requestedPath, const std::string& fromModule);
+    void preloadImports(Program* program);
+    std::unique_ptr<Program> loadModule(const std::string& resolvedPath);
 };
 
 #endif // INTERPRETER_H
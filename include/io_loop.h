@@ -0,0 +1,72 @@
+#ifndef IO_LOOP_H
+#define IO_LOOP_H
+
+#include "scheduler.h"
+#include "value.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs file operations and timers in the background for the async builtins.
+// Every operation hands back a task that `await` waits on like a spawned
+// program's, so a script can keep many of them in flight and collect the
+// results later.
+//
+// File operations go to a few I/O threads of their own, so slow disks never
+// take workers from the TaskPool that programs run on. Timers cost no thread
+// each: one timer thread sleeps until the earliest deadline.
+//
+// When the loop shuts down, file operations already submitted still run to
+// completion; timers that have not fired are dropped.
+class IOLoop {
+public:
+    using Operation = std::function<Value()>;
+
+    explicit IOLoop(unsigned ioThreads);
+    ~IOLoop();
+    IOLoop(const IOLoop&) = delete;
+    IOLoop& operator=(const IOLoop&) = delete;
+
+    // Started on first use
+    static IOLoop& shared();
+
+    // Runs `op` on an I/O thread. The task finishes with its result, or
+    // fails with what it threw; `name` is what the task prints as.
+    std::shared_ptr<ProgramTask> submit(std::string name, Operation op);
+    // A task that finishes with an empty string after `delay`
+    std::shared_ptr<ProgramTask> timer(std::chrono::milliseconds delay);
+
+private:
+    struct Pending {
+        std::shared_ptr<ProgramTask> task;
+        Operation op;
+    };
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        std::shared_ptr<ProgramTask> task;
+        bool operator>(const Timer& other) const { return deadline > other.deadline; }
+    };
+
+    std::vector<std::thread> ioThreads;
+    std::thread timerThread;
+
+    // Guarded by mutex
+    std::mutex mutex;
+    std::condition_variable ioReady;
+    std::condition_variable timersChanged;
+    std::deque<Pending> operations;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    bool stopping = false;
+
+    void ioLoop();
+    void timerLoop();
+};
+
+#endif // IO_LOOP_H
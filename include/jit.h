@@ -4,27 +4,44 @@
 #include "interpreter.h"
 #include "ast.h"
 #include <memory>
-#include <functional>
+#include <string>
+#include <vector>
 
-// JIT Compiler: compiles simple loops to native code using LLVM
+// Tiered JIT: the interpreter counts calls and loop iterations, and hot
+// functions and loops that only compute on int/float values are compiled to
+// native code with LLVM ORC. Compiled code is cached per AST node.
+//
+// Compiled code has no side effects besides its own variables, so when a guard
+// fails part-way (division by zero, ...) it returns without writing anything
+// back and the interpreter simply runs the call or loop itself.
 class LLVMJITCompiler {
 public:
+    // Interpreted calls of a function before it is compiled
+    static constexpr unsigned kHotCallCount = 10;
+    // Iterations of one loop execution before the rest of it is compiled
+    static constexpr unsigned kHotLoopIterations = 100;
+
     LLVMJITCompiler();
     ~LLVMJITCompiler();
-    
-    // Check if a while loop is JIT-compilable
-    bool isCompilable(WhileStatement *stmt);
-    
-    // Compile and execute a while loop, returns false if not compilable
-    // If compilable, executes the loop and returns true
-    bool compileAndExecute(WhileStatement *stmt, Interpreter *interp, Environment &env);
-    
-    // Check if a for loop is JIT-compilable
-    bool isCompilable(ForStatement *stmt);
-    
-    // Compile and execute a for loop, returns false if not compilable
-    bool compileAndExecute(ForStatement *stmt, Interpreter *interp, Environment &env);
-    
+
+    // Keeps compiled objects in `dir` and reuses them in later runs. The key of
+    // each object hashes the generated IR, the host CPU, `source` (the entry
+    // script) and the imported sources, so an edited import never hits a stale
+    // entry. Must be called before anything is compiled.
+    void enableCache(const std::string &dir, const std::string &source);
+
+    // Counts a call of `func` and, once it is hot and compiled, runs it
+    // natively. Returns false when the interpreter has to run the call: the
+    // function is still cold, cannot be compiled, or a guard failed.
+    bool tryCall(FunctionDeclaration *func, const std::vector<Value> &args, Value &result, Interpreter &interp);
+
+    // Runs the remaining iterations of a loop natively, entering at its
+    // condition. `iterations` is how many the interpreter has run so far: the
+    // loop is looked up on entry and compiled once it reaches
+    // kHotLoopIterations. Returns false when the interpreter has to go on.
+    bool runLoop(WhileStatement *stmt, unsigned iterations, Interpreter &interp);
+    bool runLoop(ForStatement *stmt, unsigned iterations, Interpreter &interp);
+
 private:
     class Impl;
     std::unique_ptr<Impl> impl;
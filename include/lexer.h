@@ -2,10 +2,15 @@
 #define LEXER_H
 
 #include "token.h"
+#include <deque>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 
+// Turns source text into tokens in one pass. Keywords are found through a
+// perfect hash built at compile time, and runs of blanks, comment text and
+// string bodies are skipped 16 bytes at a time where the CPU has SSE2 or NEON.
+// Token values point into the lexer, so it must outlive its tokens.
 class Lexer {
 public:
     Lexer(const std::string& source);
@@ -17,10 +22,14 @@ private:
     std::string source;
     size_t position;
     int line;
-    int column;
-    
-    static std::unordered_map<std::string, TokenType> keywords;
+    size_t lineStart;  // offset of the current line's first char
+    // Text of the string literals with escapes and of template literals,
+    // which differs from their source; a deque never moves its elements
+    std::deque<std::string> literals;
     
+    int column() const { return static_cast<int>(position - lineStart) + 1; }
+    // The source from `start` up to the current position
+    std::string_view text(size_t start) const;
     char currentChar() const;
     char peekChar(size_t offset = 1) const;
     void advance();
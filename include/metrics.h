@@ -0,0 +1,155 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Runtime metrics and trace events for long-running scripts (--metrics,
+// --metrics-jsonl, --trace). Every thread records into a shard of its own, so
+// recording never contends; the shards are added up only when the metrics are
+// exported.
+//
+// Nothing is recorded until enable() is called. Each recording site first
+// reads one relaxed flag, so the instrumentation costs next to nothing when
+// it is off and stays compiled in.
+//
+// Gauges are counters that go both ways (programs running, whens pending).
+// Histograms count durations in buckets of powers of two microseconds.
+// Trace events are spans (program runs, awaits, imports) kept per thread and
+// written in the Chrome trace-event format that Perfetto and chrome://tracing
+// read.
+class Metrics {
+public:
+    enum class Counter : uint8_t {
+        ProgramsSpawned,
+        ProgramsFailed,
+        Awaits,
+        Imports,
+        JitFunctionsCompiled,
+        JitFunctionsFailed,
+        JitLoopsCompiled,
+        JitLoopsFailed,
+        JitNativeCalls,
+        JitNativeLoops,
+        JitGuardExits,  // native code handed a call or loop back to the interpreter
+        Count
+    };
+    enum class Gauge : uint8_t {
+        ProgramsRunning,
+        WhensPending,
+        Count
+    };
+    enum class Histogram : uint8_t {
+        ProgramSeconds,
+        AwaitSeconds,
+        ImportSeconds,
+        JitCompileSeconds,
+        IoRead,
+        IoWrite,
+        IoReadDir,
+        IoCopy,
+        IoReader,  // readLine, readLines and readChunk
+        Count
+    };
+
+    // Starts recording; with `trace`, spans are kept for writeTrace() too
+    static void enable(bool trace);
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+    static bool tracing() { return tracingOn.load(std::memory_order_relaxed); }
+
+    static void count(Counter counter)
+    {
+        if (enabled()) add(counter);
+    }
+    static void adjust(Gauge gauge, int64_t delta)
+    {
+        if (enabled()) add(gauge, delta);
+    }
+
+    // Everything recorded so far in the Prometheus text format, with the heap
+    // and collector statistics
+    static void writePrometheus(std::ostream& out);
+    // The same as one line of JSON, stamped with the wall-clock time
+    static void writeJSONLine(std::ostream& out);
+    // Every span recorded so far as a Chrome trace-event file
+    static void writeTrace(std::ostream& out);
+
+private:
+    friend class MetricsScope;
+    static std::atomic<bool> on;
+    static std::atomic<bool> tracingOn;
+
+    static void add(Counter counter);
+    static void add(Gauge gauge, int64_t delta);
+    static void observe(Histogram histogram, std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end);
+    static void span(const char* category, const std::string& name, std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end);
+};
+
+// Times its scope into a histogram. Given a category, the scope is also a
+// span named `name` in the trace. Does nothing while metrics are off.
+class MetricsScope {
+public:
+    explicit MetricsScope(Metrics::Histogram histogram, const char* category = nullptr,
+                          const std::string* name = nullptr)
+        : histogram(histogram), category(category), name(name), active(Metrics::enabled())
+    {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+    ~MetricsScope()
+    {
+        if (!active) return;
+        auto end = std::chrono::steady_clock::now();
+        Metrics::observe(histogram, start, end);
+        if (category && Metrics::tracing()) {
+            Metrics::span(category, name ? *name : std::string(), start, end);
+        }
+    }
+    MetricsScope(const MetricsScope&) = delete;
+    MetricsScope& operator=(const MetricsScope&) = delete;
+
+private:
+    Metrics::Histogram histogram;
+    const char* category;
+    const std::string* name;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Writes the metrics out while a script runs: the Prometheus file is replaced
+// every `interval` (renamed into place, so a scraper never reads half of
+// it), and a JSON line is appended to the other file. Both are written once
+// more, and the trace file once, when the exporter is destroyed. Empty paths
+// are skipped.
+class MetricsExporter {
+public:
+    struct Options {
+        std::string prometheusPath;
+        std::string jsonlPath;
+        std::string tracePath;
+        std::chrono::milliseconds interval{10000};
+    };
+
+    explicit MetricsExporter(Options options);
+    ~MetricsExporter();
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+private:
+    Options options;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable stopChanged;
+    bool stopping = false;  // guarded by mutex
+
+    void exportMetrics();
+};
+
+#endif // METRICS_H
@@ -0,0 +1,49 @@
+#ifndef MODULE_CACHE_H
+#define MODULE_CACHE_H
+
+#include "ast.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Keeps parsed modules on disk, so later runs load imports without lexing
+// and parsing them. Each module is stored as a compact binary encoding of its
+// freshly parsed Program (before the Resolver has bound anything), in a file
+// named after the module's path.
+//
+// An entry records the source's modification time, size and hash. If the
+// time and size still match, the entry is used without reading the source
+// at all; otherwise the source is hashed and the entry is used only if the
+// contents are unchanged. The entry also carries a hash of its own encoded
+// body, so one damaged or edited on disk is parsed afresh instead of run.
+// Entries are read through mmap where available.
+class ModuleCache {
+public:
+    explicit ModuleCache(std::string dir);
+
+    // A module loaded from the cache or parsed from its source
+    struct Module {
+        std::unique_ptr<Program> program;
+        uint64_t sourceHash = 0;  // hash() of the source text
+    };
+
+    // xxHash64 of `text`. Unlike std::hash, it is the same in every build,
+    // so it can name and check files that outlive the process.
+    static uint64_t hash(const std::string& text);
+
+    // Throws if the source cannot be read or does not parse
+    Module load(const std::string& path);
+
+    // The binary form of a program straight from the parser. decode() gives
+    // null for anything it cannot read.
+    static std::string encode(Program& program);
+    static std::unique_ptr<Program> decode(const char* data, size_t size);
+
+private:
+    std::string dir;
+
+    std::string entryPath(const std::string& path) const;
+};
+
+#endif // MODULE_CACHE_H
@@ -0,0 +1,77 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Interpreter;
+
+// Rewrites a parsed program into a cheaper one that does the same, before
+// the Resolver binds it. Both engines run the rewritten tree.
+//
+// Level 1 folds operators and template strings whose operands are all
+// literals, and drops code that can never run: the branch an if with a
+// constant condition does not take, while loops whose condition is a false
+// constant, and statements after a return, break, continue or throw.
+//
+// Level 2 also replaces reads of a const whose initializer folds to a literal
+// of its declared type with that literal, and takes len(x) in a for loop's
+// condition once before the loop when nothing in the loop can change x. Both
+// rely on seeing every statement that could write the variable, so they are
+// skipped in programs that import or use other files.
+//
+// Folding uses the interpreter's own operator rules, so a folded program
+// prints what the original would have. An operation that would fail at run
+// time (or divide an int by zero) is left in place to fail there.
+class Optimizer {
+public:
+    static constexpr int kMaxLevel = 2;
+
+    Optimizer(Interpreter& interp, int level) : interp(interp), level(level) {}
+
+    // Rewrites `program` in place; new nodes come from the program's arena
+    void optimize(Program* program);
+
+    // Writes `program` out as source, as --dump-ast shows it
+    static void print(Program* program, std::ostream& out);
+
+private:
+    struct Name {
+        int declarations = 0;  // variables, parameters, functions and catch variables
+        std::string type;      // declared type of the last of them
+        bool assigned = false;
+    };
+
+    Interpreter& interp;
+    int level;
+
+    // What level 2 knows about the whole program before rewriting it
+    std::unordered_map<std::string, Name> names;
+    bool seesEverything = true;  // no import or use could run code not in the program
+    bool hasWhen = false;        // watchers may run between any two statements
+
+    // Consts whose reads are replaced from here on, and the order they were
+    // declared in, so leaving a scope can forget its own
+    std::unordered_map<std::string, Value> constants;
+    std::vector<std::string> constantOrder;
+
+    void gather(ASTNode* node);
+    void declare(VariableDeclaration* decl);
+    void forgetSince(size_t mark);
+
+    void rewrite(std::unique_ptr<ASTNode>& node);
+    void rewrite(std::unique_ptr<Expression>& expr);
+    void rewriteStatements(std::vector<std::unique_ptr<ASTNode>>& statements);
+    void rewriteBlock(Block* block);
+    void rewriteFunction(Block* body);
+    void rewriteTemplate(TemplateLiteral* tmpl);
+    void hoistLength(std::unique_ptr<ASTNode>& node);
+    bool mayChangeLength(ASTNode* node, const std::string& name, bool elementsResize);
+
+    bool fold(BinaryOperator op, const Value& left, const Value& right, Value& result);
+};
+
+#endif // OPTIMIZER_H
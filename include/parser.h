@@ -3,27 +3,38 @@
 
 #include "token.h"
 #include "ast.h"
+#include "builtins.h"
+#include <initializer_list>
 #include <vector>
 #include <memory>
 #include <stdexcept>
 
 class Parser {
 public:
+    // The tokens are borrowed, not copied, and must outlive the parser
     Parser(const std::vector<Token>& tokens);
+    Parser(std::vector<Token>&&) = delete;
     
+    // The returned Program owns the arena its nodes are allocated from
+
     std::unique_ptr<Program> parse();
     std::unique_ptr<Expression> parseExpression();
+
+    // A function defined before this source (by an earlier REPL fragment),
+    // which shadowable builtins give way to like one declared in it
+    void declareFunction(const std::string& name) { builtins.declare(name); }
     
 private:
-    std::vector<Token> tokens;
+    const std::vector<Token>& tokens;
     size_t current;
+    BuiltinBinder builtins;
     
-    Token peek() const;
-    Token previous() const;
-    Token advance();
+    const Token& peek() const;
+    const Token& previous() const;
+    const Token& advance();
     bool check(TokenType type) const;
-    bool match(const std::vector<TokenType>& types);
-    Token consume(TokenType type, const std::string& message);
+    bool match(std::initializer_list<TokenType> types);
+    const Token& consume(TokenType type, const std::string& message);
     bool isAtEnd() const;
     
     // Parsing methods
@@ -57,6 +68,7 @@ private:
     std::unique_ptr<Expression> parseUnary();
     std::unique_ptr<Expression> parsePrimary();
     std::unique_ptr<Expression> parsePostfix();
+    std::unique_ptr<Expression> parseTemplate(const std::string& value);
     
     // Helper for parsing function types: (type1, type2)->returnType
     std::string parseFunctionType();
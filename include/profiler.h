@@ -0,0 +1,117 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "ast.h"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Execution profile of the tree walker (--profile). Calls of functions and
+// programs are timed as they enter and leave, which gives exact call counts
+// and inclusive/exclusive times. That time is also charged to the whole call
+// stack, so it can be written in the collapsed format read by flamegraph.pl
+// and speedscope. Loops count how often they run and how many iterations the
+// interpreter executed before the JIT took over, if it did.
+//
+// Calls made from code the JIT runs natively are not seen; their time stays
+// with the native caller.
+class Profiler {
+public:
+    Profiler();
+
+    // `node` identifies the function; `name` and `line` label it in reports
+    void enter(const ASTNode* node, const std::string& name, int line);
+    void leave();
+    void loop(const ASTNode* node, const char* kind, int line, uint64_t iterations, bool native);
+
+    // Closes the top-level frame; call once the script has finished
+    void stop();
+
+    // One line per call stack: "<main>;outer:3;fib:10 <exclusive microseconds>"
+    void writeCollapsed(std::ostream& out) const;
+    // The `top` functions by exclusive time and loops by iterations
+    void writeSummary(std::ostream& out, size_t top) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct FunctionStats {
+        std::string name;
+        int line;
+        uint64_t calls = 0;
+        Clock::duration inclusive{};  // only counted at the outermost active call
+        Clock::duration exclusive{};
+        int active = 0;               // recursion depth
+    };
+    struct StackNode {
+        size_t function;
+        std::unordered_map<size_t, size_t> children;  // function -> node
+        Clock::duration self{};
+        size_t parent;
+    };
+    struct Frame {
+        size_t node;
+        Clock::time_point start;
+        Clock::duration children{};
+    };
+    struct LoopStats {
+        const char* kind;
+        int line;
+        uint64_t entries = 0;
+        uint64_t iterations = 0;
+        uint64_t native = 0;  // entries the JIT finished
+    };
+
+    std::unordered_map<const ASTNode*, size_t> functionIndex;
+    std::vector<FunctionStats> functions;  // 0 is the top level
+    std::vector<StackNode> nodes;          // call tree, 0 is the top level
+    std::vector<Frame> frames;
+    std::unordered_map<const ASTNode*, LoopStats> loops;
+
+    std::string label(size_t function) const;
+};
+
+// Times one call for the lifetime of the scope; does nothing without a profiler
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const ASTNode* node, const std::string& name, int line)
+        : profiler(profiler)
+    {
+        if (profiler) profiler->enter(node, name, line);
+    }
+    ~ProfileScope()
+    {
+        if (profiler) profiler->leave();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* profiler;
+};
+
+// Reports one execution of a loop when the scope ends, however it is left
+class LoopProfile {
+public:
+    LoopProfile(Profiler* profiler, const ASTNode* node, const char* kind, const unsigned& iterations,
+                const bool& native)
+        : profiler(profiler), node(node), kind(kind), iterations(iterations), native(native) {}
+    ~LoopProfile()
+    {
+        if (profiler) profiler->loop(node, kind, node->line, iterations, native);
+    }
+    LoopProfile(const LoopProfile&) = delete;
+    LoopProfile& operator=(const LoopProfile&) = delete;
+
+private:
+    Profiler* profiler;
+    const ASTNode* node;
+    const char* kind;
+    const unsigned& iterations;
+    const bool& native;
+};
+
+#endif // PROFILER_H
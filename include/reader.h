@@ -0,0 +1,51 @@
+#ifndef READER_H
+#define READER_H
+
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+// Reads a file a line or a chunk at a time, so a script can go through files
+// far larger than memory. Where the platform has mmap the file is mapped and
+// each line is copied straight out of the mapping; pages already read are
+// handed back as the reader moves on, so memory use stays flat however large
+// the file. Anything that cannot be mapped (pipes, devices, other platforms)
+// is read through a stream instead.
+//
+// Readers are shared by reference like channels, and reads are serialized,
+// so programs given the same reader each get different lines.
+class FileReader {
+public:
+    explicit FileReader(const std::string& path);  // throws if it cannot be opened
+    ~FileReader();
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    const std::string& path() const { return filePath; }
+
+    // The next line without its line ending ("\n" or "\r\n"); false at the end
+    bool readLine(std::string& line);
+    // Up to maxBytes more bytes; empty at the end
+    std::string readChunk(size_t maxBytes);
+    // Releases the file; later reads find nothing
+    void close();
+
+private:
+    std::string filePath;
+    std::mutex mutex;
+
+    // Mapped files
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t position = 0;
+    size_t released = 0;  // pages before this offset were given back
+
+    // Everything else
+    std::ifstream stream;
+
+    void releaseConsumed();
+    void unmap();
+};
+
+#endif // READER_H
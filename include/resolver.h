@@ -0,0 +1,59 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "ast.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Binds variable references to (depth, slot) pairs so the Interpreter can reach
+// locals without hashing names. It mirrors the scopes the Interpreter pushes:
+// a parameter scope per call, one per block, one per for loop and one per
+// catch clause.
+//
+// Only names declared inside the same function body are bound. Globals, free
+// names (seen through dynamic scoping), names brought in by imports and names
+// declared directly in switch cases (which may or may not run) are left to the
+// runtime name lookup.
+class Resolver {
+public:
+    void resolve(Program* program);
+
+    // Whether the program just resolved declares functions or programs, or
+    // holds function expressions, `when`s or loops. The interpreter keeps
+    // pointers to those (the JIT and profiler index loops by node), so such
+    // a program must outlive it.
+    bool holdsCode() const { return holds; }
+
+private:
+    struct Scope {
+        std::unordered_map<std::string, int> slots;
+        int* numSlots;  // node field that receives the slot count, if any
+        int count;
+    };
+
+    std::vector<Scope> scopes;                  // scopes of the current function, innermost last
+    std::unordered_set<std::string> unbound;    // names bound by name in the current function
+    std::unordered_set<std::string> imported;   // names defined by imports anywhere
+    Captures* captures = nullptr;               // of the current function, null at top level
+    bool holds = false;
+
+    void resolveNode(ASTNode* node);
+    void resolveExpression(Expression* expr);
+    void resolveBlock(Block* block);
+    void resolveFunction(const std::vector<std::pair<std::string, std::string>>& params, Block* body,
+                         Captures& captured);
+
+    void pushScope(int* numSlots, int count = 0);
+    void popScope();
+    int declare(const std::string& name);
+    bool bind(const std::string& name, int& depth, int& slot) const;
+    void capture(const std::string& name);
+
+    static void collectImports(ASTNode* node, std::unordered_set<std::string>& names);
+    static void collectCaseDeclarations(ASTNode* node, std::unordered_set<std::string>& names);
+    static bool collectReads(Expression* expr, std::vector<std::string>& names);
+};
+
+#endif // RESOLVER_H
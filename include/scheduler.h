@@ -0,0 +1,103 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "value.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool that spawned programs run on. Every worker has
+// its own deque: jobs submitted from a worker go on its own deque and it
+// takes the newest first, and an idle worker steals the oldest job of another
+// one. Jobs submitted from other threads are dealt out round-robin.
+//
+// A job that has to wait (for a task or on a channel) marks the wait with a
+// Blocking guard. While too few threads are left running, the pool starts a
+// spare worker for the queued jobs, which retires once it runs out of work,
+// so jobs waiting on each other can never tie up every worker.
+class TaskPool {
+public:
+    using Job = std::function<void()>;
+
+    explicit TaskPool(unsigned workers);
+    ~TaskPool();
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // One worker per hardware thread, started on first use
+    static TaskPool& shared();
+
+    void submit(Job job);
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+    // Marks the calling thread as blocked for its lifetime; does nothing on
+    // threads that are not running pool jobs
+    class Blocking {
+    public:
+        Blocking();
+        ~Blocking();
+        Blocking(const Blocking&) = delete;
+        Blocking& operator=(const Blocking&) = delete;
+
+    private:
+        TaskPool* pool;
+    };
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued{0};
+    std::atomic<unsigned> nextQueue{0};
+
+    // Guarded by sleepMutex
+    bool stopping = false;
+    unsigned idle = 0;     // workers asleep waiting for jobs
+    unsigned blocked = 0;  // threads inside a Blocking guard
+    unsigned spares = 0;   // spare workers still running
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable sparesDone;
+
+    bool take(size_t first, Job& job);  // own deque first, then steals
+    void workerLoop(size_t index);
+    void spareLoop();
+    unsigned running() const { return size() + spares - idle - blocked; }
+    void startSpareIfNeeded();  // sleepMutex held
+};
+
+// A program started with `spawn`. Awaiting it gives the program's return
+// value, or rethrows the error it failed with.
+class ProgramTask {
+public:
+    explicit ProgramTask(std::string program) : name(std::move(program)) {}
+
+    const std::string& program() const { return name; }
+    bool done() const { return finished.load(std::memory_order_acquire); }
+
+    void finish(Value value);
+    void fail(std::exception_ptr exception);
+
+    // Blocks until the program has finished
+    Value wait();
+
+private:
+    std::string name;
+    std::atomic<bool> finished{false};
+    std::mutex mutex;
+    std::condition_variable finishedChanged;
+    Value result;
+    std::exception_ptr error;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,68 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "ast.h"
+#include "interpreter.h"
+#include "value.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A long-lived interpreter for hosts that embed the language, and for the
+// REPL. Everything a fragment defines (variables, functions, programs, types,
+// imports) stays visible to the fragments run after it.
+//
+// Each distinct source text is lexed, parsed and resolved once and kept, so
+// evaluating the same text again only runs it. It is parsed again if a
+// function or program name has been defined since, because which calls go to
+// builtins depends on the names defined when it was parsed. Fragments that
+// hold code (functions, loops and the like; see Resolver::holdsCode) are
+// never dropped, since the interpreter points into their AST. Up to
+// kMaxPlainFragments others are kept; beyond that they are all dropped and
+// parsed again when next seen. call() runs a script function without any
+// parsing at all.
+//
+// A session is used from one thread at a time. Errors are thrown as from
+// Interpreter::interpret.
+class Session {
+public:
+    Session() = default;
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // For options such as enableModuleCache()
+    Interpreter& interpreter() { return interp; }
+
+    // Runs `source`; gives the value of its last statement when that is an
+    // expression, and 0 otherwise
+    Value eval(const std::string& source);
+
+    // Binds a host value as a global, replacing any earlier one of that name
+    void define(const std::string& name, const Value& value, const std::string& type = "any");
+    Value get(const std::string& name);
+    // Calls a function the script defined, or a function value held in a global
+    Value call(const std::string& name, std::vector<Value> args);
+
+    // How print() would show `value`
+    std::string format(const Value& value);
+
+private:
+    struct Fragment {
+        std::unique_ptr<Program> program;
+        size_t names;     // function and program names defined when it was parsed
+        bool holdsCode;
+    };
+    static constexpr size_t kMaxPlainFragments = 1024;
+
+    Interpreter interp;
+    std::unordered_map<std::string, Fragment> fragments;  // by source text
+    size_t plainFragments = 0;                           // of those, ones that hold no code
+    std::vector<std::unique_ptr<Program>> replaced;      // code-holding fragments parsed again
+
+    size_t definedNames() const { return interp.functions.size() + interp.programs.size(); }
+
+    Program* compile(const std::string& source);
+};
+
+#endif // SESSION_H
@@ -0,0 +1,85 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The field layout of objects: their field names, in the order they were
+// added. Objects built the same way (by one object literal, or by one type's
+// constructor code) share a shape and keep only their values, in a flat
+// array indexed by the field's slot in the shape.
+//
+// Shapes form a tree rooted at empty(): adding a field moves an object to a
+// child, which is created the first time and shared after that. Shapes live
+// for the whole process and never change once made, so any thread can read
+// them; only finding or adding a child takes a lock.
+class Shape {
+public:
+    // Objects with more fields than this, or whose next shape would be one
+    // of too many children, keep their own field index instead (see
+    // ObjectValue); objects used as dictionaries would otherwise fill the
+    // tree with shapes no other object shares
+    static constexpr size_t kMaxFields = 32;
+    static constexpr size_t kMaxChildren = 64;
+
+    static const Shape* empty();
+
+    // The shape with `name` added after these fields, or nullptr when that
+    // would be more than the limits above allow. `name` must not be here yet.
+    const Shape* with(const std::string& name) const;
+    // The shape reached by adding `names` in order, leaving out repeats
+    const Shape* withAll(const std::vector<std::string>& names) const;
+
+    // The slot of `name`, or -1
+    int slotOf(const std::string& name) const;
+    const std::vector<std::string>& names() const { return fieldNames; }
+    size_t size() const { return fieldNames.size(); }
+    uint32_t id() const { return shapeId; }
+
+    Shape(const Shape&) = delete;
+    Shape& operator=(const Shape&) = delete;
+
+private:
+    Shape() = default;
+
+    uint32_t shapeId = 0;
+    std::vector<std::string> fieldNames;
+    std::unordered_map<std::string, uint32_t> index;  // only for shapes with many fields
+
+    mutable std::mutex mutex;
+    mutable std::unordered_map<std::string, std::unique_ptr<Shape>> children;
+};
+
+// The inline cache of one field access or assignment site: the slot of its
+// field in the last few shapes seen there. Sites are shared by every thread
+// running the AST, so each entry is a single word holding the shape id and
+// the slot, and a site that has seen more shapes than it holds just looks
+// the field up.
+class FieldCache {
+public:
+    static constexpr int kEntries = 4;
+
+    // The slot of `name` in `shape`, or -1
+    int slotOf(const Shape* shape, const std::string& name) const
+    {
+        uint64_t tag = static_cast<uint64_t>(shape->id()) << 32;
+        for (const auto& entry : entries) {
+            uint64_t e = entry.load(std::memory_order_relaxed);
+            if ((e & ~uint64_t{0xFFFFFFFF}) == tag) return static_cast<int>(static_cast<uint32_t>(e));
+            if (e == 0) break;
+        }
+        return miss(shape, name);
+    }
+
+private:
+    mutable std::atomic<uint64_t> entries[kEntries] = {};
+
+    int miss(const Shape* shape, const std::string& name) const;
+};
+
+#endif // SHAPE_H
@@ -0,0 +1,45 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+
+// Kernels behind the numeric array builtins (sum, dot, addArrays, sqrt of an
+// array, ...), picked once at startup for the best instruction set the CPU
+// has: AVX2 or SSE4.1 on x86, NEON on AArch64, plain loops everywhere else.
+// The choice is made at run time, so a build without -march=native still
+// uses AVX2 where it exists.
+//
+// Every implementation gives bit-identical results. Int arithmetic wraps;
+// float sums and dot products add in 8 interleaved lanes that are combined in
+// a fixed order, whatever the vector width. Only the min and max of arrays
+// holding NaN are unspecified.
+struct VectorKernels {
+    const char* name;  // "avx2", "sse4.1", "neon" or "scalar"
+
+    // Reductions; min and max need n > 0
+    int (*sumInt)(const int* a, size_t n);
+    float (*sumFloat)(const float* a, size_t n);
+    int (*minInt)(const int* a, size_t n);
+    int (*maxInt)(const int* a, size_t n);
+    float (*minFloat)(const float* a, size_t n);
+    float (*maxFloat)(const float* a, size_t n);
+    int (*dotInt)(const int* a, const int* b, size_t n);
+    float (*dotFloat)(const float* a, const float* b, size_t n);
+
+    // Elementwise; `out` may be one of the inputs
+    void (*addInt)(const int* a, const int* b, int* out, size_t n);
+    void (*addFloat)(const float* a, const float* b, float* out, size_t n);
+    void (*mulInt)(const int* a, const int* b, int* out, size_t n);
+    void (*mulFloat)(const float* a, const float* b, float* out, size_t n);
+    void (*scaleInt)(const int* a, int k, int* out, size_t n);
+    void (*scaleFloat)(const float* a, float k, float* out, size_t n);
+    void (*sqrtFloat)(const float* a, float* out, size_t n);
+    void (*absInt)(const int* a, int* out, size_t n);
+    void (*absFloat)(const float* a, float* out, size_t n);
+    void (*floorFloat)(const float* a, int* out, size_t n);
+};
+
+// The kernels for this CPU
+const VectorKernels& vectorKernels();
+
+#endif // SIMD_H
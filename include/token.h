@@ -3,6 +3,7 @@
 
 #include <string>
 #include <memory>
+#include <string_view>
 
 enum class TokenType {
     // Literals
@@ -35,6 +36,7 @@ enum class TokenType {
     KW_FALSE,
     KW_PROGRAM,
     KW_AWAIT,
+    KW_SPAWN,
     KW_TYPE,
     KW_TYPEOF,
     KW_TRY,
@@ -85,16 +87,21 @@ enum class TokenType {
     UNKNOWN
 };
 
+// `value` points into the Lexer that made the token: at its copy of the
+// source, or at the text of a literal with escapes. Tokens are only valid
+// while that Lexer is alive.
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
     int line;
     int column;
     
-    Token(TokenType type = TokenType::UNKNOWN, const std::string& value = "", 
+    Token(TokenType type = TokenType::UNKNOWN, std::string_view value = "",
           int line = 0, int column = 0)
         : type(type), value(value), line(line), column(column) {}
     
+    std::string text() const { return std::string(value); }
+    
     std::string toString() const;
 };
 
@@ -0,0 +1,58 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "value.h"
+#include <string>
+#include <vector>
+
+// A declared type spec ("int", "[int|string]", "{x:int,y:int}", "Point", ...)
+// compiled once into a tree. Descriptors are interned by spec text and live
+// for the whole process, so a check is a pointer chase plus a tag compare for
+// the primitive types, and equal specs share one tree.
+class TypeDescriptor {
+public:
+    enum class Kind {
+        Int, Float, String, Bool, Object, Function, Task, Channel, Reader, Any,
+        Array,          // [T]: every element matches `element`
+        Tuple,          // [T1, T2]: element i matches members[i]
+        Record,         // {f:T, ...}: field fields[i] exists and matches members[i]
+        Union,          // T1|T2: any of members
+        StringLiteral,  // "text"
+        IntLiteral,     // 42
+        True, False,
+        Named,          // a `type` declaration, looked up when checked
+        Never,          // unknown or malformed specs match nothing
+    };
+
+    // The descriptor for `spec`, compiled on first use. Thread-safe.
+    static const TypeDescriptor* get(const std::string& spec);
+    // The type of variables nobody declared a type for
+    static const TypeDescriptor* defaultType();
+
+    bool matches(const Value& v) const;
+
+    // Moves an array about to be stored in a variable of this type to the
+    // unboxed storage the type allows, if any
+    void adopt(Value& v) const
+    {
+        if (unboxed == ArrayValue::Storage::Boxed) return;
+        if (auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&v)) (*arr)->unbox(unboxed);
+    }
+
+    Kind kind = Kind::Never;
+    std::string spec;       // as declared; what diagnostics and typeof print
+    int valueIndex = -1;    // Value alternative of Int/Float/String/Bool, else -1
+    bool checkOnAssign = false;  // unions, arrays and any are re-checked on every assignment
+    const TypeDescriptor* element = nullptr;  // Array and Tuple: the spec between the brackets
+    ArrayValue::Storage unboxed = ArrayValue::Storage::Boxed;  // [int], [float] and [bool] arrays
+    std::vector<const TypeDescriptor*> members;
+    std::vector<std::string> fields;
+    const Shape* shape = nullptr;  // Record: the shape of objects with exactly `fields`, in order
+    std::string text;       // StringLiteral contents, or the Named type's name
+    int number = 0;         // IntLiteral value
+
+private:
+    void compile();
+};
+
+#endif // TYPES_H
@@ -0,0 +1,233 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "heap.h"
+#include "shape.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Forward declarations
+class ArrayValue;
+class ObjectValue;
+class FunctionDeclaration;
+class FunctionExpression;
+class ProgramTask;
+class Channel;
+class FileReader;
+
+// Value type supports int, float, string, bool, array, object, function refs,
+// handles of spawned programs, channels and file readers
+using Value = std::variant<int, float, std::string, bool,
+                           std::shared_ptr<ArrayValue>,
+                           std::shared_ptr<ObjectValue>,
+                           FunctionDeclaration*,
+                           FunctionExpression*,
+                           std::shared_ptr<ProgramTask>,
+                           std::shared_ptr<Channel>,
+                           std::shared_ptr<FileReader>>;
+
+// Array: ordered collection of Values. Arrays held by [int], [float] and
+// [bool] variables keep their elements unboxed in a contiguous buffer (4 or 1
+// bytes each instead of a whole Value); storing any other kind of value in
+// one converts it back to boxed storage, so the storage never shows in
+// behavior.
+class ArrayValue : public HeapObject, public std::enable_shared_from_this<ArrayValue> {
+public:
+    enum class Storage { Boxed, Int, Float, Bool };
+
+    ArrayValue() : HeapObject(Kind::Array) {}
+    explicit ArrayValue(std::vector<Value> elems) : HeapObject(Kind::Array), values(std::move(elems)) {}
+    // Arrays with unboxed elements
+    static std::shared_ptr<ArrayValue> ofInts(std::vector<int> elems);
+    static std::shared_ptr<ArrayValue> ofFloats(std::vector<float> elems);
+
+    Storage storage() const { return kind; }
+    size_t size() const
+    {
+        switch (kind) {
+            case Storage::Int: return ints.size();
+            case Storage::Float: return floats.size();
+            case Storage::Bool: return bools.size();
+            default: return values.size();
+        }
+    }
+    bool empty() const { return size() == 0; }
+
+    // Unchecked; callers test the index against size() first
+    Value at(size_t i) const
+    {
+        switch (kind) {
+            case Storage::Int: return ints[i];
+            case Storage::Float: return floats[i];
+            case Storage::Bool: return bools[i] != 0;
+            default: return values[i];
+        }
+    }
+    void set(size_t i, Value v)
+    {
+        if (!fits(v)) box();
+        switch (kind) {
+            case Storage::Int: ints[i] = std::get<int>(v); break;
+            case Storage::Float: floats[i] = std::get<float>(v); break;
+            case Storage::Bool: bools[i] = std::get<bool>(v); break;
+            default: values[i] = std::move(v); break;
+        }
+    }
+    void push(Value v)
+    {
+        if (!fits(v)) box();
+        switch (kind) {
+            case Storage::Int: ints.push_back(std::get<int>(v)); break;
+            case Storage::Float: floats.push_back(std::get<float>(v)); break;
+            case Storage::Bool: bools.push_back(std::get<bool>(v)); break;
+            default: values.push_back(std::move(v)); break;
+        }
+    }
+    Value pop();  // the last element, which must exist
+    void reserve(size_t n);
+    void clear();
+
+    // Calls f(const Value&) on each element in order until it returns false;
+    // returns whether it went through all of them
+    template <typename F>
+    bool each(F f) const
+    {
+        switch (kind) {
+            case Storage::Int:
+                for (int v : ints) if (!f(Value(v))) return false;
+                return true;
+            case Storage::Float:
+                for (float v : floats) if (!f(Value(v))) return false;
+                return true;
+            case Storage::Bool:
+                for (char v : bools) if (!f(Value(v != 0))) return false;
+                return true;
+            default:
+                for (const Value& v : values) if (!f(v)) return false;
+                return true;
+        }
+    }
+
+    // Elements [begin, end) as a new array with the same storage
+    std::shared_ptr<ArrayValue> slice(size_t begin, size_t end) const;
+    // Moves to `storage` if every element fits it; returns whether it did
+    bool unbox(Storage storage);
+    // The elements as Values, converting to boxed storage first
+    std::vector<Value>& boxed();
+
+    // The unboxed buffers, valid while storage() says so
+    std::vector<int> ints;
+    std::vector<float> floats;
+    std::vector<char> bools;
+
+private:
+    Storage kind = Storage::Boxed;
+    std::vector<Value> values;
+
+    bool fits(const Value& v) const
+    {
+        switch (kind) {
+            case Storage::Int: return std::holds_alternative<int>(v);
+            case Storage::Float: return std::holds_alternative<float>(v);
+            case Storage::Bool: return std::holds_alternative<bool>(v);
+            default: return true;
+        }
+    }
+    void box();
+};
+
+// Object: fields by name, in the order they were added. The values sit in a
+// flat array laid out by the object's shape (see shape.h), so objects built
+// alike share one copy of their field names; an object that outgrows the
+// shapes keeps its own index of names instead.
+class ObjectValue : public HeapObject, public std::enable_shared_from_this<ObjectValue> {
+public:
+    ObjectValue() : HeapObject(Kind::Object) {}
+    // An object of `shape` holding `values`, one per slot
+    ObjectValue(const Shape* shape, std::vector<Value> values)
+        : HeapObject(Kind::Object), layout(shape), slots(std::move(values)) {}
+    ObjectValue(const ObjectValue& other);
+    ObjectValue& operator=(const ObjectValue&) = delete;
+
+    size_t size() const { return slots.size(); }
+    bool empty() const { return slots.empty(); }
+    // nullptr once the object keeps its own index
+    const Shape* shape() const { return layout; }
+
+    // The field's value, or nullptr
+    Value* find(const std::string& name)
+    {
+        int slot = slotOf(name);
+        return slot >= 0 ? &slots[slot] : nullptr;
+    }
+    const Value* find(const std::string& name) const { return const_cast<ObjectValue*>(this)->find(name); }
+    // The same, through the inline cache of the site looking it up
+    Value* find(const std::string& name, const FieldCache& cache)
+    {
+        if (!layout) return find(name);
+        int slot = cache.slotOf(layout, name);
+        return slot >= 0 ? &slots[slot] : nullptr;
+    }
+
+    // Sets the field, adding it after the others if it is new
+    void set(const std::string& name, Value v)
+    {
+        int slot = slotOf(name);
+        if (slot >= 0) {
+            slots[slot] = std::move(v);
+        } else {
+            add(name, std::move(v));
+        }
+    }
+    void set(const std::string& name, Value v, const FieldCache& cache)
+    {
+        int slot = layout ? cache.slotOf(layout, name) : slotOf(name);
+        if (slot >= 0) {
+            slots[slot] = std::move(v);
+        } else {
+            add(name, std::move(v));
+        }
+    }
+
+    // Calls f(const std::string& name, const Value& value) on each field in order
+    template <typename F>
+    void each(F f) const
+    {
+        const auto& names = layout ? layout->names() : own->names;
+        for (size_t i = 0; i < slots.size(); ++i) f(names[i], slots[i]);
+    }
+    // The values alone, in field order
+    std::vector<Value>& values() { return slots; }
+    void clear();
+
+private:
+    struct Index {
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint32_t> slots;
+    };
+
+    const Shape* layout = Shape::empty();
+    std::unique_ptr<Index> own;  // once the object outgrows the shapes
+    std::vector<Value> slots;
+
+    int slotOf(const std::string& name) const;
+    void add(const std::string& name, Value v);
+};
+
+// Copies arrays and objects all the way down, so the copy shares no mutable
+// state with the original. Values that were shared, or cyclic, stay that way
+// among the copies made by one copier.
+class ValueCopier {
+public:
+    Value copy(const Value& v);
+
+    std::vector<Value> functions;  // function values met while copying, for the caller to follow
+
+private:
+    std::unordered_map<const void*, Value> copies;  // original -> its copy
+};
+
+#endif // VALUE_H
@@ -0,0 +1,50 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "value.h"
+#include <string>
+#include <vector>
+
+class Interpreter;
+
+// Stack VM executing a BytecodeProgram. Builtins, operators on mixed types and
+// type checks are delegated to the host Interpreter so both engines agree.
+class VM {
+public:
+    explicit VM(Interpreter& host);
+
+    void execute(const BytecodeProgram& program);
+
+private:
+    struct Frame {
+        const FunctionProto* proto;
+        const Instruction* ip;
+        size_t base;      // first slot of the frame in the value stack
+        size_t returnTo;  // stack index the result is written to
+    };
+
+    // Registered by PUSH_HANDLER: where to resume when a runtime error escapes
+    struct Handler {
+        size_t frameDepth;
+        size_t sp;
+        const Instruction* target;
+    };
+
+    Interpreter& host;
+    const BytecodeProgram* program = nullptr;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<Handler> handlers;
+    std::vector<Value> globals;
+    std::vector<const TypeDescriptor*> globalTypes;
+    std::vector<unsigned char> globalState;  // 0 undefined, 1 defined, 2 defined and type-checked on assignment
+    std::vector<const FunctionProto*> functionTable;
+    std::vector<Value> builtinArgs;  // CALL_BUILTIN's argument vector, kept between calls
+    size_t spOffset = 0;
+
+    void run();
+    void ensureStack(size_t needed);
+};
+
+#endif // VM_H
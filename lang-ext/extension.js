@@ -98,6 +98,48 @@ class AxolotlLanguageProvider {
                 returnType: 'void',
                 documentation: 'Sleep for specified milliseconds (blocks execution)'
             },
+            {
+                name: 'sleepAsync',
+                params: [{name: 'ms', type: 'int'}],
+                returnType: 'task',
+                documentation: 'A timer task that finishes after ms milliseconds'
+            },
+            {
+                name: 'channel',
+                params: [{name: 'capacity', type: 'int'}],
+                returnType: 'channel',
+                documentation: 'Create a channel holding up to capacity values'
+            },
+            {
+                name: 'send',
+                params: [{name: 'ch', type: 'channel'}, {name: 'value', type: 'any'}],
+                returnType: 'void',
+                documentation: 'Send a copy of value (blocks while the channel is full)'
+            },
+            {
+                name: 'recv',
+                params: [{name: 'ch', type: 'channel'}],
+                returnType: 'any',
+                documentation: 'Receive the next value (blocks while the channel is empty)'
+            },
+            {
+                name: 'tryRecv',
+                params: [{name: 'ch', type: 'channel'}],
+                returnType: 'any',
+                documentation: 'Receive without waiting: [true, value], or [false, 0] if empty'
+            },
+            {
+                name: 'select',
+                params: [{name: 'channels', type: 'any'}],
+                returnType: 'any',
+                documentation: 'Receive from the first channel with a value: [index, value], or [-1, 0] once all are closed and drained'
+            },
+            {
+                name: 'close',
+                params: [{name: 'ch', type: 'any'}],
+                returnType: 'void',
+                documentation: 'Close a channel (values already sent can still be received) or a reader'
+            },
             {
                 name: 'toString',
                 params: [{name: 'value', type: 'any'}],
@@ -128,12 +170,66 @@ class AxolotlLanguageProvider {
                 returnType: 'void',
                 documentation: 'Copy file from source to destination path'
             },
+            {
+                name: 'remove',
+                params: [{name: 'filepath', type: 'string'}],
+                returnType: 'void',
+                documentation: 'Delete a file'
+            },
             {
                 name: 'readDir',
                 params: [{name: 'dirPath', type: 'string'}],
                 returnType: '[string]',
                 documentation: 'Read directory and return array of filenames'
             },
+            {
+                name: 'readAsync',
+                params: [{name: 'filepath', type: 'string'}],
+                returnType: 'task',
+                documentation: 'Start reading a file; await the task for its contents'
+            },
+            {
+                name: 'writeAsync',
+                params: [{name: 'filepath', type: 'string'}, {name: 'content', type: 'string'}],
+                returnType: 'task',
+                documentation: 'Start writing content to a file; await the task to wait for it'
+            },
+            {
+                name: 'copyAsync',
+                params: [{name: 'source', type: 'string'}, {name: 'dest', type: 'string'}],
+                returnType: 'task',
+                documentation: 'Start copying a file; await the task to wait for it'
+            },
+            {
+                name: 'readDirAsync',
+                params: [{name: 'dirPath', type: 'string'}],
+                returnType: 'task',
+                documentation: 'Start listing a directory; await the task for the array of filenames'
+            },
+            {
+                name: 'openReader',
+                params: [{name: 'filepath', type: 'string'}],
+                returnType: 'reader',
+                documentation: 'Open a file to read a line or a chunk at a time'
+            },
+            {
+                name: 'readLine',
+                params: [{name: 'r', type: 'reader'}],
+                returnType: 'any',
+                documentation: 'Read the next line: [true, line], or [false, ""] at the end'
+            },
+            {
+                name: 'readLines',
+                params: [{name: 'r', type: 'reader'}, {name: 'maxLines', type: 'int'}],
+                returnType: '[string]',
+                documentation: 'Read up to maxLines more lines (empty array at the end)'
+            },
+            {
+                name: 'readChunk',
+                params: [{name: 'r', type: 'reader'}, {name: 'maxBytes', type: 'int'}],
+                returnType: 'string',
+                documentation: 'Read up to maxBytes more bytes ("" at the end)'
+            },
             {
                 name: 'sin',
                 params: [{name: 'x', type: 'float|int'}],
@@ -233,9 +329,15 @@ class AxolotlLanguageProvider {
             },
             {
                 name: 'sort',
-                params: [{name: 'array', type: '[any]'}],
+                params: [{name: 'array', type: '[any]'}, {name: 'compare', type: 'function'}],
                 returnType: '[any]',
-                documentation: 'Sort array elements in ascending order'
+                documentation: 'Sort an array variable in place, in ascending order or by compare(a, b) (optional), which returns a negative number or true when a goes first'
+            },
+            {
+                name: 'stableSort',
+                params: [{name: 'array', type: '[any]'}, {name: 'compare', type: 'function'}],
+                returnType: '[any]',
+                documentation: 'Like sort, but equal elements keep their original order; compare is optional'
             },
             {
                 name: 'find',
@@ -372,6 +474,37 @@ class AxolotlLanguageProvider {
                 returnType: 'float',
                 documentation: 'Linear interpolation between a and b by factor t (0.0 to 1.0)'
             },
+            // Vector functions (SIMD over numeric arrays)
+            {
+                name: 'sum',
+                params: [{name: 'array', type: '[int]|[float]'}],
+                returnType: 'int|float',
+                documentation: 'Sum of the elements of a numeric array'
+            },
+            {
+                name: 'dot',
+                params: [{name: 'a', type: '[int]|[float]'}, {name: 'b', type: '[int]|[float]'}],
+                returnType: 'int|float',
+                documentation: 'Dot product of two numeric arrays of the same length'
+            },
+            {
+                name: 'addArrays',
+                params: [{name: 'a', type: '[int]|[float]'}, {name: 'b', type: '[int]|[float]'}],
+                returnType: '[int]|[float]',
+                documentation: 'New array of the element-wise sums of a and b'
+            },
+            {
+                name: 'mulArrays',
+                params: [{name: 'a', type: '[int]|[float]'}, {name: 'b', type: '[int]|[float]'}],
+                returnType: '[int]|[float]',
+                documentation: 'New array of the element-wise products of a and b'
+            },
+            {
+                name: 'scale',
+                params: [{name: 'array', type: '[int]|[float]'}, {name: 'k', type: 'int|float'}],
+                returnType: '[int]|[float]',
+                documentation: 'New array of every element multiplied by k'
+            },
             // Utility functions
             {
                 name: 'assert',
@@ -414,6 +547,18 @@ class AxolotlLanguageProvider {
                 params: [{name: 'obj1', type: 'object'}, {name: 'obj2', type: 'object'}],
                 returnType: 'object',
                 documentation: 'Merge two objects into a new object'
+            },
+            {
+                name: 'gc',
+                params: [],
+                returnType: 'int',
+                documentation: 'Free unreachable cycles of arrays and objects now; returns how many were freed'
+            },
+            {
+                name: 'gcStats',
+                params: [],
+                returnType: 'object',
+                documentation: 'Collector statistics: collections, objects, freed, lastPauseUs, maxPauseUs, totalPauseUs'
             }
         ];
 
@@ -577,6 +722,7 @@ class AxolotlLanguageProvider {
             { name: 'type', detail: 'Type declaration', snippet: 'type ${1:Name} = ${2:definition};' },
             { name: 'program', detail: 'Program declaration', snippet: 'program ${1:name}(${2:params}) {\n\t${3}\n}' },
             { name: 'await', detail: 'Await expression', snippet: 'await ${1:expression}' },
+            { name: 'spawn', detail: 'Start a program on another thread', snippet: 'spawn ${1:program}($2)' },
             { name: 'typeof', detail: 'Typeof operator', snippet: 'typeof(${1:value})' }
         ];
 
@@ -0,0 +1,34 @@
+#include "include/arena.h"
+
+static thread_local Arena* currentArena = nullptr;
+
+Arena* Arena::current()
+{
+    return currentArena;
+}
+
+void* Arena::allocateBlock(std::size_t size, std::size_t align)
+{
+    // Oversized requests get a block of their own so the current one stays usable
+    std::size_t blockSize = size + align > kBlockSize ? size + align : kBlockSize;
+    blocks.emplace_back(new char[blockSize]);  // left uninitialized, unlike make_unique
+    char* memory = blocks.back().get();
+    std::size_t offset = (reinterpret_cast<std::size_t>(memory) + align - 1) & ~(align - 1);
+    offset -= reinterpret_cast<std::size_t>(memory);
+    if (blockSize == kBlockSize) {
+        block = memory;
+        capacity = blockSize;
+        used = offset + size;
+    }
+    return memory + offset;
+}
+
+ArenaScope::ArenaScope(Arena* arena) : saved(currentArena)
+{
+    currentArena = arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+    currentArena = saved;
+}
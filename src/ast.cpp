@@ -1,60 +1,145 @@
 #include "include/ast.h"
+#include "include/arena.h"
+#include <new>
+
+namespace {
+
+// Precedes every node and records where its memory came from
+struct alignas(std::max_align_t) NodeHeader {
+    Arena* arena;
+};
+
+}
+
+void* ASTNode::operator new(std::size_t size)
+{
+    Arena* arena = Arena::current();
+    void* memory = arena ? arena->allocate(sizeof(NodeHeader) + size) : ::operator new(sizeof(NodeHeader) + size);
+    return new (memory) NodeHeader{arena} + 1;
+}
+
+void ASTNode::operator delete(void* p) noexcept
+{
+    if (!p) return;
+    NodeHeader* header = static_cast<NodeHeader*>(p) - 1;
+    if (!header->arena) {
+        ::operator delete(header);
+    }
+}
+
+// ASTNode: statements that cannot leave early
+Completion ASTNode::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
 
 // IntegerLiteral
 std::string IntegerLiteral::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value IntegerLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // FloatLiteral
 std::string FloatLiteral::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value FloatLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // StringLiteral
 std::string StringLiteral::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value StringLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
+// TemplateLiteral
+std::string TemplateLiteral::accept(ASTVisitor* visitor) {
+    return visitor->visit(this);
+}
+
+Value TemplateLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // BooleanLiteral
 std::string BooleanLiteral::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value BooleanLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // Identifier
 std::string Identifier::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value Identifier::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // BinaryOp
 std::string BinaryOp::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value BinaryOp::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // UnaryOp
 std::string UnaryOp::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value UnaryOp::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // FunctionCall
 std::string FunctionCall::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value FunctionCall::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // ArrayLiteral
 std::string ArrayLiteral::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value ArrayLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // ObjectLiteral
 std::string ObjectLiteral::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value ObjectLiteral::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // FunctionExpression
 std::string FunctionExpression::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value FunctionExpression::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 std::string ThrowStatement::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
@@ -68,21 +153,37 @@ std::string IndexAccess::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value IndexAccess::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // FieldAccess
 std::string FieldAccess::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value FieldAccess::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // IndexAssignment
 std::string IndexAssignment::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value IndexAssignment::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // FieldAssignment
 std::string FieldAssignment::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value FieldAssignment::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // Block
 std::string Block::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
@@ -98,6 +199,10 @@ std::string Assignment::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value Assignment::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // IfStatement
 std::string IfStatement::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
@@ -158,6 +263,19 @@ std::string AwaitExpression::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
 
+Value AwaitExpression::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
+// SpawnExpression
+std::string SpawnExpression::accept(ASTVisitor* visitor) {
+    return visitor->visit(this);
+}
+
+Value SpawnExpression::acceptValue(ValueVisitor* visitor) {
+    return visitor->visitValue(this);
+}
+
 // TypeDeclaration
 std::string TypeDeclaration::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
@@ -186,3 +304,40 @@ std::string SwitchStatement::accept(ASTVisitor* visitor) {
 std::string WhenStatement::accept(ASTVisitor* visitor) {
     return visitor->visit(this);
 }
+
+// Statements that can complete abruptly
+Completion Block::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion IfStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion WhileStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion ForStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion ReturnStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion TryStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion BreakStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion ContinueStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
+
+Completion SwitchStatement::acceptExec(ExecVisitor* visitor) {
+    return visitor->exec(this);
+}
@@ -0,0 +1,1267 @@
+#include "include/builtins.h"
+#include "include/channel.h"
+#include "include/interpreter.h"
+#include "include/io_loop.h"
+#include "include/metrics.h"
+#include "include/reader.h"
+#include "include/simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// The file operations behind read/write/readDir/copy and their async versions.
+// They only touch their arguments, so they can run on an I/O thread.
+std::string readFile(const std::string &filepath)
+{
+    MetricsScope io(Metrics::Histogram::IoRead);
+    std::ifstream file(filepath, std::ios::in | std::ios::ate);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open file for reading: " + filepath);
+    }
+    // Sized up front and read in one go, so the contents are copied once
+    std::string content(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&content[0], static_cast<std::streamsize>(content.size()));
+    content.resize(static_cast<size_t>(file.gcount()));
+    return content;
+}
+
+void writeFile(const std::string &filepath, const std::string &content)
+{
+    MetricsScope io(Metrics::Histogram::IoWrite);
+    std::ofstream file(filepath, std::ios::out);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open file for writing: " + filepath);
+    }
+    file << content;
+}
+
+std::shared_ptr<ArrayValue> readDirectory(const std::string &dirPath)
+{
+    MetricsScope io(Metrics::Histogram::IoReadDir);
+    auto result = std::make_shared<ArrayValue>();
+    try {
+        for (const auto& entry : fs::directory_iterator(dirPath)) {
+            result->push(entry.path().filename().string());
+        }
+    } catch (const fs::filesystem_error& e) {
+        throw std::runtime_error("Could not read directory: " + dirPath + " - " + e.what());
+    }
+    return result;
+}
+
+void copyFile(const std::string &sourcePath, const std::string &destPath)
+{
+    MetricsScope io(Metrics::Histogram::IoCopy);
+    std::ifstream srcFile(sourcePath, std::ios::binary);
+    if (!srcFile.is_open())
+    {
+        throw std::runtime_error("Could not open source file for copying: " + sourcePath);
+    }
+    std::ofstream dstFile(destPath, std::ios::binary);
+    if (!dstFile.is_open())
+    {
+        throw std::runtime_error("Could not open destination file for copying: " + destPath);
+    }
+    dstFile << srcFile.rdbuf();
+}
+
+Channel &requireChannel(const Value &v, const std::string &fn)
+{
+    auto channel = std::get_if<std::shared_ptr<Channel>>(&v);
+    if (!channel) throw std::runtime_error(fn + "() requires a channel");
+    return **channel;
+}
+
+FileReader &requireReader(const Value &v, const std::string &fn)
+{
+    auto reader = std::get_if<std::shared_ptr<FileReader>>(&v);
+    if (!reader) throw std::runtime_error(fn + "() requires a reader");
+    return **reader;
+}
+
+// The elements of an array of numbers, as the vector kernels take them: the
+// unboxed buffer itself when there is one, a converted copy otherwise. All
+// ints stay ints; any float makes every element a float.
+class NumericArray {
+public:
+    NumericArray(const Value &v, const std::string &fn)
+    {
+        auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&v);
+        if (!arr) throw std::runtime_error(fn + "() requires an array of numbers");
+        const ArrayValue &a = **arr;
+        count = a.size();
+        if (a.storage() == ArrayValue::Storage::Int) {
+            intData = a.ints.data();
+            return;
+        }
+        if (a.storage() == ArrayValue::Storage::Float) {
+            floatData = a.floats.data();
+            return;
+        }
+        bool allInts = a.each([](const Value &e) { return std::holds_alternative<int>(e); });
+        if (allInts) {
+            intCopy.reserve(count);
+            a.each([this](const Value &e) { intCopy.push_back(std::get<int>(e)); return true; });
+            intData = intCopy.data();
+            return;
+        }
+        floatCopy.reserve(count);
+        bool numeric = a.each([this](const Value &e) {
+            if (auto i = std::get_if<int>(&e)) floatCopy.push_back(static_cast<float>(*i));
+            else if (auto f = std::get_if<float>(&e)) floatCopy.push_back(*f);
+            else return false;
+            return true;
+        });
+        if (!numeric) throw std::runtime_error(fn + "() requires an array of numbers");
+        floatData = floatCopy.data();
+    }
+    NumericArray(const NumericArray &) = delete;
+    NumericArray &operator=(const NumericArray &) = delete;
+
+    size_t size() const { return count; }
+    bool isInt() const { return intData != nullptr || count == 0; }
+    const int *ints() const { return intData; }
+    // The elements as floats, converting ints on first use
+    const float *floats()
+    {
+        if (!floatData) {
+            floatCopy.assign(intData, intData + count);
+            floatData = floatCopy.data();
+        }
+        return floatData;
+    }
+
+private:
+    size_t count = 0;
+    const int *intData = nullptr;
+    const float *floatData = nullptr;
+    std::vector<int> intCopy;
+    std::vector<float> floatCopy;
+};
+
+// Arrays at least this long are sorted on several threads
+constexpr size_t kParallelSortThreshold = 1 << 16;
+
+// Sorts [first, last), splitting it in halves that are sorted on their own
+// threads, as long as there are threads left and the halves are long enough,
+// then merging them. Merging keeps equal elements in order, so the result is
+// stable whenever the pieces are sorted stably.
+template <typename It, typename Less>
+void parallelSort(It first, It last, Less less, bool stable, unsigned threads)
+{
+    size_t n = static_cast<size_t>(last - first);
+    if (threads < 2 || n < kParallelSortThreshold) {
+        if (stable) std::stable_sort(first, last, less);
+        else std::sort(first, last, less);
+        return;
+    }
+    It middle = first + n / 2;
+    std::thread left([=] { parallelSort(first, middle, less, stable, threads / 2); });
+    parallelSort(middle, last, less, stable, threads - threads / 2);
+    left.join();
+    std::inplace_merge(first, middle, last, less);
+}
+
+template <typename T, typename Less>
+void sortVector(std::vector<T> &items, Less less, bool stable)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    parallelSort(items.begin(), items.end(), less, stable, threads);
+}
+
+// NaN sorts after every number, which keeps the ordering strict and weak
+bool floatLess(float a, float b) { return a < b || (!std::isnan(a) && std::isnan(b)); }
+
+bool numberLess(const Value &a, const Value &b)
+{
+    auto ia = std::get_if<int>(&a);
+    auto ib = std::get_if<int>(&b);
+    if (ia && ib) return *ia < *ib;
+    double da = ia ? *ia : std::get<float>(a);
+    double db = ib ? *ib : std::get<float>(b);
+    return da < db || (!std::isnan(da) && std::isnan(db));
+}
+
+// The two arrays of an elementwise builtin, which must have the same length
+void requireSameLength(const NumericArray &a, const NumericArray &b, const std::string &fn)
+{
+    if (a.size() != b.size()) {
+        throw std::runtime_error(fn + "() requires arrays of the same length");
+    }
+}
+
+} // namespace
+
+Value NativeFunction::call(Interpreter &interp, std::vector<Value> &args, const std::string &arrayName,
+                           const TypeDescriptor *arrayType) const
+{
+    if (arity != kVariadic && args.size() != static_cast<size_t>(arity)) {
+        std::string expected = arity == 0 ? "no arguments"
+                                          : (usage.empty() ? "" : "exactly ") + std::to_string(arity) +
+                                                (arity == 1 ? " argument" : " arguments");
+        throw std::runtime_error(name + "() expects " + expected + (usage.empty() ? "" : ": " + usage));
+    }
+    NativeCall native{interp, args, arrayName, arrayType};
+    return fn(native);
+}
+
+BuiltinRegistry &BuiltinRegistry::global()
+{
+    static BuiltinRegistry registry;
+    return registry;
+}
+
+BuiltinRegistry::BuiltinRegistry()
+{
+    Interpreter::registerBuiltins(*this);
+}
+
+const NativeFunction *BuiltinRegistry::add(NativeFunction function)
+{
+    auto &entry = functions[function.name];
+    if (entry) {
+        *entry = std::move(function);  // calls bound to the old entry see the new one
+    } else {
+        entry = std::make_unique<NativeFunction>(std::move(function));
+    }
+    return entry.get();
+}
+
+const NativeFunction *BuiltinRegistry::add(const std::string &name, int arity,
+                                           std::function<Value(std::vector<Value> &)> fn)
+{
+    return add({name, arity, "", [fn = std::move(fn)](NativeCall &call) { return fn(call.args); }});
+}
+
+const NativeFunction *BuiltinRegistry::find(const std::string &name) const
+{
+    auto found = functions.find(name);
+    return found == functions.end() ? nullptr : found->second.get();
+}
+
+void BuiltinRegistry::yieldToScripts(std::initializer_list<const char *> names)
+{
+    for (const char *name : names) {
+        auto found = functions.find(name);
+        if (found != functions.end()) found->second->shadowable = true;
+    }
+}
+
+void BuiltinBinder::bind(FunctionCall *call, const std::string &name)
+{
+    call->builtin = BuiltinRegistry::global().find(name);
+    if (call->builtin && call->builtin->shadowable) shadowable.push_back(call);
+}
+
+void BuiltinBinder::adopt(BuiltinBinder &nested)
+{
+    shadowable.insert(shadowable.end(), nested.shadowable.begin(), nested.shadowable.end());
+    nested.shadowable.clear();
+}
+
+void BuiltinBinder::finish()
+{
+    for (FunctionCall *call : shadowable) {
+        if (declared.count(call->builtin->name)) call->builtin = nullptr;
+    }
+    shadowable.clear();
+}
+
+// The standard library. These run on evaluated arguments, so the tree walker,
+// the bytecode VM and host code all call them the same way.
+void Interpreter::registerBuiltins(BuiltinRegistry &registry)
+{
+    // Built-in: write(...)
+    registry.add({"write", 2, "write(filepath, content)", [](NativeCall &call) -> Value {
+        writeFile(call.interp.valueToString(call.args[0]), call.interp.valueToString(call.args[1]));
+        return std::string(); // write returns empty string
+    }});
+
+    // Built-in: read(...)
+    registry.add({"read", 1, "read(filepath)", [](NativeCall &call) -> Value {
+        return readFile(call.interp.valueToString(call.args[0]));
+    }});
+
+    // Built-in: readDir(...)
+    registry.add({"readDir", 1, "readDir(dirPath)", [](NativeCall &call) -> Value {
+        return readDirectory(call.interp.valueToString(call.args[0]));
+    }});
+
+    // Built-in: copy(...)
+    registry.add({"copy", 2, "copy(sourcePath, destPath)", [](NativeCall &call) -> Value {
+        copyFile(call.interp.valueToString(call.args[0]), call.interp.valueToString(call.args[1]));
+        return std::string(); // Return empty string for void functions
+    }});
+
+    // Built-in: remove(filepath) - deletes a file, such as one the script wrote
+    registry.add({"remove", 1, "remove(filepath)", [](NativeCall &call) -> Value {
+        std::string filepath = call.interp.valueToString(call.args[0]);
+        std::error_code ec;
+        if (!fs::remove(filepath, ec)) {
+            throw std::runtime_error("Could not remove file: " + filepath + (ec ? " - " + ec.message() : ""));
+        }
+        return std::string();
+    }});
+
+    // Async versions of the file builtins. Each returns a task right away and
+    // runs on the I/O loop; `await` gives what the blocking builtin returns.
+    registry.add({"readAsync", 1, "readAsync(filepath)", [](NativeCall &call) -> Value {
+        std::string filepath = call.interp.valueToString(call.args[0]);
+        return IOLoop::shared().submit("readAsync", [filepath]() -> Value { return readFile(filepath); });
+    }});
+    registry.add({"writeAsync", 2, "writeAsync(filepath, content)", [](NativeCall &call) -> Value {
+        std::string filepath = call.interp.valueToString(call.args[0]);
+        std::string content = call.interp.valueToString(call.args[1]);
+        return IOLoop::shared().submit("writeAsync", [filepath, content]() -> Value {
+            writeFile(filepath, content);
+            return std::string();
+        });
+    }});
+    registry.add({"readDirAsync", 1, "readDirAsync(dirPath)", [](NativeCall &call) -> Value {
+        std::string dirPath = call.interp.valueToString(call.args[0]);
+        return IOLoop::shared().submit("readDirAsync", [dirPath]() -> Value { return readDirectory(dirPath); });
+    }});
+    registry.add({"copyAsync", 2, "copyAsync(sourcePath, destPath)", [](NativeCall &call) -> Value {
+        std::string sourcePath = call.interp.valueToString(call.args[0]);
+        std::string destPath = call.interp.valueToString(call.args[1]);
+        return IOLoop::shared().submit("copyAsync", [sourcePath, destPath]() -> Value {
+            copyFile(sourcePath, destPath);
+            return std::string();
+        });
+    }});
+
+    // Built-in: print(...)
+    registry.add({"print", NativeFunction::kVariadic, "", [](NativeCall &call) -> Value {
+        std::string line;
+        bool first = true;
+        for (auto &v : call.args)
+        {
+            if (!first)
+                line += " ";
+            line += call.interp.valueToString(v);
+            first = false;
+        }
+        // Lines printed by concurrent programs never interleave
+        static std::mutex outputMutex;
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << line << std::endl;
+        return std::string();
+    }});
+
+    // Built-in: len(array or string)
+    registry.add({"len", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v))
+        {
+            auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
+            return static_cast<int>(arr->size());
+        }
+        if (std::holds_alternative<std::string>(v))
+        {
+            const std::string &s = std::get<std::string>(v);
+            return static_cast<int>(s.size());
+        }
+        throw std::runtime_error("len() requires array or string");
+    }});
+
+    // Built-in: push(array, value)
+    registry.add({"push", 2, "", [](NativeCall &call) -> Value {
+        // The array must be passed as a variable
+        if (!call.arrayName.empty())
+        {
+            const Value &arrVal = call.args[0];
+            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal))
+            {
+                auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+                const Value &val = call.args[1];
+                // Enforce array element typing based on variable's declared type
+                if (call.arrayType && call.arrayType->element) {
+                    const TypeDescriptor *element = call.arrayType->element;
+                    if (!element->matches(val)) {
+                        throw std::runtime_error("Type error: cannot push value to array '" + call.arrayName + "' of element type '" + element->spec + "'");
+                    }
+                }
+                arr->push(std::move(val));
+                return std::string();
+            }
+        }
+        throw std::runtime_error("push() requires array variable as first argument");
+    }, true});
+
+    // Built-in: pop(array)
+    registry.add({"pop", 1, "", [](NativeCall &call) -> Value {
+        // The array must be passed as a variable
+        if (!call.arrayName.empty())
+        {
+            const Value &arrVal = call.args[0];
+            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal))
+            {
+                auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+                if (!arr->empty())
+                {
+                    return arr->pop();
+                }
+                return std::string();
+            }
+        }
+        throw std::runtime_error("pop() requires array variable");
+    }, true});
+
+    // Built-in: substr(string, start, length)
+    registry.add({"substr", 3, "", [](NativeCall &call) -> Value {
+        const Value &s = call.args[0];
+        const Value &start = call.args[1];
+        const Value &len = call.args[2];
+        if (std::holds_alternative<std::string>(s) &&
+            std::holds_alternative<int>(start) &&
+            std::holds_alternative<int>(len))
+        {
+            const std::string &str = std::get<std::string>(s);
+            int st = std::get<int>(start);
+            int l = std::get<int>(len);
+            if (st < 0 || st >= (int)str.size())
+                return std::string();
+            return str.substr(st, l);
+        }
+        throw std::runtime_error("substr() requires (string, int, int)");
+    }});
+
+    // Built-in: toUpper(string)
+    registry.add({"toUpper", 1, "", [](NativeCall &call) -> Value {
+        const Value &s = call.args[0];
+        if (std::holds_alternative<std::string>(s))
+        {
+            std::string str = std::get<std::string>(s);
+            for (char &c : str)
+            {
+                if (c >= 'a' && c <= 'z')
+                {
+                    c = c - 'a' + 'A';
+                }
+            }
+            return str;
+        }
+        throw std::runtime_error("toUpper() requires string");
+    }});
+
+    // Built-in: toLower(string)
+    registry.add({"toLower", 1, "", [](NativeCall &call) -> Value {
+        const Value &s = call.args[0];
+        if (std::holds_alternative<std::string>(s))
+        {
+            std::string str = std::get<std::string>(s);
+            for (char &c : str)
+            {
+                if (c >= 'A' && c <= 'Z')
+                {
+                    c = c - 'A' + 'a';
+                }
+            }
+            return str;
+        }
+        throw std::runtime_error("toLower() requires string");
+    }});
+
+    // Built-in: indexOf(string, substring)
+    registry.add({"indexOf", 2, "", [](NativeCall &call) -> Value {
+        const Value &s = call.args[0];
+        const Value &sub = call.args[1];
+        if (std::holds_alternative<std::string>(s) && std::holds_alternative<std::string>(sub))
+        {
+            const std::string &str = std::get<std::string>(s);
+            const std::string &substring = std::get<std::string>(sub);
+            size_t pos = str.find(substring);
+            if (pos != std::string::npos)
+            {
+                return static_cast<int>(pos);
+            }
+            return -1;
+        }
+        throw std::runtime_error("indexOf() requires (string, string)");
+    }});
+
+    // Built-in: contains(string, substring)
+    registry.add({"contains", 2, "", [](NativeCall &call) -> Value {
+        const Value &s = call.args[0];
+        const Value &sub = call.args[1];
+        if (std::holds_alternative<std::string>(s) && std::holds_alternative<std::string>(sub))
+        {
+            const std::string &str = std::get<std::string>(s);
+            const std::string &substring = std::get<std::string>(sub);
+            bool result = str.find(substring) != std::string::npos;
+            return result;
+        }
+        throw std::runtime_error("contains() requires (string, string)");
+    }});
+
+    // Built-in: millis() - returns current time in milliseconds
+    registry.add({"millis", 0, "", [](NativeCall &) -> Value {
+        auto now = std::chrono::high_resolution_clock::now();
+        auto duration = now.time_since_epoch();
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+        return static_cast<int>(millis);
+    }});
+
+    // Built-in: sleep(milliseconds) - sleep for specified milliseconds
+    registry.add({"sleep", 1, "", [](NativeCall &call) -> Value {
+        const Value &ms = call.args[0];
+        if (std::holds_alternative<int>(ms))
+        {
+            int milliseconds = std::get<int>(ms);
+            TaskPool::Blocking blocking;  // a sleeping program leaves its worker to others
+            std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+            return std::string();
+        }
+        throw std::runtime_error("sleep() requires int argument");
+    }});
+
+    // Built-in: sleepAsync(milliseconds) - a task that finishes after the delay
+    registry.add({"sleepAsync", 1, "sleepAsync(milliseconds)", [](NativeCall &call) -> Value {
+        auto ms = std::get_if<int>(&call.args[0]);
+        if (!ms) throw std::runtime_error("sleepAsync() requires int argument");
+        return IOLoop::shared().timer(std::chrono::milliseconds(std::max(*ms, 0)));
+    }});
+    // Newer than the file builtins above, so a script's own function of the
+    // same name is the one it calls
+    registry.yieldToScripts({"remove", "readAsync", "writeAsync", "readDirAsync", "copyAsync", "sleepAsync"});
+
+    // Readers go through a file a piece at a time instead of loading it whole
+    registry.add({"openReader", 1, "openReader(filepath)", [](NativeCall &call) -> Value {
+        return std::make_shared<FileReader>(call.interp.valueToString(call.args[0]));
+    }});
+    // [true, line], or [false, ""] at the end of the file
+    registry.add({"readLine", 1, "readLine(reader)", [](NativeCall &call) -> Value {
+        MetricsScope io(Metrics::Histogram::IoReader);
+        std::string line;
+        bool read = requireReader(call.args[0], "readLine").readLine(line);
+        return std::make_shared<ArrayValue>(std::vector<Value>{read, std::move(line)});
+    }});
+    // Up to maxLines more lines; an empty array at the end of the file
+    registry.add({"readLines", 2, "readLines(reader, maxLines)", [](NativeCall &call) -> Value {
+        MetricsScope io(Metrics::Histogram::IoReader);
+        FileReader &reader = requireReader(call.args[0], "readLines");
+        auto maxLines = std::get_if<int>(&call.args[1]);
+        if (!maxLines || *maxLines < 1) throw std::runtime_error("readLines() requires a line count of at least 1");
+        auto lines = std::make_shared<ArrayValue>();
+        std::string line;
+        for (int i = 0; i < *maxLines && reader.readLine(line); ++i) {
+            lines->push(std::move(line));
+        }
+        return lines;
+    }});
+    // Up to maxBytes more bytes; "" at the end of the file
+    registry.add({"readChunk", 2, "readChunk(reader, maxBytes)", [](NativeCall &call) -> Value {
+        MetricsScope io(Metrics::Histogram::IoReader);
+        FileReader &reader = requireReader(call.args[0], "readChunk");
+        auto maxBytes = std::get_if<int>(&call.args[1]);
+        if (!maxBytes || *maxBytes < 1) throw std::runtime_error("readChunk() requires a size of at least 1");
+        return reader.readChunk(static_cast<size_t>(*maxBytes));
+    }});
+    registry.yieldToScripts({"openReader", "readLine", "readLines", "readChunk"});
+
+    // Channels: bounded queues that programs send values through
+    registry.add({"channel", 1, "channel(capacity)", [](NativeCall &call) -> Value {
+        auto capacity = std::get_if<int>(&call.args[0]);
+        if (!capacity || *capacity < 1) throw std::runtime_error("channel() requires a capacity of at least 1");
+        return std::make_shared<Channel>(static_cast<size_t>(*capacity));
+    }});
+    registry.add({"send", 2, "send(channel, value)", [](NativeCall &call) -> Value {
+        requireChannel(call.args[0], "send").send(call.args[1]);
+        return std::string();
+    }});
+    registry.add({"recv", 1, "recv(channel)", [](NativeCall &call) -> Value {
+        Value value;
+        if (!requireChannel(call.args[0], "recv").recv(value)) {
+            throw std::runtime_error("recv() on a closed channel with nothing left to receive");
+        }
+        return value;
+    }});
+    // [true, value], or [false, 0] when nothing is waiting in the channel
+    registry.add({"tryRecv", 1, "tryRecv(channel)", [](NativeCall &call) -> Value {
+        Value value;
+        bool received = requireChannel(call.args[0], "tryRecv").tryRecv(value);
+        return std::make_shared<ArrayValue>(std::vector<Value>{received, value});
+    }});
+    registry.add({"close", 1, "close(channel or reader)", [](NativeCall &call) -> Value {
+        if (auto reader = std::get_if<std::shared_ptr<FileReader>>(&call.args[0])) {
+            (*reader)->close();
+        } else {
+            requireChannel(call.args[0], "close").close();
+        }
+        return std::string();
+    }});
+    // [index, value] for the first of the channels to have a value, or [-1, 0]
+    // once all of them are closed and drained
+    registry.add({"select", 1, "select(channels)", [](NativeCall &call) -> Value {
+        auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&call.args[0]);
+        if (!arr) throw std::runtime_error("select() requires an array of channels");
+        // Held here so the channels outlive the wait even if the array changes
+        std::vector<std::shared_ptr<Channel>> held;
+        std::vector<Channel *> channels;
+        (*arr)->each([&](const Value &elem) {
+            requireChannel(elem, "select");
+            held.push_back(std::get<std::shared_ptr<Channel>>(elem));
+            channels.push_back(held.back().get());
+            return true;
+        });
+        Value value;
+        int index = Channel::select(channels, value);
+        return std::make_shared<ArrayValue>(std::vector<Value>{index, value});
+    }});
+    // Common names a script may already give its own functions
+    registry.yieldToScripts({"channel", "send", "recv", "tryRecv", "close", "select"});
+
+    // Built-in: toString(value) - convert value to string
+    registry.add({"toString", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        std::string result = call.interp.valueToString(v);
+        return Value(result);
+    }});
+
+    // Math functions
+    registry.add({"sin", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::sin(val);
+    }});
+    registry.add({"cos", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::cos(val);
+    }});
+    registry.add({"tan", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::tan(val);
+    }});
+    registry.add({"sqrt", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v)) {
+            NumericArray a(v, "sqrt");
+            std::vector<float> out(a.size());
+            vectorKernels().sqrtFloat(a.floats(), out.data(), a.size());
+            return ArrayValue::ofFloats(std::move(out));
+        }
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::sqrt(val);
+    }});
+    registry.add({"pow", 2, "", [](NativeCall &call) -> Value {
+        const Value &base = call.args[0];
+        const Value &exp = call.args[1];
+        float b = std::holds_alternative<float>(base) ? std::get<float>(base) : static_cast<float>(std::get<int>(base));
+        float e = std::holds_alternative<float>(exp) ? std::get<float>(exp) : static_cast<float>(std::get<int>(exp));
+        return std::pow(b, e);
+    }});
+    registry.add({"abs", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v)) {
+            NumericArray a(v, "abs");
+            if (a.isInt()) {
+                std::vector<int> out(a.size());
+                vectorKernels().absInt(a.ints(), out.data(), a.size());
+                return ArrayValue::ofInts(std::move(out));
+            }
+            std::vector<float> out(a.size());
+            vectorKernels().absFloat(a.floats(), out.data(), a.size());
+            return ArrayValue::ofFloats(std::move(out));
+        }
+        if (std::holds_alternative<int>(v)) {
+            return std::abs(std::get<int>(v));
+        }
+        return std::fabs(std::get<float>(v));
+    }});
+    registry.add({"floor", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v)) {
+            NumericArray a(v, "floor");
+            if (a.isInt()) {
+                return ArrayValue::ofInts(std::vector<int>(a.ints(), a.ints() + a.size()));
+            }
+            std::vector<int> out(a.size());
+            vectorKernels().floorFloat(a.floats(), out.data(), a.size());
+            return ArrayValue::ofInts(std::move(out));
+        }
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return static_cast<int>(std::floor(val));
+    }});
+    registry.add({"ceil", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return static_cast<int>(std::ceil(val));
+    }});
+    registry.add({"round", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return static_cast<int>(std::round(val));
+    }});
+    registry.add({"min", NativeFunction::kVariadic, "", [](NativeCall &call) -> Value {
+        if (call.args.size() == 1) {
+            NumericArray arr(call.args[0], "min");
+            if (arr.size() == 0) throw std::runtime_error("min() of an empty array");
+            if (arr.isInt()) return vectorKernels().minInt(arr.ints(), arr.size());
+            return vectorKernels().minFloat(arr.floats(), arr.size());
+        }
+        if (call.args.size() != 2) {
+            throw std::runtime_error("min() expects 2 numbers or 1 array");
+        }
+        const Value &a = call.args[0];
+        const Value &b = call.args[1];
+        if (std::holds_alternative<int>(a) && std::holds_alternative<int>(b)) {
+            return std::min(std::get<int>(a), std::get<int>(b));
+        }
+        float fa = std::holds_alternative<float>(a) ? std::get<float>(a) : static_cast<float>(std::get<int>(a));
+        float fb = std::holds_alternative<float>(b) ? std::get<float>(b) : static_cast<float>(std::get<int>(b));
+        return std::min(fa, fb);
+    }});
+    registry.add({"max", NativeFunction::kVariadic, "", [](NativeCall &call) -> Value {
+        if (call.args.size() == 1) {
+            NumericArray arr(call.args[0], "max");
+            if (arr.size() == 0) throw std::runtime_error("max() of an empty array");
+            if (arr.isInt()) return vectorKernels().maxInt(arr.ints(), arr.size());
+            return vectorKernels().maxFloat(arr.floats(), arr.size());
+        }
+        if (call.args.size() != 2) {
+            throw std::runtime_error("max() expects 2 numbers or 1 array");
+        }
+        const Value &a = call.args[0];
+        const Value &b = call.args[1];
+        if (std::holds_alternative<int>(a) && std::holds_alternative<int>(b)) {
+            return std::max(std::get<int>(a), std::get<int>(b));
+        }
+        float fa = std::holds_alternative<float>(a) ? std::get<float>(a) : static_cast<float>(std::get<int>(a));
+        float fb = std::holds_alternative<float>(b) ? std::get<float>(b) : static_cast<float>(std::get<int>(b));
+        return std::max(fa, fb);
+    }});
+    registry.add({"random", 0, "", [](NativeCall &) -> Value {
+        // One generator per thread; spawned programs call this concurrently
+        thread_local std::random_device rd;
+        thread_local std::mt19937 gen(rd());
+        thread_local std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+        return dis(gen);
+    }});
+
+    // Advanced math functions
+    registry.add({"log", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::log(val);
+    }});
+    registry.add({"log10", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::log10(val);
+    }});
+    registry.add({"exp", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::exp(val);
+    }});
+    registry.add({"asin", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::asin(val);
+    }});
+    registry.add({"acos", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::acos(val);
+    }});
+    registry.add({"atan", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
+        return std::atan(val);
+    }});
+    registry.add({"atan2", 2, "", [](NativeCall &call) -> Value {
+        const Value &y = call.args[0];
+        const Value &x = call.args[1];
+        float fy = std::holds_alternative<float>(y) ? std::get<float>(y) : static_cast<float>(std::get<int>(y));
+        float fx = std::holds_alternative<float>(x) ? std::get<float>(x) : static_cast<float>(std::get<int>(x));
+        return std::atan2(fy, fx);
+    }});
+    registry.add({"clamp", 3, "", [](NativeCall &call) -> Value {
+        const Value &val = call.args[0];
+        const Value &minVal = call.args[1];
+        const Value &maxVal = call.args[2];
+        if (std::holds_alternative<int>(val) && std::holds_alternative<int>(minVal) && std::holds_alternative<int>(maxVal)) {
+            int v = std::get<int>(val);
+            int mn = std::get<int>(minVal);
+            int mx = std::get<int>(maxVal);
+            return std::max(mn, std::min(mx, v));
+        }
+        float fv = std::holds_alternative<float>(val) ? std::get<float>(val) : static_cast<float>(std::get<int>(val));
+        float fmn = std::holds_alternative<float>(minVal) ? std::get<float>(minVal) : static_cast<float>(std::get<int>(minVal));
+        float fmx = std::holds_alternative<float>(maxVal) ? std::get<float>(maxVal) : static_cast<float>(std::get<int>(maxVal));
+        return std::max(fmn, std::min(fmx, fv));
+    }});
+    registry.add({"lerp", 3, "", [](NativeCall &call) -> Value {
+        const Value &a = call.args[0];
+        const Value &b = call.args[1];
+        const Value &t = call.args[2];
+        float fa = std::holds_alternative<float>(a) ? std::get<float>(a) : static_cast<float>(std::get<int>(a));
+        float fb = std::holds_alternative<float>(b) ? std::get<float>(b) : static_cast<float>(std::get<int>(b));
+        float ft = std::holds_alternative<float>(t) ? std::get<float>(t) : static_cast<float>(std::get<int>(t));
+        return fa + (fb - fa) * ft;
+    }});
+
+    // Numeric array functions, run by the SIMD kernels. Arrays of ints give
+    // ints; a float anywhere gives floats.
+    registry.add({"sum", 1, "", [](NativeCall &call) -> Value {
+        NumericArray a(call.args[0], "sum");
+        if (a.isInt()) return vectorKernels().sumInt(a.ints(), a.size());
+        return vectorKernels().sumFloat(a.floats(), a.size());
+    }});
+    registry.add({"dot", 2, "", [](NativeCall &call) -> Value {
+        NumericArray a(call.args[0], "dot");
+        NumericArray b(call.args[1], "dot");
+        requireSameLength(a, b, "dot");
+        if (a.isInt() && b.isInt()) return vectorKernels().dotInt(a.ints(), b.ints(), a.size());
+        return vectorKernels().dotFloat(a.floats(), b.floats(), a.size());
+    }});
+    registry.add({"addArrays", 2, "", [](NativeCall &call) -> Value {
+        NumericArray a(call.args[0], "addArrays");
+        NumericArray b(call.args[1], "addArrays");
+        requireSameLength(a, b, "addArrays");
+        if (a.isInt() && b.isInt()) {
+            std::vector<int> out(a.size());
+            vectorKernels().addInt(a.ints(), b.ints(), out.data(), a.size());
+            return ArrayValue::ofInts(std::move(out));
+        }
+        std::vector<float> out(a.size());
+        vectorKernels().addFloat(a.floats(), b.floats(), out.data(), a.size());
+        return ArrayValue::ofFloats(std::move(out));
+    }});
+    registry.add({"mulArrays", 2, "", [](NativeCall &call) -> Value {
+        NumericArray a(call.args[0], "mulArrays");
+        NumericArray b(call.args[1], "mulArrays");
+        requireSameLength(a, b, "mulArrays");
+        if (a.isInt() && b.isInt()) {
+            std::vector<int> out(a.size());
+            vectorKernels().mulInt(a.ints(), b.ints(), out.data(), a.size());
+            return ArrayValue::ofInts(std::move(out));
+        }
+        std::vector<float> out(a.size());
+        vectorKernels().mulFloat(a.floats(), b.floats(), out.data(), a.size());
+        return ArrayValue::ofFloats(std::move(out));
+    }});
+    registry.add({"scale", 2, "", [](NativeCall &call) -> Value {
+        NumericArray a(call.args[0], "scale");
+        const Value &k = call.args[1];
+        if (!std::holds_alternative<int>(k) && !std::holds_alternative<float>(k)) {
+            throw std::runtime_error("scale() requires a number as factor");
+        }
+        if (a.isInt() && std::holds_alternative<int>(k)) {
+            std::vector<int> out(a.size());
+            vectorKernels().scaleInt(a.ints(), std::get<int>(k), out.data(), a.size());
+            return ArrayValue::ofInts(std::move(out));
+        }
+        float factor = std::holds_alternative<float>(k) ? std::get<float>(k) : static_cast<float>(std::get<int>(k));
+        std::vector<float> out(a.size());
+        vectorKernels().scaleFloat(a.floats(), factor, out.data(), a.size());
+        return ArrayValue::ofFloats(std::move(out));
+    }});
+
+    // Added after scripts could already declare functions with these names,
+    // so a script's own sum() or scale() is the one it calls
+    registry.yieldToScripts({"sum", "dot", "addArrays", "mulArrays", "scale"});
+
+    // Array functions
+    registry.add({"slice", 3, "", [](NativeCall &call) -> Value {
+        const Value &arrVal = call.args[0];
+        const Value &startVal = call.args[1];
+        const Value &endVal = call.args[2];
+        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("slice() requires array");
+        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+        int start = std::get<int>(startVal);
+        int end = std::get<int>(endVal);
+        if (start < 0) start = 0;
+        if (end < start) end = start;
+        return arr->slice(start, end);
+    }});
+    registry.add({"reverse", 1, "", [](NativeCall &call) -> Value {
+        const Value &arrVal = call.args[0];
+        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("reverse() requires array");
+        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+        auto result = arr->slice(0, arr->size());
+        switch (result->storage()) {
+            case ArrayValue::Storage::Int: std::reverse(result->ints.begin(), result->ints.end()); break;
+            case ArrayValue::Storage::Float: std::reverse(result->floats.begin(), result->floats.end()); break;
+            case ArrayValue::Storage::Bool: std::reverse(result->bools.begin(), result->bools.end()); break;
+            default: std::reverse(result->boxed().begin(), result->boxed().end()); break;
+        }
+        return result;
+    }});
+    registry.add({"join", 2, "", [](NativeCall &call) -> Value {
+        const Value &arrVal = call.args[0];
+        const Value &sepVal = call.args[1];
+        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("join() requires array");
+        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+        const std::string &sep = std::get<std::string>(sepVal);
+        std::string result;
+        bool first = true;
+        arr->each([&](const Value &elem) {
+            if (!first) result += sep;
+            first = false;
+            result += call.interp.valueToString(elem);
+            return true;
+        });
+        return result;
+    }});
+    // sort(array[, comparator]) and stableSort(array[, comparator]) order an
+    // array variable in place. Without a comparator numbers compare as
+    // numbers, strings as strings, and arrays holding other or mixed kinds by
+    // their text. A comparator gets two elements and returns a negative
+    // number, or true, when the first one goes first.
+    auto sortArray = [](NativeCall &call, const std::string &fn, bool stable) -> Value {
+        if (call.args.size() != 1 && call.args.size() != 2) {
+            throw std::runtime_error(fn + "() expects an array and an optional comparator");
+        }
+        if (call.arrayName.empty()) throw std::runtime_error(fn + "() requires array variable");
+        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(call.args[0])) throw std::runtime_error(fn + "() requires array");
+        auto arr = std::get<std::shared_ptr<ArrayValue>>(call.args[0]);
+
+        if (call.args.size() == 2) {
+            const Value &comparator = call.args[1];
+            size_t params = 0;
+            if (auto f = std::get_if<FunctionDeclaration *>(&comparator)) params = (*f)->params.size();
+            else if (auto f = std::get_if<FunctionExpression *>(&comparator)) params = (*f)->params.size();
+            else throw std::runtime_error(fn + "() comparator must be a function");
+            if (params != 2) throw std::runtime_error(fn + "() comparator must take 2 arguments");
+
+            auto less = [&](const Value &a, const Value &b) {
+                Value order = std::holds_alternative<FunctionDeclaration *>(comparator)
+                                  ? call.interp.callFunction(std::get<FunctionDeclaration *>(comparator), {a, b})
+                                  : call.interp.callFunction(std::get<FunctionExpression *>(comparator), {a, b});
+                if (auto asBool = std::get_if<bool>(&order)) return *asBool;
+                if (auto asInt = std::get_if<int>(&order)) return *asInt < 0;
+                if (auto asFloat = std::get_if<float>(&order)) return *asFloat < 0;
+                throw std::runtime_error(fn + "() comparator must return a number or bool");
+            };
+            // The comparator may touch the array, so a copy is sorted. Merge
+            // sort stays in bounds even if the comparator is inconsistent, and
+            // script code only runs on this thread.
+            std::vector<Value> items;
+            items.reserve(arr->size());
+            arr->each([&](const Value &v) { items.push_back(v); return true; });
+            std::stable_sort(items.begin(), items.end(), less);
+            ArrayValue::Storage storage = arr->storage();
+            *arr = ArrayValue(std::move(items));
+            arr->unbox(storage);
+            return arr;
+        }
+
+        switch (arr->storage()) {
+            case ArrayValue::Storage::Int:
+                sortVector(arr->ints, std::less<int>(), stable);
+                return arr;
+            case ArrayValue::Storage::Float:
+                sortVector(arr->floats, floatLess, stable);
+                return arr;
+            case ArrayValue::Storage::Bool:
+                sortVector(arr->bools, std::less<char>(), stable);
+                return arr;
+            default:
+                break;
+        }
+        std::vector<Value> &items = arr->boxed();
+        bool numbers = arr->each([](const Value &v) {
+            return std::holds_alternative<int>(v) || std::holds_alternative<float>(v);
+        });
+        if (numbers) {
+            sortVector(items, numberLess, stable);
+            return arr;
+        }
+        bool strings = arr->each([](const Value &v) { return std::holds_alternative<std::string>(v); });
+        if (strings) {
+            sortVector(items, [](const Value &a, const Value &b) {
+                return std::get<std::string>(a) < std::get<std::string>(b);
+            }, stable);
+            return arr;
+        }
+        // Mixed kinds: each element's text is computed once, not per comparison
+        std::vector<std::pair<std::string, Value>> keyed;
+        keyed.reserve(items.size());
+        for (auto &v : items) keyed.emplace_back(call.interp.valueToString(v), std::move(v));
+        sortVector(keyed, [](const std::pair<std::string, Value> &a, const std::pair<std::string, Value> &b) {
+            return a.first < b.first;
+        }, stable);
+        for (size_t i = 0; i < items.size(); ++i) items[i] = std::move(keyed[i].second);
+        return arr;
+    };
+    registry.add({"sort", NativeFunction::kVariadic, "", [sortArray](NativeCall &call) -> Value {
+        return sortArray(call, "sort", false);
+    }, true});
+    registry.add({"stableSort", NativeFunction::kVariadic, "", [sortArray](NativeCall &call) -> Value {
+        return sortArray(call, "stableSort", true);
+    }, true});
+    registry.yieldToScripts({"stableSort"});
+    // Index of the first element that prints the same as `needle`, or -1. An int
+    // or bool searched in an array of the same unboxed storage compares directly.
+    auto findElement = [](Interpreter &interp, const ArrayValue &arr, const Value &needle) -> int {
+        if (arr.storage() == ArrayValue::Storage::Int && std::holds_alternative<int>(needle)) {
+            auto it = std::find(arr.ints.begin(), arr.ints.end(), std::get<int>(needle));
+            return it == arr.ints.end() ? -1 : static_cast<int>(it - arr.ints.begin());
+        }
+        if (arr.storage() == ArrayValue::Storage::Bool && std::holds_alternative<bool>(needle)) {
+            auto it = std::find(arr.bools.begin(), arr.bools.end(), static_cast<char>(std::get<bool>(needle)));
+            return it == arr.bools.end() ? -1 : static_cast<int>(it - arr.bools.begin());
+        }
+        std::string text = interp.valueToString(needle);
+        for (size_t i = 0; i < arr.size(); i++) {
+            if (interp.valueToString(arr.at(i)) == text) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    };
+    registry.add({"find", 2, "", [findElement](NativeCall &call) -> Value {
+        const Value &arrVal = call.args[0];
+        const Value &searchVal = call.args[1];
+        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("find() requires array");
+        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+        return findElement(call.interp, *arr, searchVal);
+    }});
+    registry.add({"includes", 2, "", [findElement](NativeCall &call) -> Value {
+        const Value &arrVal = call.args[0];
+        const Value &searchVal = call.args[1];
+        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("includes() requires array");
+        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
+        return findElement(call.interp, *arr, searchVal) >= 0;
+    }});
+
+    // String functions
+    registry.add({"trim", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (!std::holds_alternative<std::string>(v)) throw std::runtime_error("trim() requires string");
+        const std::string &str = std::get<std::string>(v);
+        size_t start = str.find_first_not_of(" \t\n\r");
+        if (start == std::string::npos) {
+            return std::string("");
+        }
+        size_t end = str.find_last_not_of(" \t\n\r");
+        return str.substr(start, end - start + 1);
+    }});
+    registry.add({"replace", 3, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &searchVal = call.args[1];
+        const Value &replaceVal = call.args[2];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("replace() requires string");
+        std::string str = std::get<std::string>(strVal);
+        const std::string &search = std::get<std::string>(searchVal);
+        const std::string &replacement = std::get<std::string>(replaceVal);
+        size_t pos = str.find(search);
+        if (pos != std::string::npos) {
+            str.replace(pos, search.length(), replacement);
+        }
+        return str;
+    }});
+    registry.add({"split", 2, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &delimVal = call.args[1];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("split() requires string");
+        const std::string &str = std::get<std::string>(strVal);
+        const std::string &delim = std::get<std::string>(delimVal);
+        auto result = std::make_shared<ArrayValue>();
+        size_t start = 0;
+        size_t end = str.find(delim);
+        while (end != std::string::npos) {
+            result->push(str.substr(start, end - start));
+            start = end + delim.length();
+            end = str.find(delim, start);
+        }
+        result->push(str.substr(start));
+        return result;
+    }});
+    registry.add({"startsWith", 2, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &prefixVal = call.args[1];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("startsWith() requires string");
+        const std::string &str = std::get<std::string>(strVal);
+        const std::string &prefix = std::get<std::string>(prefixVal);
+        return str.rfind(prefix, 0) == 0;
+    }});
+    registry.add({"endsWith", 2, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &suffixVal = call.args[1];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("endsWith() requires string");
+        const std::string &str = std::get<std::string>(strVal);
+        const std::string &suffix = std::get<std::string>(suffixVal);
+        if (suffix.length() > str.length()) {
+            return false;
+        } else {
+            return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+        }
+    }});
+    registry.add({"repeat", 2, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &countVal = call.args[1];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("repeat() requires string");
+        const std::string &str = std::get<std::string>(strVal);
+        int count = std::get<int>(countVal);
+        std::string result;
+        for (int i = 0; i < count; i++) {
+            result += str;
+        }
+        return result;
+    }});
+    registry.add({"charAt", 2, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &idxVal = call.args[1];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("charAt() requires string");
+        const std::string &str = std::get<std::string>(strVal);
+        int idx = std::get<int>(idxVal);
+        if (idx < 0 || idx >= (int)str.length()) {
+            return std::string("");
+        } else {
+            return std::string(1, str[idx]);
+        }
+    }});
+    registry.add({"charCodeAt", 2, "", [](NativeCall &call) -> Value {
+        const Value &strVal = call.args[0];
+        const Value &idxVal = call.args[1];
+        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("charCodeAt() requires string");
+        const std::string &str = std::get<std::string>(strVal);
+        int idx = std::get<int>(idxVal);
+        if (idx < 0 || idx >= (int)str.length()) {
+            return -1;
+        } else {
+            return static_cast<int>(str[idx]);
+        }
+    }});
+
+    // Type conversion functions
+    registry.add({"toInt", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (std::holds_alternative<int>(v)) {
+            return std::get<int>(v);
+        } else if (std::holds_alternative<float>(v)) {
+            return static_cast<int>(std::get<float>(v));
+        } else if (std::holds_alternative<bool>(v)) {
+            return std::get<bool>(v) ? 1 : 0;
+        } else if (std::holds_alternative<std::string>(v)) {
+            try {
+                return std::stoi(std::get<std::string>(v));
+            } catch (...) {
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+    }});
+    registry.add({"toFloat", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        if (std::holds_alternative<float>(v)) {
+            return std::get<float>(v);
+        } else if (std::holds_alternative<int>(v)) {
+            return static_cast<float>(std::get<int>(v));
+        } else if (std::holds_alternative<std::string>(v)) {
+            try {
+                return std::stof(std::get<std::string>(v));
+            } catch (...) {
+                return 0.0f;
+            }
+        } else {
+            return 0.0f;
+        }
+    }});
+    registry.add({"toBool", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        return call.interp.isTruthy(v);
+    }});
+
+    // Utility functions
+    registry.add({"assert", 2, "", [](NativeCall &call) -> Value {
+        const Value &condVal = call.args[0];
+        const Value &msgVal = call.args[1];
+        if (!call.interp.isTruthy(condVal)) {
+            throw std::runtime_error("Assertion failed: " + std::get<std::string>(msgVal));
+        }
+        return std::string();
+    }});
+    registry.add({"error", 1, "", [](NativeCall &call) -> Value {
+        const Value &msgVal = call.args[0];
+        throw std::runtime_error(std::get<std::string>(msgVal));
+    }});
+    registry.add({"keys", 1, "", [](NativeCall &call) -> Value {
+        const Value &objVal = call.args[0];
+        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal)) throw std::runtime_error("keys() requires object");
+        auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
+        auto result = std::make_shared<ArrayValue>();
+        obj->each([&](const std::string& key, const Value&) { result->push(key); });
+        return result;
+    }});
+    registry.add({"values", 1, "", [](NativeCall &call) -> Value {
+        const Value &objVal = call.args[0];
+        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal)) throw std::runtime_error("values() requires object");
+        auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
+        auto result = std::make_shared<ArrayValue>();
+        obj->each([&](const std::string&, const Value& val) { result->push(val); });
+        return result;
+    }});
+    registry.add({"hasKey", 2, "", [](NativeCall &call) -> Value {
+        const Value &objVal = call.args[0];
+        const Value &keyVal = call.args[1];
+        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal)) throw std::runtime_error("hasKey() requires object");
+        auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
+        const std::string &key = std::get<std::string>(keyVal);
+        return obj->find(key) != nullptr;
+    }});
+    registry.add({"clone", 1, "", [](NativeCall &call) -> Value {
+        const Value &v = call.args[0];
+        // Deep copy for arrays and objects
+        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v)) {
+            auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
+            return std::make_shared<ArrayValue>(*arr);  // shallow copy, same storage
+        }
+        if (std::holds_alternative<std::shared_ptr<ObjectValue>>(v)) {
+            auto obj = std::get<std::shared_ptr<ObjectValue>>(v);
+            return std::make_shared<ObjectValue>(*obj);  // shallow copy of the fields
+        }
+        return v;
+    }});
+    registry.add({"merge", 2, "", [](NativeCall &call) -> Value {
+        const Value &obj1Val = call.args[0];
+        const Value &obj2Val = call.args[1];
+        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(obj1Val) || 
+            !std::holds_alternative<std::shared_ptr<ObjectValue>>(obj2Val)) {
+            throw std::runtime_error("merge() requires two objects");
+        }
+        auto obj1 = std::get<std::shared_ptr<ObjectValue>>(obj1Val);
+        auto obj2 = std::get<std::shared_ptr<ObjectValue>>(obj2Val);
+        auto result = std::make_shared<ObjectValue>(*obj1);
+        obj2->each([&](const std::string& key, const Value& val) { result->set(key, val); });
+        return result;
+    }});
+
+    // The cycle collector (see heap.h). gc() collects now and gives how many
+    // arrays and objects it freed; 0 while spawned programs are running.
+    registry.add({"gc", 0, "gc()", [](NativeCall &) -> Value {
+        return static_cast<int>(Heap::collect());
+    }});
+    registry.add({"gcStats", 0, "gcStats()", [](NativeCall &) -> Value {
+        Heap::Stats stats = Heap::stats();
+        auto result = std::make_shared<ObjectValue>();
+        result->set("collections", static_cast<int>(stats.collections));
+        result->set("objects", static_cast<int>(stats.objects));
+        result->set("freed", static_cast<int>(stats.freed));
+        result->set("lastPauseUs", static_cast<int>(stats.lastPauseUs));
+        result->set("maxPauseUs", static_cast<int>(stats.maxPauseUs));
+        result->set("totalPauseUs", static_cast<int>(stats.totalPauseUs));
+        return result;
+    }});
+    registry.yieldToScripts({"gc", "gcStats"});
+}
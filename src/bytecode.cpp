@@ -0,0 +1,634 @@
+#include "include/bytecode.h"
+#include "include/interpreter.h"
+#include "include/builtins.h"
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+// Thrown while compiling when the program needs the tree walker
+class Unsupported : public std::runtime_error {
+public:
+    explicit Unsupported(const std::string& what) : std::runtime_error(what) {}
+};
+
+// Net operand stack effect of an instruction, used to size frames
+int stackEffect(const Instruction& ins) {
+    switch (ins.op) {
+        case OpCode::CONST:
+        case OpCode::LOAD_LOCAL:
+        case OpCode::LOAD_GLOBAL:
+        case OpCode::TYPEOF_LOCAL:
+        case OpCode::TYPEOF_GLOBAL:
+            return 1;
+        case OpCode::POP:
+        case OpCode::DEFINE_LOCAL:
+        case OpCode::DEFINE_GLOBAL:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::GET_INDEX:
+        case OpCode::SET_FIELD:
+        case OpCode::RETURN:
+            return -1;
+        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+        case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::GT: case OpCode::LE: case OpCode::GE:
+        case OpCode::AND: case OpCode::OR:
+            return -1;
+        case OpCode::JUMP_IF_NOT_EQ: case OpCode::JUMP_IF_NOT_NE:
+        case OpCode::JUMP_IF_NOT_LT: case OpCode::JUMP_IF_NOT_GT:
+        case OpCode::JUMP_IF_NOT_LE: case OpCode::JUMP_IF_NOT_GE:
+        case OpCode::SET_INDEX:
+            return -2;
+        case OpCode::JUMP_IF_NOT_EQ_CONST: case OpCode::JUMP_IF_NOT_NE_CONST:
+        case OpCode::JUMP_IF_NOT_LT_CONST: case OpCode::JUMP_IF_NOT_GT_CONST:
+        case OpCode::JUMP_IF_NOT_LE_CONST: case OpCode::JUMP_IF_NOT_GE_CONST:
+            return -1;
+        case OpCode::MAKE_ARRAY:
+        case OpCode::MAKE_OBJECT:
+        case OpCode::CONCAT:
+            return 1 - ins.a;
+        case OpCode::STORE_LOCAL:
+        case OpCode::STORE_GLOBAL:
+            return -ins.c;
+        case OpCode::CALL:
+            return -ins.a;
+        case OpCode::CALL_FUNC:
+        case OpCode::CALL_BUILTIN:
+            return 1 - ins.b;
+        default:
+            return 0;
+    }
+}
+
+} // namespace
+
+class BytecodeCompiler::Impl {
+public:
+    explicit Impl(BytecodeProgram& out) : out(out) {}
+
+    void compileProgram(Program* program) {
+        // Pre-pass: names of top-level functions, so calls can bind to them
+        // even when the declaration comes later in the file
+        for (auto& decl : program->declarations) {
+            if (auto fn = dynamic_cast<FunctionDeclaration*>(decl.get())) {
+                functionSlot(fn->name);
+            }
+        }
+
+        auto main = newProto("<main>");
+        FunctionState state{main, {}, 0, true, {}, {}};
+        state.scopes.emplace_back();
+        fn = &state;
+        for (auto& decl : program->declarations) {
+            compileNode(decl.get());
+        }
+        emit(OpCode::HALT);
+        finishFunction();
+
+        // The tree walker scopes names dynamically: a function sees the locals
+        // of whoever called it. The VM binds free names to globals, which only
+        // agrees when no function-local of that name exists anywhere.
+        for (auto& name : freeNames) {
+            if (localNames.count(name)) {
+                throw Unsupported("'" + name + "' is resolved through dynamic scoping");
+            }
+        }
+    }
+
+private:
+    struct Local {
+        int slot;
+        int info;
+    };
+
+    struct Loop {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+
+    struct FunctionState {
+        FunctionProto* proto;
+        std::vector<std::unordered_map<std::string, Local>> scopes;
+        size_t nextSlot;
+        bool isMain;
+        std::vector<Loop> loops;
+        std::vector<size_t> scopeMarks;
+        size_t depth = 0;
+    };
+
+    BytecodeProgram& out;
+    FunctionState* fn = nullptr;
+    std::unordered_map<std::string, int> globals;
+    std::unordered_map<std::string, int> functions;
+    std::unordered_set<std::string> localNames;
+    std::unordered_set<std::string> freeNames;
+
+    FunctionProto* newProto(const std::string& name) {
+        out.protos.push_back(std::make_unique<FunctionProto>());
+        out.protos.back()->name = name;
+        return out.protos.back().get();
+    }
+
+    size_t emit(OpCode op, int a = 0, int b = 0, int c = 0) {
+        Instruction ins{op, a, b, c};
+        int effect = stackEffect(ins);
+        fn->depth = (effect < 0 && (size_t)-effect > fn->depth) ? 0 : fn->depth + effect;
+        if (fn->depth > fn->proto->maxStack) fn->proto->maxStack = fn->depth;
+        fn->proto->code.push_back(ins);
+        return fn->proto->code.size() - 1;
+    }
+
+    size_t here() const { return fn->proto->code.size(); }
+
+    // Discard the top of stack, folding it into a preceding store when possible
+    void emitPop() {
+        auto& code = fn->proto->code;
+        if (!code.empty() && code.back().c == 0 &&
+            (code.back().op == OpCode::STORE_LOCAL || code.back().op == OpCode::STORE_GLOBAL)) {
+            code.back().c = 1;
+            fn->depth--;
+            return;
+        }
+        emit(OpCode::POP);
+    }
+
+    // Branch on a condition, fusing a trailing comparison into the jump
+    size_t emitJumpIfFalse() {
+        auto& code = fn->proto->code;
+        if (!code.empty()) {
+            OpCode fused = OpCode::JUMP_IF_FALSE;
+            switch (code.back().op) {
+                case OpCode::EQ: fused = OpCode::JUMP_IF_NOT_EQ; break;
+                case OpCode::NE: fused = OpCode::JUMP_IF_NOT_NE; break;
+                case OpCode::LT: fused = OpCode::JUMP_IF_NOT_LT; break;
+                case OpCode::GT: fused = OpCode::JUMP_IF_NOT_GT; break;
+                case OpCode::LE: fused = OpCode::JUMP_IF_NOT_LE; break;
+                case OpCode::GE: fused = OpCode::JUMP_IF_NOT_GE; break;
+                case OpCode::EQ_CONST: fused = OpCode::JUMP_IF_NOT_EQ_CONST; break;
+                case OpCode::NE_CONST: fused = OpCode::JUMP_IF_NOT_NE_CONST; break;
+                case OpCode::LT_CONST: fused = OpCode::JUMP_IF_NOT_LT_CONST; break;
+                case OpCode::GT_CONST: fused = OpCode::JUMP_IF_NOT_GT_CONST; break;
+                case OpCode::LE_CONST: fused = OpCode::JUMP_IF_NOT_LE_CONST; break;
+                case OpCode::GE_CONST: fused = OpCode::JUMP_IF_NOT_GE_CONST; break;
+                default: break;
+            }
+            if (fused >= OpCode::JUMP_IF_NOT_EQ_CONST) {
+                // The constant moves to b; a becomes the jump target
+                code.back().b = code.back().a;
+                code.back().op = fused;
+                fn->depth--;
+                return code.size() - 1;
+            }
+            if (fused != OpCode::JUMP_IF_FALSE) {
+                code.back().op = fused;
+                fn->depth--;
+                return code.size() - 1;
+            }
+        }
+        return emit(OpCode::JUMP_IF_FALSE);
+    }
+    void patch(size_t at, size_t target) { fn->proto->code[at].a = static_cast<int>(target); }
+
+    int constant(const Value& v) {
+        fn->proto->constants.push_back(v);
+        return static_cast<int>(fn->proto->constants.size() - 1);
+    }
+
+    int globalSlot(const std::string& name) {
+        auto it = globals.find(name);
+        if (it != globals.end()) return it->second;
+        int slot = static_cast<int>(out.globalNames.size());
+        out.globalNames.push_back(name);
+        globals[name] = slot;
+        return slot;
+    }
+
+    int functionSlot(const std::string& name) {
+        auto it = functions.find(name);
+        if (it != functions.end()) return it->second;
+        int slot = static_cast<int>(out.functionNames.size());
+        out.functionNames.push_back(name);
+        functions[name] = slot;
+        return slot;
+    }
+
+    int varInfo(const std::string& name, const std::string& type) {
+        out.varInfos.push_back(VarInfo{name, TypeDescriptor::get(type)});
+        return static_cast<int>(out.varInfos.size() - 1);
+    }
+
+    void finishFunction() {
+        if (fn->nextSlot > fn->proto->numSlots) fn->proto->numSlots = fn->nextSlot;
+    }
+
+    void pushScope() {
+        fn->scopes.emplace_back();
+        fn->scopeMarks.push_back(fn->nextSlot);
+    }
+
+    void popScope() {
+        if (fn->nextSlot > fn->proto->numSlots) fn->proto->numSlots = fn->nextSlot;
+        fn->nextSlot = fn->scopeMarks.back();
+        fn->scopeMarks.pop_back();
+        fn->scopes.pop_back();
+    }
+
+    // Top-level declarations of the script are globals; everything else is a frame slot
+    bool atGlobalScope() const { return fn->isMain && fn->scopes.size() == 1; }
+
+    const Local* findLocal(const std::string& name) const {
+        for (auto it = fn->scopes.rbegin(); it != fn->scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) return &found->second;
+        }
+        return nullptr;
+    }
+
+    Local declareLocal(const std::string& name, const std::string& type) {
+        localNames.insert(name);
+        auto& scope = fn->scopes.back();
+        auto existing = scope.find(name);
+        int info = varInfo(name, type);
+        if (existing != scope.end()) {
+            existing->second.info = info;
+            return existing->second;
+        }
+        Local local{static_cast<int>(fn->nextSlot++), info};
+        scope[name] = local;
+        return local;
+    }
+
+    // Global access from inside a function: remember it for the dynamic scoping check
+    int freeGlobal(const std::string& name) {
+        if (!fn->isMain) freeNames.insert(name);
+        return globalSlot(name);
+    }
+
+    // ---- statements ----
+
+    void compileNode(ASTNode* node) {
+        if (auto e = dynamic_cast<Expression*>(node)) {
+            compileExpression(e);
+            emitPop();
+        } else if (auto s = dynamic_cast<ExpressionStatement*>(node)) {
+            compileExpression(s->expression.get());
+            emitPop();
+        } else if (auto s = dynamic_cast<VariableDeclaration*>(node)) {
+            compileVariableDeclaration(s);
+        } else if (auto s = dynamic_cast<Block*>(node)) {
+            compileBlock(s);
+        } else if (auto s = dynamic_cast<IfStatement*>(node)) {
+            compileExpression(s->condition.get());
+            size_t toElse = emitJumpIfFalse();
+            compileBlock(s->thenBlock.get());
+            if (s->elseBlock) {
+                size_t toEnd = emit(OpCode::JUMP);
+                patch(toElse, here());
+                compileBlock(s->elseBlock.get());
+                patch(toEnd, here());
+            } else {
+                patch(toElse, here());
+            }
+        } else if (auto s = dynamic_cast<WhileStatement*>(node)) {
+            size_t start = here();
+            compileExpression(s->condition.get());
+            size_t toEnd = emitJumpIfFalse();
+            fn->loops.emplace_back();
+            compileBlock(s->body.get());
+            emit(OpCode::JUMP, static_cast<int>(start));
+            finishLoop(start, here());
+            patch(toEnd, here());
+        } else if (auto s = dynamic_cast<ForStatement*>(node)) {
+            pushScope();
+            if (s->init) compileNode(s->init.get());
+            size_t start = here();
+            compileExpression(s->condition.get());
+            size_t toEnd = emitJumpIfFalse();
+            fn->loops.emplace_back();
+            compileBlock(s->body.get());
+            size_t update = here();
+            compileExpression(s->update.get());
+            emitPop();
+            emit(OpCode::JUMP, static_cast<int>(start));
+            finishLoop(update, here());
+            patch(toEnd, here());
+            popScope();
+        } else if (auto s = dynamic_cast<ReturnStatement*>(node)) {
+            if (fn->isMain) throw Unsupported("return outside of a function");
+            if (s->value) {
+                compileExpression(s->value.get());
+            } else {
+                emit(OpCode::CONST, constant(0));
+            }
+            emit(OpCode::RETURN);
+        } else if (dynamic_cast<BreakStatement*>(node)) {
+            if (fn->loops.empty()) throw Unsupported("break outside of a loop");
+            fn->loops.back().breaks.push_back(emit(OpCode::JUMP));
+        } else if (dynamic_cast<ContinueStatement*>(node)) {
+            if (fn->loops.empty()) throw Unsupported("continue outside of a loop");
+            fn->loops.back().continues.push_back(emit(OpCode::JUMP));
+        } else if (auto s = dynamic_cast<FunctionDeclaration*>(node)) {
+            if (!atGlobalScope()) throw Unsupported("nested function declaration '" + s->name + "'");
+            FunctionProto* proto = compileFunction(s->name, s->params, s->body.get(), s);
+            emit(OpCode::DEFINE_FUNC, functionSlot(s->name), protoIndex(proto));
+            emit(OpCode::CONST, constant(s));
+            emit(OpCode::DEFINE_GLOBAL, globalSlot(s->name), varInfo(s->name, "function"), 0);
+        } else if (auto s = dynamic_cast<TypeDeclaration*>(node)) {
+            emit(OpCode::DEFINE_TYPE, constant(s->name), constant(s->typeSpec));
+        } else {
+            throw Unsupported("statement kind not supported by the VM");
+        }
+    }
+
+    void finishLoop(size_t continueTarget, size_t breakTarget) {
+        Loop loop = std::move(fn->loops.back());
+        fn->loops.pop_back();
+        for (size_t at : loop.continues) patch(at, continueTarget);
+        for (size_t at : loop.breaks) patch(at, breakTarget);
+    }
+
+    void compileBlock(Block* block) {
+        pushScope();
+        for (auto& stmt : block->statements) {
+            compileNode(stmt.get());
+        }
+        popScope();
+    }
+
+    void compileVariableDeclaration(VariableDeclaration* node) {
+        if (node->initializer) {
+            compileExpression(node->initializer.get());
+        } else if (node->type == "object") {
+            emit(OpCode::MAKE_OBJECT, 0, keyList({}));
+        } else if (node->type == "string") {
+            emit(OpCode::CONST, constant(std::string()));
+        } else {
+            emit(OpCode::CONST, constant(0));
+        }
+
+        bool check = node->initializer != nullptr;
+        if (atGlobalScope()) {
+            emit(OpCode::DEFINE_GLOBAL, globalSlot(node->name), varInfo(node->name, node->type), check ? 1 : 0);
+        } else {
+            Local local = declareLocal(node->name, node->type);
+            emit(OpCode::DEFINE_LOCAL, local.slot, check ? local.info : -1);
+        }
+    }
+
+    FunctionProto* compileFunction(const std::string& name,
+                                   const std::vector<std::pair<std::string, std::string>>& params,
+                                   Block* body, const ASTNode* key) {
+        FunctionProto* proto = newProto(name);
+        proto->numParams = params.size();
+        out.protoFor[key] = proto;
+
+        FunctionState state{proto, {}, 0, false, {}, {}};
+        FunctionState* saved = fn;
+        fn = &state;
+        state.scopes.emplace_back();
+        for (auto& param : params) {
+            declareLocal(param.first, param.second);
+        }
+        compileBlock(body);
+        emit(OpCode::CONST, constant(std::string()));
+        emit(OpCode::RETURN);
+        finishFunction();
+        fn = saved;
+        return proto;
+    }
+
+    int protoIndex(FunctionProto* proto) {
+        for (size_t i = 0; i < out.protos.size(); ++i) {
+            if (out.protos[i].get() == proto) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    int keyList(std::vector<std::string> keys) {
+        const Shape* shape = Shape::empty()->withAll(keys);
+        out.keyShapes.push_back(shape && shape->size() == keys.size() ? shape : nullptr);
+        out.keyLists.push_back(std::move(keys));
+        return static_cast<int>(out.keyLists.size() - 1);
+    }
+
+    int fieldCache(const FieldCache* cache) {
+        out.fieldCaches.push_back(cache);
+        return static_cast<int>(out.fieldCaches.size() - 1);
+    }
+
+    int varRef(Identifier* id) {
+        VarRef ref;
+        if (const Local* local = findLocal(id->name)) {
+            ref.slot = local->slot;
+            ref.info = local->info;
+        } else {
+            ref.isGlobal = true;
+            ref.slot = freeGlobal(id->name);
+        }
+        out.varRefs.push_back(ref);
+        return static_cast<int>(out.varRefs.size() - 1);
+    }
+
+    // ---- expressions ----
+
+    void compileExpression(Expression* expr) {
+        if (auto e = dynamic_cast<IntegerLiteral*>(expr)) {
+            emit(OpCode::CONST, constant(e->value));
+        } else if (auto e = dynamic_cast<FloatLiteral*>(expr)) {
+            emit(OpCode::CONST, constant(e->value));
+        } else if (auto e = dynamic_cast<BooleanLiteral*>(expr)) {
+            emit(OpCode::CONST, constant(e->value));
+        } else if (auto e = dynamic_cast<StringLiteral*>(expr)) {
+            emit(OpCode::CONST, constant(e->value));
+        } else if (auto e = dynamic_cast<TemplateLiteral*>(expr)) {
+            compileTemplate(e);
+        } else if (auto e = dynamic_cast<Identifier*>(expr)) {
+            if (const Local* local = findLocal(e->name)) {
+                emit(OpCode::LOAD_LOCAL, local->slot);
+            } else {
+                emit(OpCode::LOAD_GLOBAL, freeGlobal(e->name));
+            }
+        } else if (auto e = dynamic_cast<BinaryOp*>(expr)) {
+            compileExpression(e->left.get());
+            OpCode op = binaryOpCode(e->op);
+            // A number on the right rides in the instruction instead of being pushed
+            OpCode withConstant = constantOpCode(op);
+            if (withConstant != op && dynamic_cast<IntegerLiteral*>(e->right.get())) {
+                emit(withConstant, constant(static_cast<IntegerLiteral*>(e->right.get())->value));
+            } else if (withConstant != op && dynamic_cast<FloatLiteral*>(e->right.get())) {
+                emit(withConstant, constant(static_cast<FloatLiteral*>(e->right.get())->value));
+            } else {
+                compileExpression(e->right.get());
+                emit(op);
+            }
+        } else if (auto e = dynamic_cast<UnaryOp*>(expr)) {
+            compileUnary(e);
+        } else if (auto e = dynamic_cast<FunctionCall*>(expr)) {
+            compileCall(e);
+        } else if (auto e = dynamic_cast<ArrayLiteral*>(expr)) {
+            for (auto& elem : e->elements) compileExpression(elem.get());
+            emit(OpCode::MAKE_ARRAY, static_cast<int>(e->elements.size()));
+        } else if (auto e = dynamic_cast<ObjectLiteral*>(expr)) {
+            std::vector<std::string> keys;
+            for (auto& field : e->fields) {
+                compileExpression(field.second.get());
+                keys.push_back(field.first);
+            }
+            int count = static_cast<int>(keys.size());
+            emit(OpCode::MAKE_OBJECT, count, keyList(std::move(keys)));
+        } else if (auto e = dynamic_cast<FunctionExpression*>(expr)) {
+            compileFunction("<anonymous>", e->params, e->body.get(), e);
+            emit(OpCode::CONST, constant(e));
+        } else if (auto e = dynamic_cast<IndexAccess*>(expr)) {
+            compileExpression(e->object.get());
+            compileExpression(e->index.get());
+            emit(OpCode::GET_INDEX);
+        } else if (auto e = dynamic_cast<FieldAccess*>(expr)) {
+            compileExpression(e->object.get());
+            emit(OpCode::GET_FIELD, constant(e->field), fieldCache(&e->cache));
+        } else if (auto e = dynamic_cast<IndexAssignment*>(expr)) {
+            compileExpression(e->object.get());
+            compileExpression(e->index.get());
+            compileExpression(e->value.get());
+            auto id = dynamic_cast<Identifier*>(e->object.get());
+            emit(OpCode::SET_INDEX, 0, id ? varRef(id) : -1);
+        } else if (auto e = dynamic_cast<FieldAssignment*>(expr)) {
+            compileExpression(e->object.get());
+            compileExpression(e->value.get());
+            emit(OpCode::SET_FIELD, constant(e->field), fieldCache(&e->cache));
+        } else if (auto e = dynamic_cast<Assignment*>(expr)) {
+            compileExpression(e->value.get());
+            if (const Local* local = findLocal(e->name)) {
+                bool check = out.varInfos[local->info].type->checkOnAssign;
+                emit(OpCode::STORE_LOCAL, local->slot, check ? local->info : -1);
+            } else {
+                emit(OpCode::STORE_GLOBAL, freeGlobal(e->name));
+            }
+        } else {
+            throw Unsupported("expression kind not supported by the VM");
+        }
+    }
+
+    static OpCode binaryOpCode(BinaryOperator op) {
+        switch (op) {
+            case BinaryOperator::ADD: return OpCode::ADD;
+            case BinaryOperator::SUBTRACT: return OpCode::SUB;
+            case BinaryOperator::MULTIPLY: return OpCode::MUL;
+            case BinaryOperator::DIVIDE: return OpCode::DIV;
+            case BinaryOperator::MODULO: return OpCode::MOD;
+            case BinaryOperator::EQUAL: return OpCode::EQ;
+            case BinaryOperator::NOT_EQUAL: return OpCode::NE;
+            case BinaryOperator::LESS: return OpCode::LT;
+            case BinaryOperator::GREATER: return OpCode::GT;
+            case BinaryOperator::LESS_EQUAL: return OpCode::LE;
+            case BinaryOperator::GREATER_EQUAL: return OpCode::GE;
+            case BinaryOperator::LOGICAL_AND: return OpCode::AND;
+            case BinaryOperator::LOGICAL_OR: return OpCode::OR;
+            case BinaryOperator::ASSIGN: break;
+        }
+        throw Unsupported("binary operator " + binaryOpToString(op));
+    }
+
+    // The form of an arithmetic or comparison opcode taking its right operand
+    // from the constants; `op` itself when there is none
+    static OpCode constantOpCode(OpCode op) {
+        static_assert(static_cast<int>(OpCode::GE_CONST) - static_cast<int>(OpCode::ADD_CONST) ==
+                          static_cast<int>(OpCode::GE) - static_cast<int>(OpCode::ADD),
+                      "the _CONST opcodes mirror ADD ... GE");
+        if (op < OpCode::ADD || op > OpCode::GE) return op;
+        return static_cast<OpCode>(static_cast<int>(op) - static_cast<int>(OpCode::ADD) +
+                                   static_cast<int>(OpCode::ADD_CONST));
+    }
+
+    void compileUnary(UnaryOp* node) {
+        if (node->op == UnaryOperator::TYPEOF) {
+            // typeof on a plain identifier reports the variable's declared type
+            if (auto id = dynamic_cast<Identifier*>(node->operand.get())) {
+                if (const Local* local = findLocal(id->name)) {
+                    emit(OpCode::TYPEOF_LOCAL, local->slot, local->info);
+                } else {
+                    emit(OpCode::TYPEOF_GLOBAL, freeGlobal(id->name));
+                }
+                return;
+            }
+        }
+        compileExpression(node->operand.get());
+        switch (node->op) {
+            case UnaryOperator::NEGATE: emit(OpCode::NEG); break;
+            case UnaryOperator::LOGICAL_NOT: emit(OpCode::NOT); break;
+            case UnaryOperator::TYPEOF: emit(OpCode::TYPEOF); break;
+        }
+    }
+
+    void compileCall(FunctionCall* node) {
+        // Resolve the callee the same way the tree walker does: builtins first,
+        // then named functions, then function values
+        std::string callName = node->name;
+        if (node->callee) {
+            if (auto id = dynamic_cast<Identifier*>(node->callee.get())) {
+                callName = id->name;
+            } else {
+                callName.clear();
+            }
+        }
+        int argc = static_cast<int>(node->args.size());
+
+        if (node->builtin) {
+            BuiltinCall call{node->builtin, argc, -1};
+            if (node->builtin->takesArrayVariable && !node->args.empty()) {
+                if (auto id = dynamic_cast<Identifier*>(node->args[0].get())) {
+                    call.arrayVar = varRef(id);
+                }
+            }
+            for (auto& arg : node->args) compileExpression(arg.get());
+            out.builtinCalls.push_back(call);
+            emit(OpCode::CALL_BUILTIN, static_cast<int>(out.builtinCalls.size() - 1), argc);
+            return;
+        }
+
+        if (!callName.empty() && functions.count(callName)) {
+            for (auto& arg : node->args) compileExpression(arg.get());
+            emit(OpCode::CALL_FUNC, functions[callName], argc);
+            return;
+        }
+
+        if (!node->callee) throw Unsupported("call without a callee");
+        compileExpression(node->callee.get());
+        for (auto& arg : node->args) compileExpression(arg.get());
+        emit(OpCode::CALL, argc);
+    }
+
+    // Template strings: like the tree walker, a part that throws while it is
+    // evaluated is kept as its source text
+    void compileTemplate(TemplateLiteral* node) {
+        for (auto& part : node->parts) {
+            if (!part.expr) {
+                emit(OpCode::CONST, constant(part.text));
+                continue;
+            }
+            size_t depth = fn->depth;
+            size_t handler = emit(OpCode::PUSH_HANDLER);
+            compileExpression(part.expr.get());
+            emit(OpCode::POP_HANDLER);
+            size_t toEnd = emit(OpCode::JUMP);
+            patch(handler, here());
+            fn->depth = depth;
+            emit(OpCode::CONST, constant("${" + part.text + "}"));
+            patch(toEnd, here());
+        }
+        // Even a single interpolated part has to be rendered as a string
+        emit(OpCode::CONCAT, static_cast<int>(node->parts.size()));
+    }
+};
+
+std::unique_ptr<BytecodeProgram> BytecodeCompiler::compile(Program* program) {
+    auto out = std::make_unique<BytecodeProgram>();
+    try {
+        Impl impl(*out);
+        impl.compileProgram(program);
+    } catch (const Unsupported& e) {
+        reason = e.what();
+        return nullptr;
+    }
+    reason.clear();
+    return out;
+}
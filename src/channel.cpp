@@ -0,0 +1,187 @@
+#include "include/channel.h"
+#include "include/scheduler.h"
+#include <stdexcept>
+
+void Channel::Waiter::signal()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    signaled = true;
+    ready.notify_one();
+}
+
+void Channel::Waiter::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [this] { return signaled; });
+    signaled = false;
+}
+
+Channel::Channel(size_t capacity) : slotCount(capacity)
+{
+    if (capacity == 0) {
+        throw std::runtime_error("Channel capacity must be at least 1");
+    }
+    slots.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].turn.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Position p uses slot p % capacity on lap p / capacity. On lap n a slot's
+// turn is 2n while it waits for that lap's send and 2n + 1 while it holds
+// the value for that lap's receive, which then moves it on to 2n + 2.
+bool Channel::push(Value& value)
+{
+    size_t position = sendPosition.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[position % slotCount];
+        size_t lap = position / slotCount;
+        size_t turn = slot.turn.load(std::memory_order_acquire);
+        if (turn == 2 * lap) {
+            if (sendPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.value = std::move(value);
+                slot.turn.store(2 * lap + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (turn < 2 * lap) {
+            return false;  // the slot still holds the value sent a lap ago
+        } else {
+            position = sendPosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Channel::pop(Value& out)
+{
+    size_t position = recvPosition.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[position % slotCount];
+        size_t lap = position / slotCount;
+        size_t turn = slot.turn.load(std::memory_order_acquire);
+        if (turn == 2 * lap + 1) {
+            if (recvPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                out = std::move(slot.value);
+                slot.value = Value();
+                slot.turn.store(2 * lap + 2, std::memory_order_release);
+                return true;
+            }
+        } else if (turn < 2 * lap + 1) {
+            return false;  // nothing has been sent into the slot yet
+        } else {
+            position = recvPosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Channel::enlist(std::vector<Waiter*>& list, std::atomic<size_t>& count, Waiter* waiter)
+{
+    std::lock_guard<std::mutex> lock(waitersMutex);
+    list.push_back(waiter);
+    count++;
+}
+
+void Channel::delist(std::vector<Waiter*>& list, std::atomic<size_t>& count, Waiter* waiter)
+{
+    std::lock_guard<std::mutex> lock(waitersMutex);
+    for (auto it = list.begin(); it != list.end(); ++it) {
+        if (*it == waiter) {
+            list.erase(it);
+            count--;
+            return;
+        }
+    }
+}
+
+// Waiters enlist before they check the channel one last time, and the fence
+// pairs with theirs: either they see this send or receive, or it sees them.
+void Channel::wake(std::vector<Waiter*>& list, std::atomic<size_t>& count)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (count.load(std::memory_order_relaxed) == 0) return;
+    std::lock_guard<std::mutex> lock(waitersMutex);
+    for (Waiter* waiter : list) waiter->signal();
+}
+
+void Channel::send(const Value& value)
+{
+    Value copy = ValueCopier().copy(value);
+    if (!closed() && push(copy)) {
+        wake(receivers, sleepingReceivers);
+        return;
+    }
+
+    Waiter waiter;
+    TaskPool::Blocking blocking;
+    while (true) {
+        enlist(senders, sleepingSenders, &waiter);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool sent = !closed() && push(copy);
+        if (!sent && !closed()) waiter.wait();
+        delist(senders, sleepingSenders, &waiter);
+        if (sent) {
+            wake(receivers, sleepingReceivers);
+            return;
+        }
+        if (closed()) {
+            throw std::runtime_error("Send on a closed channel");
+        }
+    }
+}
+
+bool Channel::tryRecv(Value& out)
+{
+    if (!pop(out)) return false;
+    wake(senders, sleepingSenders);
+    return true;
+}
+
+bool Channel::recv(Value& out)
+{
+    Channel* self = this;
+    return select({self}, out) == 0;
+}
+
+void Channel::close()
+{
+    isClosed.store(true);
+    std::lock_guard<std::mutex> lock(waitersMutex);
+    for (Waiter* waiter : senders) waiter->signal();
+    for (Waiter* waiter : receivers) waiter->signal();
+}
+
+int Channel::select(const std::vector<Channel*>& channels, Value& out)
+{
+    // Index of the channel received from, -1 if all are closed and drained,
+    // -2 if the caller has to wait
+    auto attempt = [&]() {
+        bool open = false;
+        for (size_t i = 0; i < channels.size(); ++i) {
+            if (channels[i]->tryRecv(out)) return static_cast<int>(i);
+            if (!channels[i]->closed()) open = true;
+        }
+        if (open) return -2;
+        // Everything is closed now, but values sent before that still count
+        for (size_t i = 0; i < channels.size(); ++i) {
+            if (channels[i]->tryRecv(out)) return static_cast<int>(i);
+        }
+        return -1;
+    };
+
+    int index = attempt();
+    if (index != -2) return index;
+
+    Waiter waiter;
+    TaskPool::Blocking blocking;
+    while (true) {
+        for (Channel* channel : channels) {
+            channel->enlist(channel->receivers, channel->sleepingReceivers, &waiter);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        index = attempt();
+        if (index == -2) waiter.wait();
+        for (Channel* channel : channels) {
+            channel->delist(channel->receivers, channel->sleepingReceivers, &waiter);
+        }
+        if (index != -2) return index;
+    }
+}
@@ -0,0 +1,257 @@
+#include "include/heap.h"
+#include "include/value.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// The containers created on one thread. Each thread tracks into its own
+// registry so allocating never contends; a container freed on another thread
+// (values sent over channels are) locks the registry it was created in.
+struct Registry {
+    std::mutex mutex;
+    std::vector<HeapObject*> objects;
+    size_t allocated = 0;  // since this registry last reported to the heap
+};
+
+namespace {
+
+// Allocations are reported to the shared counter in steps of this many
+constexpr size_t kReportStep = 256;
+// Never collect more often than once per this many allocations; beyond it,
+// once per as many allocations as survived the last collection, which keeps
+// the cost of collecting proportional to allocation
+constexpr size_t kMinThreshold = 16384;
+// Marks containers that must be kept whatever refers to them
+constexpr long kRoot = 1L << 40;
+
+// Never destroyed, so containers freed while the process exits still find them
+struct Registries {
+    std::mutex mutex;
+    std::vector<Registry*> all;
+    std::vector<Registry*> idle;  // left behind by threads that have ended
+    std::atomic<size_t> allocated{0};
+    std::atomic<size_t> threshold{kMinThreshold};
+    std::atomic<uint64_t> reported{0};  // every allocation reported, never reset
+    Heap::Stats stats;  // guarded by mutex
+};
+
+Registries& registries()
+{
+    static Registries* instance = new Registries;
+    return *instance;
+}
+
+// A thread's registry; handed on to a later thread when this one ends
+struct ThreadRegistry {
+    Registry* registry;
+
+    ThreadRegistry()
+    {
+        Registries& regs = registries();
+        std::lock_guard<std::mutex> lock(regs.mutex);
+        if (!regs.idle.empty()) {
+            registry = regs.idle.back();
+            regs.idle.pop_back();
+        } else {
+            registry = new Registry;
+            regs.all.push_back(registry);
+        }
+    }
+    ~ThreadRegistry()
+    {
+        Registries& regs = registries();
+        std::lock_guard<std::mutex> lock(regs.mutex);
+        regs.idle.push_back(registry);
+    }
+};
+
+thread_local ThreadRegistry threadRegistry;
+
+long useCount(HeapObject* object)
+{
+    if (object->heapKind() == HeapObject::Kind::Array) {
+        return static_cast<ArrayValue*>(object)->weak_from_this().use_count();
+    }
+    return static_cast<ObjectValue*>(object)->weak_from_this().use_count();
+}
+
+std::shared_ptr<void> share(HeapObject* object)
+{
+    if (object->heapKind() == HeapObject::Kind::Array) {
+        return static_cast<ArrayValue*>(object)->shared_from_this();
+    }
+    return static_cast<ObjectValue*>(object)->shared_from_this();
+}
+
+HeapObject* container(const Value& value)
+{
+    if (auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&value)) return arr->get();
+    if (auto obj = std::get_if<std::shared_ptr<ObjectValue>>(&value)) return obj->get();
+    return nullptr;
+}
+
+// Calls f(HeapObject*) for every container `object` holds directly
+template <typename F>
+void eachChild(HeapObject* object, F f)
+{
+    if (object->heapKind() == HeapObject::Kind::Array) {
+        auto arr = static_cast<ArrayValue*>(object);
+        if (arr->storage() != ArrayValue::Storage::Boxed) return;  // only numbers and bools
+        arr->each([&](const Value& v) {
+            if (HeapObject* child = container(v)) f(child);
+            return true;
+        });
+        return;
+    }
+    static_cast<ObjectValue*>(object)->each([&](const std::string&, const Value& v) {
+        if (HeapObject* child = container(v)) f(child);
+    });
+}
+
+void clearContents(HeapObject* object)
+{
+    if (object->heapKind() == HeapObject::Kind::Array) {
+        static_cast<ArrayValue*>(object)->clear();
+    } else {
+        static_cast<ObjectValue*>(object)->clear();
+    }
+}
+
+} // namespace
+
+std::atomic<bool> Heap::collectionDue{false};
+std::atomic<int> Heap::mutators{0};
+
+HeapObject::HeapObject(Kind kind) : kind(kind)
+{
+    Heap::track(this);
+}
+
+HeapObject::~HeapObject()
+{
+    Heap::untrack(this);
+}
+
+void Heap::track(HeapObject* object)
+{
+    Registry* registry = threadRegistry.registry;
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    object->registry = registry;
+    object->slot = static_cast<uint32_t>(registry->objects.size());
+    registry->objects.push_back(object);
+    if (++registry->allocated == kReportStep) {
+        registry->allocated = 0;
+        Registries& regs = registries();
+        regs.reported.fetch_add(kReportStep, std::memory_order_relaxed);
+        size_t total = regs.allocated.fetch_add(kReportStep, std::memory_order_relaxed) + kReportStep;
+        if (total >= regs.threshold.load(std::memory_order_relaxed)) {
+            collectionDue.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Heap::untrack(HeapObject* object)
+{
+    Registry* registry = object->registry;
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    HeapObject* last = registry->objects.back();
+    registry->objects[object->slot] = last;
+    last->slot = object->slot;
+    registry->objects.pop_back();
+}
+
+size_t Heap::collect()
+{
+    collectionDue.store(false, std::memory_order_relaxed);
+    if (mutators.load(std::memory_order_acquire) != 0) {
+        return 0;  // due again after the next few allocations
+    }
+    auto start = std::chrono::steady_clock::now();
+    Registries& regs = registries();
+
+    std::vector<HeapObject*> objects;
+    {
+        std::lock_guard<std::mutex> lock(regs.mutex);
+        for (Registry* registry : regs.all) {
+            std::lock_guard<std::mutex> registryLock(registry->mutex);
+            objects.insert(objects.end(), registry->objects.begin(), registry->objects.end());
+        }
+    }
+
+    // References from outside the tracked containers. A container no
+    // shared_ptr owns yet is being built or lives on the stack: keep it.
+    for (HeapObject* object : objects) {
+        long count = useCount(object);
+        object->gcRefs = count > 0 ? count : kRoot;
+        object->gcReachable = false;
+    }
+    for (HeapObject* object : objects) {
+        eachChild(object, [](HeapObject* child) { --child->gcRefs; });
+    }
+
+    std::vector<HeapObject*> pending;
+    for (HeapObject* object : objects) {
+        if (object->gcRefs > 0) {
+            object->gcReachable = true;
+            pending.push_back(object);
+        }
+    }
+    while (!pending.empty()) {
+        HeapObject* object = pending.back();
+        pending.pop_back();
+        eachChild(object, [&](HeapObject* child) {
+            if (!child->gcReachable) {
+                child->gcReachable = true;
+                pending.push_back(child);
+            }
+        });
+    }
+
+    // Holding every unreachable container while emptying them means each is
+    // freed on its own afterwards, with nothing left to free recursively
+    std::vector<std::shared_ptr<void>> garbage;
+    for (HeapObject* object : objects) {
+        if (!object->gcReachable) {
+            garbage.push_back(share(object));
+            pending.push_back(object);
+        }
+    }
+    for (HeapObject* object : pending) {
+        clearContents(object);
+    }
+    size_t freed = garbage.size();
+    garbage.clear();
+
+    size_t survivors = objects.size() - freed;
+    regs.allocated.store(0, std::memory_order_relaxed);
+    regs.threshold.store(std::max(kMinThreshold, survivors), std::memory_order_relaxed);
+
+    auto pause = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    std::lock_guard<std::mutex> lock(regs.mutex);
+    regs.stats.collections++;
+    regs.stats.freed += freed;
+    regs.stats.lastPauseUs = pause;
+    regs.stats.maxPauseUs = std::max(regs.stats.maxPauseUs, pause);
+    regs.stats.totalPauseUs += pause;
+    return freed;
+}
+
+Heap::Stats Heap::stats()
+{
+    Registries& regs = registries();
+    std::lock_guard<std::mutex> lock(regs.mutex);
+    Stats stats = regs.stats;
+    stats.objects = 0;
+    // Every registry stays locked until the count is read, so no step of
+    // allocations moves into `reported` unseen and the total never goes back
+    std::vector<std::unique_lock<std::mutex>> registryLocks;
+    for (Registry* registry : regs.all) {
+        registryLocks.emplace_back(registry->mutex);
+        stats.objects += registry->objects.size();
+        stats.allocated += registry->allocated;
+    }
+    stats.allocated += regs.reported.load(std::memory_order_relaxed);
+    return stats;
+}
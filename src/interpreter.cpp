@@ -1,9 +1,18 @@
 #include "include/interpreter.h"
+#include "include/builtins.h"
 #include "include/lexer.h"
 #include "include/parser.h"
 #include "include/operators.h"
 #include "include/jit.h"
+#include "include/metrics.h"
+#include "include/module_cache.h"
+#include "include/optimizer.h"
+#include "include/profiler.h"
+#include "include/reader.h"
+#include "include/resolver.h"
 #include "include/error_handler.h"
+#include <algorithm>
+#include <climits>
 #include <variant>
 #include <sstream>
 #include <fstream>
@@ -14,1320 +23,480 @@
 #include <typeinfo>
 #include <cmath>
 #include <random>
+#include <condition_variable>
+#include <mutex>
 
 namespace fs = std::filesystem;
 
-// Global interpreter pointer for type checking
-Interpreter* currentInterpreter = nullptr;
+// The interpreter running on this thread, for type checking
+thread_local Interpreter* currentInterpreter = nullptr;
 
-// Helper: trim whitespace
-static inline std::string trim(const std::string &s) {
-    size_t a = s.find_first_not_of(" \t\n\r");
-    if (a == std::string::npos) return "";
-    size_t b = s.find_last_not_of(" \t\n\r");
-    return s.substr(a, b - a + 1);
-}
+// Environment
+namespace {
 
-// Split a string by '|' into parts (no advanced parsing required here)
-static std::vector<std::string> splitUnion(const std::string &s) {
-    std::vector<std::string> out;
-    size_t start = 0;
-    for (size_t i = 0; i <= s.size(); ++i) {
-        if (i == s.size() || s[i] == '|') {
-            out.push_back(trim(s.substr(start, i - start)));
-            start = i + 1;
-        }
+// Only unions, arrays and "any" are re-checked on assignment; the common
+// primitive types are skipped
+void checkAssignment(const std::string &name, const TypeDescriptor *declared, const Value &value)
+{
+    if (declared->checkOnAssign && !declared->matches(value)) {
+        throw std::runtime_error("Type error: cannot assign value to variable '" + name + "' of type '" + declared->spec + "'");
     }
-    return out;
 }
 
-// Forward declaration
-bool valueMatchesType(const Value &v, const std::string &typeSpec);
-
-// Forward declaration for interpreter access
-class Interpreter;
-extern Interpreter* currentInterpreter;
-
-// Check whether a Value matches a declared type specification. Supports unions ("a|b"), array types ("[T]"), object types, and literal types.
-bool valueMatchesType(const Value &v, const std::string &typeSpec) {
-    std::string t = trim(typeSpec);
-    if (t.empty()) return false;
+} // namespace
 
-    // Custom type lookup - resolve custom types first
-    if (currentInterpreter && currentInterpreter->typeRegistry.find(t) != currentInterpreter->typeRegistry.end()) {
-        std::string customTypeSpec = currentInterpreter->typeRegistry[t];
-        return valueMatchesType(v, customTypeSpec);
+void Environment::define(const std::string &name, Variable var)
+{
+    if (depth == 0)
+    {
+        pushScope();
     }
-
-    // Array type: [inner] or specific array elements
-    if (t.size() >= 2 && t.front() == '[' && t.back() == ']') {
-        std::string inner = t.substr(1, t.size() - 2);
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(v)) return false;
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
-        
-        // Check if it's a specific array with comma-separated elements
-        if (inner.find(',') != std::string::npos) {
-            // Split by comma for specific array elements: [type1, type2]
-            std::vector<std::string> elementTypes;
-            size_t start = 0;
-            for (size_t i = 0; i <= inner.size(); ++i) {
-                if (i == inner.size() || inner[i] == ',') {
-                    elementTypes.push_back(trim(inner.substr(start, i - start)));
-                    start = i + 1;
-                }
-            }
-            if (arr->elements.size() != elementTypes.size()) return false;
-            for (size_t i = 0; i < arr->elements.size(); ++i) {
-                if (!valueMatchesType(arr->elements[i], elementTypes[i])) return false;
-            }
-            return true;
-        } else {
-            // Regular array type: all elements must match inner type
-            for (auto &elem : arr->elements) {
-                if (!valueMatchesType(elem, inner)) return false;
-            }
-            return true;
+    Scope &scope = scopes[depth - 1];
+    if (depth == 1)
+    {
+        auto found = globalIndex.find(name);
+        if (found != globalIndex.end())
+        {
+            scope.slots[found->second] = std::move(var);
+            return;
         }
+        globalIndex.emplace(name, scope.slots.size());
     }
-
-    // Object type: {field1:type1,field2:type2}
-    if (t.size() >= 2 && t.front() == '{' && t.back() == '}') {
-        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(v)) return false;
-        auto obj = std::get<std::shared_ptr<ObjectValue>>(v);
-        
-        std::string inner = t.substr(1, t.size() - 2);
-        if (inner.empty()) return true; // Empty object type matches any object
-        
-        // Parse field specifications with proper brace matching
-        size_t pos = 0;
-        while (pos < inner.size()) {
-            // Skip whitespace
-            while (pos < inner.size() && (inner[pos] == ' ' || inner[pos] == '\t' || inner[pos] == '\n')) pos++;
-            if (pos >= inner.size()) break;
-            
-            // Find field name
-            size_t colonPos = inner.find(':', pos);
-            if (colonPos == std::string::npos) break;
-            
-            std::string fieldName = trim(inner.substr(pos, colonPos - pos));
-            
-            // Find field type with proper brace matching
-            size_t typeStart = colonPos + 1;
-            size_t typeEnd = typeStart;
-            int braceCount = 0;
-            int bracketCount = 0;
-            
-            while (typeEnd < inner.size()) {
-                char c = inner[typeEnd];
-                if (c == '{') braceCount++;
-                else if (c == '}') braceCount--;
-                else if (c == '[') bracketCount++;
-                else if (c == ']') bracketCount--;
-                else if (c == ',' && braceCount == 0 && bracketCount == 0) {
-                    break; // Found end of this field type
-                }
-                typeEnd++;
+    else
+    {
+        for (size_t i = scope.names.size(); i-- > 0;)
+        {
+            if (scope.names[i] == name)
+            {
+                scope.slots[i] = std::move(var);
+                return;
             }
-            
-            std::string fieldType = trim(inner.substr(typeStart, typeEnd - typeStart));
-            
-            // Check if object has this field and it matches the type
-            if (obj->fields.find(fieldName) == obj->fields.end()) return false;
-            if (!valueMatchesType(obj->fields[fieldName], fieldType)) return false;
-            
-            pos = typeEnd + 1; // Skip the comma
-        }
-        return true;
-    }
-
-    // Union: split and check any (only applies to non-array/object top-level types)
-    if (t.find('|') != std::string::npos) {
-        auto parts = splitUnion(t);
-        for (auto &p : parts) {
-            if (valueMatchesType(v, p)) return true;
-        }
-        return false;
-    }
-
-    // String literal type: "specific_string"
-    if (t.size() >= 2 && t.front() == '"' && t.back() == '"') {
-        if (!std::holds_alternative<std::string>(v)) return false;
-        std::string expectedStr = t.substr(1, t.size() - 2);
-        return std::get<std::string>(v) == expectedStr;
-    }
-
-    // Integer literal type: specific number
-    if (t.find_first_not_of("0123456789-") == std::string::npos && !t.empty() && t != "-") {
-        if (!std::holds_alternative<int>(v)) return false;
-        try {
-            int expectedInt = std::stoi(t);
-            return std::get<int>(v) == expectedInt;
-        } catch (...) {
-            // Not a valid integer literal
         }
     }
+    scope.slots.push_back(std::move(var));
+    scope.names.push_back(name);
+}
 
-    // Boolean literal types
-    if (t == "true") {
-        return std::holds_alternative<bool>(v) && std::get<bool>(v) == true;
-    }
-    if (t == "false") {
-        return std::holds_alternative<bool>(v) && std::get<bool>(v) == false;
+void Environment::defineSlot(int slot, const std::string &name, Variable var)
+{
+    if (depth == 0)
+    {
+        pushScope();
     }
-
-    // "any" type matches anything
-    if (t == "any") return true;
-
-    // Base types
-    if (t == "int") return std::holds_alternative<int>(v);
-    if (t == "float") return std::holds_alternative<float>(v);
-    if (t == "string") return std::holds_alternative<std::string>(v);
-    if (t == "bool") return std::holds_alternative<bool>(v);
-    if (t == "object") return std::holds_alternative<std::shared_ptr<ObjectValue>>(v);
-    
-    // Function types - accept function pointers
-    if (t == "func" || t.rfind("(", 0) == 0) {
-        return std::holds_alternative<FunctionDeclaration*>(v) || std::holds_alternative<FunctionExpression*>(v);
+    Scope &scope = scopes[depth - 1];
+    if ((size_t)slot >= scope.slots.size())
+    {
+        scope.slots.resize(slot + 1);
+        scope.names.resize(slot + 1);
     }
-
-    // Fallback: if declared type is unknown, be permissive
-    return false;
+    scope.slots[slot] = std::move(var);
+    scope.names[slot] = name;
 }
 
-// Environment
-void Environment::define(const std::string &name, const Variable &var)
+Variable *Environment::find(const std::string &name)
 {
-    if (scopes.empty())
-    {
-        scopes.push_back({});
-    }
-    scopes.back()[name] = var;
+    return const_cast<Variable *>(static_cast<const Environment *>(this)->find(name));
 }
 
-Variable Environment::get(const std::string &name) const
+const Variable *Environment::find(const std::string &name) const
 {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+    for (size_t d = depth; d-- > 1;)
     {
-        auto found = it->find(name);
-        if (found != it->end())
+        const Scope &scope = scopes[d];
+        for (size_t i = scope.names.size(); i-- > 0;)
         {
-            return found->second;
+            if (scope.names[i] == name)
+            {
+                return &scope.slots[i];
+            }
         }
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    if (depth > 0)
+    {
+        auto found = globalIndex.find(name);
+        if (found != globalIndex.end())
+        {
+            return &scopes[0].slots[found->second];
+        }
+    }
+    return nullptr;
 }
 
-void Environment::set(const std::string &name, const Value &value)
+uint64_t Environment::keyOf(const std::string &name) const
 {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+    for (size_t d = depth; d-- > 1;)
     {
-        auto found = it->find(name);
-        if (found != it->end())
+        const Scope &scope = scopes[d];
+        for (size_t i = scope.names.size(); i-- > 0;)
         {
-            // Skip type checking for common types to avoid valueMatchesType overhead
-            // Only check if type is complex (unions, arrays, or "any")
-            const std::string &declared = found->second.type;
-            if (!declared.empty() && 
-                (declared.find('|') != std::string::npos || 
-                 declared.find('[') != std::string::npos ||
-                 declared == "any")) {
-                if (!valueMatchesType(value, declared)) {
-                    throw std::runtime_error("Type error: cannot assign value to variable '" + name + "' of type '" + declared + "'");
-                }
+            if (scope.names[i] == name)
+            {
+                return (uint64_t)d << 32 | i;
             }
-            found->second.value = value;
-            return;
         }
     }
-    throw std::runtime_error("Undefined variable: " + name);
-}
-
-bool Environment::has(const std::string &name) const
-{
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+    if (depth > 0)
     {
-        if (it->find(name) != it->end())
+        auto found = globalIndex.find(name);
+        if (found != globalIndex.end())
         {
-            return true;
+            return found->second;
         }
     }
-    return false;
+    return kNoVariable;
 }
 
-void Environment::pushScope()
+uint64_t Environment::keyOf(int hops, int slot) const
 {
-    scopes.push_back({});
+    return (uint64_t)(depth - 1 - hops) << 32 | (uint64_t)slot;
 }
 
-void Environment::popScope()
+Variable &Environment::get(const std::string &name)
 {
-    if (!scopes.empty())
+    if (Variable *var = find(name))
     {
-        scopes.pop_back();
+        return *var;
     }
+    throw std::runtime_error("Undefined variable: " + name);
 }
 
-// Interpreter
-Interpreter::Interpreter()
+const Variable &Environment::get(const std::string &name) const
 {
-    environment.pushScope();
-    jitCompiler = std::make_unique<LLVMJITCompiler>();
-    currentInterpreter = this;
-}
-
-Interpreter::~Interpreter() {
-    // Wait for all running programs to complete before destroying
-    std::lock_guard<std::mutex> lock(programsMutex);
-    for (auto& [name, future] : runningPrograms) {
-        if (future.valid()) {
-            future.wait();
-        }
+    if (const Variable *var = find(name))
+    {
+        return *var;
     }
-    runningPrograms.clear();
+    throw std::runtime_error("Undefined variable: " + name);
 }
 
-void Interpreter::interpret(Program *program)
+Variable &Environment::at(int hops, int slot, const std::string &name)
 {
-    program->accept(this);
+    Scope &scope = scopes[depth - 1 - hops];
+    if (scope.names[slot].empty())
+    {
+        throw std::runtime_error("Undefined variable: " + name);
+    }
+    return scope.slots[slot];
 }
 
-std::string Interpreter::visit(IntegerLiteral *node)
+void Environment::set(const std::string &name, const Value &value)
 {
-    return std::to_string(node->value);
+    Variable &var = get(name);
+    checkAssignment(name, var.type, value);
+    var.value = value;
+    var.type->adopt(var.value);
 }
 
-std::string Interpreter::visit(FloatLiteral *node)
+void Environment::setAt(int hops, int slot, const std::string &name, const Value &value)
 {
-    std::ostringstream oss;
-    oss << node->value;
-    return oss.str();
+    Variable &var = at(hops, slot, name);
+    checkAssignment(name, var.type, value);
+    var.value = value;
+    var.type->adopt(var.value);
 }
 
-std::string Interpreter::visit(StringLiteral *node)
-{
-    std::string value = node->value;
-    
-    // Handle template string interpolation ${...}
-    if (value.find("${") != std::string::npos) {
-        std::string result;
-        size_t pos = 0;
-        
-        while (pos < value.size()) {
-            size_t start = value.find("${", pos);
-            if (start == std::string::npos) {
-                result += value.substr(pos);
-                break;
-            }
-            
-            result += value.substr(pos, start - pos);
-            
-            // Find matching closing brace
-            size_t end = start + 2;
-            int braceCount = 1;
-            while (end < value.size() && braceCount > 0) {
-                if (value[end] == '{') braceCount++;
-                else if (value[end] == '}') braceCount--;
-                end++;
-            }
-            
-            if (braceCount != 0) {
-                result += value.substr(start);
-                break;
-            }
-            
-            std::string expr = value.substr(start + 2, end - start - 3);
-            // Parse and evaluate the expression
-            try {
-                Lexer exprLexer(expr);
-                auto exprTokens = exprLexer.tokenize();
-                Parser exprParser(exprTokens);
-                auto exprAst = exprParser.parseExpression();
-                Value exprValue = evaluate(exprAst.get());
-                result += valueToString(exprValue);
-            } catch (...) {
-                result += "${" + expr + "}";
-            }
-            
-            pos = end;
-        }
-        
-        Value stringValue = result;
-        lastValue = stringValue;
-        return "[string]";
-    }
-    
-    Value stringValue = value;
-    lastValue = stringValue;
-    return "[string]";
-}
-
-std::string Interpreter::visit(BooleanLiteral *node)
+bool Environment::has(const std::string &name) const
 {
-    return node->value ? "true" : "false";
+    return find(name) != nullptr;
 }
 
-std::string Interpreter::visit(Identifier *node)
+void Environment::pushScope(size_t numSlots)
 {
-    Variable var = environment.get(node->name);
-    // Store the variable for typeof operations (includes declared type info)
-    lastVariable = var;
-    lastVariableName = node->name;
-    
-    // Store array/object values in lastValue for later retrieval
-    if (std::holds_alternative<std::shared_ptr<ArrayValue>>(var.value))
-    {
-        lastValue = var.value;
-        return "[array]";
-    }
-    if (std::holds_alternative<std::shared_ptr<ObjectValue>>(var.value))
-    {
-        lastValue = var.value;
-        return "{object}";
-    }
-    // Handle function values
-    if (std::holds_alternative<FunctionDeclaration*>(var.value))
-    {
-        lastValue = var.value;
-        return "[function]";
-    }
-    if (std::holds_alternative<FunctionExpression*>(var.value))
-    {
-        lastValue = var.value;
-        return "[function]";
-    }
-    // Handle string values to prevent evaluate() from parsing them
-    if (std::holds_alternative<std::string>(var.value))
+    if (depth == scopes.size())
     {
-        lastValue = var.value;
-        return "[string]";
+        scopes.emplace_back();
     }
-    return valueToString(var.value);
-}
-
-std::string Interpreter::visit(BinaryOp *node)
-{
-    Value left = evaluate(node->left.get());
-    Value right = evaluate(node->right.get());
-    Value result = performBinaryOp(left, node->op, right);
-    return valueToString(result);
-}
-
-std::string Interpreter::visit(UnaryOp *node)
-{
-    Value operand = evaluate(node->operand.get());
-    Value result = performUnaryOp(node->op, operand);
-    return valueToString(result);
+    Scope &scope = scopes[depth++];
+    scope.slots.resize(numSlots);
+    scope.names.resize(numSlots);
 }
 
-std::string Interpreter::visit(FunctionCall *node)
+void Environment::popScope()
 {
-    // Determine function name (support callee identifiers)
-    std::string callName = node->name;
-    if (node->callee) {
-        if (auto id = dynamic_cast<Identifier*>(node->callee.get())) {
-            callName = id->name;
-        }
-    }
-
-    // Built-in: write(...)
-    if (callName == "write")
+    if (depth > 0)
     {
-        if (node->args.size() != 2)
+        Scope &scope = scopes[--depth];
+        scope.slots.clear();
+        // Emptied rather than destroyed, so the next scope here reuses their buffers
+        for (std::string &name : scope.names)
         {
-            throw std::runtime_error("write() expects exactly 2 arguments: write(filepath, content)");
+            name.clear();
         }
-
-        // Evaluate arguments
-        Value fpVal = evaluate(node->args[0].get());
-        Value contentVal = evaluate(node->args[1].get());
-
-        std::string filepath = valueToString(fpVal);
-        std::string content = valueToString(contentVal);
-
-        // Write to file
-        std::ofstream file(filepath, std::ios::out);
-        if (!file.is_open())
+        if (depth == 0)
         {
-            throw std::runtime_error("Could not open file for writing: " + filepath);
+            globalIndex.clear();
         }
-
-        file << content;
-        file.close();
-
-        return ""; // write returns empty string
     }
+}
 
-    // Built-in: read(...)
-    if (callName == "read")
-    {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("read() expects exactly 1 argument: read(filepath)");
-        }
-
-        // Evaluate filepath argument
-        Value fpVal = evaluate(node->args[0].get());
-        std::string filepath = valueToString(fpVal);
-
-        // Open file
-        std::ifstream file(filepath, std::ios::in);
-        if (!file.is_open())
+// Pushes a scope for the lifetime of the guard, so it is popped again when a
+// return, break or error unwinds through the statement that owns it
+class ScopeGuard {
+public:
+    ScopeGuard(Environment &env, size_t numSlots = 0) : env(env) { env.pushScope(numSlots); }
+    ~ScopeGuard() { env.popScope(); }
+    ScopeGuard(const ScopeGuard &) = delete;
+    ScopeGuard &operator=(const ScopeGuard &) = delete;
+
+private:
+    Environment &env;
+};
+
+// The arguments of a call, evaluated into a vector borrowed from the
+// interpreter and handed back, emptied, once the call returns; so a call
+// allocates nothing once as many calls have been nested before
+class Interpreter::CallArgs {
+public:
+    std::vector<Value> values;
+
+    CallArgs(Interpreter &interp, FunctionCall *call) : interp(interp)
+    {
+        if (!interp.spareArgs.empty())
         {
-            throw std::runtime_error("Could not open file for reading: " + filepath);
+            values = std::move(interp.spareArgs.back());
+            interp.spareArgs.pop_back();
         }
-
-        // Read file content into string
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        file.close();
-
-        return buffer.str(); // return file content as std::string
+        interp.evaluateArgs(call, values);
     }
-
-    // Built-in: readDir(...)
-    if (callName == "readDir")
+    ~CallArgs()
     {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("readDir() expects exactly 1 argument: readDir(dirPath)");
-        }
-
-        Value dirVal = evaluate(node->args[0].get());
-        std::string dirPath = valueToString(dirVal);
-
-        auto result = std::make_shared<ArrayValue>();
-        
-        try {
-            for (const auto& entry : fs::directory_iterator(dirPath)) {
-                result->elements.push_back(entry.path().filename().string());
-            }
-        } catch (const fs::filesystem_error& e) {
-            throw std::runtime_error("Could not read directory: " + dirPath + " - " + e.what());
-        }
-
-        lastValue = result;
-        return "[array]";
+        values.clear();
+        interp.spareArgs.push_back(std::move(values));
     }
+    CallArgs(const CallArgs &) = delete;
+    CallArgs &operator=(const CallArgs &) = delete;
 
-    // Built-in: copy(...)
-    if (callName == "copy")
-    {
-        if (node->args.size() != 2)
-        {
-            throw std::runtime_error("copy() expects exactly 2 arguments: copy(sourcePath, destPath)");
-        }
+private:
+    Interpreter &interp;
+};
 
-        // Evaluate source and destination arguments
-        Value srcVal = evaluate(node->args[0].get());
-        Value dstVal = evaluate(node->args[1].get());
-        std::string sourcePath = valueToString(srcVal);
-        std::string destPath = valueToString(dstVal);
-
-        // Open source file
-        std::ifstream srcFile(sourcePath, std::ios::binary);
-        if (!srcFile.is_open())
-        {
-            throw std::runtime_error("Could not open source file for copying: " + sourcePath);
-        }
-
-        // Open destination file
-        std::ofstream dstFile(destPath, std::ios::binary);
-        if (!dstFile.is_open())
-        {
-            srcFile.close();
-            throw std::runtime_error("Could not open destination file for copying: " + destPath);
-        }
-
-        // Copy content
-        dstFile << srcFile.rdbuf();
-
-        // Close files
-        srcFile.close();
-        dstFile.close();
+// Interpreter
+Interpreter::Interpreter()
+{
+    environment.pushScope();
+    jitCompiler = std::make_unique<LLVMJITCompiler>();
+    currentInterpreter = this;
+}
 
-        return ""; // Return empty string for void functions
+void Interpreter::enableJITCache(const std::string& dir, const std::string& source)
+{
+    if (jitCompiler) {
+        jitCompiler->enableCache(dir, source);
     }
+}
 
-    // Built-in: print(...)
-    if (callName == "print")
-    {
-        bool first = true;
-        for (auto &a : node->args)
-        {
-            Value v = evaluate(a.get());
-            if (!first)
-                std::cout << " ";
-            std::cout << valueToString(v);
-            first = false;
-        }
-        std::cout << std::endl;
-        return "";
-    }
+void Interpreter::disableJIT()
+{
+    jitCompiler.reset();
+}
 
-    // Built-in: len(array or string)
-    if (callName == "len")
-    {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("len() expects 1 argument");
-        }
-        Value v = evaluate(node->args[0].get());
-        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v))
-        {
-            auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
-            return std::to_string(arr->elements.size());
-        }
-        if (std::holds_alternative<std::string>(v))
-        {
-            auto s = std::get<std::string>(v);
-            return std::to_string(s.size());
-        }
-        throw std::runtime_error("len() requires array or string");
+void Interpreter::enableModuleCache(const std::string& dir)
+{
+    moduleCache = std::make_shared<ModuleCache>(dir);
+}
+
+Profiler& Interpreter::enableProfiling()
+{
+    if (!profiler) {
+        profiler = std::make_unique<Profiler>();
     }
+    return *profiler;
+}
 
-    // Built-in: push(array, value)
-    if (callName == "push")
-    {
-        if (node->args.size() != 2)
-        {
-            throw std::runtime_error("push() expects 2 arguments");
-        }
-        // Try to get the array by identifier
-        Identifier *arrayId = dynamic_cast<Identifier *>(node->args[0].get());
-        if (arrayId)
-        {
-            Variable arrayVar = environment.get(arrayId->name);
-            Value arrVal = arrayVar.value;
-            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal))
-            {
-                auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-                Value val = evaluate(node->args[1].get());
-                // Enforce array element typing based on variable's declared type
-                if (!arrayVar.type.empty() && arrayVar.type.size() >= 2 && arrayVar.type.front() == '[' && arrayVar.type.back() == ']') {
-                    std::string inner = arrayVar.type.substr(1, arrayVar.type.size() - 2);
-                    if (!valueMatchesType(val, inner)) {
-                        throw std::runtime_error("Type error: cannot push value to array '" + arrayId->name + "' of element type '" + inner + "'");
-                    }
-                }
-                arr->elements.push_back(val);
-                return "";
+// A spawned program's context: what code with `captures` can reach in
+// `parent` as it is now. Only the variables are copied, with `copier`; the
+// functions and programs share the parent's AST. Imports come along only when
+// that code runs some. Tasks run without the JIT.
+Interpreter::Interpreter(const Interpreter &parent, const Captures &captures, ValueCopier &copier)
+    : typeRegistry(parent.typeRegistry),
+      currentModulePath(parent.currentModulePath),
+      optimizationLevel(parent.optimizationLevel),
+      moduleCache(parent.moduleCache)
+{
+    environment.pushScope();
+    std::vector<const Captures *> pending{&captures};
+    std::unordered_set<const Captures *> followed{&captures};
+    std::unordered_set<std::string> seen;
+    auto follow = [&](const Captures &reached) {
+        if (followed.insert(&reached).second) pending.push_back(&reached);
+    };
+    // Functions met among the copied values reach further names in turn
+    while (!pending.empty() || !copier.functions.empty()) {
+        if (!copier.functions.empty()) {
+            Value fn = std::move(copier.functions.back());
+            copier.functions.pop_back();
+            if (auto decl = std::get_if<FunctionDeclaration *>(&fn)) {
+                follow((*decl)->captures);
+            } else {
+                follow(std::get<FunctionExpression *>(fn)->captures);
             }
+            continue;
         }
-        throw std::runtime_error("push() requires array variable as first argument");
-    }
-
-    // Built-in: pop(array)
-    if (callName == "pop")
-    {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("pop() expects 1 argument");
+        const Captures *reached = pending.back();
+        pending.pop_back();
+        if (reached->imports && importedFiles.empty()) {
+            importedFiles = parent.importedFiles;
+            resolvedImports = parent.resolvedImports;
+            moduleExports = parent.moduleExports;
+            moduleDefaultExports = parent.moduleDefaultExports;
+            for (auto &module : moduleExports) {
+                for (auto &entry : module.second) entry.second = copier.copy(entry.second);
+            }
+            for (auto &entry : moduleDefaultExports) {
+                entry.second = copier.copy(entry.second);
+            }
         }
-        // Try to get the array by identifier
-        Identifier *arrayId = dynamic_cast<Identifier *>(node->args[0].get());
-        if (arrayId)
-        {
-            Variable arrayVar = environment.get(arrayId->name);
-            Value arrVal = arrayVar.value;
-            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal))
-            {
-                auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-                if (!arr->elements.empty())
-                {
-                    Value last = arr->elements.back();
-                    arr->elements.pop_back();
-                    return valueToString(last);
-                }
-                return "";
+        for (const std::string &name : reached->names) {
+            if (!seen.insert(name).second) continue;
+            // The innermost definition, as dynamic scoping would find it here
+            if (const Variable *var = parent.environment.find(name)) {
+                environment.define(name, Variable(copier.copy(var->value), var->type, var->isConst));
+            }
+            auto fn = parent.functions.find(name);
+            if (fn != parent.functions.end()) {
+                functions.emplace(name, fn->second);
+                follow(fn->second->captures);
+            }
+            auto prog = parent.programs.find(name);
+            if (prog != parent.programs.end()) {
+                programs.emplace(name, prog->second);
+                if (prog->second) follow(prog->second->captures);
             }
         }
-        throw std::runtime_error("pop() requires array variable");
     }
+}
 
-    // Built-in: substr(string, start, length)
-    if (callName == "substr")
-    {
-        if (node->args.size() != 3)
-        {
-            throw std::runtime_error("substr() expects 3 arguments");
-        }
-        Value s = evaluate(node->args[0].get());
-        Value start = evaluate(node->args[1].get());
-        Value len = evaluate(node->args[2].get());
-        if (std::holds_alternative<std::string>(s) &&
-            std::holds_alternative<int>(start) &&
-            std::holds_alternative<int>(len))
-        {
-            std::string str = std::get<std::string>(s);
-            int st = std::get<int>(start);
-            int l = std::get<int>(len);
-            if (st < 0 || st >= (int)str.size())
-                return "";
-            return str.substr(st, l);
+Interpreter::~Interpreter() {
+    // Programs still running were spawned from here and may use its AST;
+    // their errors were never awaited, so nobody is left to report them to
+    for (auto &task : spawnedTasks) {
+        try {
+            task->wait();
+        } catch (...) {
         }
-        throw std::runtime_error("substr() requires (string, int, int)");
     }
+    Metrics::adjust(Metrics::Gauge::WhensPending, -static_cast<int64_t>(pendingWhens.size()));
+}
 
-    // Built-in: toUpper(string)
-    if (callName == "toUpper")
-    {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("toUpper() expects 1 argument");
-        }
-        Value s = evaluate(node->args[0].get());
-        if (std::holds_alternative<std::string>(s))
-        {
-            std::string str = std::get<std::string>(s);
-            for (char &c : str)
-            {
-                if (c >= 'a' && c <= 'z')
-                {
-                    c = c - 'a' + 'A';
-                }
-            }
-            return str;
-        }
-        throw std::runtime_error("toUpper() requires string");
+void Interpreter::interpret(Program *program)
+{
+    if (currentModulePath.empty()) {
+        preloadImports(program);
     }
+    optimize(program);
+    Resolver().resolve(program);
+    program->accept(this);
+}
 
-    // Built-in: toLower(string)
-    if (callName == "toLower")
-    {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("toLower() expects 1 argument");
-        }
-        Value s = evaluate(node->args[0].get());
-        if (std::holds_alternative<std::string>(s))
-        {
-            std::string str = std::get<std::string>(s);
-            for (char &c : str)
-            {
-                if (c >= 'A' && c <= 'Z')
-                {
-                    c = c - 'A' + 'a';
-                }
-            }
-            return str;
-        }
-        throw std::runtime_error("toLower() requires string");
-    }
+// A module shares its globals with the importer, whose code the Optimizer
+// cannot see, so modules stop at level 1
+void Interpreter::optimize(Program *program)
+{
+    int level = currentModulePath.empty() ? optimizationLevel : std::min(optimizationLevel, 1);
+    Optimizer(*this, level).optimize(program);
+}
 
-    // Built-in: indexOf(string, substring)
-    if (callName == "indexOf")
-    {
-        if (node->args.size() != 2)
-        {
-            throw std::runtime_error("indexOf() expects 2 arguments");
-        }
-        Value s = evaluate(node->args[0].get());
-        Value sub = evaluate(node->args[1].get());
-        if (std::holds_alternative<std::string>(s) && std::holds_alternative<std::string>(sub))
-        {
-            std::string str = std::get<std::string>(s);
-            std::string substring = std::get<std::string>(sub);
-            size_t pos = str.find(substring);
-            if (pos != std::string::npos)
-            {
-                return std::to_string(pos);
-            }
-            return "-1";
-        }
-        throw std::runtime_error("indexOf() requires (string, string)");
-    }
+Value Interpreter::visitValue(IntegerLiteral *node)
+{
+    return node->value;
+}
 
-    // Built-in: contains(string, substring)
-    if (callName == "contains")
-    {
-        if (node->args.size() != 2)
-        {
-            throw std::runtime_error("contains() expects 2 arguments");
-        }
-        Value s = evaluate(node->args[0].get());
-        Value sub = evaluate(node->args[1].get());
-        if (std::holds_alternative<std::string>(s) && std::holds_alternative<std::string>(sub))
-        {
-            std::string str = std::get<std::string>(s);
-            std::string substring = std::get<std::string>(sub);
-            bool result = str.find(substring) != std::string::npos;
-            lastValue = result;
-            return "[bool]";
-        }
-        throw std::runtime_error("contains() requires (string, string)");
-    }
+Value Interpreter::visitValue(FloatLiteral *node)
+{
+    return node->value;
+}
 
-    // Built-in: millis() - returns current time in milliseconds
-    if (callName == "millis")
-    {
-        if (node->args.size() != 0)
-        {
-            throw std::runtime_error("millis() expects no arguments");
-        }
-        auto now = std::chrono::high_resolution_clock::now();
-        auto duration = now.time_since_epoch();
-        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-        lastValue = static_cast<int>(millis);
-        return "[int]";
-    }
+Value Interpreter::visitValue(StringLiteral *node)
+{
+    return node->value;
+}
 
-    // Built-in: sleep(milliseconds) - sleep for specified milliseconds
-    if (callName == "sleep")
-    {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("sleep() expects 1 argument");
+// Interpolations were parsed with the literal; a part that throws while it is
+// evaluated is kept as its source text
+Value Interpreter::visitValue(TemplateLiteral *node)
+{
+    std::string result;
+    result.reserve(node->literalLength + 16 * node->parts.size());  // some room for each value
+    for (auto &part : node->parts) {
+        if (!part.expr) {
+            result += part.text;
+            continue;
         }
-        Value ms = evaluate(node->args[0].get());
-        if (std::holds_alternative<int>(ms))
-        {
-            int milliseconds = std::get<int>(ms);
-            std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
-            return "";
+        try {
+            Value value = evaluate(part.expr.get());
+            if (auto str = std::get_if<std::string>(&value)) {
+                result += *str;
+            } else {
+                result += valueToString(value);
+            }
+        } catch (...) {
+            result += "${";
+            result += part.text;
+            result += '}';
         }
-        throw std::runtime_error("sleep() requires int argument");
     }
+    return result;
+}
+
+Value Interpreter::visitValue(BooleanLiteral *node)
+{
+    return node->value;
+}
 
-    // Built-in: toString(value) - convert value to string
-    if (callName == "toString")
+Value Interpreter::visitValue(Identifier *node)
+{
+    return lookup(node).value;
+}
+
+Variable &Interpreter::lookup(Identifier *id)
+{
+    if (id->depth >= 0)
     {
-        if (node->args.size() != 1)
-        {
-            throw std::runtime_error("toString() expects 1 argument");
-        }
-        Value v = evaluate(node->args[0].get());
-        std::string result = valueToString(v);
-        lastValue = Value(result);
-        return "[string]";
-    }
-
-    // Math functions
-    if (callName == "sin") {
-        if (node->args.size() != 1) throw std::runtime_error("sin() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::sin(val);
-        return "[float]";
-    }
-    if (callName == "cos") {
-        if (node->args.size() != 1) throw std::runtime_error("cos() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::cos(val);
-        return "[float]";
-    }
-    if (callName == "tan") {
-        if (node->args.size() != 1) throw std::runtime_error("tan() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::tan(val);
-        return "[float]";
-    }
-    if (callName == "sqrt") {
-        if (node->args.size() != 1) throw std::runtime_error("sqrt() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::sqrt(val);
-        return "[float]";
-    }
-    if (callName == "pow") {
-        if (node->args.size() != 2) throw std::runtime_error("pow() expects 2 arguments");
-        Value base = evaluate(node->args[0].get());
-        Value exp = evaluate(node->args[1].get());
-        float b = std::holds_alternative<float>(base) ? std::get<float>(base) : static_cast<float>(std::get<int>(base));
-        float e = std::holds_alternative<float>(exp) ? std::get<float>(exp) : static_cast<float>(std::get<int>(exp));
-        lastValue = std::pow(b, e);
-        return "[float]";
-    }
-    if (callName == "abs") {
-        if (node->args.size() != 1) throw std::runtime_error("abs() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        if (std::holds_alternative<int>(v)) {
-            lastValue = std::abs(std::get<int>(v));
-            return "[int]";
-        }
-        lastValue = std::fabs(std::get<float>(v));
-        return "[float]";
-    }
-    if (callName == "floor") {
-        if (node->args.size() != 1) throw std::runtime_error("floor() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = static_cast<int>(std::floor(val));
-        return "[int]";
-    }
-    if (callName == "ceil") {
-        if (node->args.size() != 1) throw std::runtime_error("ceil() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = static_cast<int>(std::ceil(val));
-        return "[int]";
-    }
-    if (callName == "round") {
-        if (node->args.size() != 1) throw std::runtime_error("round() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = static_cast<int>(std::round(val));
-        return "[int]";
-    }
-    if (callName == "min") {
-        if (node->args.size() != 2) throw std::runtime_error("min() expects 2 arguments");
-        Value a = evaluate(node->args[0].get());
-        Value b = evaluate(node->args[1].get());
-        if (std::holds_alternative<int>(a) && std::holds_alternative<int>(b)) {
-            lastValue = std::min(std::get<int>(a), std::get<int>(b));
-            return "[int]";
-        }
-        float fa = std::holds_alternative<float>(a) ? std::get<float>(a) : static_cast<float>(std::get<int>(a));
-        float fb = std::holds_alternative<float>(b) ? std::get<float>(b) : static_cast<float>(std::get<int>(b));
-        lastValue = std::min(fa, fb);
-        return "[float]";
-    }
-    if (callName == "max") {
-        if (node->args.size() != 2) throw std::runtime_error("max() expects 2 arguments");
-        Value a = evaluate(node->args[0].get());
-        Value b = evaluate(node->args[1].get());
-        if (std::holds_alternative<int>(a) && std::holds_alternative<int>(b)) {
-            lastValue = std::max(std::get<int>(a), std::get<int>(b));
-            return "[int]";
-        }
-        float fa = std::holds_alternative<float>(a) ? std::get<float>(a) : static_cast<float>(std::get<int>(a));
-        float fb = std::holds_alternative<float>(b) ? std::get<float>(b) : static_cast<float>(std::get<int>(b));
-        lastValue = std::max(fa, fb);
-        return "[float]";
-    }
-    if (callName == "random") {
-        if (node->args.size() != 0) throw std::runtime_error("random() expects no arguments");
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        static std::uniform_real_distribution<float> dis(0.0f, 1.0f);
-        float randomValue = dis(gen);
-        lastValue = randomValue;
-        std::ostringstream oss;
-        oss << randomValue;
-        return oss.str();
+        return environment.at(id->depth, id->slot, id->name);
     }
+    return environment.get(id->name);
+}
 
-    // Advanced math functions
-    if (callName == "log") {
-        if (node->args.size() != 1) throw std::runtime_error("log() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::log(val);
-        return "[float]";
-    }
-    if (callName == "log10") {
-        if (node->args.size() != 1) throw std::runtime_error("log10() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::log10(val);
-        return "[float]";
-    }
-    if (callName == "exp") {
-        if (node->args.size() != 1) throw std::runtime_error("exp() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::exp(val);
-        return "[float]";
-    }
-    if (callName == "asin") {
-        if (node->args.size() != 1) throw std::runtime_error("asin() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::asin(val);
-        return "[float]";
-    }
-    if (callName == "acos") {
-        if (node->args.size() != 1) throw std::runtime_error("acos() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::acos(val);
-        return "[float]";
-    }
-    if (callName == "atan") {
-        if (node->args.size() != 1) throw std::runtime_error("atan() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        float val = std::holds_alternative<float>(v) ? std::get<float>(v) : static_cast<float>(std::get<int>(v));
-        lastValue = std::atan(val);
-        return "[float]";
-    }
-    if (callName == "atan2") {
-        if (node->args.size() != 2) throw std::runtime_error("atan2() expects 2 arguments");
-        Value y = evaluate(node->args[0].get());
-        Value x = evaluate(node->args[1].get());
-        float fy = std::holds_alternative<float>(y) ? std::get<float>(y) : static_cast<float>(std::get<int>(y));
-        float fx = std::holds_alternative<float>(x) ? std::get<float>(x) : static_cast<float>(std::get<int>(x));
-        lastValue = std::atan2(fy, fx);
-        return "[float]";
-    }
-    if (callName == "clamp") {
-        if (node->args.size() != 3) throw std::runtime_error("clamp() expects 3 arguments");
-        Value val = evaluate(node->args[0].get());
-        Value minVal = evaluate(node->args[1].get());
-        Value maxVal = evaluate(node->args[2].get());
-        if (std::holds_alternative<int>(val) && std::holds_alternative<int>(minVal) && std::holds_alternative<int>(maxVal)) {
-            int v = std::get<int>(val);
-            int mn = std::get<int>(minVal);
-            int mx = std::get<int>(maxVal);
-            lastValue = std::max(mn, std::min(mx, v));
-            return "[int]";
-        }
-        float fv = std::holds_alternative<float>(val) ? std::get<float>(val) : static_cast<float>(std::get<int>(val));
-        float fmn = std::holds_alternative<float>(minVal) ? std::get<float>(minVal) : static_cast<float>(std::get<int>(minVal));
-        float fmx = std::holds_alternative<float>(maxVal) ? std::get<float>(maxVal) : static_cast<float>(std::get<int>(maxVal));
-        lastValue = std::max(fmn, std::min(fmx, fv));
-        return "[float]";
-    }
-    if (callName == "lerp") {
-        if (node->args.size() != 3) throw std::runtime_error("lerp() expects 3 arguments");
-        Value a = evaluate(node->args[0].get());
-        Value b = evaluate(node->args[1].get());
-        Value t = evaluate(node->args[2].get());
-        float fa = std::holds_alternative<float>(a) ? std::get<float>(a) : static_cast<float>(std::get<int>(a));
-        float fb = std::holds_alternative<float>(b) ? std::get<float>(b) : static_cast<float>(std::get<int>(b));
-        float ft = std::holds_alternative<float>(t) ? std::get<float>(t) : static_cast<float>(std::get<int>(t));
-        lastValue = fa + (fb - fa) * ft;
-        return "[float]";
-    }
-
-    // Array functions
-    if (callName == "slice") {
-        if (node->args.size() != 3) throw std::runtime_error("slice() expects 3 arguments");
-        Value arrVal = evaluate(node->args[0].get());
-        Value startVal = evaluate(node->args[1].get());
-        Value endVal = evaluate(node->args[2].get());
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("slice() requires array");
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-        int start = std::get<int>(startVal);
-        int end = std::get<int>(endVal);
-        auto result = std::make_shared<ArrayValue>();
-        for (int i = start; i < end && i < (int)arr->elements.size(); i++) {
-            result->elements.push_back(arr->elements[i]);
-        }
-        lastValue = result;
-        return "[array]";
-    }
-    if (callName == "reverse") {
-        if (node->args.size() != 1) throw std::runtime_error("reverse() expects 1 argument");
-        Value arrVal = evaluate(node->args[0].get());
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("reverse() requires array");
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-        auto result = std::make_shared<ArrayValue>();
-        for (auto it = arr->elements.rbegin(); it != arr->elements.rend(); ++it) {
-            result->elements.push_back(*it);
-        }
-        lastValue = result;
-        return "[array]";
-    }
-    if (callName == "join") {
-        if (node->args.size() != 2) throw std::runtime_error("join() expects 2 arguments");
-        Value arrVal = evaluate(node->args[0].get());
-        Value sepVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("join() requires array");
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-        std::string sep = std::get<std::string>(sepVal);
-        std::string result;
-        for (size_t i = 0; i < arr->elements.size(); i++) {
-            if (i > 0) result += sep;
-            result += valueToString(arr->elements[i]);
-        }
-        lastValue = result;
-        return "[string]";
-    }
-    if (callName == "sort") {
-        if (node->args.size() != 1) throw std::runtime_error("sort() expects 1 argument");
-        Identifier *arrayId = dynamic_cast<Identifier *>(node->args[0].get());
-        if (!arrayId) throw std::runtime_error("sort() requires array variable");
-        Variable arrayVar = environment.get(arrayId->name);
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrayVar.value)) throw std::runtime_error("sort() requires array");
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrayVar.value);
-        std::sort(arr->elements.begin(), arr->elements.end(), [this](const Value& a, const Value& b) {
-            return valueToString(a) < valueToString(b);
-        });
-        lastValue = arr;
-        return "[array]";
-    }
-    if (callName == "find") {
-        if (node->args.size() != 2) throw std::runtime_error("find() expects 2 arguments");
-        Value arrVal = evaluate(node->args[0].get());
-        Value searchVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("find() requires array");
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-        for (size_t i = 0; i < arr->elements.size(); i++) {
-            if (valueToString(arr->elements[i]) == valueToString(searchVal)) {
-                lastValue = static_cast<int>(i);
-                return "[int]";
-            }
-        }
-        lastValue = -1;
-        return "[int]";
-    }
-    if (callName == "includes") {
-        if (node->args.size() != 2) throw std::runtime_error("includes() expects 2 arguments");
-        Value arrVal = evaluate(node->args[0].get());
-        Value searchVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::shared_ptr<ArrayValue>>(arrVal)) throw std::runtime_error("includes() requires array");
-        auto arr = std::get<std::shared_ptr<ArrayValue>>(arrVal);
-        for (const auto& elem : arr->elements) {
-            if (valueToString(elem) == valueToString(searchVal)) {
-                lastValue = true;
-                return "[bool]";
-            }
-        }
-        lastValue = false;
-        return "[bool]";
-    }
-
-    // String functions
-    if (callName == "trim") {
-        if (node->args.size() != 1) throw std::runtime_error("trim() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        if (!std::holds_alternative<std::string>(v)) throw std::runtime_error("trim() requires string");
-        std::string str = std::get<std::string>(v);
-        size_t start = str.find_first_not_of(" \t\n\r");
-        if (start == std::string::npos) {
-            lastValue = std::string("");
-            return "[string]";
-        }
-        size_t end = str.find_last_not_of(" \t\n\r");
-        lastValue = str.substr(start, end - start + 1);
-        return "[string]";
-    }
-    if (callName == "replace") {
-        if (node->args.size() != 3) throw std::runtime_error("replace() expects 3 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value searchVal = evaluate(node->args[1].get());
-        Value replaceVal = evaluate(node->args[2].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("replace() requires string");
-        std::string str = std::get<std::string>(strVal);
-        std::string search = std::get<std::string>(searchVal);
-        std::string replacement = std::get<std::string>(replaceVal);
-        size_t pos = str.find(search);
-        if (pos != std::string::npos) {
-            str.replace(pos, search.length(), replacement);
-        }
-        lastValue = str;
-        return "[string]";
-    }
-    if (callName == "split") {
-        if (node->args.size() != 2) throw std::runtime_error("split() expects 2 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value delimVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("split() requires string");
-        std::string str = std::get<std::string>(strVal);
-        std::string delim = std::get<std::string>(delimVal);
-        auto result = std::make_shared<ArrayValue>();
-        size_t start = 0;
-        size_t end = str.find(delim);
-        while (end != std::string::npos) {
-            result->elements.push_back(str.substr(start, end - start));
-            start = end + delim.length();
-            end = str.find(delim, start);
-        }
-        result->elements.push_back(str.substr(start));
-        lastValue = result;
-        return "[array]";
-    }
-    if (callName == "startsWith") {
-        if (node->args.size() != 2) throw std::runtime_error("startsWith() expects 2 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value prefixVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("startsWith() requires string");
-        std::string str = std::get<std::string>(strVal);
-        std::string prefix = std::get<std::string>(prefixVal);
-        lastValue = str.rfind(prefix, 0) == 0;
-        return "[bool]";
-    }
-    if (callName == "endsWith") {
-        if (node->args.size() != 2) throw std::runtime_error("endsWith() expects 2 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value suffixVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("endsWith() requires string");
-        std::string str = std::get<std::string>(strVal);
-        std::string suffix = std::get<std::string>(suffixVal);
-        if (suffix.length() > str.length()) {
-            lastValue = false;
-        } else {
-            lastValue = str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
-        }
-        return "[bool]";
-    }
-    if (callName == "repeat") {
-        if (node->args.size() != 2) throw std::runtime_error("repeat() expects 2 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value countVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("repeat() requires string");
-        std::string str = std::get<std::string>(strVal);
-        int count = std::get<int>(countVal);
-        std::string result;
-        for (int i = 0; i < count; i++) {
-            result += str;
-        }
-        lastValue = result;
-        return "[string]";
-    }
-    if (callName == "charAt") {
-        if (node->args.size() != 2) throw std::runtime_error("charAt() expects 2 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value idxVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("charAt() requires string");
-        std::string str = std::get<std::string>(strVal);
-        int idx = std::get<int>(idxVal);
-        if (idx < 0 || idx >= (int)str.length()) {
-            lastValue = std::string("");
-        } else {
-            lastValue = std::string(1, str[idx]);
-        }
-        return "[string]";
-    }
-    if (callName == "charCodeAt") {
-        if (node->args.size() != 2) throw std::runtime_error("charCodeAt() expects 2 arguments");
-        Value strVal = evaluate(node->args[0].get());
-        Value idxVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::string>(strVal)) throw std::runtime_error("charCodeAt() requires string");
-        std::string str = std::get<std::string>(strVal);
-        int idx = std::get<int>(idxVal);
-        if (idx < 0 || idx >= (int)str.length()) {
-            lastValue = -1;
-        } else {
-            lastValue = static_cast<int>(str[idx]);
-        }
-        return "[int]";
-    }
-
-    // Type conversion functions
-    if (callName == "toInt") {
-        if (node->args.size() != 1) throw std::runtime_error("toInt() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        if (std::holds_alternative<int>(v)) {
-            lastValue = std::get<int>(v);
-        } else if (std::holds_alternative<float>(v)) {
-            lastValue = static_cast<int>(std::get<float>(v));
-        } else if (std::holds_alternative<bool>(v)) {
-            lastValue = std::get<bool>(v) ? 1 : 0;
-        } else if (std::holds_alternative<std::string>(v)) {
-            try {
-                lastValue = std::stoi(std::get<std::string>(v));
-            } catch (...) {
-                lastValue = 0;
-            }
-        } else {
-            lastValue = 0;
-        }
-        return "[int]";
-    }
-    if (callName == "toFloat") {
-        if (node->args.size() != 1) throw std::runtime_error("toFloat() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        if (std::holds_alternative<float>(v)) {
-            lastValue = std::get<float>(v);
-        } else if (std::holds_alternative<int>(v)) {
-            lastValue = static_cast<float>(std::get<int>(v));
-        } else if (std::holds_alternative<std::string>(v)) {
-            try {
-                lastValue = std::stof(std::get<std::string>(v));
-            } catch (...) {
-                lastValue = 0.0f;
-            }
-        } else {
-            lastValue = 0.0f;
-        }
-        return "[float]";
-    }
-    if (callName == "toBool") {
-        if (node->args.size() != 1) throw std::runtime_error("toBool() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        lastValue = isTruthy(v);
-        return "[bool]";
-    }
+Value Interpreter::visitValue(BinaryOp *node)
+{
+    Value left = evaluate(node->left.get());
+    Value right = evaluate(node->right.get());
+    return performBinaryOp(left, node->op, right);
+}
 
-    // Utility functions
-    if (callName == "assert") {
-        if (node->args.size() != 2) throw std::runtime_error("assert() expects 2 arguments");
-        Value condVal = evaluate(node->args[0].get());
-        Value msgVal = evaluate(node->args[1].get());
-        if (!isTruthy(condVal)) {
-            throw std::runtime_error("Assertion failed: " + std::get<std::string>(msgVal));
+Value Interpreter::visitValue(UnaryOp *node)
+{
+    // typeof on a plain identifier reports the variable's declared type
+    if (node->op == UnaryOperator::TYPEOF) {
+        if (auto id = dynamic_cast<Identifier*>(node->operand.get())) {
+            const Variable &var = lookup(id);
+            return getTypeOfValue(var.value, var.type->spec);
         }
-        return "";
-    }
-    if (callName == "error") {
-        if (node->args.size() != 1) throw std::runtime_error("error() expects 1 argument");
-        Value msgVal = evaluate(node->args[0].get());
-        throw std::runtime_error(std::get<std::string>(msgVal));
     }
-    if (callName == "keys") {
-        if (node->args.size() != 1) throw std::runtime_error("keys() expects 1 argument");
-        Value objVal = evaluate(node->args[0].get());
-        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal)) throw std::runtime_error("keys() requires object");
-        auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
-        auto result = std::make_shared<ArrayValue>();
-        for (const auto& [key, val] : obj->fields) {
-            result->elements.push_back(key);
+    Value operand = evaluate(node->operand.get());
+    return performUnaryOp(node->op, operand);
+}
+
+Value Interpreter::visitValue(FunctionCall *node)
+{
+    // Builtins were bound by the parser and evaluate their arguments up front
+    if (const NativeFunction *builtin = node->builtin)
+    {
+        CallArgs args(*this, node);
+        // push/pop/sort work on an array variable and need its name and declared type
+        if (builtin->takesArrayVariable && !node->args.empty())
+        {
+            if (auto id = dynamic_cast<Identifier *>(node->args[0].get()))
+            {
+                Value result = builtin->call(*this, args.values, id->name, lookup(id).type);
+                if (!whenWatchers.empty())
+                {
+                    notifyChanged(id);
+                }
+                return result;
+            }
         }
-        lastValue = result;
-        return "[array]";
-    }
-    if (callName == "values") {
-        if (node->args.size() != 1) throw std::runtime_error("values() expects 1 argument");
-        Value objVal = evaluate(node->args[0].get());
-        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal)) throw std::runtime_error("values() requires object");
-        auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
-        auto result = std::make_shared<ArrayValue>();
-        for (const auto& [key, val] : obj->fields) {
-            result->elements.push_back(val);
-        }
-        lastValue = result;
-        return "[array]";
-    }
-    if (callName == "hasKey") {
-        if (node->args.size() != 2) throw std::runtime_error("hasKey() expects 2 arguments");
-        Value objVal = evaluate(node->args[0].get());
-        Value keyVal = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal)) throw std::runtime_error("hasKey() requires object");
-        auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
-        std::string key = std::get<std::string>(keyVal);
-        lastValue = obj->fields.find(key) != obj->fields.end();
-        return "[bool]";
-    }
-    if (callName == "clone") {
-        if (node->args.size() != 1) throw std::runtime_error("clone() expects 1 argument");
-        Value v = evaluate(node->args[0].get());
-        // Deep copy for arrays and objects
-        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v)) {
-            auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
-            auto newArr = std::make_shared<ArrayValue>();
-            newArr->elements = arr->elements; // Shallow copy elements
-            lastValue = newArr;
-            return "[array]";
-        }
-        if (std::holds_alternative<std::shared_ptr<ObjectValue>>(v)) {
-            auto obj = std::get<std::shared_ptr<ObjectValue>>(v);
-            auto newObj = std::make_shared<ObjectValue>();
-            newObj->fields = obj->fields; // Shallow copy fields
-            lastValue = newObj;
-            return "{object}";
-        }
-        lastValue = v;
-        return valueToString(v);
-    }
-    if (callName == "merge") {
-        if (node->args.size() != 2) throw std::runtime_error("merge() expects 2 arguments");
-        Value obj1Val = evaluate(node->args[0].get());
-        Value obj2Val = evaluate(node->args[1].get());
-        if (!std::holds_alternative<std::shared_ptr<ObjectValue>>(obj1Val) || 
-            !std::holds_alternative<std::shared_ptr<ObjectValue>>(obj2Val)) {
-            throw std::runtime_error("merge() requires two objects");
-        }
-        auto obj1 = std::get<std::shared_ptr<ObjectValue>>(obj1Val);
-        auto obj2 = std::get<std::shared_ptr<ObjectValue>>(obj2Val);
-        auto result = std::make_shared<ObjectValue>();
-        result->fields = obj1->fields;
-        for (const auto& [key, val] : obj2->fields) {
-            result->fields[key] = val;
-        }
-        lastValue = result;
-        return "{object}";
+        return builtin->call(*this, args.values);
     }
 
     // Check if this is a call to a function variable (via callee)
@@ -1346,7 +515,7 @@ std::string Interpreter::visit(FunctionCall *node)
                 if (prog == nullptr)
                 {
                     // Skip unknown built-in programs (like removed counter)
-                    return "";
+                    return std::string();
                 }
                 
                 if (node->args.size() != prog->params.size())
@@ -1356,39 +525,9 @@ std::string Interpreter::visit(FunctionCall *node)
                 }
 
                 // Run program synchronously
-                environment.pushScope();
-
-                for (size_t i = 0; i < node->args.size(); ++i)
-                {
-                    Value argVal = evaluate(node->args[i].get());
-                    Variable param(argVal, prog->params[i].second, false);
-                    environment.define(prog->params[i].first, param);
-                }
-
-                try
-                {
-                    executeBlock(prog->body.get());
-                }
-                catch (const ReturnException &e)
-                {
-                    environment.popScope();
-                    if (std::holds_alternative<std::shared_ptr<ArrayValue>>(e.value) ||
-                        std::holds_alternative<std::shared_ptr<ObjectValue>>(e.value) ||
-                        std::holds_alternative<FunctionDeclaration*>(e.value) ||
-                        std::holds_alternative<FunctionExpression*>(e.value))
-                    {
-                        lastValue = e.value;
-                        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(e.value))
-                            return "[array]";
-                        if (std::holds_alternative<std::shared_ptr<ObjectValue>>(e.value))
-                            return "{object}";
-                        return "[function]";
-                    }
-                    return valueToString(e.value);
-                }
-
-                environment.popScope();
-                return "";
+                CallArgs args(*this, node);
+                ProfileScope profile(profiler.get(), prog, prog->name, prog->line);
+                return callFunction(prog->params, prog->paramTypes, prog->body.get(), args.values);
             }
             
             // Then check if it's a named function
@@ -1401,39 +540,8 @@ std::string Interpreter::visit(FunctionCall *node)
                     throw std::runtime_error("Function argument count mismatch");
                 }
 
-                environment.pushScope();
-
-                for (size_t i = 0; i < node->args.size(); ++i)
-                {
-                    Value argVal = evaluate(node->args[i].get());
-                    Variable param(argVal, func->params[i].second, false);
-                    environment.define(func->params[i].first, param);
-                }
-
-                try
-                {
-                    executeBlock(func->body.get());
-                }
-                catch (const ReturnException &e)
-                {
-                    environment.popScope();
-                    if (std::holds_alternative<std::shared_ptr<ArrayValue>>(e.value) ||
-                        std::holds_alternative<std::shared_ptr<ObjectValue>>(e.value) ||
-                        std::holds_alternative<FunctionDeclaration*>(e.value) ||
-                        std::holds_alternative<FunctionExpression*>(e.value))
-                    {
-                        lastValue = e.value;
-                        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(e.value))
-                            return "[array]";
-                        if (std::holds_alternative<std::shared_ptr<ObjectValue>>(e.value))
-                            return "{object}";
-                        return "[function]";
-                    }
-                    return valueToString(e.value);
-                }
-
-                environment.popScope();
-                return "";
+                CallArgs args(*this, node);
+                return callFunction(func, args.values);
             }
             
             // Otherwise try to get it from environment
@@ -1451,27 +559,8 @@ std::string Interpreter::visit(FunctionCall *node)
                         throw std::runtime_error("Function argument count mismatch");
                     }
 
-                    environment.pushScope();
-
-                    for (size_t i = 0; i < node->args.size(); ++i)
-                    {
-                        Value argVal = evaluate(node->args[i].get());
-                        Variable param(argVal, func->params[i].second, false);
-                        environment.define(func->params[i].first, param);
-                    }
-
-                    try
-                    {
-                        executeBlock(func->body.get());
-                    }
-                    catch (const ReturnException &e)
-                    {
-                        environment.popScope();
-                        return valueToString(e.value);
-                    }
-
-                    environment.popScope();
-                    return "";
+                    CallArgs args(*this, node);
+                    return callFunction(func, args.values);
                 }
                 
                 // Check if it's a FunctionExpression*
@@ -1484,27 +573,8 @@ std::string Interpreter::visit(FunctionCall *node)
                         throw std::runtime_error("Function argument count mismatch");
                     }
 
-                    environment.pushScope();
-
-                    for (size_t i = 0; i < node->args.size(); ++i)
-                    {
-                        Value argVal = evaluate(node->args[i].get());
-                        Variable param(argVal, func->params[i].second, false);
-                        environment.define(func->params[i].first, param);
-                    }
-
-                    try
-                    {
-                        executeBlock(func->body.get());
-                    }
-                    catch (const ReturnException &e)
-                    {
-                        environment.popScope();
-                        return valueToString(e.value);
-                    }
-
-                    environment.popScope();
-                    return "";
+                    CallArgs args(*this, node);
+                    return callFunction(func, args.values);
                 }
                 
                 throw std::runtime_error("Callee must be a function");
@@ -1525,27 +595,8 @@ std::string Interpreter::visit(FunctionCall *node)
                 throw std::runtime_error("Function argument count mismatch");
             }
 
-            environment.pushScope();
-
-            for (size_t i = 0; i < node->args.size(); ++i)
-            {
-                Value argVal = evaluate(node->args[i].get());
-                Variable param(argVal, func->params[i].second, false);
-                environment.define(func->params[i].first, param);
-            }
-
-            try
-            {
-                executeBlock(func->body.get());
-            }
-            catch (const ReturnException &e)
-            {
-                environment.popScope();
-                return valueToString(e.value);
-            }
-
-            environment.popScope();
-            return "";
+            CallArgs args(*this, node);
+            return callFunction(func, args.values);
         }
         
         // Check if it's a FunctionExpression*
@@ -1557,27 +608,8 @@ std::string Interpreter::visit(FunctionCall *node)
                 throw std::runtime_error("Function argument count mismatch");
             }
 
-            environment.pushScope();
-
-            for (size_t i = 0; i < node->args.size(); ++i)
-            {
-                Value argVal = evaluate(node->args[i].get());
-                Variable param(argVal, func->params[i].second, false);
-                environment.define(func->params[i].first, param);
-            }
-
-            try
-            {
-                executeBlock(func->body.get());
-            }
-            catch (const ReturnException &e)
-            {
-                environment.popScope();
-                return valueToString(e.value);
-            }
-
-            environment.popScope();
-            return "";
+            CallArgs args(*this, node);
+            return callFunction(func, args.values);
         }
         
         throw std::runtime_error("Callee must be a function");
@@ -1587,12 +619,98 @@ std::string Interpreter::visit(FunctionCall *node)
     throw std::runtime_error("Invalid function call");
 }
 
+// Arguments are evaluated in the caller's scope before the call's own scope is pushed
+void Interpreter::evaluateArgs(FunctionCall *call, std::vector<Value> &args)
+{
+    args.reserve(call->args.size());
+    for (auto &arg : call->args)
+    {
+        args.push_back(evaluate(arg.get()));
+    }
+}
+
+// Hot functions run natively once the JIT has compiled them
+Value Interpreter::callFunction(FunctionDeclaration *func, std::vector<Value> &args)
+{
+    ProfileScope profile(profiler.get(), func, func->name, func->line);
+    Value result;
+    if (jitCompiler && jitCompiler->tryCall(func, args, result, *this))
+    {
+        return result;
+    }
+    return callFunction(func->params, func->paramTypes, func->body.get(), args);
+}
+
+Value Interpreter::callFunction(FunctionExpression *func, std::vector<Value> &args)
+{
+    ProfileScope profile(profiler.get(), func, "<anonymous>", func->line);
+    return callFunction(func->params, func->paramTypes, func->body.get(), args);
+}
+
+// Parameters are bound to slots 0..n-1 of a fresh scope (the Resolver numbers them the same way)
+Value Interpreter::callFunction(const std::vector<std::pair<std::string, std::string>> &params,
+                                const std::vector<const TypeDescriptor *> &paramTypes, Block *body, std::vector<Value> &args)
+{
+    ScopeGuard scope(environment, params.size());
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        environment.defineSlot((int)i, params[i].first, Variable(std::move(args[i]), paramTypes[i], false));
+    }
+
+    if (executeBlock(body) == Completion::Return)
+    {
+        return std::move(returnValue);
+    }
+    return std::string();
+}
+
 std::string Interpreter::visit(Block *node)
 {
-    executeBlock(node);
+    exec(node);
     return "";
 }
 
+Completion Interpreter::exec(Block *node)
+{
+    return executeBlock(node);
+}
+
+void Interpreter::checkInitializerType(const std::string &name, const TypeDescriptor *declared, const Value &value)
+{
+    if (declared->matches(value)) {
+        return;
+    }
+    const std::string &type = declared->spec;
+
+    // Diagnostic output: show declared type and initializer element/value types
+    try {
+        std::cerr << "[type-check] variable '" << name << "' declared as '" << type << "' but initializer = ";
+        if (std::holds_alternative<std::shared_ptr<ArrayValue>>(value)) {
+            auto arr = std::get<std::shared_ptr<ArrayValue>>(value);
+            std::cerr << "[";
+            for (size_t i = 0; i < arr->size(); ++i) {
+                if (i) std::cerr << ", ";
+                const Value ev = arr->at(i);
+                if (std::holds_alternative<int>(ev)) std::cerr << "int(" << std::get<int>(ev) << ")";
+                else if (std::holds_alternative<float>(ev)) std::cerr << "float(" << std::get<float>(ev) << ")";
+                else if (std::holds_alternative<std::string>(ev)) std::cerr << "string(\"" << std::get<std::string>(ev) << "\")";
+                else if (std::holds_alternative<bool>(ev)) std::cerr << "bool(" << (std::get<bool>(ev) ? "true" : "false") << ")";
+                else std::cerr << "<complex>";
+            }
+            std::cerr << "]\n";
+        } else {
+            if (std::holds_alternative<int>(value)) std::cerr << "int(" << std::get<int>(value) << ")\n";
+            else if (std::holds_alternative<float>(value)) std::cerr << "float(" << std::get<float>(value) << ")\n";
+            else if (std::holds_alternative<std::string>(value)) std::cerr << "string(\"" << std::get<std::string>(value) << "\")\n";
+            else if (std::holds_alternative<bool>(value)) std::cerr << "bool(" << (std::get<bool>(value) ? "true" : "false") << ")\n";
+            else std::cerr << "<complex>\n";
+        }
+    } catch (...) {}
+
+    std::cerr << "[debug] caught exception type: " << typeid(std::runtime_error).name() << std::endl;
+    throw std::runtime_error("Type error: initializer for '" + name + "' does not match declared type '" + type + "'");
+}
+
 std::string Interpreter::visit(VariableDeclaration *node)
 {
     Value value;
@@ -1618,49 +736,42 @@ std::string Interpreter::visit(VariableDeclaration *node)
     }
     // Enforce declared type if initializer exists
     if (node->initializer) {
-        if (!valueMatchesType(value, node->type)) {
-            // Diagnostic output: show declared type and initializer element/value types
-            try {
-                std::cerr << "[type-check] variable '" << node->name << "' declared as '" << node->type << "' but initializer = ";
-                if (std::holds_alternative<std::shared_ptr<ArrayValue>>(value)) {
-                    auto arr = std::get<std::shared_ptr<ArrayValue>>(value);
-                    std::cerr << "[";
-                    for (size_t i = 0; i < arr->elements.size(); ++i) {
-                        if (i) std::cerr << ", ";
-                        const Value &ev = arr->elements[i];
-                        if (std::holds_alternative<int>(ev)) std::cerr << "int(" << std::get<int>(ev) << ")";
-                        else if (std::holds_alternative<float>(ev)) std::cerr << "float(" << std::get<float>(ev) << ")";
-                        else if (std::holds_alternative<std::string>(ev)) std::cerr << "string(\"" << std::get<std::string>(ev) << "\")";
-                        else if (std::holds_alternative<bool>(ev)) std::cerr << "bool(" << (std::get<bool>(ev) ? "true" : "false") << ")";
-                        else std::cerr << "<complex>";
-                    }
-                    std::cerr << "]\n";
-                } else {
-                    if (std::holds_alternative<int>(value)) std::cerr << "int(" << std::get<int>(value) << ")\n";
-                    else if (std::holds_alternative<float>(value)) std::cerr << "float(" << std::get<float>(value) << ")\n";
-                    else if (std::holds_alternative<std::string>(value)) std::cerr << "string(\"" << std::get<std::string>(value) << "\")\n";
-                    else if (std::holds_alternative<bool>(value)) std::cerr << "bool(" << (std::get<bool>(value) ? "true" : "false") << ")\n";
-                    else std::cerr << "<complex>\n";
-                }
-            } catch (...) {}
-
-            std::cerr << "[debug] caught exception type: " << typeid(std::runtime_error).name() << std::endl;
-            throw std::runtime_error("Type error: initializer for '" + node->name + "' does not match declared type '" + node->type + "'");
-        }
+        checkInitializerType(node->name, node->declaredType, value);
+    }
+    if (node->slot >= 0)
+    {
+        environment.defineSlot(node->slot, node->name, Variable(value, node->declaredType, false));
+    }
+    else
+    {
+        environment.define(node->name, Variable(value, node->declaredType, false));
+    }
+    if (!whenAwaitedNames.empty() || !whenWatchers.empty())
+    {
+        notifyDefined(node->name);
     }
-    environment.define(node->name, Variable(value, node->type, false));
     return "";
 }
 
-std::string Interpreter::visit(Assignment *node)
+Value Interpreter::visitValue(Assignment *node)
 {
     Value value = evaluate(node->value.get());
-    environment.set(node->name, value);
-    checkPendingWhens(node->name);
-    return valueToString(value);
+    if (node->depth >= 0)
+    {
+        environment.setAt(node->depth, node->slot, node->name, value);
+    }
+    else
+    {
+        environment.set(node->name, value);
+    }
+    if (!whenWatchers.empty())
+    {
+        notifyChanged(node->depth >= 0 ? environment.keyOf(node->depth, node->slot) : environment.keyOf(node->name));
+    }
+    return value;
 }
 
-std::string Interpreter::visit(FieldAssignment *node)
+Value Interpreter::visitValue(FieldAssignment *node)
 {
     Value objVal = evaluate(node->object.get());
     Value val = evaluate(node->value.get());
@@ -1671,12 +782,19 @@ std::string Interpreter::visit(FieldAssignment *node)
     }
 
     auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
-    obj->fields[node->field] = val;
+    obj->set(node->field, val, node->cache);
+    if (!whenWatchers.empty())
+    {
+        if (auto id = dynamic_cast<Identifier *>(node->object.get()))
+        {
+            notifyChanged(id);
+        }
+    }
 
-    return "";
+    return std::string();
 }
 
-std::string Interpreter::visit(IndexAssignment *node)
+Value Interpreter::visitValue(IndexAssignment *node)
 {
     Value objVal = evaluate(node->object.get());
     Value idx = evaluate(node->index.get());
@@ -1690,24 +808,30 @@ std::string Interpreter::visit(IndexAssignment *node)
             throw std::runtime_error("Array index must be integer");
         }
         int i = std::get<int>(idx);
-        if (i < 0 || i >= (int)arr->elements.size())
+        if (i < 0 || i >= (int)arr->size())
         {
             throw std::runtime_error("Array index out of bounds");
         }
         // If we can, enforce element type from the variable declaration (if object expression is identifier)
         if (auto id = dynamic_cast<Identifier*>(node->object.get())) {
-            if (environment.has(id->name)) {
-                Variable arrayVar = environment.get(id->name);
-                if (!arrayVar.type.empty() && arrayVar.type.size() >= 2 && arrayVar.type.front() == '[' && arrayVar.type.back() == ']') {
-                    std::string inner = arrayVar.type.substr(1, arrayVar.type.size() - 2);
-                    if (!valueMatchesType(val, inner)) {
-                        throw std::runtime_error("Type error: cannot assign element to array '" + id->name + "' of element type '" + inner + "'");
+            if (id->depth >= 0 || environment.has(id->name)) {
+                const Variable &arrayVar = lookup(id);
+                if (const TypeDescriptor *element = arrayVar.type->element) {
+                    if (!element->matches(val)) {
+                        throw std::runtime_error("Type error: cannot assign element to array '" + id->name + "' of element type '" + element->spec + "'");
                     }
                 }
             }
         }
-        arr->elements[i] = val;
-        return "";
+        arr->set(i, val);
+        if (!whenWatchers.empty())
+        {
+            if (auto id = dynamic_cast<Identifier *>(node->object.get()))
+            {
+                notifyChanged(id);
+            }
+        }
+        return std::string();
     }
 
     if (std::holds_alternative<std::shared_ptr<ObjectValue>>(objVal))
@@ -1718,108 +842,153 @@ std::string Interpreter::visit(IndexAssignment *node)
         }
         auto obj = std::get<std::shared_ptr<ObjectValue>>(objVal);
         std::string key = std::get<std::string>(idx);
-        obj->fields[key] = val;
-        return "";
+        obj->set(key, val);
+        if (!whenWatchers.empty())
+        {
+            if (auto id = dynamic_cast<Identifier *>(node->object.get()))
+            {
+                notifyChanged(id);
+            }
+        }
+        return std::string();
     }
 
     throw std::runtime_error("Index assignment requires array or object on left side");
 }
 
 std::string Interpreter::visit(IfStatement *node)
+{
+    exec(node);
+    return "";
+}
+
+Completion Interpreter::exec(IfStatement *node)
 {
     Value cond = evaluate(node->condition.get());
     if (isTruthy(cond))
     {
-        executeBlock(node->thenBlock.get());
+        return executeBlock(node->thenBlock.get());
     }
     else if (node->elseBlock)
     {
-        executeBlock(node->elseBlock.get());
+        return executeBlock(node->elseBlock.get());
     }
-    return "";
+    return Completion::Normal;
 }
 
 std::string Interpreter::visit(WhileStatement *node)
 {
-    // Try JIT compilation first
-    if (jitCompiler && jitCompiler->isCompilable(node)) {
-        if (jitCompiler->compileAndExecute(node, this, environment)) {
-            return "";
-        }
-    }
-    
-    // Fallback to interpreted execution
-    while (isTruthy(evaluate(node->condition.get())))
+    exec(node);
+    return "";
+}
+
+// Loops hand over to the JIT on entry when already compiled, or once they
+// have run LLVMJITCompiler::kHotLoopIterations iterations
+Completion Interpreter::exec(WhileStatement *node)
+{
+    unsigned iterations = 0;
+    bool native = false;
+    LoopProfile profile(profiler.get(), node, "while", iterations, native);
+    for (;; ++iterations)
     {
-        try {
-            executeBlock(node->body.get());
+        if (jitCompiler && jitCompiler->runLoop(node, iterations, *this))
+        {
+            native = true;
+            break;
+        }
+        if (!isTruthy(evaluate(node->condition.get())))
+        {
+            break;
         }
-        catch (const BreakException&) {
+        Completion completion = executeBlock(node->body.get());
+        if (completion == Completion::Break)
+        {
+            ++iterations;
             break;
         }
-        catch (const ContinueException&) {
-            continue;
+        if (completion == Completion::Return)
+        {
+            ++iterations;
+            return completion;
         }
     }
-    return "";
+    return Completion::Normal;
 }
 
 std::string Interpreter::visit(ForStatement *node)
 {
-    // Try JIT compilation first
-    if (jitCompiler && jitCompiler->isCompilable(node)) {
-        environment.pushScope();
-        if (node->init) {
-            node->init->accept(this);
-        }
-        if (jitCompiler->compileAndExecute(node, this, environment)) {
-            environment.popScope();
-            return "";
-        }
-        environment.popScope();
-    }
-    
-    // Fallback to interpreted execution
-    environment.pushScope();
+    exec(node);
+    return "";
+}
+
+Completion Interpreter::exec(ForStatement *node)
+{
+    ScopeGuard scope(environment, node->numSlots);
 
     if (node->init)
     {
         node->init->accept(this);
     }
 
-    while (isTruthy(evaluate(node->condition.get())))
+    unsigned iterations = 0;
+    bool native = false;
+    LoopProfile profile(profiler.get(), node, "for", iterations, native);
+    for (;; ++iterations)
     {
-        try {
-            executeBlock(node->body.get());
+        if (jitCompiler && jitCompiler->runLoop(node, iterations, *this))
+        {
+            native = true;
+            break;
         }
-        catch (const BreakException&) {
+        if (!isTruthy(evaluate(node->condition.get())))
+        {
+            break;
+        }
+        Completion completion = executeBlock(node->body.get());
+        if (completion == Completion::Break)
+        {
+            ++iterations;
             break;
         }
-        catch (const ContinueException&) {
-            // Continue to update expression
+        if (completion == Completion::Return)
+        {
+            ++iterations;
+            return completion;
         }
         evaluate(node->update.get());
     }
 
-    environment.popScope();
-    return "";
+    return Completion::Normal;
 }
 
 std::string Interpreter::visit(ReturnStatement *node)
 {
-    Value value = 0;
+    exec(node);
+    return "";
+}
+
+Completion Interpreter::exec(ReturnStatement *node)
+{
+    returnValue = 0;
     if (node->value)
     {
-        value = evaluate(node->value.get());
+        returnValue = evaluate(node->value.get());
     }
-    throw ReturnException(value);
+    return Completion::Return;
 }
 
 std::string Interpreter::visit(FunctionDeclaration *node)
 {
     functions[node->name] = node;
     // Also store in environment so typeof can access it
-    environment.define(node->name, Variable(node, "function", false));
+    if (node->slot >= 0)
+    {
+        environment.defineSlot(node->slot, node->name, Variable(node, "function", false));
+    }
+    else
+    {
+        environment.define(node->name, Variable(node, "function", false));
+    }
     return "";
 }
 
@@ -1827,7 +996,19 @@ std::string Interpreter::visit(Program *node)
 {
     for (auto &decl : node->declarations)
     {
-        decl->accept(this);
+        // A return, break or continue outside any function or loop ends the script
+        if (decl->acceptExec(this) != Completion::Normal)
+        {
+            break;
+        }
+        if (whensDue())
+        {
+            runPendingWhens();
+        }
+        if (Heap::due())
+        {
+            Heap::collect();
+        }
     }
     return "";
 }
@@ -1836,12 +1017,26 @@ std::string Interpreter::visit(ExpressionStatement *node)
 {
     // Evaluate the expression and discard the result
     evaluate(node->expression.get());
-    checkPendingWhens();
     return "";
 }
 
+// Every import statement resolves its path, and the same module is usually
+// imported from many places, so successful lookups are remembered for the run
+std::string Interpreter::resolveImportPath(const std::string& requestedPath, const std::string& fromModule) {
+    std::string key = fs::path(fromModule).parent_path().string();
+    key += '\0';
+    key += requestedPath;
+    auto it = resolvedImports.find(key);
+    if (it != resolvedImports.end()) {
+        return it->second;
+    }
+    std::string resolved = findImportPath(requestedPath, fromModule);
+    resolvedImports.emplace(std::move(key), resolved);
+    return resolved;
+}
+
 // Helper function to resolve import paths with Node.js-like behavior
-std::string Interpreter::resolveImportPath(const std::string& requestedPath) {
+std::string Interpreter::findImportPath(const std::string& requestedPath, const std::string& fromModule) {
     fs::path requested(requestedPath);
     
     // If path has an extension, use it as-is but validate it
@@ -1855,8 +1050,8 @@ std::string Interpreter::resolveImportPath(const std::string& requestedPath) {
         fs::path absPath;
         if (requested.is_relative()) {
             // If we have a current module path, resolve relative to its directory
-            if (!currentModulePath.empty()) {
-                fs::path currentDir = fs::path(currentModulePath).parent_path();
+            if (!fromModule.empty()) {
+                fs::path currentDir = fs::path(fromModule).parent_path();
                 absPath = currentDir / requested;
             } else {
                 absPath = fs::current_path() / requested;
@@ -1868,29 +1063,149 @@ std::string Interpreter::resolveImportPath(const std::string& requestedPath) {
         if (fs::exists(absPath)) {
             return absPath.string();
         }
-        throw std::runtime_error("File not found: " + absPath.string());
-    }
-    
-    // No extension provided - try .axo first (default for Axolotl files)
-    fs::path axoPath = requested;
-    axoPath += ".axo";
-    fs::path absAxoPath = fs::absolute(axoPath);
-    
-    if (fs::exists(absAxoPath)) {
-        return absAxoPath.string();
-    }
-    
-    // If .axo doesn't exist, check if it's a directory with index.axo
-    fs::path dirPath = fs::absolute(requested);
-    if (fs::is_directory(dirPath)) {
-        fs::path indexPath = dirPath / "index.axo";
-        if (fs::exists(indexPath)) {
-            return indexPath.string();
+        throw std::runtime_error("File not found: " + absPath.string());
+    }
+    
+    // No extension provided - try .axo first (default for Axolotl files)
+    fs::path axoPath = requested;
+    axoPath += ".axo";
+    fs::path absAxoPath = fs::absolute(axoPath);
+    
+    if (fs::exists(absAxoPath)) {
+        return absAxoPath.string();
+    }
+    
+    // If .axo doesn't exist, check if it's a directory with index.axo
+    fs::path dirPath = fs::absolute(requested);
+    if (fs::is_directory(dirPath)) {
+        fs::path indexPath = dirPath / "index.axo";
+        if (fs::exists(indexPath)) {
+            return indexPath.string();
+        }
+    }
+    
+    // File not found
+    throw std::runtime_error("Module not found: '" + requestedPath + "'. Tried: " + absAxoPath.string() + ", " + (dirPath / "index.axo").string());
+}
+
+namespace {
+
+// Reads and parses one module, through the cache when there is one. Touches
+// nothing else, so modules can be parsed on several threads at once.
+ModuleCache::Module parseModuleFile(const std::string& path, ModuleCache* cache)
+{
+    if (cache) {
+        return cache->load(path);
+    }
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open import file: " + path);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+
+    ModuleCache::Module module;
+    module.sourceHash = ModuleCache::hash(source);
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    module.program = parser.parse();
+    return module;
+}
+
+} // namespace
+
+// Finds every module the program imports or uses, directly or through other
+// modules, and parses them ahead of time. Each round parses the modules found
+// in the previous one in parallel on the task pool; the imports of those are
+// the next round. Nothing runs here: module bodies still run when their import
+// is reached, and a module that fails to parse reports it then.
+void Interpreter::preloadImports(Program* program)
+{
+    std::vector<std::pair<std::string, Program*>> parsed{{currentModulePath, program}};
+    while (!parsed.empty()) {
+        std::vector<std::string> round;
+        for (auto& [from, module] : parsed) {
+            for (auto& decl : module->declarations) {
+                std::string requested;
+                if (auto import = dynamic_cast<ImportDeclaration*>(decl.get())) {
+                    requested = import->path;
+                } else if (auto use = dynamic_cast<UseDeclaration*>(decl.get())) {
+                    requested = use->path;
+                } else {
+                    continue;
+                }
+                std::string path;
+                try {
+                    path = resolveImportPath(requested, from);
+                } catch (const std::exception&) {
+                    continue;  // reported when the import runs
+                }
+                if (fs::path(path).extension() != ".axo" || importedFiles.count(path) || preloadedModules.count(path)) {
+                    continue;
+                }
+                preloadedModules[path];
+                round.push_back(path);
+            }
+        }
+
+        if (round.size() == 1) {
+            PreloadedModule& slot = preloadedModules[round[0]];
+            try {
+                ModuleCache::Module module = parseModuleFile(round[0], moduleCache.get());
+                slot.program = std::move(module.program);
+                slot.sourceHash = module.sourceHash;
+            } catch (...) {
+                slot.error = std::current_exception();
+            }
+        } else if (!round.empty()) {
+            std::mutex mutex;
+            std::condition_variable finished;
+            size_t remaining = round.size();
+            for (auto& path : round) {
+                PreloadedModule* slot = &preloadedModules[path];
+                ModuleCache* cache = moduleCache.get();
+                TaskPool::shared().submit([&, slot, cache, path] {
+                    try {
+                        ModuleCache::Module module = parseModuleFile(path, cache);
+                        slot->program = std::move(module.program);
+                        slot->sourceHash = module.sourceHash;
+                    } catch (...) {
+                        slot->error = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (--remaining == 0) finished.notify_one();
+                });
+            }
+            TaskPool::Blocking blocking;
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return remaining == 0; });
+        }
+
+        parsed.clear();
+        for (auto& path : round) {
+            PreloadedModule& slot = preloadedModules[path];
+            if (slot.program) parsed.emplace_back(path, slot.program.get());
         }
     }
-    
-    // File not found
-    throw std::runtime_error("Module not found: '" + requestedPath + "'. Tried: " + absAxoPath.string() + ", " + (dirPath / "index.axo").string());
+}
+
+// An imported .axo file, parsed ahead by preloadImports() or now; records
+// the hash of its source
+std::unique_ptr<Program> Interpreter::loadModule(const std::string& resolvedPath)
+{
+    auto preloaded = preloadedModules.find(resolvedPath);
+    if (preloaded != preloadedModules.end()) {
+        PreloadedModule module = std::move(preloaded->second);
+        preloadedModules.erase(preloaded);
+        if (module.error) std::rethrow_exception(module.error);
+        importedFiles[resolvedPath] = module.sourceHash;
+        return std::move(module.program);
+    }
+    ModuleCache::Module module = parseModuleFile(resolvedPath, moduleCache.get());
+    importedFiles[resolvedPath] = module.sourceHash;
+    return std::move(module.program);
 }
 
 std::string Interpreter::visit(ImportDeclaration *node)
@@ -1898,7 +1213,7 @@ std::string Interpreter::visit(ImportDeclaration *node)
     try
     {
         // Resolve the import path using Node.js-like resolution
-        std::string resolvedPath = resolveImportPath(node->path);
+        std::string resolvedPath = resolveImportPath(node->path, currentModulePath);
         
         // Check file extension to determine how to process
         fs::path filePath(resolvedPath);
@@ -1926,22 +1241,11 @@ std::string Interpreter::visit(ImportDeclaration *node)
             
             if (!alreadyImported) {
                 // Mark as imported to prevent cycles
-                importedFiles.insert(resolvedPath);
+                importedFiles[resolvedPath] = 0;
+                Metrics::count(Metrics::Counter::Imports);
+                MetricsScope metrics(Metrics::Histogram::ImportSeconds, "import", &resolvedPath);
                 
-                std::ifstream file(resolvedPath);
-                if (!file.is_open()) {
-                    throw std::runtime_error("Could not open import file: " + resolvedPath);
-                }
-                
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                std::string source = buffer.str();
-
-                // Tokenize and parse
-                Lexer lexer(source);
-                auto tokens = lexer.tokenize();
-                Parser parser(tokens);
-                auto ast = parser.parse();
+                auto ast = loadModule(resolvedPath);
 
                 // Set current module path and interpret to populate exports
                 std::string savedModulePath = currentModulePath;
@@ -2011,7 +1315,7 @@ std::string Interpreter::visit(UseDeclaration *node)
     try
     {
         // Resolve the use path using Node.js-like resolution
-        std::string resolvedPath = resolveImportPath(node->path);
+        std::string resolvedPath = resolveImportPath(node->path, currentModulePath);
         
         // Check file extension to determine how to process
         fs::path filePath(resolvedPath);
@@ -2034,26 +1338,15 @@ std::string Interpreter::visit(UseDeclaration *node)
             
             if (!alreadyImported) {
                 // Mark as imported to prevent cycles
-                importedFiles.insert(resolvedPath);
-                
-                std::ifstream file(resolvedPath);
-                if (!file.is_open()) {
-                    throw std::runtime_error("Could not open use file: " + resolvedPath);
-                }
+                importedFiles[resolvedPath] = 0;
+                Metrics::count(Metrics::Counter::Imports);
+                MetricsScope metrics(Metrics::Histogram::ImportSeconds, "import", &resolvedPath);
                 
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                std::string source = buffer.str();
-
-                // Tokenize and parse
-                Lexer lexer(source);
-                auto tokens = lexer.tokenize();
-                Parser parser(tokens);
-                auto ast = parser.parse();
+                auto ast = loadModule(resolvedPath);
 
                 // Set current module path and interpret in isolated environment
                 std::string savedModulePath = currentModulePath;
-                Environment savedEnvironment = environment;
+                Environment savedEnvironment = std::move(environment);
                 
                 // Create a new isolated environment for the used file
                 environment = Environment();
@@ -2064,7 +1357,7 @@ std::string Interpreter::visit(UseDeclaration *node)
                 currentModulePath = savedModulePath;
                 
                 // Restore the original environment
-                environment = savedEnvironment;
+                environment = std::move(savedEnvironment);
                 
                 // Store the AST to keep function declarations alive
                 importedASTs[resolvedPath] = std::move(ast);
@@ -2109,7 +1402,7 @@ std::string Interpreter::visit(ExportDeclaration *node)
         } else if (auto varDecl = dynamic_cast<VariableDeclaration*>(node->declaration.get())) {
             // Get the variable value from environment
             if (environment.has(varDecl->name)) {
-                Variable var = environment.get(varDecl->name);
+                const Variable &var = environment.get(varDecl->name);
                 std::cerr << "[debug] Exporting variable '" << varDecl->name << "' with value: " << valueToString(var.value) << std::endl;
                 if (node->isDefault) {
                     moduleDefaultExports[currentModule] = var.value;
@@ -2122,7 +1415,7 @@ std::string Interpreter::visit(ExportDeclaration *node)
         // Named exports: export {x, y};
         for (const std::string& exportName : node->namedExports) {
             if (environment.has(exportName)) {
-                Variable var = environment.get(exportName);
+                const Variable &var = environment.get(exportName);
                 moduleExports[currentModule][exportName] = var.value;
             }
         }
@@ -2134,7 +1427,7 @@ std::string Interpreter::visit(ExportDeclaration *node)
 std::string Interpreter::visit(TypeDeclaration *node)
 {
     // Store the type definition in the type registry
-    typeRegistry[node->name] = node->typeSpec;
+    typeRegistry[node->name] = node->descriptor;
     return "";
 }
 
@@ -2145,20 +1438,27 @@ std::string Interpreter::visit(ThrowStatement *node)
 }
 
 std::string Interpreter::visit(TryStatement *node)
+{
+    exec(node);
+    return "";
+}
+
+Completion Interpreter::exec(TryStatement *node)
 {
     bool finallyExecuted = false;
+    Completion completion = Completion::Normal;
     
     try {
-        executeBlock(node->tryBlock.get());
+        completion = executeBlock(node->tryBlock.get());
     }
     catch (const ThrowException &e) {
         if (node->catchBlock) {
-            environment.pushScope();
+            environment.pushScope(node->catchVariable.empty() ? 0 : 1);
             if (!node->catchVariable.empty()) {
-                environment.define(node->catchVariable, Variable(e.value, "any", false));
+                environment.defineSlot(0, node->catchVariable, Variable(e.value, "any", false));
             }
             try {
-                executeBlock(node->catchBlock.get());
+                completion = executeBlock(node->catchBlock.get());
             }
             catch (...) {
                 environment.popScope();
@@ -2190,20 +1490,36 @@ std::string Interpreter::visit(TryStatement *node)
     }
     
     if (node->finallyBlock && !finallyExecuted) {
-        executeBlock(node->finallyBlock.get());
+        // The finally block may call functions, which reuse returnValue
+        Value pending = std::move(returnValue);
+        Completion finallyCompletion = executeBlock(node->finallyBlock.get());
+        if (finallyCompletion != Completion::Normal) {
+            return finallyCompletion;  // it overrides whatever the try or catch block did
+        }
+        returnValue = std::move(pending);
     }
     
-    return "";
+    return completion;
 }
 
 std::string Interpreter::visit(BreakStatement *node)
 {
-    throw BreakException();
+    return "";
+}
+
+Completion Interpreter::exec(BreakStatement *)
+{
+    return Completion::Break;
 }
 
 std::string Interpreter::visit(ContinueStatement *node)
 {
-    throw ContinueException();
+    return "";
+}
+
+Completion Interpreter::exec(ContinueStatement *)
+{
+    return Completion::Continue;
 }
 
 std::string Interpreter::visit(ProgramDeclaration *node)
@@ -2212,114 +1528,192 @@ std::string Interpreter::visit(ProgramDeclaration *node)
     return "";
 }
 
-std::string Interpreter::visit(AwaitExpression *node)
+// The program `call` names, or null when it names none
+ProgramDeclaration *Interpreter::calledProgram(FunctionCall *call)
 {
-    // Handle await with function call - run the program asynchronously and wait for it
-    if (auto funcCall = dynamic_cast<FunctionCall*>(node->expression.get())) {
-        std::string programName;
-        if (funcCall->callee) {
-            if (auto id = dynamic_cast<Identifier*>(funcCall->callee.get())) {
-                programName = id->name;
-            }
-        } else {
-            programName = funcCall->name;
-        }
-        
-        // Check if it's a program
-        auto progIt = programs.find(programName);
-        if (progIt != programs.end()) {
-            ProgramDeclaration *prog = progIt->second;
-            if (prog == nullptr) {
-                return "";
-            }
-            
-            if (funcCall->args.size() != prog->params.size()) {
-                throw std::runtime_error("Program argument count mismatch");
-            }
-
-            // Evaluate arguments in the main thread first
-            std::vector<Value> argValues;
-            for (size_t i = 0; i < funcCall->args.size(); ++i) {
-                argValues.push_back(evaluate(funcCall->args[i].get()));
-            }
-            
-            // Create a lambda to run the program in background
-            auto programRunner = [this, prog, argValues]() {
-                Environment localEnv = this->environment; // Copy current environment
-                localEnv.pushScope();
-
-                for (size_t i = 0; i < argValues.size(); ++i) {
-                    Variable param(argValues[i], prog->params[i].second, false);
-                    localEnv.define(prog->params[i].first, param);
-                }
+    std::string name = call->name;
+    if (auto id = dynamic_cast<Identifier*>(call->callee.get())) {
+        name = id->name;
+    }
+    auto it = programs.find(name);
+    return it == programs.end() ? nullptr : it->second;
+}
 
-                // Execute program body with local environment
-                Environment savedEnv = this->environment;
-                this->environment = localEnv;
-                try {
-                    executeBlock(prog->body.get());
-                } catch (...) {
-                    // Restore environment on exception
-                    this->environment = savedEnv;
-                    throw;
-                }
-                this->environment = savedEnv;
-            };
+// The task gets a copy of the arguments and of everything the program can
+// reach, so the thread it runs on shares no Environment, array or object with
+// this one
+std::shared_ptr<ProgramTask> Interpreter::spawnProgram(ProgramDeclaration *prog, FunctionCall *call)
+{
+    if (call->args.size() != prog->params.size()) {
+        throw std::runtime_error("Program argument count mismatch");
+    }
+    std::vector<Value> args;
+    evaluateArgs(call, args);
+
+    ValueCopier copier;
+    for (auto &arg : args) {
+        arg = copier.copy(arg);
+    }
+    std::shared_ptr<Interpreter> context(new Interpreter(*this, prog->captures, copier));
+
+    auto task = std::make_shared<ProgramTask>(prog->name);
+    spawnedTasks.erase(std::remove_if(spawnedTasks.begin(), spawnedTasks.end(),
+                                      [](const std::shared_ptr<ProgramTask> &t) { return t->done(); }),
+                       spawnedTasks.end());
+    spawnedTasks.push_back(task);
+    // Counted until the context and its values are gone, so no collection
+    // runs while the task may touch containers
+    Heap::enterMutator();
+    Metrics::count(Metrics::Counter::ProgramsSpawned);
+    TaskPool::shared().submit([context, task, prog, args]() mutable {
+        context->runTask(*task, prog, std::move(args));
+        context.reset();
+        args.clear();
+        Heap::leaveMutator();
+    });
+    return task;
+}
 
-            // Start program in background thread and wait for it
-            auto future = std::async(std::launch::async, programRunner);
-            future.wait();
-            return "";
+void Interpreter::runTask(ProgramTask &task, ProgramDeclaration *prog, std::vector<Value> args)
+{
+    // Named types resolve against the interpreter running on this thread; a
+    // thread waiting for another task may run this one in the middle of its own
+    Interpreter *outer = currentInterpreter;
+    currentInterpreter = this;
+    Metrics::adjust(Metrics::Gauge::ProgramsRunning, 1);
+    Value result;
+    std::exception_ptr error;
+    {
+        MetricsScope metrics(Metrics::Histogram::ProgramSeconds, "program", &prog->name);
+        try {
+            result = callFunction(prog->params, prog->paramTypes, prog->body.get(), args);
+        } catch (...) {
+            Metrics::count(Metrics::Counter::ProgramsFailed);
+            error = std::current_exception();
         }
     }
-    
-    // For non-program expressions, just evaluate normally
-    evaluate(node->expression.get());
-    return "";
+    Metrics::adjust(Metrics::Gauge::ProgramsRunning, -1);
+    currentInterpreter = outer;
+    // Only now wake whoever awaits the task, so the metrics and trace it may
+    // export next already account for this run
+    if (error) {
+        task.fail(error);
+    } else {
+        task.finish(std::move(result));
+    }
 }
 
-Value Interpreter::evaluate(Expression *expr)
+Value Interpreter::visitValue(SpawnExpression *node)
 {
-    std::string result = expr->accept(this);
-    // Check if a complex value was stored
-    if (!result.empty() && (result == "[array]" || result == "{object}" || result == "[function]" || result == "[bool]" || result == "[int]" || result == "[string]"))
-    {
-        return lastValue;
+    ProgramDeclaration *prog = calledProgram(node->call.get());
+    if (!prog) {
+        throw std::runtime_error("spawn requires a program call");
     }
-    // Convert result string back to Value if needed
-    if (result.empty())
-        return std::string("");
-    if (result == "true")
-        return true;
-    if (result == "false")
-        return false;
-    try
-    {
-        if (result.find('.') != std::string::npos)
-        {
-            return std::stof(result);
+    return spawnProgram(prog, node->call.get());
+}
+
+// `await prog(args)` runs the program on the pool and waits for it, and
+// `await task` waits for a spawned one or an async builtin's. Either gives the
+// task's result. `await [t1, t2]` waits for every task in the array and gives
+// their results in order. Awaiting anything else just evaluates it.
+Value Interpreter::visitValue(AwaitExpression *node)
+{
+    std::shared_ptr<ProgramTask> task;
+    ProgramDeclaration *prog = nullptr;
+    if (auto call = dynamic_cast<FunctionCall*>(node->expression.get())) {
+        prog = calledProgram(call);
+        if (prog) task = spawnProgram(prog, call);
+    }
+    if (!task) {
+        Value value = evaluate(node->expression.get());
+        if (auto tasks = std::get_if<std::shared_ptr<ArrayValue>>(&value)) {
+            auto results = std::make_shared<ArrayValue>();
+            results->reserve((*tasks)->size());
+            ValueCopier copier;
+            (*tasks)->each([&](const Value &v) {
+                auto task = std::get_if<std::shared_ptr<ProgramTask>>(&v);
+                if (!task) {
+                    results->push(v);
+                    return true;
+                }
+                Metrics::count(Metrics::Counter::Awaits);
+                MetricsScope metrics(Metrics::Histogram::AwaitSeconds, "await", &(*task)->program());
+                results->push(copier.copy((*task)->wait()));
+                return true;
+            });
+            return results;
         }
-        return std::stoi(result);
-    }
-    catch (...)
-    {
-        return result;
+        if (!std::holds_alternative<std::shared_ptr<ProgramTask>>(value)) {
+            return value;
+        }
+        task = std::get<std::shared_ptr<ProgramTask>>(value);
     }
+
+    // This thread only waits now, so the wait profiles as the program's time
+    ProfileScope profile(prog ? profiler.get() : nullptr, prog, task->program(), prog ? prog->line : 0);
+    Metrics::count(Metrics::Counter::Awaits);
+    MetricsScope metrics(Metrics::Histogram::AwaitSeconds, "await", &task->program());
+    ValueCopier copier;
+    return copier.copy(task->wait());
+}
+
+Value Interpreter::evaluate(Expression *expr)
+{
+    return expr->acceptValue(this);
 }
 
+// ASTVisitor entry points for expressions: evaluate via visitValue and render
+std::string Interpreter::visit(IntegerLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(FloatLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(StringLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(TemplateLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(BooleanLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(Identifier *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(BinaryOp *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(UnaryOp *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(FunctionCall *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(ArrayLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(ObjectLiteral *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(FunctionExpression *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(IndexAccess *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(FieldAccess *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(IndexAssignment *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(FieldAssignment *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(Assignment *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(AwaitExpression *node) { return valueToString(visitValue(node)); }
+std::string Interpreter::visit(SpawnExpression *node) { return valueToString(visitValue(node)); }
+
 void Interpreter::execute(Statement *stmt)
 {
     stmt->accept(this);
 }
 
-void Interpreter::executeBlock(Block *block)
+Completion Interpreter::exec(ASTNode *node)
 {
-    environment.pushScope();
+    node->accept(this);
+    return Completion::Normal;
+}
+
+Completion Interpreter::executeBlock(Block *block)
+{
+    ScopeGuard scope(environment, block->numSlots);
     for (auto &stmt : block->statements)
     {
-        stmt->accept(this);
+        Completion completion = stmt->acceptExec(this);
+        if (completion != Completion::Normal)
+        {
+            return completion;
+        }
+        if (whensDue())
+        {
+            runPendingWhens();
+        }
+        if (Heap::due())
+        {
+            Heap::collect();
+        }
     }
-    environment.popScope();
+    return Completion::Normal;
 }
 
 Value Interpreter::performBinaryOp(const Value &left, BinaryOperator op, const Value &right)
@@ -2332,8 +1726,14 @@ Value Interpreter::performBinaryOp(const Value &left, BinaryOperator op, const V
             case BinaryOperator::ADD: return l + r;
             case BinaryOperator::SUBTRACT: return l - r;
             case BinaryOperator::MULTIPLY: return l * r;
-            case BinaryOperator::DIVIDE: return l / r;
-            case BinaryOperator::MODULO: return l % r;
+            // The divide instruction traps on 0 and on INT_MIN / -1
+            case BinaryOperator::DIVIDE:
+                if (r == 0) throw std::runtime_error("Division by zero");
+                if (r == -1 && l == INT_MIN) throw std::runtime_error("Integer overflow in division");
+                return l / r;
+            case BinaryOperator::MODULO:
+                if (r == 0) throw std::runtime_error("Modulo by zero");
+                return r == -1 ? 0 : l % r;
             case BinaryOperator::LESS: return l < r;
             case BinaryOperator::GREATER: return l > r;
             case BinaryOperator::LESS_EQUAL: return l <= r;
@@ -2397,13 +1797,8 @@ Value Interpreter::performUnaryOp(UnaryOperator op, const Value &operand)
             return -std::get<float>(operand);
         case UnaryOperator::LOGICAL_NOT:
             return !isTruthy(operand);
-        case UnaryOperator::TYPEOF: {
-            std::string typeStr = getTypeOfValue(operand);
-            // Clear variable info after typeof operation
-            lastVariableName.clear();
-            lastVariable = Variable();
-            return typeStr;
-        }
+        case UnaryOperator::TYPEOF:
+            return getTypeOfValue(operand);
     }
     throw std::runtime_error("Unknown unary operator: " + unaryOpToString(op));
 }
@@ -2429,12 +1824,17 @@ bool Interpreter::isTruthy(const Value &v)
     if (std::holds_alternative<std::shared_ptr<ArrayValue>>(v))
     {
         auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
-        return !arr->elements.empty();
+        return !arr->empty();
     }
     if (std::holds_alternative<std::shared_ptr<ObjectValue>>(v))
     {
         auto obj = std::get<std::shared_ptr<ObjectValue>>(v);
-        return !obj->fields.empty();
+        return !obj->empty();
+    }
+    if (std::holds_alternative<std::shared_ptr<ProgramTask>>(v) || std::holds_alternative<std::shared_ptr<Channel>>(v) ||
+        std::holds_alternative<std::shared_ptr<FileReader>>(v))
+    {
+        return true;
     }
     return false;
 }
@@ -2471,11 +1871,11 @@ std::string Interpreter::valueToString(const Value &v)
     {
         auto arr = std::get<std::shared_ptr<ArrayValue>>(v);
         std::string result = "[";
-        for (size_t i = 0; i < arr->elements.size(); ++i)
+        for (size_t i = 0; i < arr->size(); ++i)
         {
             if (i > 0)
                 result += ", ";
-            result += valueToString(arr->elements[i]);
+            result += valueToString(arr->at(i));
         }
         result += "]";
         return result;
@@ -2485,25 +1885,35 @@ std::string Interpreter::valueToString(const Value &v)
         auto obj = std::get<std::shared_ptr<ObjectValue>>(v);
         std::string result = "{";
         bool first = true;
-        for (auto &[key, val] : obj->fields)
+        obj->each([&](const std::string &key, const Value &val)
         {
             if (!first)
                 result += ", ";
             result += key + ": " + valueToString(val);
             first = false;
-        }
+        });
         result += "}";
         return result;
     }
+    if (auto task = std::get_if<std::shared_ptr<ProgramTask>>(&v))
+    {
+        return "[task " + (*task)->program() + "]";
+    }
+    if (std::holds_alternative<std::shared_ptr<Channel>>(v))
+    {
+        return "[channel]";
+    }
+    if (auto reader = std::get_if<std::shared_ptr<FileReader>>(&v))
+    {
+        return "[reader " + (*reader)->path() + "]";
+    }
     return "";
 }
 
-std::string Interpreter::getTypeOfValue(const Value &v)
+std::string Interpreter::getTypeOfValue(const Value &v, const std::string &declaredType)
 {
-    // If we have variable info from the last identifier access, use declared type when appropriate
-    if (!lastVariableName.empty() && !lastVariable.type.empty()) {
-        std::string declaredType = lastVariable.type;
-        
+    // If the value came from a typed variable, use its declared type when appropriate
+    if (!declaredType.empty()) {
         // For custom types, check if they exist in type registry
         if (typeRegistry.find(declaredType) != typeRegistry.end()) {
             return declaredType;  // Return the custom type name
@@ -2519,6 +1929,9 @@ std::string Interpreter::getTypeOfValue(const Value &v)
             return declaredType;  // Return array type like [int] or custom array type
         }
         if (declaredType == "object" && std::holds_alternative<std::shared_ptr<ObjectValue>>(v)) return "object";
+        if (declaredType == "task" && std::holds_alternative<std::shared_ptr<ProgramTask>>(v)) return "task";
+        if (declaredType == "channel" && std::holds_alternative<std::shared_ptr<Channel>>(v)) return "channel";
+        if (declaredType == "reader" && std::holds_alternative<std::shared_ptr<FileReader>>(v)) return "reader";
     }
     
     // Fallback to runtime type detection
@@ -2550,32 +1963,68 @@ std::string Interpreter::getTypeOfValue(const Value &v)
     {
         return "object";
     }
+    if (std::holds_alternative<std::shared_ptr<ProgramTask>>(v))
+    {
+        return "task";
+    }
+    if (std::holds_alternative<std::shared_ptr<Channel>>(v))
+    {
+        return "channel";
+    }
+    if (std::holds_alternative<std::shared_ptr<FileReader>>(v))
+    {
+        return "reader";
+    }
     return "unknown";
 }
 
-std::string Interpreter::visit(ArrayLiteral *node)
+Value Interpreter::visitValue(ArrayLiteral *node)
 {
     auto arr = std::make_shared<ArrayValue>();
+    arr->reserve(node->elements.size());
     for (auto &elem : node->elements)
     {
-        arr->elements.push_back(evaluate(elem.get()));
+        arr->push(evaluate(elem.get()));
     }
-    lastValue = arr;
-    return "[array]";
+    return arr;
 }
 
-std::string Interpreter::visit(ObjectLiteral *node)
+Value Interpreter::visitValue(ObjectLiteral *node)
 {
+    const Shape *shape = node->shape.load(std::memory_order_acquire);
+    if (!shape)
+    {
+        std::vector<std::string> keys;
+        for (auto &field : node->fields)
+        {
+            keys.push_back(field.first);
+        }
+        shape = Shape::empty()->withAll(keys);
+        if (!shape || shape->size() != keys.size())
+        {
+            shape = Shape::empty();
+        }
+        node->shape.store(shape, std::memory_order_release);
+    }
+    if (shape->size() == node->fields.size())
+    {
+        std::vector<Value> values;
+        values.reserve(node->fields.size());
+        for (auto &field : node->fields)
+        {
+            values.push_back(evaluate(field.second.get()));
+        }
+        return std::make_shared<ObjectValue>(shape, std::move(values));
+    }
     auto obj = std::make_shared<ObjectValue>();
     for (auto &field : node->fields)
     {
-        obj->fields[field.first] = evaluate(field.second.get());
+        obj->set(field.first, evaluate(field.second.get()));
     }
-    lastValue = obj;
-    return "{object}";
+    return obj;
 }
 
-std::string Interpreter::visit(IndexAccess *node)
+Value Interpreter::visitValue(IndexAccess *node)
 {
     Value obj = evaluate(node->object.get());
     Value idx = evaluate(node->index.get());
@@ -2587,24 +2036,9 @@ std::string Interpreter::visit(IndexAccess *node)
         if (std::holds_alternative<int>(idx))
         {
             int i = std::get<int>(idx);
-            if (i >= 0 && i < (int)arr->elements.size())
+            if (i >= 0 && i < (int)arr->size())
             {
-                Value elem = arr->elements[i];
-                // Store complex values for chaining
-                if (std::holds_alternative<std::shared_ptr<ArrayValue>>(elem) ||
-                    std::holds_alternative<std::shared_ptr<ObjectValue>>(elem))
-                {
-                    lastValue = elem;
-                    if (std::holds_alternative<std::shared_ptr<ArrayValue>>(elem))
-                    {
-                        return "[array]";
-                    }
-                    else
-                    {
-                        return "{object}";
-                    }
-                }
-                return valueToString(elem);
+                return arr->at(i);
             }
         }
         throw std::runtime_error("Array index out of bounds");
@@ -2614,27 +2048,11 @@ std::string Interpreter::visit(IndexAccess *node)
     if (std::holds_alternative<std::shared_ptr<ObjectValue>>(obj))
     {
         auto obj_val = std::get<std::shared_ptr<ObjectValue>>(obj);
-        std::string key = valueToString(idx);
-        if (obj_val->fields.find(key) != obj_val->fields.end())
+        if (const Value *found = obj_val->find(valueToString(idx)))
         {
-            Value field = obj_val->fields[key];
-            // Store complex values for chaining
-            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(field) ||
-                std::holds_alternative<std::shared_ptr<ObjectValue>>(field))
-            {
-                lastValue = field;
-                if (std::holds_alternative<std::shared_ptr<ArrayValue>>(field))
-                {
-                    return "[array]";
-                }
-                else
-                {
-                    return "{object}";
-                }
-            }
-            return valueToString(field);
+            return *found;
         }
-        return "";
+        return std::string();
     }
 
     // String indexing
@@ -2655,43 +2073,27 @@ std::string Interpreter::visit(IndexAccess *node)
     throw std::runtime_error("Index access requires array, object, or string");
 }
 
-std::string Interpreter::visit(FieldAccess *node)
+Value Interpreter::visitValue(FieldAccess *node)
 {
     Value obj = evaluate(node->object.get());
 
     if (std::holds_alternative<std::shared_ptr<ObjectValue>>(obj))
     {
         auto obj_val = std::get<std::shared_ptr<ObjectValue>>(obj);
-        if (obj_val->fields.find(node->field) != obj_val->fields.end())
+        if (const Value *found = obj_val->find(node->field, node->cache))
         {
-            Value field = obj_val->fields[node->field];
-            // Store complex values for chaining
-            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(field) ||
-                std::holds_alternative<std::shared_ptr<ObjectValue>>(field))
-            {
-                lastValue = field;
-                if (std::holds_alternative<std::shared_ptr<ArrayValue>>(field))
-                {
-                    return "[array]";
-                }
-                else
-                {
-                    return "{object}";
-                }
-            }
-            return valueToString(field);
+            return *found;
         }
-        return "";
+        return std::string();
     }
 
     throw std::runtime_error("Field access requires object");
 }
 
-std::string Interpreter::visit(FunctionExpression* node)
+Value Interpreter::visitValue(FunctionExpression *node)
 {
-    // Store the function expression pointer in lastValue so it can be retrieved
-    lastValue = node;
-    return "[function]";
+    // Function expressions evaluate to a pointer to their own node
+    return node;
 }
 
 std::string Interpreter::visit(CaseClause* node)
@@ -2702,94 +2104,274 @@ std::string Interpreter::visit(CaseClause* node)
 
 std::string Interpreter::visit(SwitchStatement* node)
 {
-    Value discriminantValue = evaluate(node->discriminant.get());
-    bool matched = false;
-    bool fallthrough = false;
-    
+    exec(node);
+    return "";
+}
+
+namespace {
+
+// The int whose decimal form is exactly `text`, if there is one
+bool printsAsInt(const std::string& text, int& value)
+{
+    if (text.empty() || text.size() > 11) return false;
     try {
-        for (auto& caseClause : node->cases) {
-            if (caseClause->isDefault) {
-                // Default case - execute if no previous match or if falling through
-                if (!matched || fallthrough) {
-                    matched = true;
-                    fallthrough = true;
-                    for (auto& stmt : caseClause->statements) {
-                        stmt->accept(this);
-                        checkPendingWhens();
-                    }
-                }
-            } else {
-                // Regular case - check if value matches
-                Value caseValue = evaluate(caseClause->value.get());
-                bool caseMatches = (valueToString(discriminantValue) == valueToString(caseValue));
-                
-                if (caseMatches || fallthrough) {
-                    matched = true;
-                    fallthrough = true;
-                    for (auto& stmt : caseClause->statements) {
-                        stmt->accept(this);
-                        checkPendingWhens();
-                    }
-                }
+        size_t used = 0;
+        value = std::stoi(text, &used);
+        return used == text.size() && std::to_string(value) == text;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// A switch whose ints span at most this many times as many slots as it has
+// int cases gets a dense table
+constexpr size_t kDenseSpread = 4;
+
+} // namespace
+
+const SwitchTable* Interpreter::switchTable(SwitchStatement* node)
+{
+    const SwitchTable* table = node->table.load(std::memory_order_acquire);
+    if (table) {
+        return table;
+    }
+
+    auto built = std::make_unique<SwitchTable>();
+    std::vector<std::pair<int, uint32_t>> ints;
+    for (uint32_t i = 0; i < node->cases.size(); ++i) {
+        CaseClause* clause = node->cases[i].get();
+        if (clause->isDefault) {
+            if (built->fallback == SwitchTable::kNone) built->fallback = i;
+            continue;
+        }
+        Expression* value = clause->value.get();
+        if (!dynamic_cast<IntegerLiteral*>(value) && !dynamic_cast<StringLiteral*>(value) &&
+            !dynamic_cast<FloatLiteral*>(value) && !dynamic_cast<BooleanLiteral*>(value)) {
+            built->linear = true;
+            break;
+        }
+        std::string text = valueToString(evaluate(value));
+        // Only the first of several cases that print the same can match
+        if (built->texts.emplace(text, i).second) {
+            int n;
+            if (printsAsInt(text, n)) ints.emplace_back(n, i);
+        }
+    }
+
+    if (!built->linear && !ints.empty()) {
+        auto range = std::minmax_element(ints.begin(), ints.end());
+        int64_t span = int64_t(range.second->first) - range.first->first + 1;
+        if (span <= int64_t(kDenseSpread * ints.size())) {
+            built->low = range.first->first;
+            built->dense.assign(static_cast<size_t>(span), SwitchTable::kNone);
+            for (auto& entry : ints) built->dense[entry.first - built->low] = entry.second;
+        } else {
+            built->ints.insert(ints.begin(), ints.end());
+        }
+    }
+
+    // Another thread may have built one meanwhile; both are the same
+    const SwitchTable* expected = nullptr;
+    if (node->table.compare_exchange_strong(expected, built.get(), std::memory_order_acq_rel)) {
+        return built.release();
+    }
+    return expected;
+}
+
+// Runs the clauses from the first that matches or is a default, falling
+// through the ones after it until a break
+Completion Interpreter::exec(SwitchStatement* node)
+{
+    Value discriminantValue = evaluate(node->discriminant.get());
+    const SwitchTable* table = switchTable(node);
+    size_t start = node->cases.size();
+
+    if (!table->linear) {
+        uint32_t match = SwitchTable::kNone;
+        if (auto n = std::get_if<int>(&discriminantValue)) {
+            if (!table->dense.empty()) {
+                int64_t offset = int64_t(*n) - table->low;
+                if (offset >= 0 && offset < int64_t(table->dense.size())) match = table->dense[offset];
+            } else if (!table->ints.empty()) {
+                auto it = table->ints.find(*n);
+                if (it != table->ints.end()) match = it->second;
+            }
+        } else {
+            auto str = std::get_if<std::string>(&discriminantValue);
+            auto it = table->texts.find(str ? *str : valueToString(discriminantValue));
+            if (it != table->texts.end()) match = it->second;
+        }
+        uint32_t first = std::min(match, table->fallback);
+        if (first != SwitchTable::kNone) start = first;
+    } else {
+        std::string discriminantText = valueToString(discriminantValue);
+        for (size_t i = 0; i < node->cases.size(); ++i) {
+            CaseClause* clause = node->cases[i].get();
+            if (clause->isDefault || valueToString(evaluate(clause->value.get())) == discriminantText) {
+                start = i;
+                break;
             }
         }
     }
-    catch (const BreakException&) {
-        // Break statement exits the switch
-        return "";
+
+    for (size_t i = start; i < node->cases.size(); ++i) {
+        CaseClause* clause = node->cases[i].get();
+        // Case values are still evaluated when falling through them
+        if (table->linear && !clause->isDefault && i > start) {
+            evaluate(clause->value.get());
+        }
+        for (auto& stmt : clause->statements) {
+            Completion completion = stmt->acceptExec(this);
+            if (completion == Completion::Break) {
+                // Break statement exits the switch
+                return Completion::Normal;
+            }
+            if (completion != Completion::Normal) {
+                return completion;
+            }
+            if (whensDue()) {
+                runPendingWhens();
+            }
+        }
     }
     
-    return "";
+    return Completion::Normal;
 }
 
 std::string Interpreter::visit(WhenStatement* node)
 {
-    PendingWhen pw;
-    pw.condition = node->condition.get();
-    pw.body = node->body.get();
-    pw.dependencies = node->dependencies;
-    
-    // Store initial values of dependencies
+    auto pw = std::make_shared<PendingWhen>();
+    pw->node = node;
+    pendingWhens.push_back(pw);
+    Metrics::adjust(Metrics::Gauge::WhensPending, 1);
+    if (node->polled) {
+        polledWhens.push_back(pw);
+        return "";
+    }
     for (const auto& dep : node->dependencies) {
-        if (environment.has(dep)) {
-            pw.lastValues[dep] = environment.get(dep).value;
+        uint64_t key = environment.keyOf(dep);
+        if (key == Environment::kNoVariable) {
+            whenAwaitedNames[dep].push_back(pw);
+        } else {
+            whenWatchers[key].push_back(pw);
+            pw->keys.push_back(key);
         }
     }
-    
-    pendingWhens.push_back(std::move(pw));
+    // Without listed dependencies the condition may already hold
+    if (node->inferred) {
+        queueWhen(pw);
+    }
     return "";
 }
 
-void Interpreter::checkPendingWhens(const std::string& changedVar)
+void Interpreter::queueWhen(const WhenPtr& pw)
 {
-    auto it = pendingWhens.begin();
-    while (it != pendingWhens.end()) {
-        bool shouldCheck = false;
-        
-        if (it->dependencies.empty()) {
-            // No dependencies - check every time
-            shouldCheck = true;
-        } else if (!changedVar.empty()) {
-            // Check if changed variable is in dependencies
-            for (const auto& dep : it->dependencies) {
-                if (dep == changedVar) {
-                    shouldCheck = true;
-                    break;
-                }
+    if (!pw->queued && !pw->fired) {
+        pw->queued = true;
+        queuedWhens.push_back(pw);
+    }
+}
+
+void Interpreter::notifyChanged(uint64_t key)
+{
+    auto found = whenWatchers.find(key);
+    if (found != whenWatchers.end()) {
+        for (const auto& pw : found->second) {
+            queueWhen(pw);
+        }
+    }
+}
+
+void Interpreter::notifyChanged(Identifier* id)
+{
+    notifyChanged(id->depth >= 0 ? environment.keyOf(id->depth, id->slot) : environment.keyOf(id->name));
+}
+
+// A declaration binds the watchers that were waiting for the name, and counts
+// as a change for those already watching the variable it overwrites
+void Interpreter::notifyDefined(const std::string& name)
+{
+    uint64_t key = environment.keyOf(name);
+    auto awaited = whenAwaitedNames.find(name);
+    if (awaited != whenAwaitedNames.end()) {
+        std::vector<WhenPtr> watchers = std::move(awaited->second);
+        whenAwaitedNames.erase(awaited);
+        for (const auto& pw : watchers) {
+            if (!pw->fired) {
+                whenWatchers[key].push_back(pw);
+                pw->keys.push_back(key);
             }
         }
-        
-        if (shouldCheck) {
-            try {
-                Value condValue = evaluate(it->condition);
-                if (isTruthy(condValue)) {
-                    executeBlock(it->body);
-                    it = pendingWhens.erase(it);
-                    continue;
-                }
-            } catch (...) {
+    }
+    notifyChanged(key);
+}
+
+void Interpreter::runPendingWhens()
+{
+    // Watchers woken while a body runs go to the next batch
+    std::vector<WhenPtr> batch;
+    batch.swap(queuedWhens);
+    batch.insert(batch.end(), polledWhens.begin(), polledWhens.end());
+    for (const auto& pw : batch) {
+        pw->queued = false;
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const WhenPtr& pw = batch[i];
+        if (pw->fired) {
+            continue;  // by a body earlier in this batch
+        }
+        bool holds = false;
+        try {
+            holds = isTruthy(evaluate(pw->node->condition.get()));
+        } catch (...) {
             // If evaluation fails, keep the when statement
         }
-        ++it;
+        if (!holds) {
+            continue;
+        }
+        removeWhen(pw);
+        try {
+            executeBlock(pw->node->body.get());
+        } catch (...) {
+            for (size_t j = i + 1; j < batch.size(); ++j) {
+                if (!batch[j]->node->polled) {
+                    queueWhen(batch[j]);
+                }
+            }
+            throw;
+        }
+    }
+}
+
+void Interpreter::removeWhen(const WhenPtr& pw)
+{
+    pw->fired = true;
+    auto unlink = [&pw](std::vector<WhenPtr>& list) {
+        list.erase(std::remove(list.begin(), list.end(), pw), list.end());
+    };
+    for (uint64_t key : pw->keys) {
+        auto found = whenWatchers.find(key);
+        if (found != whenWatchers.end()) {
+            unlink(found->second);
+            if (found->second.empty()) {
+                whenWatchers.erase(found);
+            }
+        }
+    }
+    for (const auto& dep : pw->node->dependencies) {
+        auto found = whenAwaitedNames.find(dep);
+        if (found != whenAwaitedNames.end()) {
+            unlink(found->second);
+            if (found->second.empty()) {
+                whenAwaitedNames.erase(found);
+            }
+        }
     }
+    if (pw->node->polled) {
+        unlink(polledWhens);
+    }
+    size_t pending = pendingWhens.size();
+    unlink(pendingWhens);
+    Metrics::adjust(Metrics::Gauge::WhensPending, -static_cast<int64_t>(pending - pendingWhens.size()));
 }
+
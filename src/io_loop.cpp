@@ -0,0 +1,106 @@
+#include "include/io_loop.h"
+
+IOLoop::IOLoop(unsigned threads)
+{
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) {
+        ioThreads.emplace_back([this] { ioLoop(); });
+    }
+    timerThread = std::thread([this] { timerLoop(); });
+}
+
+IOLoop::~IOLoop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ioReady.notify_all();
+    timersChanged.notify_all();
+    for (auto& thread : ioThreads) {
+        thread.join();
+    }
+    timerThread.join();
+}
+
+IOLoop& IOLoop::shared()
+{
+    // Enough to overlap the waits of a handful of files; more would only
+    // contend for the same disk
+    static IOLoop loop(4);
+    return loop;
+}
+
+std::shared_ptr<ProgramTask> IOLoop::submit(std::string name, Operation op)
+{
+    auto task = std::make_shared<ProgramTask>(std::move(name));
+    Heap::enterMutator();  // operations may build arrays (readDirAsync does)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        operations.push_back({task, std::move(op)});
+    }
+    ioReady.notify_one();
+    return task;
+}
+
+std::shared_ptr<ProgramTask> IOLoop::timer(std::chrono::milliseconds delay)
+{
+    auto task = std::make_shared<ProgramTask>("sleepAsync");
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Timer entry{std::chrono::steady_clock::now() + delay, task};
+        earliest = timers.empty() || entry.deadline < timers.top().deadline;
+        timers.push(std::move(entry));
+    }
+    if (earliest) timersChanged.notify_one();
+    return task;
+}
+
+void IOLoop::ioLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ioReady.wait(lock, [this] { return stopping || !operations.empty(); });
+        if (operations.empty()) return;  // stopping, and nothing left to finish
+        Pending pending = std::move(operations.front());
+        operations.pop_front();
+        lock.unlock();
+        try {
+            pending.task->finish(pending.op());
+        } catch (...) {
+            pending.task->fail(std::current_exception());
+        }
+        pending = Pending();
+        Heap::leaveMutator();
+        lock.lock();
+    }
+}
+
+void IOLoop::timerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (timers.empty()) {
+            timersChanged.wait(lock);
+            continue;
+        }
+        auto deadline = timers.top().deadline;
+        if (std::chrono::steady_clock::now() < deadline) {
+            timersChanged.wait_until(lock, deadline);
+            continue;  // an earlier timer may have come in meanwhile
+        }
+        // Every timer that is due fires in this round
+        std::vector<std::shared_ptr<ProgramTask>> due;
+        auto now = std::chrono::steady_clock::now();
+        while (!timers.empty() && timers.top().deadline <= now) {
+            due.push_back(timers.top().task);
+            timers.pop();
+        }
+        lock.unlock();
+        for (auto& task : due) {
+            task->finish(std::string());
+        }
+        lock.lock();
+    }
+}
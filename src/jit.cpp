@@ -1,290 +1,1073 @@
 #include "include/jit.h"
 #include "include/interpreter.h"
+#include "include/metrics.h"
 #include "include/operators.h"
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/BasicBlock.h>
-#include <llvm/ExecutionEngine/ExecutionEngine.h>
-#include <llvm/ExecutionEngine/MCJIT.h>
-#include <llvm/Support/TargetSelect.h>
-#include <llvm/MC/TargetRegistry.h>
-#include <llvm/Support/ManagedStatic.h>
 #include <llvm/IR/Verifier.h>
-#include <iostream>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/xxhash.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
 
 namespace l = llvm;
 
+namespace {
+
+// Static type of a compiled value. Variables are int or float; bool only
+// appears as the result of comparisons and logical operators.
+enum class Kind { Int, Float, Bool };
+
+enum class State { Counting, Compiling, Compiled, Failed };
+
+// Thrown while generating code for something the JIT does not handle
+class NotCompilable : public std::runtime_error {
+public:
+    explicit NotCompilable(const std::string &what) : std::runtime_error(what) {}
+};
+
+bool kindOfType(const std::string &type, Kind &kind)
+{
+    if (type == "int") { kind = Kind::Int; return true; }
+    if (type == "float") { kind = Kind::Float; return true; }
+    return false;
+}
+
+bool kindOfType(const TypeDescriptor *type, Kind &kind)
+{
+    if (type->kind == TypeDescriptor::Kind::Int) { kind = Kind::Int; return true; }
+    if (type->kind == TypeDescriptor::Kind::Float) { kind = Kind::Float; return true; }
+    return false;
+}
+
+bool kindOfValue(const Value &v, Kind &kind)
+{
+    if (std::holds_alternative<int>(v)) { kind = Kind::Int; return true; }
+    if (std::holds_alternative<float>(v)) { kind = Kind::Float; return true; }
+    return false;
+}
+
+// Values cross into native code as 8-byte cells holding an int or a float
+uint64_t toCell(const Value &v)
+{
+    uint64_t cell = 0;
+    if (std::holds_alternative<int>(v)) {
+        int i = std::get<int>(v);
+        std::memcpy(&cell, &i, sizeof i);
+    } else {
+        float f = std::get<float>(v);
+        std::memcpy(&cell, &f, sizeof f);
+    }
+    return cell;
+}
+
+Value fromCell(uint64_t cell, Kind kind)
+{
+    if (kind == Kind::Float) {
+        float f;
+        std::memcpy(&f, &cell, sizeof f);
+        return f;
+    }
+    int i;
+    std::memcpy(&i, &cell, sizeof i);
+    return i;
+}
+
+using NativeEntry = bool (*)(uint64_t *cells);
+using Callees = std::vector<std::pair<std::string, FunctionDeclaration *>>;
+
+struct FunctionEntry {
+    State state = State::Counting;
+    unsigned calls = 0;
+    std::string symbol;       // native function called by other compiled code
+    std::vector<Kind> params;
+    Kind result = Kind::Int;
+    NativeEntry entry = nullptr;  // cells[0..n) arguments, cells[n] result
+    Callees callees;          // every function the native code calls, by the name it was bound to
+};
+
+struct LoopEntry {
+    State state = State::Counting;
+    NativeEntry entry = nullptr;  // one cell per variable, written back on success
+    std::vector<std::string> vars;
+    std::vector<Kind> kinds;
+    Callees callees;
+};
+
+// Object files on disk, named by the key each module carries as its identifier
+class DiskCache : public l::ObjectCache {
+public:
+    explicit DiskCache(std::string dir) : dir(std::move(dir)) {}
+
+    bool contains(const std::string &key) const
+    {
+        std::error_code ec;
+        return std::filesystem::exists(path(key), ec);
+    }
+
+    void notifyObjectCompiled(const l::Module *module, l::MemoryBufferRef object) override
+    {
+        // Concurrent runs may store the same key: write aside, then rename into place
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        std::string target = path(module->getModuleIdentifier());
+        std::string temp = target + ".tmp" + std::to_string(l::sys::Process::getProcessId());
+        {
+            std::ofstream out(temp, std::ios::binary);
+            out.write(object.getBufferStart(), object.getBufferSize());
+            if (!out) {
+                std::filesystem::remove(temp, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(temp, target, ec);
+        if (ec) std::filesystem::remove(temp, ec);
+    }
+
+    std::unique_ptr<l::MemoryBuffer> getObject(const l::Module *module) override
+    {
+        auto buffer = l::MemoryBuffer::getFile(path(module->getModuleIdentifier()));
+        if (!buffer) return nullptr;
+        return std::move(*buffer);
+    }
+
+private:
+    std::string dir;
+
+    std::string path(const std::string &key) const { return dir + "/" + key + ".o"; }
+};
+
+} // namespace
+
 class LLVMJITCompiler::Impl {
 public:
-    Impl() {
-        l::InitializeNativeTarget();
-        l::InitializeNativeTargetAsmPrinter();
-        l::InitializeNativeTargetDisassembler();
+    class Codegen;
+
+    std::mutex mutex;
+    std::unique_ptr<l::orc::LLJIT> jit;  // created on first compile
+    bool unavailable = false;
+    std::unique_ptr<DiskCache> cache;
+    std::string cacheSalt;  // host, CPU and entry script parts of every cache key
+    unsigned nextSymbol = 0;
+    std::unordered_map<const FunctionDeclaration *, FunctionEntry> functions;
+    std::unordered_map<const ASTNode *, LoopEntry> loops;
+
+    bool ensureJIT();
+    void compileFunction(FunctionDeclaration *func, Interpreter &interp);
+    void compileLoop(const ASTNode *node, Expression *condition, Expression *update, Block *body,
+                     Interpreter &interp);
+    bool runLoop(const ASTNode *node, Expression *condition, Expression *update, Block *body,
+                 unsigned iterations, Interpreter &interp);
+    NativeEntry lookup(const std::string &symbol);
+    std::string cacheKey(const std::string &ir, const Interpreter &interp) const;
+
+    static bool calleesUnchanged(const Callees &callees, Interpreter &interp);
+};
+
+// Generates one LLVM module: the function or loop being tiered up plus any
+// callees that are not compiled yet.
+class LLVMJITCompiler::Impl::Codegen {
+public:
+    Codegen(Impl &impl, Interpreter &interp)
+        : impl(impl), interp(interp), ctx(std::make_unique<l::LLVMContext>()),
+          module(std::make_unique<l::Module>("axolotl_jit", *ctx)), builder(*ctx)
+    {
+        module->setDataLayout(impl.jit->getDataLayout());
+        module->setTargetTriple(impl.jit->getTargetTriple().str());
     }
+
+    // Functions marked Compiling by this module, in the order they were reached
+    std::vector<FunctionDeclaration *> pending;
+    Callees callees;
+
+    l::Function *declareFunction(FunctionDeclaration *func);
+    void generatePending();
+    void generateFunction(FunctionDeclaration *func);
+    std::string generateLoop(Expression *condition, Expression *update, Block *body, LoopEntry &loop,
+                             Environment &env);
+    bool finish();
+
+private:
+    bool addModule();
+
+    struct Typed {
+        l::Value *value;
+        Kind kind;
+    };
+
+    struct Var {
+        l::AllocaInst *slot;
+        Kind kind;
+    };
+
+    struct LoopTargets {
+        l::BasicBlock *breakTo;
+        l::BasicBlock *continueTo;
+    };
+
+    // State of the native function currently being generated
+    struct Frame {
+        l::Function *fn = nullptr;
+        l::BasicBlock *entry = nullptr;
+        l::BasicBlock *deopt = nullptr;
+        std::vector<std::unordered_map<std::string, Var>> scopes;
+        std::vector<LoopTargets> loops;
+        bool isFunction = false;
+        Kind result = Kind::Int;
+        l::Value *out = nullptr;
+        // Loop mode: variables read from the interpreter on entry
+        Environment *env = nullptr;
+        LoopEntry *loop = nullptr;
+        l::Value *cells = nullptr;
+        std::vector<Var> outer;
+    };
+
+    Impl &impl;
+    Interpreter &interp;
+    std::unique_ptr<l::LLVMContext> ctx;
+    std::unique_ptr<l::Module> module;
+    l::IRBuilder<> builder;
+    Frame frame;
+
+    l::Type *typeOf(Kind kind);
+    l::FunctionType *signature(const FunctionEntry &entry);
+    void generateEntry(const FunctionEntry &entry, l::Function *fn);
+
+    l::AllocaInst *allocate(Kind kind, const std::string &name);
+    Var lookupVar(const std::string &name);
+    void startBlock(const char *name);
+    bool terminated();
+
+    void genBlock(Block *block);
+    void genStatement(ASTNode *node);
+    void genLoop(Expression *condition, Expression *update, Block *body, l::BasicBlock *exit);
+    Typed genExpression(Expression *expr);
+    Typed genBinary(BinaryOp *node);
+    Typed genCall(FunctionCall *call);
+    l::Value *truthy(const Typed &v);
+    void guardDivisor(l::Value *lhs, l::Value *rhs);
 };
 
-LLVMJITCompiler::LLVMJITCompiler() : impl(std::make_unique<Impl>()) {}
-LLVMJITCompiler::~LLVMJITCompiler() = default;
+l::Type *LLVMJITCompiler::Impl::Codegen::typeOf(Kind kind)
+{
+    switch (kind) {
+        case Kind::Int: return l::Type::getInt32Ty(*ctx);
+        case Kind::Float: return l::Type::getFloatTy(*ctx);
+        case Kind::Bool: return l::Type::getInt1Ty(*ctx);
+    }
+    return nullptr;
+}
 
-// Minimal pattern matcher: recognize condition of form `id < INT` and body
-// containing `sum = sum + 1; i = i + 1;` (or increments by constants).
-static bool matchConditionAsIdLtInt(Expression* cond, std::string &idName, int &limit) {
-    if (!cond) return false;
-    auto bin = dynamic_cast<BinaryOp*>(cond);
-    if (!bin) return false;
-    if (bin->op != BinaryOperator::LESS) return false;
-    auto lhsId = dynamic_cast<Identifier*>(bin->left.get());
-    auto rhsInt = dynamic_cast<IntegerLiteral*>(bin->right.get());
-    if (lhsId && rhsInt) {
-        idName = lhsId->name;
-        limit = rhsInt->value;
-        return true;
-    }
-    // support reversed (INT > id)
-    auto lhsInt = dynamic_cast<IntegerLiteral*>(bin->left.get());
-    auto rhsId = dynamic_cast<Identifier*>(bin->right.get());
-    if (lhsInt && rhsId) {
-        idName = rhsId->name;
-        limit = lhsInt->value;
-        return true;
+// Native functions take their parameters by value plus a pointer for the
+// result, and return false when a guard failed
+l::FunctionType *LLVMJITCompiler::Impl::Codegen::signature(const FunctionEntry &entry)
+{
+    std::vector<l::Type *> params;
+    for (Kind kind : entry.params) {
+        params.push_back(typeOf(kind));
     }
-    return false;
+    params.push_back(typeOf(entry.result)->getPointerTo());
+    return l::FunctionType::get(l::Type::getInt1Ty(*ctx), params, false);
 }
 
-// Match increment assignment: id = id + CONST (CONST can be 1)
-static bool matchIncrement(ASTNode* node, std::string &targetId, int &inc) {
-    if (!node) return false;
-    
-    // Try ExpressionStatement first
-    if (auto exprStmt = dynamic_cast<ExpressionStatement*>(node)) {
-        if (auto assign = dynamic_cast<Assignment*>(exprStmt->expression.get())) {
-            targetId = assign->name;
-            auto bin = dynamic_cast<BinaryOp*>(assign->value.get());
-            if (!bin || bin->op != BinaryOperator::ADD) return false;
-            
-            auto leftId = dynamic_cast<Identifier*>(bin->left.get());
-            auto rightInt = dynamic_cast<IntegerLiteral*>(bin->right.get());
-            if (leftId && rightInt && leftId->name == targetId) {
-                inc = rightInt->value;
-                return true;
+l::Function *LLVMJITCompiler::Impl::Codegen::declareFunction(FunctionDeclaration *func)
+{
+    FunctionEntry &entry = impl.functions[func];
+    if (entry.state == State::Failed) {
+        throw NotCompilable("calls a function that cannot be compiled");
+    }
+    if (entry.state == State::Counting) {
+        std::vector<Kind> params;
+        for (auto &param : func->params) {
+            Kind kind;
+            if (!kindOfType(param.second, kind)) {
+                entry.state = State::Failed;
+                throw NotCompilable("parameter '" + param.first + "' is not int or float");
             }
+            params.push_back(kind);
         }
-    }
-    
-    // Try direct Assignment
-    if (auto assign = dynamic_cast<Assignment*>(node)) {
-        targetId = assign->name;
-        auto bin = dynamic_cast<BinaryOp*>(assign->value.get());
-        if (!bin || bin->op != BinaryOperator::ADD) return false;
-        
-        auto leftId = dynamic_cast<Identifier*>(bin->left.get());
-        auto rightInt = dynamic_cast<IntegerLiteral*>(bin->right.get());
-        if (leftId && rightInt && leftId->name == targetId) {
-            inc = rightInt->value;
-            return true;
+        if (!kindOfType(func->returnType, entry.result)) {
+            entry.state = State::Failed;
+            throw NotCompilable("return type is not int or float");
         }
+        entry.params = std::move(params);
+        entry.symbol = "ax_fn_" + std::to_string(impl.nextSymbol++);
+        entry.state = State::Compiling;
+        pending.push_back(func);
     }
-    
-    return false;
+    // Compiled functions live in earlier modules; ORC resolves the declaration
+    if (l::Function *fn = module->getFunction(entry.symbol)) {
+        return fn;
+    }
+    if (entry.state == State::Compiled) {
+        callees.insert(callees.end(), entry.callees.begin(), entry.callees.end());
+    }
+    return l::Function::Create(signature(entry), l::Function::ExternalLinkage, entry.symbol, module.get());
 }
 
-bool LLVMJITCompiler::isCompilable(WhileStatement *stmt) {
-    if (!stmt) return false;
-    // Expect condition id < int
-    std::string condId; int limit;
-    if (!matchConditionAsIdLtInt(stmt->condition.get(), condId, limit)) return false;
-    // Expect body with two increments
-    if (!stmt->body) return false;
-    if (stmt->body->statements.size() < 1) return false;
-    // Conservative: require at least one increment statement
-    bool foundInc = false;
-    for (auto &s : stmt->body->statements) {
-        std::string id; int inc;
-        if (matchIncrement(s.get(), id, inc)) foundInc = true;
-    }
-    return foundInc;
-}
-
-// Compile the simple loop and execute. Returns true if JIT handled it.
-bool LLVMJITCompiler::compileAndExecute(WhileStatement *stmt, Interpreter *interp, Environment &env) {
-    // Only support pattern with two integer variables (e.g., sum and i)
-    std::string loopId; int limit;
-    if (!matchConditionAsIdLtInt(stmt->condition.get(), loopId, limit)) return false;
-
-    // Find increments and capture variable names and increments
-    std::vector<std::pair<std::string,int>> increments;
-    for (auto &s : stmt->body->statements) {
-        std::string id; int inc;
-        if (matchIncrement(s.get(), id, inc)) {
-            increments.emplace_back(id, inc);
+void LLVMJITCompiler::Impl::Codegen::generatePending()
+{
+    // Bodies are generated one after the other; calls only declare
+    for (size_t i = 0; i < pending.size(); ++i) {
+        FunctionDeclaration *func = pending[i];
+        try {
+            generateFunction(func);
+        } catch (const NotCompilable &) {
+            impl.functions[func].state = State::Failed;
+            throw;
         }
     }
-    if (increments.empty()) return false;
+}
+
+void LLVMJITCompiler::Impl::Codegen::generateFunction(FunctionDeclaration *func)
+{
+    FunctionEntry &entry = impl.functions[func];
+    frame = Frame();
+    frame.fn = module->getFunction(entry.symbol);
+    frame.isFunction = true;
+    frame.result = entry.result;
+    frame.entry = l::BasicBlock::Create(*ctx, "entry", frame.fn);
+    frame.deopt = l::BasicBlock::Create(*ctx, "deopt", frame.fn);
+    l::BasicBlock *body = l::BasicBlock::Create(*ctx, "body", frame.fn);
+
+    builder.SetInsertPoint(frame.deopt);
+    builder.CreateRet(builder.getFalse());
+    builder.SetInsertPoint(frame.entry);
+    builder.CreateBr(body);
+    builder.SetInsertPoint(body);
 
-    // For simplicity, find two variables: loop counter (loopId) and one other (e.g., sum)
-    std::string otherId = "";
-    for (auto &p : increments) {
-        if (p.first != loopId) { otherId = p.first; break; }
+    // Parameters: the interpreter pushes one scope for them, then the body's
+    frame.scopes.emplace_back();
+    auto arg = frame.fn->arg_begin();
+    for (size_t i = 0; i < func->params.size(); ++i, ++arg) {
+        Var var{allocate(entry.params[i], func->params[i].first), entry.params[i]};
+        builder.CreateStore(&*arg, var.slot);
+        frame.scopes.back()[func->params[i].first] = var;
     }
+    frame.out = &*arg;
 
-    // Retrieve current values from environment
-    int loopVal = 0;
-    int otherVal = 0;
-    try {
-        Variable lv = env.get(loopId);
-        if (std::holds_alternative<int>(lv.value)) loopVal = std::get<int>(lv.value);
-        if (!otherId.empty()) {
-            Variable ov = env.get(otherId);
-            if (std::holds_alternative<int>(ov.value)) otherVal = std::get<int>(ov.value);
-        }
-    } catch (...) {
+    genBlock(func->body.get());
+    // Falling off the end returns an empty string, which only the interpreter can produce
+    if (!terminated()) {
+        builder.CreateBr(frame.deopt);
+    }
+    generateEntry(entry, frame.fn);
+}
+
+// Uniform entry point for the interpreter: arguments and result in cells
+void LLVMJITCompiler::Impl::Codegen::generateEntry(const FunctionEntry &entry, l::Function *target)
+{
+    l::Type *i64 = l::Type::getInt64Ty(*ctx);
+    auto type = l::FunctionType::get(l::Type::getInt1Ty(*ctx), {l::Type::getInt64PtrTy(*ctx)}, false);
+    auto fn = l::Function::Create(type, l::Function::ExternalLinkage, entry.symbol + "_entry", module.get());
+    l::Value *cells = &*fn->arg_begin();
+    builder.SetInsertPoint(l::BasicBlock::Create(*ctx, "entry", fn));
+
+    std::vector<l::Value *> args;
+    for (size_t i = 0; i < entry.params.size(); ++i) {
+        l::Value *cell = builder.CreateGEP(i64, cells, builder.getInt64(i));
+        l::Type *type = typeOf(entry.params[i]);
+        args.push_back(builder.CreateLoad(type, builder.CreateBitCast(cell, type->getPointerTo())));
+    }
+    l::Value *out = builder.CreateGEP(i64, cells, builder.getInt64(entry.params.size()));
+    args.push_back(builder.CreateBitCast(out, typeOf(entry.result)->getPointerTo()));
+    builder.CreateRet(builder.CreateCall(target, args));
+}
+
+std::string LLVMJITCompiler::Impl::Codegen::generateLoop(Expression *condition, Expression *update, Block *body,
+                                                         LoopEntry &loop, Environment &env)
+{
+    std::string symbol = "ax_loop_" + std::to_string(impl.nextSymbol++);
+    auto type = l::FunctionType::get(l::Type::getInt1Ty(*ctx), {l::Type::getInt64PtrTy(*ctx)}, false);
+    frame = Frame();
+    frame.fn = l::Function::Create(type, l::Function::ExternalLinkage, symbol, module.get());
+    frame.env = &env;
+    frame.loop = &loop;
+    frame.cells = &*frame.fn->arg_begin();
+    frame.entry = l::BasicBlock::Create(*ctx, "entry", frame.fn);
+    frame.deopt = l::BasicBlock::Create(*ctx, "deopt", frame.fn);
+    l::BasicBlock *start = l::BasicBlock::Create(*ctx, "start", frame.fn);
+    l::BasicBlock *exit = l::BasicBlock::Create(*ctx, "exit", frame.fn);
+
+    builder.SetInsertPoint(frame.deopt);
+    builder.CreateRet(builder.getFalse());
+    builder.SetInsertPoint(frame.entry);
+    builder.CreateBr(start);
+    builder.SetInsertPoint(start);
+
+    // Outermost scope: the interpreter's variables, loaded on first use
+    frame.scopes.emplace_back();
+    genLoop(condition, update, body, exit);
+
+    // Write every variable back only once the loop has finished natively
+    builder.SetInsertPoint(exit);
+    l::Type *i64 = l::Type::getInt64Ty(*ctx);
+    for (size_t i = 0; i < frame.outer.size(); ++i) {
+        l::Type *type = typeOf(frame.outer[i].kind);
+        l::Value *cell = builder.CreateGEP(i64, frame.cells, builder.getInt64(i));
+        builder.CreateStore(builder.CreateLoad(type, frame.outer[i].slot),
+                            builder.CreateBitCast(cell, type->getPointerTo()));
+    }
+    builder.CreateRet(builder.getTrue());
+    return symbol;
+}
+
+bool LLVMJITCompiler::Impl::Codegen::finish()
+{
+    if (l::verifyModule(*module, &l::errs())) {
         return false;
     }
 
-    // Build LLVM IR
-    l::LLVMContext context;
-    std::unique_ptr<l::Module> module = std::make_unique<l::Module>("axolotl_jit_mod", context);
-    l::IRBuilder<> builder(context);
-
-    // Define function: void fn(int64_t* other_ptr, int64_t* loop_ptr)
-    l::Type *i64 = l::Type::getInt64Ty(context);
-    l::Type *i64ptr = l::PointerType::get(context, 0);
-    l::FunctionType *ft = l::FunctionType::get(l::Type::getVoidTy(context), {i64ptr, i64ptr}, false);
-    l::Function *fn = l::Function::Create(ft, l::Function::ExternalLinkage, "ax_loop", module.get());
-    auto argsIt = fn->arg_begin();
-    l::Argument *argOther = &*argsIt++;
-    argOther->setName("other_ptr");
-    l::Argument *argLoop = &*argsIt++;
-    argLoop->setName("loop_ptr");
-
-    l::BasicBlock *entry = l::BasicBlock::Create(context, "entry", fn);
-    l::BasicBlock *loopBB = l::BasicBlock::Create(context, "loop", fn);
-    l::BasicBlock *afterBB = l::BasicBlock::Create(context, "after", fn);
-
-    builder.SetInsertPoint(entry);
-    // Load loop variable
-    l::Value *loopLoad = builder.CreateLoad(i64, argLoop);
-    l::Value *limitVal = l::ConstantInt::get(i64, limit);
-    l::Value *cmp = builder.CreateICmpSLT(loopLoad, limitVal);
-    builder.CreateCondBr(cmp, loopBB, afterBB);
-
-    // loop body
-    builder.SetInsertPoint(loopBB);
-    // perform increments: other += inc where applicable
-    if (!otherId.empty()) {
-        // load other
-        l::Value *otherLoad = builder.CreateLoad(i64, argOther);
-        // find increment amount for other
-        int otherInc = 0;
-        for (auto &p : increments) if (p.first == otherId) otherInc = p.second;
-        l::Value *otherAdd = builder.CreateAdd(otherLoad, l::ConstantInt::get(i64, otherInc));
-        builder.CreateStore(otherAdd, argOther);
-    }
-    // increment loop variable
-    l::Value *loopLoad2 = builder.CreateLoad(i64, argLoop);
-    int loopInc = 1;
-    for (auto &p : increments) if (p.first == loopId) loopInc = p.second;
-    l::Value *loopAdd = builder.CreateAdd(loopLoad2, l::ConstantInt::get(i64, loopInc));
-    builder.CreateStore(loopAdd, argLoop);
-    // compare and branch
-    l::Value *loopLoad3 = builder.CreateLoad(i64, argLoop);
-    l::Value *cmp2 = builder.CreateICmpSLT(loopLoad3, limitVal);
-    builder.CreateCondBr(cmp2, loopBB, afterBB);
-
-    builder.SetInsertPoint(afterBB);
-    builder.CreateRetVoid();
-
-    // Verify
-    if (l::verifyFunction(*fn, &l::errs())) {
+    // Cached objects are found by the module identifier; a hit skips both the
+    // pipeline below and code generation
+    if (impl.cache) {
+        std::string ir;
+        l::raw_string_ostream os(ir);
+        module->print(os, nullptr);
+        os.flush();
+        module->setModuleIdentifier(impl.cacheKey(ir, interp));
+        if (impl.cache->contains(module->getModuleIdentifier())) {
+            return addModule();
+        }
+    }
+
+    l::LoopAnalysisManager lam;
+    l::FunctionAnalysisManager fam;
+    l::CGSCCAnalysisManager cgam;
+    l::ModuleAnalysisManager mam;
+    l::PassBuilder passes;
+    passes.registerModuleAnalyses(mam);
+    passes.registerCGSCCAnalyses(cgam);
+    passes.registerFunctionAnalyses(fam);
+    passes.registerLoopAnalyses(lam);
+    passes.crossRegisterProxies(lam, fam, cgam, mam);
+    passes.buildPerModuleDefaultPipeline(l::OptimizationLevel::O2).run(*module, mam);
+    return addModule();
+}
+
+bool LLVMJITCompiler::Impl::Codegen::addModule()
+{
+    if (auto err = impl.jit->addIRModule(l::orc::ThreadSafeModule(std::move(module), std::move(ctx)))) {
+        l::consumeError(std::move(err));
         return false;
     }
+    return true;
+}
 
-    // Skip JIT for now - use fast calculation instead
-    int iterations = limit - loopVal;
-    if (iterations <= 0) return true;
-    
-    // Update variables directly
-    for (auto &p : increments) {
-        try {
-            if (p.first == loopId) {
-                env.set(loopId, loopVal + (p.second * iterations));
-            } else {
-                Variable var = env.get(p.first);
-                if (std::holds_alternative<int>(var.value)) {
-                    int currentVal = std::get<int>(var.value);
-                    env.set(p.first, currentVal + (p.second * iterations));
-                }
+l::AllocaInst *LLVMJITCompiler::Impl::Codegen::allocate(Kind kind, const std::string &name)
+{
+    // Allocas go in the entry block so mem2reg can promote them
+    l::IRBuilder<> entry(frame.entry, frame.entry->getFirstInsertionPt());
+    return entry.CreateAlloca(typeOf(kind), nullptr, name);
+}
+
+LLVMJITCompiler::Impl::Codegen::Var LLVMJITCompiler::Impl::Codegen::lookupVar(const std::string &name)
+{
+    for (auto scope = frame.scopes.rbegin(); scope != frame.scopes.rend(); ++scope) {
+        auto found = scope->find(name);
+        if (found != scope->end()) {
+            return found->second;
+        }
+    }
+    if (frame.isFunction) {
+        // Free names are resolved through the callers' scopes at runtime
+        throw NotCompilable("'" + name + "' is not a local");
+    }
+
+    // A variable of the interpreter: loaded from its cell on entry
+    Variable *var = frame.env->find(name);
+    Kind declared, actual;
+    if (!var || !kindOfType(var->type, declared) || !kindOfValue(var->value, actual) || declared != actual) {
+        throw NotCompilable("'" + name + "' is not an int or float variable");
+    }
+    l::IRBuilder<> entry(frame.entry->getTerminator());
+    l::Type *type = typeOf(actual);
+    l::Value *cell = entry.CreateGEP(l::Type::getInt64Ty(*ctx), frame.cells, entry.getInt64(frame.outer.size()));
+    Var result{allocate(actual, name), actual};
+    entry.CreateStore(entry.CreateLoad(type, entry.CreateBitCast(cell, type->getPointerTo())), result.slot);
+
+    frame.outer.push_back(result);
+    frame.loop->vars.push_back(name);
+    frame.loop->kinds.push_back(actual);
+    frame.scopes.front()[name] = result;
+    return result;
+}
+
+// Continue in a fresh block, e.g. after a return or break; code placed there
+// is unreachable and removed by the optimizer
+void LLVMJITCompiler::Impl::Codegen::startBlock(const char *name)
+{
+    builder.SetInsertPoint(l::BasicBlock::Create(*ctx, name, frame.fn));
+}
+
+bool LLVMJITCompiler::Impl::Codegen::terminated()
+{
+    return builder.GetInsertBlock()->getTerminator() != nullptr;
+}
+
+void LLVMJITCompiler::Impl::Codegen::genBlock(Block *block)
+{
+    if (!block) return;
+    frame.scopes.emplace_back();
+    for (auto &stmt : block->statements) {
+        genStatement(stmt.get());
+    }
+    frame.scopes.pop_back();
+}
+
+void LLVMJITCompiler::Impl::Codegen::genStatement(ASTNode *node)
+{
+    if (auto expr = dynamic_cast<Expression *>(node)) {
+        genExpression(expr);
+    } else if (auto stmt = dynamic_cast<ExpressionStatement *>(node)) {
+        genExpression(stmt->expression.get());
+    } else if (auto decl = dynamic_cast<VariableDeclaration *>(node)) {
+        Kind declared;
+        if (!kindOfType(decl->type, declared)) {
+            throw NotCompilable("'" + decl->name + "' is not declared int or float");
+        }
+        // Without an initializer the interpreter stores int 0 whatever the declared type
+        Typed init{builder.getInt32(0), Kind::Int};
+        if (decl->initializer) {
+            init = genExpression(decl->initializer.get());
+            if (init.kind != declared) {
+                throw NotCompilable("initializer of '" + decl->name + "' does not match its type");
             }
-        } catch (...) {}
+        }
+        Var var{allocate(init.kind, decl->name), init.kind};
+        builder.CreateStore(init.value, var.slot);
+        frame.scopes.back()[decl->name] = var;
+    } else if (auto block = dynamic_cast<Block *>(node)) {
+        genBlock(block);
+    } else if (auto stmt = dynamic_cast<IfStatement *>(node)) {
+        l::Value *cond = truthy(genExpression(stmt->condition.get()));
+        auto thenBB = l::BasicBlock::Create(*ctx, "then", frame.fn);
+        auto elseBB = l::BasicBlock::Create(*ctx, "else", frame.fn);
+        auto mergeBB = l::BasicBlock::Create(*ctx, "endif", frame.fn);
+        builder.CreateCondBr(cond, thenBB, elseBB);
+        builder.SetInsertPoint(thenBB);
+        genBlock(stmt->thenBlock.get());
+        if (!terminated()) builder.CreateBr(mergeBB);
+        builder.SetInsertPoint(elseBB);
+        genBlock(stmt->elseBlock.get());
+        if (!terminated()) builder.CreateBr(mergeBB);
+        builder.SetInsertPoint(mergeBB);
+    } else if (auto stmt = dynamic_cast<WhileStatement *>(node)) {
+        auto exit = l::BasicBlock::Create(*ctx, "endwhile", frame.fn);
+        genLoop(stmt->condition.get(), nullptr, stmt->body.get(), exit);
+        builder.SetInsertPoint(exit);
+    } else if (auto stmt = dynamic_cast<ForStatement *>(node)) {
+        if (!stmt->condition || !stmt->update) {
+            throw NotCompilable("for loop without condition or update");
+        }
+        frame.scopes.emplace_back();
+        if (stmt->init) genStatement(stmt->init.get());
+        auto exit = l::BasicBlock::Create(*ctx, "endfor", frame.fn);
+        genLoop(stmt->condition.get(), stmt->update.get(), stmt->body.get(), exit);
+        builder.SetInsertPoint(exit);
+        frame.scopes.pop_back();
+    } else if (auto stmt = dynamic_cast<ReturnStatement *>(node)) {
+        if (!frame.isFunction) {
+            throw NotCompilable("return inside a loop");
+        }
+        Typed value{builder.getInt32(0), Kind::Int};
+        if (stmt->value) value = genExpression(stmt->value.get());
+        if (value.kind != frame.result) {
+            throw NotCompilable("returned value does not match the return type");
+        }
+        builder.CreateStore(value.value, frame.out);
+        builder.CreateRet(builder.getTrue());
+        startBlock("after.return");
+    } else if (dynamic_cast<BreakStatement *>(node) || dynamic_cast<ContinueStatement *>(node)) {
+        if (frame.loops.empty()) {
+            throw NotCompilable("break or continue outside a loop");
+        }
+        bool isBreak = dynamic_cast<BreakStatement *>(node) != nullptr;
+        builder.CreateBr(isBreak ? frame.loops.back().breakTo : frame.loops.back().continueTo);
+        startBlock("after.jump");
+    } else {
+        throw NotCompilable("unsupported statement");
+    }
+}
+
+// Condition at the top, body, then the update (for loops) and back again.
+// Leaves the builder in the body's last block; callers continue at `exit`.
+void LLVMJITCompiler::Impl::Codegen::genLoop(Expression *condition, Expression *update, Block *body,
+                                             l::BasicBlock *exit)
+{
+    auto condBB = l::BasicBlock::Create(*ctx, "loop.cond", frame.fn);
+    auto bodyBB = l::BasicBlock::Create(*ctx, "loop.body", frame.fn);
+    auto nextBB = update ? l::BasicBlock::Create(*ctx, "loop.update", frame.fn) : condBB;
+
+    builder.CreateBr(condBB);
+    builder.SetInsertPoint(condBB);
+    builder.CreateCondBr(truthy(genExpression(condition)), bodyBB, exit);
+
+    builder.SetInsertPoint(bodyBB);
+    frame.loops.push_back({exit, nextBB});
+    genBlock(body);
+    frame.loops.pop_back();
+    if (!terminated()) builder.CreateBr(nextBB);
+
+    if (update) {
+        builder.SetInsertPoint(nextBB);
+        genExpression(update);
+        builder.CreateBr(condBB);
+    }
+}
+
+LLVMJITCompiler::Impl::Codegen::Typed LLVMJITCompiler::Impl::Codegen::genExpression(Expression *expr)
+{
+    if (auto lit = dynamic_cast<IntegerLiteral *>(expr)) {
+        return {builder.getInt32(lit->value), Kind::Int};
+    }
+    if (auto lit = dynamic_cast<FloatLiteral *>(expr)) {
+        return {l::ConstantFP::get(typeOf(Kind::Float), lit->value), Kind::Float};
+    }
+    if (auto lit = dynamic_cast<BooleanLiteral *>(expr)) {
+        return {builder.getInt1(lit->value), Kind::Bool};
+    }
+    if (auto id = dynamic_cast<Identifier *>(expr)) {
+        Var var = lookupVar(id->name);
+        return {builder.CreateLoad(typeOf(var.kind), var.slot, id->name), var.kind};
+    }
+    if (auto assign = dynamic_cast<Assignment *>(expr)) {
+        Typed value = genExpression(assign->value.get());
+        Var var = lookupVar(assign->name);
+        if (value.kind != var.kind) {
+            throw NotCompilable("assignment changes the type of '" + assign->name + "'");
+        }
+        builder.CreateStore(value.value, var.slot);
+        return value;
+    }
+    if (auto un = dynamic_cast<UnaryOp *>(expr)) {
+        Typed operand = genExpression(un->operand.get());
+        if (un->op == UnaryOperator::LOGICAL_NOT) {
+            return {builder.CreateNot(truthy(operand)), Kind::Bool};
+        }
+        if (un->op == UnaryOperator::NEGATE && operand.kind == Kind::Int) {
+            return {builder.CreateNeg(operand.value), Kind::Int};
+        }
+        if (un->op == UnaryOperator::NEGATE && operand.kind == Kind::Float) {
+            return {builder.CreateFNeg(operand.value), Kind::Float};
+        }
+        throw NotCompilable("unsupported unary operator");
+    }
+    if (auto bin = dynamic_cast<BinaryOp *>(expr)) {
+        return genBinary(bin);
+    }
+    if (auto call = dynamic_cast<FunctionCall *>(expr)) {
+        return genCall(call);
+    }
+    throw NotCompilable("unsupported expression");
+}
+
+// Mirrors Interpreter::performBinaryOp for the int/int, float/float and
+// logical cases. Anything else (mixed operands concatenate or throw) is left
+// to the interpreter.
+LLVMJITCompiler::Impl::Codegen::Typed LLVMJITCompiler::Impl::Codegen::genBinary(BinaryOp *node)
+{
+    // Both operands are always evaluated, as in the interpreter
+    Typed lhs = genExpression(node->left.get());
+    Typed rhs = genExpression(node->right.get());
+
+    if (node->op == BinaryOperator::LOGICAL_AND) {
+        return {builder.CreateAnd(truthy(lhs), truthy(rhs)), Kind::Bool};
+    }
+    if (node->op == BinaryOperator::LOGICAL_OR) {
+        return {builder.CreateOr(truthy(lhs), truthy(rhs)), Kind::Bool};
+    }
+    if (lhs.kind != rhs.kind) {
+        throw NotCompilable("mixed operand types");
     }
-    
+
+    l::Value *l = lhs.value;
+    l::Value *r = rhs.value;
+    if (lhs.kind == Kind::Int) {
+        switch (node->op) {
+            case BinaryOperator::ADD: return {builder.CreateAdd(l, r), Kind::Int};
+            case BinaryOperator::SUBTRACT: return {builder.CreateSub(l, r), Kind::Int};
+            case BinaryOperator::MULTIPLY: return {builder.CreateMul(l, r), Kind::Int};
+            case BinaryOperator::DIVIDE: guardDivisor(l, r); return {builder.CreateSDiv(l, r), Kind::Int};
+            case BinaryOperator::MODULO: guardDivisor(l, r); return {builder.CreateSRem(l, r), Kind::Int};
+            case BinaryOperator::LESS: return {builder.CreateICmpSLT(l, r), Kind::Bool};
+            case BinaryOperator::GREATER: return {builder.CreateICmpSGT(l, r), Kind::Bool};
+            case BinaryOperator::LESS_EQUAL: return {builder.CreateICmpSLE(l, r), Kind::Bool};
+            case BinaryOperator::GREATER_EQUAL: return {builder.CreateICmpSGE(l, r), Kind::Bool};
+            case BinaryOperator::EQUAL: return {builder.CreateICmpEQ(l, r), Kind::Bool};
+            case BinaryOperator::NOT_EQUAL: return {builder.CreateICmpNE(l, r), Kind::Bool};
+            default: break;
+        }
+    } else if (lhs.kind == Kind::Float) {
+        switch (node->op) {
+            case BinaryOperator::ADD: return {builder.CreateFAdd(l, r), Kind::Float};
+            case BinaryOperator::SUBTRACT: return {builder.CreateFSub(l, r), Kind::Float};
+            case BinaryOperator::MULTIPLY: return {builder.CreateFMul(l, r), Kind::Float};
+            case BinaryOperator::DIVIDE: return {builder.CreateFDiv(l, r), Kind::Float};
+            case BinaryOperator::LESS: return {builder.CreateFCmpOLT(l, r), Kind::Bool};
+            case BinaryOperator::GREATER: return {builder.CreateFCmpOGT(l, r), Kind::Bool};
+            case BinaryOperator::LESS_EQUAL: return {builder.CreateFCmpOLE(l, r), Kind::Bool};
+            case BinaryOperator::GREATER_EQUAL: return {builder.CreateFCmpOGE(l, r), Kind::Bool};
+            case BinaryOperator::EQUAL: return {builder.CreateFCmpOEQ(l, r), Kind::Bool};
+            case BinaryOperator::NOT_EQUAL: return {builder.CreateFCmpUNE(l, r), Kind::Bool};
+            default: break;
+        }
+    } else {
+        // bool == bool compares "true"/"false", i.e. the values themselves
+        switch (node->op) {
+            case BinaryOperator::EQUAL: return {builder.CreateICmpEQ(l, r), Kind::Bool};
+            case BinaryOperator::NOT_EQUAL: return {builder.CreateICmpNE(l, r), Kind::Bool};
+            default: break;
+        }
+    }
+    throw NotCompilable("unsupported operator " + binaryOpToString(node->op));
+}
+
+// Calls bind to the function the interpreter would pick today: programs and
+// builtins win over functions, and the native code checks nothing else.
+LLVMJITCompiler::Impl::Codegen::Typed LLVMJITCompiler::Impl::Codegen::genCall(FunctionCall *call)
+{
+    std::string name = call->name;
+    if (call->callee) {
+        auto id = dynamic_cast<Identifier *>(call->callee.get());
+        if (!id) throw NotCompilable("call on an expression");
+        name = id->name;
+    }
+    auto found = interp.functions.find(name);
+    if (call->builtin || interp.programs.count(name) || found == interp.functions.end()) {
+        throw NotCompilable("'" + name + "' is not a user function");
+    }
+    FunctionDeclaration *func = found->second;
+    if (call->args.size() != func->params.size()) {
+        throw NotCompilable("argument count mismatch");
+    }
+
+    std::vector<Typed> args;
+    for (auto &arg : call->args) {
+        args.push_back(genExpression(arg.get()));
+    }
+    l::Function *target = declareFunction(func);
+    FunctionEntry &entry = impl.functions[func];
+    callees.emplace_back(name, func);
+
+    std::vector<l::Value *> values;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].kind != entry.params[i]) {
+            throw NotCompilable("argument type does not match parameter '" + func->params[i].first + "'");
+        }
+        values.push_back(args[i].value);
+    }
+    l::AllocaInst *out = allocate(entry.result, "ret");
+    values.push_back(out);
+    l::Value *ok = builder.CreateCall(target, values);
+    auto contBB = l::BasicBlock::Create(*ctx, "call.ok", frame.fn);
+    builder.CreateCondBr(ok, contBB, frame.deopt);
+    builder.SetInsertPoint(contBB);
+    return {builder.CreateLoad(typeOf(entry.result), out), entry.result};
+}
+
+l::Value *LLVMJITCompiler::Impl::Codegen::truthy(const Typed &v)
+{
+    switch (v.kind) {
+        case Kind::Int: return builder.CreateICmpNE(v.value, builder.getInt32(0));
+        case Kind::Float: return builder.CreateFCmpUNE(v.value, l::ConstantFP::get(typeOf(Kind::Float), 0.0));
+        case Kind::Bool: return v.value;
+    }
+    return nullptr;
+}
+
+// Division by zero and INT_MIN / -1 trap; leave them to the interpreter
+void LLVMJITCompiler::Impl::Codegen::guardDivisor(l::Value *lhs, l::Value *rhs)
+{
+    l::Value *zero = builder.CreateICmpEQ(rhs, builder.getInt32(0));
+    l::Value *overflow = builder.CreateAnd(builder.CreateICmpEQ(lhs, builder.getInt32(INT_MIN)),
+                                           builder.CreateICmpEQ(rhs, builder.getInt32(-1)));
+    auto okBB = l::BasicBlock::Create(*ctx, "div.ok", frame.fn);
+    builder.CreateCondBr(builder.CreateOr(zero, overflow), frame.deopt, okBB);
+    builder.SetInsertPoint(okBB);
+}
+
+bool LLVMJITCompiler::Impl::ensureJIT()
+{
+    if (jit) return true;
+    if (unavailable) return false;
+
+    // Scripts that never get hot do not pay for target initialization
+    l::InitializeNativeTarget();
+    l::InitializeNativeTargetAsmPrinter();
+    l::InitializeNativeTargetDisassembler();
+
+    l::orc::LLJITBuilder builder;
+    if (cache) {
+        builder.setCompileFunctionCreator(
+            [cache = cache.get()](l::orc::JITTargetMachineBuilder jtmb)
+                -> l::Expected<std::unique_ptr<l::orc::IRCompileLayer::IRCompiler>> {
+                auto tm = jtmb.createTargetMachine();
+                if (!tm) return tm.takeError();
+                return std::make_unique<l::orc::TMOwningSimpleCompiler>(std::move(*tm), cache);
+            });
+    }
+    auto created = builder.create();
+    if (!created) {
+        l::consumeError(created.takeError());
+        unavailable = true;
+        return false;
+    }
+    jit = std::move(*created);
     return true;
 }
 
-// For loop JIT compilation
-bool LLVMJITCompiler::isCompilable(ForStatement *stmt) {
-    if (!stmt || !stmt->init || !stmt->condition || !stmt->update) return false;
-    
-    // Check init is var declaration: var i: int = 0
-    auto varDecl = dynamic_cast<VariableDeclaration*>(stmt->init.get());
-    if (!varDecl || varDecl->type != "int" || !varDecl->initializer) return false;
-    
-    // Check condition: i < limit
-    std::string condId; int limit;
-    if (!matchConditionAsIdLtInt(stmt->condition.get(), condId, limit)) return false;
-    if (condId != varDecl->name) return false;
-    
-    // Check update: i = i + 1
-    std::string updateId; int inc;
-    if (!matchIncrement(stmt->update.get(), updateId, inc)) return false;
-    if (updateId != varDecl->name) return false;
-    
+NativeEntry LLVMJITCompiler::Impl::lookup(const std::string &symbol)
+{
+    auto sym = jit->lookup(symbol);
+    if (!sym) {
+        l::consumeError(sym.takeError());
+        return nullptr;
+    }
+    return reinterpret_cast<NativeEntry>(static_cast<uintptr_t>(sym->getAddress()));
+}
+
+std::string LLVMJITCompiler::Impl::cacheKey(const std::string &ir, const Interpreter &interp) const
+{
+    // Imports are hashed as they load, so an edited module changes every key
+    std::vector<std::pair<std::string, uint64_t>> imports(interp.importedFiles.begin(), interp.importedFiles.end());
+    std::sort(imports.begin(), imports.end());
+    std::string data = cacheSalt;
+    for (auto &[path, hash] : imports) {
+        data += path + '\0' + std::to_string(hash) + '\0';
+    }
+    data += ir;
+    return l::utohexstr(l::xxHash64(data), /*LowerCase=*/true);
+}
+
+bool LLVMJITCompiler::Impl::calleesUnchanged(const Callees &callees, Interpreter &interp)
+{
+    for (auto &[name, func] : callees) {
+        auto found = interp.functions.find(name);
+        if (found == interp.functions.end() || found->second != func || interp.programs.count(name)) {
+            return false;
+        }
+    }
     return true;
 }
 
-bool LLVMJITCompiler::compileAndExecute(ForStatement *stmt, Interpreter *interp, Environment &env) {
-    auto varDecl = dynamic_cast<VariableDeclaration*>(stmt->init.get());
-    if (!varDecl) return false;
-    
-    std::string loopId; int limit;
-    if (!matchConditionAsIdLtInt(stmt->condition.get(), loopId, limit)) return false;
-    
-    // Get initial value
-    int initVal = 0;
-    if (auto intLit = dynamic_cast<IntegerLiteral*>(varDecl->initializer.get())) {
-        initVal = intLit->value;
-    }
-    
-    // Find other variables being incremented in body
-    std::vector<std::pair<std::string,int>> increments;
-    for (auto &s : stmt->body->statements) {
-        std::string id; int inc;
-        if (matchIncrement(s.get(), id, inc) && id != loopId) {
-            increments.emplace_back(id, inc);
+void LLVMJITCompiler::Impl::compileFunction(FunctionDeclaration *func, Interpreter &interp)
+{
+    if (!ensureJIT()) {
+        functions[func].state = State::Failed;
+        return;
+    }
+    Codegen codegen(*this, interp);
+    try {
+        codegen.declareFunction(func);
+        codegen.generatePending();
+    } catch (const NotCompilable &) {
+        // Callees that were fine on their own get another chance later
+        for (auto pending : codegen.pending) {
+            FunctionEntry &entry = functions[pending];
+            if (entry.state == State::Compiling) entry.state = State::Counting;
         }
+        functions[func].state = State::Failed;
+        return;
     }
-    
-    // Fast path: calculate iterations and update directly
-    int iterations = limit - initVal;
-    if (iterations <= 0) return true;
-    
-    // Update variables directly without loop overhead
-    for (auto &p : increments) {
-        try {
-            Variable var = env.get(p.first);
-            if (std::holds_alternative<int>(var.value)) {
-                int currentVal = std::get<int>(var.value);
-                env.set(p.first, currentVal + (p.second * iterations));
-            }
-        } catch (...) {}
+
+    std::vector<FunctionDeclaration *> compiled = codegen.pending;
+    Callees callees = codegen.callees;
+    bool ok = codegen.finish();
+    for (auto pending : compiled) {
+        FunctionEntry &entry = functions[pending];
+        entry.entry = ok ? lookup(entry.symbol + "_entry") : nullptr;
+        entry.state = entry.entry ? State::Compiled : State::Failed;
+        entry.callees = callees;
     }
-    
-    // Set loop variable to final value
+}
+
+void LLVMJITCompiler::Impl::compileLoop(const ASTNode *node, Expression *condition, Expression *update, Block *body,
+                                        Interpreter &interp)
+{
+    LoopEntry &loop = loops[node];
+    loop.state = State::Failed;
+    if (!ensureJIT() || !condition) {
+        return;
+    }
+    Codegen codegen(*this, interp);
+    std::string symbol;
     try {
-        env.define(loopId, Variable(limit, "int", false));
-    } catch (...) {}
-    
+        symbol = codegen.generateLoop(condition, update, body, loop, interp.environment);
+        codegen.generatePending();
+    } catch (const NotCompilable &) {
+        for (auto pending : codegen.pending) {
+            FunctionEntry &entry = functions[pending];
+            if (entry.state == State::Compiling) entry.state = State::Counting;
+        }
+        loop.vars.clear();
+        loop.kinds.clear();
+        return;
+    }
+
+    std::vector<FunctionDeclaration *> compiled = codegen.pending;
+    Callees callees = codegen.callees;
+    bool ok = codegen.finish();
+    for (auto pending : compiled) {
+        FunctionEntry &entry = functions[pending];
+        entry.entry = ok ? lookup(entry.symbol + "_entry") : nullptr;
+        entry.state = entry.entry ? State::Compiled : State::Failed;
+        entry.callees = callees;
+    }
+    loop.entry = ok ? lookup(symbol) : nullptr;
+    loop.callees = callees;
+    if (loop.entry) loop.state = State::Compiled;
+}
+
+// `node` identifies the loop in the cache; both loop forms share this
+bool LLVMJITCompiler::Impl::runLoop(const ASTNode *node, Expression *condition, Expression *update, Block *body,
+                                    unsigned iterations, Interpreter &interp)
+{
+    if (iterations != 0 && iterations != kHotLoopIterations) {
+        return false;
+    }
+    NativeEntry entry;
+    std::vector<Variable *> vars;
+    std::vector<uint64_t> cells;
+    std::vector<Kind> kinds;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = loops.find(node);
+        if (found == loops.end()) {
+            // Cold loops are only compiled once they turn hot
+            if (iterations == 0) return false;
+            {
+                MetricsScope metrics(Metrics::Histogram::JitCompileSeconds);
+                compileLoop(node, condition, update, body, interp);
+            }
+            found = loops.find(node);
+            Metrics::count(found->second.state == State::Compiled ? Metrics::Counter::JitLoopsCompiled
+                                                                  : Metrics::Counter::JitLoopsFailed);
+        }
+        LoopEntry &loop = found->second;
+        if (loop.state != State::Compiled || !interp.pendingWhens.empty() || !calleesUnchanged(loop.callees, interp)) {
+            return false;
+        }
+        for (size_t i = 0; i < loop.vars.size(); ++i) {
+            Variable *var = interp.environment.find(loop.vars[i]);
+            Kind declared, actual;
+            if (!var || !kindOfType(var->type, declared) || !kindOfValue(var->value, actual) ||
+                declared != loop.kinds[i] || actual != loop.kinds[i]) {
+                return false;
+            }
+            vars.push_back(var);
+            cells.push_back(toCell(var->value));
+        }
+        entry = loop.entry;
+        kinds = loop.kinds;
+    }
+
+    cells.push_back(0);  // never empty, even for a loop without variables
+    if (!entry(cells.data())) {
+        Metrics::count(Metrics::Counter::JitGuardExits);
+        return false;
+    }
+    Metrics::count(Metrics::Counter::JitNativeLoops);
+    for (size_t i = 0; i < vars.size(); ++i) {
+        vars[i]->value = fromCell(cells[i], kinds[i]);
+    }
+    return true;
+}
+
+LLVMJITCompiler::LLVMJITCompiler() : impl(std::make_unique<Impl>()) {}
+LLVMJITCompiler::~LLVMJITCompiler() = default;
+
+void LLVMJITCompiler::enableCache(const std::string &dir, const std::string &source)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    if (impl->jit || dir.empty()) {
+        return;
+    }
+    impl->cache = std::make_unique<DiskCache>(dir);
+
+    // Objects are built for this exact CPU, as the interpreter is (-march=native)
+    l::StringMap<bool> features;
+    l::sys::getHostCPUFeatures(features);
+    std::vector<std::string> enabled;
+    for (auto &feature : features) {
+        if (feature.second) enabled.push_back(feature.first().str());
+    }
+    std::sort(enabled.begin(), enabled.end());
+    std::string salt = std::string(LLVM_VERSION_STRING) + '\0' + l::sys::getProcessTriple() + '\0' +
+                       l::sys::getHostCPUName().str() + '\0';
+    for (auto &feature : enabled) {
+        salt += feature + ',';
+    }
+    salt += '\0' + l::utohexstr(l::xxHash64(source)) + '\0';
+    impl->cacheSalt = std::move(salt);
+}
+
+bool LLVMJITCompiler::tryCall(FunctionDeclaration *func, const std::vector<Value> &args, Value &result,
+                              Interpreter &interp)
+{
+    NativeEntry entry;
+    Kind resultKind;
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        FunctionEntry &fn = impl->functions[func];
+        if (fn.state == State::Counting && ++fn.calls >= kHotCallCount) {
+            {
+                MetricsScope metrics(Metrics::Histogram::JitCompileSeconds);
+                impl->compileFunction(func, interp);
+            }
+            Metrics::count(fn.state == State::Compiled ? Metrics::Counter::JitFunctionsCompiled
+                                                       : Metrics::Counter::JitFunctionsFailed);
+        }
+        if (fn.state != State::Compiled || !interp.pendingWhens.empty() ||
+            !Impl::calleesUnchanged(fn.callees, interp)) {
+            return false;
+        }
+        for (size_t i = 0; i < args.size(); ++i) {
+            Kind kind;
+            if (!kindOfValue(args[i], kind) || kind != fn.params[i]) return false;
+        }
+        entry = fn.entry;
+        resultKind = fn.result;
+    }
+
+    std::vector<uint64_t> cells(args.size() + 1);
+    for (size_t i = 0; i < args.size(); ++i) {
+        cells[i] = toCell(args[i]);
+    }
+    if (!entry(cells.data())) {
+        Metrics::count(Metrics::Counter::JitGuardExits);
+        return false;
+    }
+    Metrics::count(Metrics::Counter::JitNativeCalls);
+    result = fromCell(cells[args.size()], resultKind);
     return true;
 }
+
+bool LLVMJITCompiler::runLoop(WhileStatement *stmt, unsigned iterations, Interpreter &interp)
+{
+    return impl->runLoop(stmt, stmt->condition.get(), nullptr, stmt->body.get(), iterations, interp);
+}
+
+bool LLVMJITCompiler::runLoop(ForStatement *stmt, unsigned iterations, Interpreter &interp)
+{
+    return impl->runLoop(stmt, stmt->condition.get(), stmt->update.get(), stmt->body.get(), iterations, interp);
+}
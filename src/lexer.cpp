@@ -1,7 +1,26 @@
 #include "../include/lexer.h"
-#include <cctype>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 
-std::unordered_map<std::string, TokenType> Lexer::keywords = {
+#if defined(__GNUC__) && defined(__SSE2__)
+#define AXO_LEX_SSE2 1
+#include <emmintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define AXO_LEX_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// ---- Keywords --------------------------------------------------------------
+
+struct Keyword {
+    const char* text;
+    TokenType type;
+};
+
+constexpr Keyword kKeywords[] = {
     {"int", TokenType::KW_INT},
     {"float", TokenType::KW_FLOAT},
     {"string", TokenType::KW_STRING},
@@ -24,6 +43,7 @@ std::unordered_map<std::string, TokenType> Lexer::keywords = {
     {"false", TokenType::KW_FALSE},
     {"program", TokenType::KW_PROGRAM},
     {"await", TokenType::KW_AWAIT},
+    {"spawn", TokenType::KW_SPAWN},
 
     {"typeof", TokenType::KW_TYPEOF},
     {"try", TokenType::KW_TRY},
@@ -38,17 +58,155 @@ std::unordered_map<std::string, TokenType> Lexer::keywords = {
     {"when", TokenType::KW_WHEN},
 };
 
+constexpr size_t kShortestKeyword = 2;
+constexpr size_t kLongestKeyword = 8;
+constexpr int kSlotBits = 7;
+constexpr size_t kSlots = size_t{1} << kSlotBits;
+
+constexpr size_t textLength(const char* text)
+{
+    size_t n = 0;
+    while (text[n]) ++n;
+    return n;
+}
+
+// Mixes the length and the first, second and last chars of a word of at
+// least two chars into a slot
+constexpr uint32_t keywordSlot(const char* text, size_t length, uint32_t seed)
+{
+    uint32_t key = uint32_t(uint8_t(text[0])) | uint32_t(uint8_t(text[1])) << 8 |
+                   uint32_t(uint8_t(text[length - 1])) << 16 | uint32_t(length) << 24;
+    return (key * seed) >> (32 - kSlotBits);
+}
+
+// The first multiplier that gives every keyword a slot of its own
+constexpr uint32_t findSeed()
+{
+    for (uint32_t seed = 1; seed < (1u << 20); seed += 2) {
+        bool used[kSlots] = {};
+        bool distinct = true;
+        for (const Keyword& keyword : kKeywords) {
+            uint32_t slot = keywordSlot(keyword.text, textLength(keyword.text), seed);
+            if (used[slot]) {
+                distinct = false;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (distinct) return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t kSeed = findSeed();
+static_assert(kSeed != 0, "no multiplier hashes the keywords without collisions");
+
+struct KeywordSlot {
+    const char* text = nullptr;
+    size_t length = 0;
+    TokenType type = TokenType::IDENTIFIER;
+};
+
+struct KeywordTable {
+    KeywordSlot slots[kSlots];
+};
+
+constexpr KeywordTable buildKeywordTable()
+{
+    KeywordTable table{};
+    for (const Keyword& keyword : kKeywords) {
+        size_t length = textLength(keyword.text);
+        KeywordSlot& slot = table.slots[keywordSlot(keyword.text, length, kSeed)];
+        slot.text = keyword.text;
+        slot.length = length;
+        slot.type = keyword.type;
+    }
+    return table;
+}
+
+constexpr KeywordTable kKeywordTable = buildKeywordTable();
+
+// The keyword `text` spells, or IDENTIFIER
+TokenType wordType(const char* text, size_t length)
+{
+    if (length < kShortestKeyword || length > kLongestKeyword) return TokenType::IDENTIFIER;
+    const KeywordSlot& slot = kKeywordTable.slots[keywordSlot(text, length, kSeed)];
+    if (slot.length == length && std::memcmp(slot.text, text, length) == 0) return slot.type;
+    return TokenType::IDENTIFIER;
+}
+
+// ---- Scanning --------------------------------------------------------------
+
+// The number of chars at the start of [begin, end) that are none of a, b, c, d
+size_t spanWithout(const char* begin, const char* end, char a, char b, char c, char d)
+{
+    const char* p = begin;
+#if AXO_LEX_SSE2
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return static_cast<size_t>(p - begin) + __builtin_ctz(mask);
+    }
+#elif AXO_LEX_NEON
+    const uint8x16_t va = vdupq_n_u8(uint8_t(a)), vb = vdupq_n_u8(uint8_t(b));
+    const uint8x16_t vc = vdupq_n_u8(uint8_t(c)), vd = vdupq_n_u8(uint8_t(d));
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb)),
+                                  vorrq_u8(vceqq_u8(v, vc), vceqq_u8(v, vd)));
+        // Four bits per byte
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        if (mask) return static_cast<size_t>(p - begin) + (__builtin_ctzll(mask) >> 2);
+    }
+#endif
+    while (p < end && *p != a && *p != b && *p != c && *p != d) ++p;
+    return static_cast<size_t>(p - begin);
+}
+
+// The number of spaces, tabs and carriage returns at the start of [begin, end)
+size_t spanBlanks(const char* begin, const char* end)
+{
+    const char* p = begin;
+#if AXO_LEX_SSE2
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, cr)));
+        int mask = ~_mm_movemask_epi8(blank) & 0xFFFF;
+        if (mask) return static_cast<size_t>(p - begin) + __builtin_ctz(mask);
+    }
+#elif AXO_LEX_NEON
+    const uint8x16_t space = vdupq_n_u8(' '), tab = vdupq_n_u8('\t'), cr = vdupq_n_u8('\r');
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t other = vmvnq_u8(vorrq_u8(vceqq_u8(v, space), vorrq_u8(vceqq_u8(v, tab), vceqq_u8(v, cr))));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(other), 4)), 0);
+        if (mask) return static_cast<size_t>(p - begin) + (__builtin_ctzll(mask) >> 2);
+    }
+#endif
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return static_cast<size_t>(p - begin);
+}
+
+} // namespace
+
 Lexer::Lexer(const std::string& source)
-    : source(source), position(0), line(1), column(1) {}
+    : source(source), position(0), line(1), lineStart(0) {}
 
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
+    // Typical code has a token every six chars or so. The guess is capped,
+    // since a huge file may hold few tokens; past it the vector grows as usual
+    constexpr size_t kMaxReservedTokens = 1 << 16;
+    tokens.reserve(std::min(source.length() / 6, kMaxReservedTokens) + 1);
     while (position < source.length()) {
-        Token token = nextToken();
-        if (token.type != TokenType::NEWLINE) {
-            tokens.push_back(token);
-        }
-        if (token.type == TokenType::EOF_TOKEN) break;
+        tokens.push_back(nextToken());
+        if (tokens.back().type == TokenType::EOF_TOKEN) break;
     }
     return tokens;
 }
@@ -56,18 +214,18 @@ std::vector<Token> Lexer::tokenize() {
 Token Lexer::nextToken() {
     skipWhitespace();
     
+    // Comments
+    while (currentChar() == '/' && peekChar() == '/') {
+        skipComment();
+        skipWhitespace();
+    }
+    
     if (position >= source.length()) {
-        return Token(TokenType::EOF_TOKEN, "", line, column);
+        return Token(TokenType::EOF_TOKEN, "", line, column());
     }
     
     char current = currentChar();
     
-    // Comments
-    if (current == '/' && peekChar() == '/') {
-        skipComment();
-        return nextToken();
-    }
-    
     // String literals
     if (current == '"' || current == '\'') {
         return readString(current);
@@ -92,6 +250,10 @@ Token Lexer::nextToken() {
     return readOperator();
 }
 
+std::string_view Lexer::text(size_t start) const {
+    return std::string_view(source).substr(start, position - start);
+}
+
 char Lexer::currentChar() const {
     if (position >= source.length()) return '\0';
     return source[position];
@@ -106,90 +268,108 @@ void Lexer::advance() {
     if (position < source.length()) {
         if (source[position] == '\n') {
             line++;
-            column = 1;
-        } else {
-            column++;
+            lineStart = position + 1;
         }
         position++;
     }
 }
 
 void Lexer::skipWhitespace() {
-    while (position < source.length() && std::isspace(currentChar())) {
-        advance();
+    const char* text = source.data();
+    const char* end = text + source.length();
+    while (position < source.length()) {
+        position += spanBlanks(text + position, end);
+        char c = currentChar();
+        if (c == '\n') {
+            advance();
+        } else if (c == '\v' || c == '\f') {
+            position++;
+        } else {
+            break;
+        }
     }
 }
 
 void Lexer::skipComment() {
-    // Skip //
-    advance();
-    advance();
-    // Skip until end of line
-    while (position < source.length() && currentChar() != '\n') {
-        advance();
-    }
+    // Skip to the end of the line, leaving the newline to skipWhitespace
+    const char* text = source.data();
+    auto newline = static_cast<const char*>(
+        std::memchr(text + position, '\n', source.length() - position));
+    position = newline ? static_cast<size_t>(newline - text) : source.length();
 }
 
 Token Lexer::readNumber() {
-    int startLine = line;
-    int startCol = column;
-    std::string value;
+    int startCol = column();
+    size_t start = position;
     bool isFloat = false;
     
     while (isDigit(currentChar())) {
-        value += currentChar();
-        advance();
+        position++;
     }
     
     if (currentChar() == '.' && isDigit(peekChar())) {
         isFloat = true;
-        value += currentChar();
-        advance();
+        position++;
         while (isDigit(currentChar())) {
-            value += currentChar();
-            advance();
+            position++;
         }
     }
     
-    return Token(isFloat ? TokenType::FLOAT : TokenType::INTEGER, value, startLine, startCol);
+    return Token(isFloat ? TokenType::FLOAT : TokenType::INTEGER, text(start), line, startCol);
 }
 
 Token Lexer::readString(char quote) {
     int startLine = line;
-    int startCol = column;
+    int startCol = column();
     advance(); // Skip opening quote
-    std::string value;
+    size_t start = position;
+    // A string without escapes is its own source text; the first escape
+    // copies what came before it into a string of its own
+    std::string* value = nullptr;
+    const char* text = source.data();
+    const char* end = text + source.length();
     
-    while (currentChar() != quote && position < source.length()) {
-        if (currentChar() == '\\') {
+    while (position < source.length()) {
+        size_t run = spanWithout(text + position, end, quote, '\\', '\n', quote);
+        if (value) value->append(text + position, run);
+        position += run;
+        char c = currentChar();
+        if (position >= source.length() || c == quote) {
+            break;
+        }
+        if (c == '\\') {
+            if (!value) value = &literals.emplace_back(text + start, position - start);
             advance();
             switch (currentChar()) {
-                case 'n': value += '\n'; break;
-                case 't': value += '\t'; break;
-                case 'r': value += '\r'; break;
-                case '"': value += '"'; break;
-                case '\'': value += '\''; break;
-                case '\\': value += '\\'; break;
-                default: value += currentChar();
+                case 'n': *value += '\n'; break;
+                case 't': *value += '\t'; break;
+                case 'r': *value += '\r'; break;
+                case '"': *value += '"'; break;
+                case '\'': *value += '\''; break;
+                case '\\': *value += '\\'; break;
+                default: *value += currentChar();
             }
-        } else {
-            value += currentChar();
+        } else if (value) {
+            *value += c;
         }
         advance();
     }
     
+    std::string_view content = value ? std::string_view(*value) : this->text(start);
     if (currentChar() == quote) {
         advance(); // Skip closing quote
     }
     
-    return Token(TokenType::STRING, value, startLine, startCol);
+    return Token(TokenType::STRING, content, startLine, startCol);
 }
 
 Token Lexer::readTemplateLiteral() {
     int startLine = line;
-    int startCol = column;
+    int startCol = column();
     advance(); // Skip opening backtick
     std::string value;
+    const char* text = source.data();
+    const char* end = text + source.length();
     
     while (currentChar() != '`' && position < source.length()) {
         if (currentChar() == '\\' && peekChar() == '$' && peekChar(2) != '{') {
@@ -229,9 +409,13 @@ Token Lexer::readTemplateLiteral() {
                 value += currentChar();
                 advance();
             }
-        } else {
+        } else if (currentChar() == '$' || currentChar() == '\n') {
             value += currentChar();
             advance();
+        } else {
+            size_t run = spanWithout(text + position, end, '`', '\\', '$', '\n');
+            value.append(text + position, run);
+            position += run;
         }
     }
     
@@ -239,31 +423,25 @@ Token Lexer::readTemplateLiteral() {
         advance(); // Skip closing backtick
     }
     
-    return Token(TokenType::TEMPLATE_STRING, value, startLine, startCol);
+    return Token(TokenType::TEMPLATE_STRING, literals.emplace_back(std::move(value)), startLine, startCol);
 }
 
 Token Lexer::readIdentifier() {
-    int startLine = line;
-    int startCol = column;
-    std::string value;
+    int startCol = column();
+    size_t start = position;
     
-    while (isAlphaNumeric(currentChar()) || currentChar() == '_') {
-        value += currentChar();
-        advance();
-    }
-    
-    // Check if it's a keyword
-    auto it = keywords.find(value);
-    if (it != keywords.end()) {
-        return Token(it->second, value, startLine, startCol);
+    while (isAlphaNumeric(currentChar())) {
+        position++;
     }
     
-    return Token(TokenType::IDENTIFIER, value, startLine, startCol);
+    size_t length = position - start;
+    return Token(wordType(source.data() + start, length), text(start), line, startCol);
 }
 
 Token Lexer::readOperator() {
     int startLine = line;
-    int startCol = column;
+    int startCol = column();
+    size_t start = position;
     char current = currentChar();
     
     switch (current) {
@@ -333,10 +511,10 @@ Token Lexer::readOperator() {
         case ':': advance(); return Token(TokenType::COLON, ":", startLine, startCol);
         default:
             advance();
-            return Token(TokenType::UNKNOWN, std::string(1, current), startLine, startCol);
+            return Token(TokenType::UNKNOWN, text(start), startLine, startCol);
     }
     
-    return Token(TokenType::UNKNOWN, std::string(1, current), startLine, startCol);
+    return Token(TokenType::UNKNOWN, text(start), startLine, startCol);
 }
 
 bool Lexer::isDigit(char c) const {
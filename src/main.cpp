@@ -1,43 +1,183 @@
 #include "include/lexer.h"
 #include "include/parser.h"
 #include "include/interpreter.h"
+#include "include/optimizer.h"
+#include "include/bytecode.h"
+#include "include/vm.h"
+#include "include/profiler.h"
+#include "include/metrics.h"
+#include "include/session.h"
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <sstream>
 
 std::string readFile(const std::string& filename) {
-    std::ifstream file(filename);
+    std::ifstream file(filename, std::ios::in | std::ios::ate);
     if (!file.is_open()) {
         throw std::runtime_error("Could not open file: " + filename);
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    std::string source(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&source[0], static_cast<std::streamsize>(source.size()));
+    source.resize(static_cast<size_t>(file.gcount()));
+    return source;
 }
 
 void printUsage(const char* programName) {
-    std::cout << "Usage: " << programName << " <script.lang>" << std::endl;
+    std::cout << "Usage: " << programName << " [--engine=tree|vm] [-O0|-O1|-O2] [--dump-ast] [--no-jit] [--jit-cache-dir=<dir>] [--module-cache-dir=<dir>] [--profile[=<file>]]" << std::endl;
+    std::cout << "       [--metrics=<file>] [--metrics-jsonl=<file>] [--metrics-interval=<ms>] [--trace=<file>] <script.lang>" << std::endl;
     std::cout << "   or: " << programName << " (interactive mode)" << std::endl;
 }
 
+struct RunOptions {
+    std::string engine = "tree";
+    std::string jitCacheDir;
+    std::string moduleCacheDir;
+    std::string profilePath;  // collapsed stacks are written here when set
+    MetricsExporter::Options metrics;  // nothing is recorded unless a path is set
+    int optimizationLevel = 1;
+    bool dumpAST = false;  // print the optimized program instead of running it
+    bool jit = true;
+};
+
+// Functions and loops listed in the --profile summary
+constexpr size_t kProfileTop = 20;
+
+void writeProfile(Profiler& profiler, const std::string& path) {
+    profiler.stop();
+    std::ofstream out(path);
+    if (out) {
+        profiler.writeCollapsed(out);
+    } else {
+        std::cerr << "Could not write profile: " << path << std::endl;
+    }
+    profiler.writeSummary(std::cerr, kProfileTop);
+    std::cerr << "Collapsed stacks written to " << path << std::endl;
+}
+
+// Run a parsed program on the selected engine. The VM covers the core language;
+// programs using anything it cannot compile run on the tree walker instead.
+// Profiling always uses the tree walker, whose calls and loops it can see.
+void runProgram(Program* program, const RunOptions& options, const std::string& source) {
+    // Made before the interpreter, so the last export comes after the
+    // programs it spawned have finished
+    std::unique_ptr<MetricsExporter> metrics;
+    const MetricsExporter::Options& paths = options.metrics;
+    if (!paths.prometheusPath.empty() || !paths.jsonlPath.empty() || !paths.tracePath.empty()) {
+        Metrics::enable(!paths.tracePath.empty());
+        metrics = std::make_unique<MetricsExporter>(paths);
+    }
+    Interpreter interpreter;
+    interpreter.setOptimizationLevel(options.optimizationLevel);
+    if (options.dumpAST) {
+        interpreter.optimize(program);
+        Optimizer::print(program, std::cout);
+        return;
+    }
+    if (!options.jit) {
+        interpreter.disableJIT();
+    } else if (!options.jitCacheDir.empty()) {
+        interpreter.enableJITCache(options.jitCacheDir, source);
+    }
+    if (!options.moduleCacheDir.empty()) {
+        interpreter.enableModuleCache(options.moduleCacheDir);
+    }
+    if (!options.profilePath.empty()) {
+        Profiler& profiler = interpreter.enableProfiling();
+        try {
+            interpreter.interpret(program);
+        } catch (...) {
+            writeProfile(profiler, options.profilePath);
+            throw;
+        }
+        writeProfile(profiler, options.profilePath);
+        return;
+    }
+    if (options.engine == "vm") {
+        interpreter.optimize(program);
+        BytecodeCompiler compiler;
+        auto bytecode = compiler.compile(program);
+        if (bytecode) {
+            VM vm(interpreter);
+            vm.execute(*bytecode);
+            return;
+        }
+    }
+    interpreter.interpret(program);
+}
+
 int main(int argc, char* argv[]) {
     std::string source;
+    std::string scriptPath;
+    RunOptions options;
     try {
-        if (argc > 2) {
-            printUsage(argv[0]);
-            return 1;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.rfind("--engine=", 0) == 0) {
+                options.engine = arg.substr(9);
+                if (options.engine != "tree" && options.engine != "vm") {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+            } else if (arg.size() == 3 && arg.rfind("-O", 0) == 0 && arg[2] >= '0' &&
+                       arg[2] <= '0' + Optimizer::kMaxLevel) {
+                options.optimizationLevel = arg[2] - '0';
+            } else if (arg == "--dump-ast") {
+                options.dumpAST = true;
+            } else if (arg == "--no-jit") {
+                options.jit = false;
+            } else if (arg.rfind("--jit-cache-dir=", 0) == 0) {
+                options.jitCacheDir = arg.substr(16);
+            } else if (arg.rfind("--module-cache-dir=", 0) == 0) {
+                options.moduleCacheDir = arg.substr(19);
+            } else if (arg == "--profile") {
+                options.profilePath = "profile.folded";
+            } else if (arg.rfind("--profile=", 0) == 0) {
+                options.profilePath = arg.substr(10);
+                if (options.profilePath.empty()) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+            } else if (arg.rfind("--metrics=", 0) == 0) {
+                options.metrics.prometheusPath = arg.substr(10);
+            } else if (arg.rfind("--metrics-jsonl=", 0) == 0) {
+                options.metrics.jsonlPath = arg.substr(16);
+            } else if (arg.rfind("--metrics-interval=", 0) == 0) {
+                int interval = std::atoi(arg.c_str() + 19);
+                if (interval <= 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                options.metrics.interval = std::chrono::milliseconds(interval);
+            } else if (arg.rfind("--trace=", 0) == 0) {
+                options.metrics.tracePath = arg.substr(8);
+            } else if (scriptPath.empty()) {
+                scriptPath = arg;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
         }
         
-        if (argc == 2) {
+        if (!scriptPath.empty()) {
             // Read from file
-            source = readFile(argv[1]);
+            source = readFile(scriptPath);
         } else {
-            // Interactive mode
+            // Interactive mode: one session for the whole run, so every input
+            // sees what the earlier ones defined
+            Session session;
+            session.interpreter().setOptimizationLevel(options.optimizationLevel);
+            if (!options.moduleCacheDir.empty()) {
+                session.interpreter().enableModuleCache(options.moduleCacheDir);
+            }
             std::cout << "Compiler Engine v1.0" << std::endl;
             std::cout << "Type 'exit' to quit" << std::endl;
             std::cout << "> ";
             
             std::string line;
+            int openBraces = 0;
             while (std::getline(std::cin, line)) {
                 if (line == "exit") break;
                 if (line.empty()) {
@@ -45,27 +185,22 @@ int main(int argc, char* argv[]) {
                     continue;
                 }
                 source += line + "\n";
+                for (char c : line) {
+                    if (c == '{') ++openBraces;
+                    if (c == '}') --openBraces;
+                }
                 
-                if (line.find(';') != std::string::npos || line.find('}') != std::string::npos) {
+                // Runs once a statement ends outside any braces, so a function
+                // can be typed over several lines
+                if (openBraces <= 0 && (line.find(';') != std::string::npos || line.find('}') != std::string::npos)) {
                     try {
-                        // Tokenize
-                        Lexer lexer(source);
-                        auto tokens = lexer.tokenize();
-                        
-                        // Parse
-                        Parser parser(tokens);
-                        auto ast = parser.parse();
-                        
-                        // Interpret
-                        Interpreter interpreter;
-                        interpreter.interpret(ast.get());
-                        
+                        session.eval(source);
                         std::cout << std::endl;
-                        source = "";
                     } catch (const std::exception& e) {
                         std::cerr << "Error: " << e.what() << std::endl;
-                        source = "";
                     }
+                    source = "";
+                    openBraces = 0;
                 }
                 std::cout << "> ";
             }
@@ -86,8 +221,7 @@ int main(int argc, char* argv[]) {
         
         // Interpret
         //std::cout << "[*] Executing..." << std::endl;
-        Interpreter interpreter;
-        interpreter.interpret(ast.get());
+        runProgram(ast.get(), options, source);
         //std::cout << "[*] Done!" << std::endl;
         
         return 0;
@@ -99,7 +233,7 @@ int main(int argc, char* argv[]) {
 
         // If it's a ParseError, show the friendly file/line/column pointer
         if (auto pe = dynamic_cast<const ParseError*>(&e)) {
-            std::string filename = (argc == 2) ? std::string(argv[1]) : "<stdin>";
+            std::string filename = !scriptPath.empty() ? scriptPath : "<stdin>";
             std::cerr << "Fatal error: " << pe->what() << std::endl;
             std::cerr << "  File: " << filename << ":" << pe->getLine() << ":" << pe->getColumn() << std::endl;
 
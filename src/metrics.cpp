@@ -0,0 +1,434 @@
+#include "include/metrics.h"
+#include "include/heap.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr size_t kCounters = static_cast<size_t>(Metrics::Counter::Count);
+constexpr size_t kGauges = static_cast<size_t>(Metrics::Gauge::Count);
+constexpr size_t kHistograms = static_cast<size_t>(Metrics::Histogram::Count);
+// Bucket i counts durations under 2^i microseconds; the last one the rest
+constexpr size_t kBuckets = 28;
+
+// How a metric is exported: its Prometheus name and labels, and its key in
+// the JSON lines
+struct Descriptor {
+    const char* name;
+    const char* labels;
+    const char* key;
+    const char* help;
+};
+
+// Entries sharing a name must be next to each other
+const Descriptor kCounterInfo[] = {
+    {"axo_programs_spawned_total", "", "programs_spawned", "Programs started by spawn or await"},
+    {"axo_programs_failed_total", "", "programs_failed", "Spawned programs that ended with an error"},
+    {"axo_awaits_total", "", "awaits", "Tasks waited for by await"},
+    {"axo_imports_total", "", "imports", "Modules loaded by import or use"},
+    {"axo_jit_compiles_total", "kind=\"function\",result=\"compiled\"", "jit_functions_compiled",
+     "Functions and loops the JIT tried to compile"},
+    {"axo_jit_compiles_total", "kind=\"function\",result=\"failed\"", "jit_functions_failed", ""},
+    {"axo_jit_compiles_total", "kind=\"loop\",result=\"compiled\"", "jit_loops_compiled", ""},
+    {"axo_jit_compiles_total", "kind=\"loop\",result=\"failed\"", "jit_loops_failed", ""},
+    {"axo_jit_native_runs_total", "kind=\"function\"", "jit_native_calls", "Calls and loops run as native code"},
+    {"axo_jit_native_runs_total", "kind=\"loop\"", "jit_native_loops", ""},
+    {"axo_jit_guard_exits_total", "", "jit_guard_exits", "Native runs that handed back to the interpreter"},
+};
+const Descriptor kGaugeInfo[] = {
+    {"axo_programs_running", "", "programs_running", "Spawned programs running now"},
+    {"axo_whens_pending", "", "whens_pending", "when statements waiting for their condition"},
+};
+const Descriptor kHistogramInfo[] = {
+    {"axo_program_duration_seconds", "", "program_seconds", "Run time of spawned programs"},
+    {"axo_await_seconds", "", "await_seconds", "Time spent waiting in await"},
+    {"axo_import_duration_seconds", "", "import_seconds", "Time to load and run an imported module"},
+    {"axo_jit_compile_seconds", "", "jit_compile_seconds", "Time spent compiling functions and loops"},
+    {"axo_io_duration_seconds", "op=\"read\"", "io_read_seconds", "Time spent in file I/O builtins"},
+    {"axo_io_duration_seconds", "op=\"write\"", "io_write_seconds", ""},
+    {"axo_io_duration_seconds", "op=\"readDir\"", "io_read_dir_seconds", ""},
+    {"axo_io_duration_seconds", "op=\"copy\"", "io_copy_seconds", ""},
+    {"axo_io_duration_seconds", "op=\"reader\"", "io_reader_seconds", ""},
+};
+static_assert(sizeof(kCounterInfo) / sizeof(Descriptor) == kCounters, "every counter needs a descriptor");
+static_assert(sizeof(kGaugeInfo) / sizeof(Descriptor) == kGauges, "every gauge needs a descriptor");
+static_assert(sizeof(kHistogramInfo) / sizeof(Descriptor) == kHistograms, "every histogram needs a descriptor");
+
+struct TraceEvent {
+    const char* category;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+// What one thread recorded. Only that thread writes the numbers, so they
+// are bumped with plain loads and stores; they are atomic so that exporting
+// can read them at any time.
+struct Shard {
+    uint32_t tid = 0;
+    std::atomic<uint64_t> counters[kCounters] = {};
+    std::atomic<int64_t> gauges[kGauges] = {};
+    std::atomic<uint64_t> buckets[kHistograms][kBuckets] = {};
+    std::atomic<uint64_t> sumNs[kHistograms] = {};
+    std::mutex eventMutex;  // only contended while the trace is written
+    std::vector<TraceEvent> events;
+};
+
+template <typename T>
+void bump(std::atomic<T>& value, T delta)
+{
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+// Never destroyed, so threads ending while the process exits still find it
+struct Shards {
+    std::mutex mutex;
+    std::vector<Shard*> all;
+    std::vector<Shard*> idle;  // left behind by threads that have ended
+};
+
+Shards& shards()
+{
+    static Shards* instance = new Shards;
+    return *instance;
+}
+
+// A thread's shard; handed on to a later thread when this one ends, which
+// keeps what it recorded in the totals
+struct ThreadShard {
+    Shard* shard;
+
+    ThreadShard()
+    {
+        Shards& all = shards();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        if (!all.idle.empty()) {
+            shard = all.idle.back();
+            all.idle.pop_back();
+        } else {
+            shard = new Shard;
+            shard->tid = static_cast<uint32_t>(all.all.size()) + 1;
+            all.all.push_back(shard);
+        }
+    }
+    ~ThreadShard()
+    {
+        Shards& all = shards();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        all.idle.push_back(shard);
+    }
+};
+
+Shard& shard()
+{
+    thread_local ThreadShard threadShard;
+    return *threadShard.shard;
+}
+
+struct Snapshot {
+    uint64_t counters[kCounters] = {};
+    int64_t gauges[kGauges] = {};
+    uint64_t buckets[kHistograms][kBuckets] = {};
+    uint64_t sumNs[kHistograms] = {};
+    Heap::Stats heap;
+};
+
+Snapshot snapshot()
+{
+    Snapshot total;
+    {
+        Shards& all = shards();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        for (Shard* s : all.all) {
+            for (size_t i = 0; i < kCounters; ++i) total.counters[i] += s->counters[i].load(std::memory_order_relaxed);
+            for (size_t i = 0; i < kGauges; ++i) total.gauges[i] += s->gauges[i].load(std::memory_order_relaxed);
+            for (size_t h = 0; h < kHistograms; ++h) {
+                for (size_t b = 0; b < kBuckets; ++b) {
+                    total.buckets[h][b] += s->buckets[h][b].load(std::memory_order_relaxed);
+                }
+                total.sumNs[h] += s->sumNs[h].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    total.heap = Heap::stats();
+    return total;
+}
+
+// The upper bound of bucket `b` in seconds
+double bucketBound(size_t b)
+{
+    return static_cast<double>(uint64_t{1} << b) * 1e-6;
+}
+
+std::string number(double value)
+{
+    char text[32];
+    std::snprintf(text, sizeof text, "%.9g", value);
+    return text;
+}
+
+// The bound of the bucket holding the `fraction` quantile, so within a factor
+// of two of the real value
+double quantile(const uint64_t (&buckets)[kBuckets], uint64_t count, double fraction)
+{
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) return bucketBound(b);
+    }
+    return bucketBound(kBuckets - 1);
+}
+
+void writeHeader(std::ostream& out, const Descriptor* previous, const Descriptor& info, const char* type)
+{
+    if (previous && std::string(previous->name) == info.name) return;
+    out << "# HELP " << info.name << ' ' << info.help << '\n';
+    out << "# TYPE " << info.name << ' ' << type << '\n';
+}
+
+void writeSample(std::ostream& out, const char* name, const char* suffix, const std::string& labels,
+                 const std::string& value)
+{
+    out << name << suffix;
+    if (!labels.empty()) out << '{' << labels << '}';
+    out << ' ' << value << '\n';
+}
+
+void writeJSONString(std::ostream& out, const std::string& text)
+{
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof escaped, "\\u%04x", c);
+                    out << escaped;
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+int64_t microseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+} // namespace
+
+std::atomic<bool> Metrics::on{false};
+std::atomic<bool> Metrics::tracingOn{false};
+
+void Metrics::enable(bool trace)
+{
+    tracingOn.store(trace, std::memory_order_relaxed);
+    on.store(true, std::memory_order_relaxed);
+}
+
+void Metrics::add(Counter counter)
+{
+    bump(shard().counters[static_cast<size_t>(counter)], uint64_t{1});
+}
+
+void Metrics::add(Gauge gauge, int64_t delta)
+{
+    bump(shard().gauges[static_cast<size_t>(gauge)], delta);
+}
+
+void Metrics::observe(Histogram histogram, std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    uint64_t us = static_cast<uint64_t>(ns < 0 ? 0 : ns) / 1000;
+    size_t bucket = 0;
+    while (bucket < kBuckets - 1 && us >= (uint64_t{1} << bucket)) ++bucket;
+    Shard& s = shard();
+    size_t h = static_cast<size_t>(histogram);
+    bump(s.buckets[h][bucket], uint64_t{1});
+    bump(s.sumNs[h], static_cast<uint64_t>(ns < 0 ? 0 : ns));
+}
+
+void Metrics::span(const char* category, const std::string& name, std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end)
+{
+    Shard& s = shard();
+    std::lock_guard<std::mutex> lock(s.eventMutex);
+    s.events.push_back({category, name, start, end});
+}
+
+void Metrics::writePrometheus(std::ostream& out)
+{
+    Snapshot total = snapshot();
+    const Descriptor* previous = nullptr;
+    for (size_t i = 0; i < kCounters; ++i) {
+        writeHeader(out, previous, kCounterInfo[i], "counter");
+        writeSample(out, kCounterInfo[i].name, "", kCounterInfo[i].labels, std::to_string(total.counters[i]));
+        previous = &kCounterInfo[i];
+    }
+    previous = nullptr;
+    for (size_t i = 0; i < kGauges; ++i) {
+        writeHeader(out, previous, kGaugeInfo[i], "gauge");
+        writeSample(out, kGaugeInfo[i].name, "", kGaugeInfo[i].labels, std::to_string(total.gauges[i]));
+        previous = &kGaugeInfo[i];
+    }
+    previous = nullptr;
+    for (size_t h = 0; h < kHistograms; ++h) {
+        const Descriptor& info = kHistogramInfo[h];
+        writeHeader(out, previous, info, "histogram");
+        std::string labels = info.labels;
+        std::string separator = labels.empty() ? "" : ",";
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < kBuckets; ++b) {
+            cumulative += total.buckets[h][b];
+            std::string le = b + 1 == kBuckets ? "+Inf" : number(bucketBound(b));
+            writeSample(out, info.name, "_bucket", labels + separator + "le=\"" + le + "\"", std::to_string(cumulative));
+        }
+        writeSample(out, info.name, "_sum", labels, number(static_cast<double>(total.sumNs[h]) * 1e-9));
+        writeSample(out, info.name, "_count", labels, std::to_string(cumulative));
+        previous = &info;
+    }
+
+    const Heap::Stats& heap = total.heap;
+    out << "# HELP axo_heap_allocations_total Arrays and objects created\n"
+        << "# TYPE axo_heap_allocations_total counter\n"
+        << "axo_heap_allocations_total " << heap.allocated << '\n'
+        << "# HELP axo_heap_objects Arrays and objects alive now\n"
+        << "# TYPE axo_heap_objects gauge\n"
+        << "axo_heap_objects " << heap.objects << '\n'
+        << "# HELP axo_gc_collections_total Cycle collections run\n"
+        << "# TYPE axo_gc_collections_total counter\n"
+        << "axo_gc_collections_total " << heap.collections << '\n'
+        << "# HELP axo_gc_freed_total Arrays and objects freed by cycle collections\n"
+        << "# TYPE axo_gc_freed_total counter\n"
+        << "axo_gc_freed_total " << heap.freed << '\n'
+        << "# HELP axo_gc_pause_seconds_total Time spent in cycle collections\n"
+        << "# TYPE axo_gc_pause_seconds_total counter\n"
+        << "axo_gc_pause_seconds_total " << number(static_cast<double>(heap.totalPauseUs) * 1e-6) << '\n'
+        << "# HELP axo_gc_pause_max_seconds Longest cycle collection\n"
+        << "# TYPE axo_gc_pause_max_seconds gauge\n"
+        << "axo_gc_pause_max_seconds " << number(static_cast<double>(heap.maxPauseUs) * 1e-6) << '\n';
+}
+
+void Metrics::writeJSONLine(std::ostream& out)
+{
+    Snapshot total = snapshot();
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    out << "{\"time_ms\":" << now;
+    for (size_t i = 0; i < kCounters; ++i) out << ",\"" << kCounterInfo[i].key << "\":" << total.counters[i];
+    for (size_t i = 0; i < kGauges; ++i) out << ",\"" << kGaugeInfo[i].key << "\":" << total.gauges[i];
+    // Histograms give their count, total and approximate median and 99th
+    // percentile, in seconds
+    for (size_t h = 0; h < kHistograms; ++h) {
+        uint64_t count = 0;
+        for (uint64_t n : total.buckets[h]) count += n;
+        out << ",\"" << kHistogramInfo[h].key << "\":{\"count\":" << count
+            << ",\"sum\":" << number(static_cast<double>(total.sumNs[h]) * 1e-9);
+        if (count > 0) {
+            out << ",\"p50\":" << number(quantile(total.buckets[h], count, 0.5))
+                << ",\"p99\":" << number(quantile(total.buckets[h], count, 0.99));
+        }
+        out << '}';
+    }
+    const Heap::Stats& heap = total.heap;
+    out << ",\"heap_allocations\":" << heap.allocated << ",\"heap_objects\":" << heap.objects
+        << ",\"gc_collections\":" << heap.collections << ",\"gc_freed\":" << heap.freed
+        << ",\"gc_pause_seconds\":" << number(static_cast<double>(heap.totalPauseUs) * 1e-6) << "}\n";
+    out.flush();
+}
+
+void Metrics::writeTrace(std::ostream& out)
+{
+    std::vector<std::pair<uint32_t, TraceEvent>> events;
+    {
+        Shards& all = shards();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        for (Shard* s : all.all) {
+            std::lock_guard<std::mutex> eventLock(s->eventMutex);
+            for (const auto& event : s->events) events.emplace_back(s->tid, event);
+        }
+    }
+    // Timestamps count from the first span
+    auto origin = std::chrono::steady_clock::time_point::max();
+    for (const auto& event : events) origin = std::min(origin, event.second.start);
+
+    out << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i].second;
+        out << (i ? ",\n" : "\n") << "{\"name\":";
+        writeJSONString(out, event.name);
+        out << ",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"ts\":" << microseconds(event.start - origin)
+            << ",\"dur\":" << microseconds(event.end - event.start) << ",\"pid\":1,\"tid\":" << events[i].first << '}';
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+MetricsExporter::MetricsExporter(Options options) : options(std::move(options))
+{
+    if (this->options.prometheusPath.empty() && this->options.jsonlPath.empty()) {
+        return;
+    }
+    thread = std::thread([this] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopChanged.wait_for(lock, this->options.interval, [this] { return stopping; })) {
+            lock.unlock();
+            exportMetrics();
+            lock.lock();
+        }
+    });
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopChanged.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    exportMetrics();
+    if (!options.tracePath.empty()) {
+        std::ofstream out(options.tracePath);
+        if (out) {
+            Metrics::writeTrace(out);
+        } else {
+            std::cerr << "Could not write trace: " << options.tracePath << std::endl;
+        }
+    }
+}
+
+void MetricsExporter::exportMetrics()
+{
+    if (!options.prometheusPath.empty()) {
+        std::string temporary = options.prometheusPath + ".tmp";
+        std::ofstream out(temporary);
+        if (out) {
+            Metrics::writePrometheus(out);
+            out.close();
+            std::rename(temporary.c_str(), options.prometheusPath.c_str());
+        } else {
+            std::cerr << "Could not write metrics: " << options.prometheusPath << std::endl;
+        }
+    }
+    if (!options.jsonlPath.empty()) {
+        std::ofstream out(options.jsonlPath, std::ios::app);
+        if (out) {
+            Metrics::writeJSONLine(out);
+        } else {
+            std::cerr << "Could not write metrics: " << options.jsonlPath << std::endl;
+        }
+    }
+}
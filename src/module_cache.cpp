@@ -0,0 +1,772 @@
+#include "include/module_cache.h"
+#include "include/builtins.h"
+#include "include/lexer.h"
+#include "include/parser.h"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/xxhash.h>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AXO_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bump when the encoding or the AST changes shape
+constexpr char kMagic[4] = {'A', 'X', 'O', 'M'};
+constexpr uint32_t kFormatVersion = 3;
+
+enum class Tag : uint8_t {
+    Null,
+    IntegerLiteral, FloatLiteral, StringLiteral, TemplateLiteral, BooleanLiteral,
+    Identifier, BinaryOp, UnaryOp, FunctionCall, ArrayLiteral, ObjectLiteral,
+    FunctionExpression, IndexAccess, FieldAccess, IndexAssignment, FieldAssignment,
+    Assignment, AwaitExpression, SpawnExpression,
+    ExpressionStatement, Block, VariableDeclaration, IfStatement, WhileStatement,
+    ForStatement, ReturnStatement, FunctionDeclaration, ProgramDeclaration,
+    ImportDeclaration, UseDeclaration, ExportDeclaration, TypeDeclaration,
+    ThrowStatement, TryStatement, BreakStatement, ContinueStatement, CaseClause,
+    SwitchStatement, WhenStatement,
+};
+
+// What an entry starts with, after the magic
+struct Header {
+    uint32_t version;
+    int64_t mtime;
+    uint64_t size;
+    uint64_t hash;      // of the source
+    uint64_t bodyHash;  // of the encoding that follows the header
+};
+
+class Writer {
+public:
+    std::string out;
+
+    void u8(uint8_t v) { out.push_back(static_cast<char>(v)); }
+    void u32(uint32_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof v); }
+    void i32(int32_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof v); }
+    void f32(float v) { out.append(reinterpret_cast<const char*>(&v), sizeof v); }
+    void str(const std::string& s)
+    {
+        u32(static_cast<uint32_t>(s.size()));
+        out.append(s);
+    }
+    void strings(const std::vector<std::string>& list)
+    {
+        u32(static_cast<uint32_t>(list.size()));
+        for (auto& s : list) str(s);
+    }
+    void params(const std::vector<std::pair<std::string, std::string>>& list)
+    {
+        u32(static_cast<uint32_t>(list.size()));
+        for (auto& p : list) {
+            str(p.first);
+            str(p.second);
+        }
+    }
+    template <typename T>
+    void nodes(const std::vector<std::unique_ptr<T>>& list)
+    {
+        u32(static_cast<uint32_t>(list.size()));
+        for (auto& n : list) node(n.get());
+    }
+
+    void node(ASTNode* n);
+};
+
+void Writer::node(ASTNode* n)
+{
+    if (!n) {
+        u8(static_cast<uint8_t>(Tag::Null));
+        return;
+    }
+    auto tag = [&](Tag t) {
+        u8(static_cast<uint8_t>(t));
+        i32(n->line);
+    };
+
+    if (auto e = dynamic_cast<IntegerLiteral*>(n)) {
+        tag(Tag::IntegerLiteral);
+        i32(e->value);
+    } else if (auto e = dynamic_cast<FloatLiteral*>(n)) {
+        tag(Tag::FloatLiteral);
+        f32(e->value);
+    } else if (auto e = dynamic_cast<StringLiteral*>(n)) {
+        tag(Tag::StringLiteral);
+        str(e->value);
+    } else if (auto e = dynamic_cast<TemplateLiteral*>(n)) {
+        tag(Tag::TemplateLiteral);
+        u32(static_cast<uint32_t>(e->parts.size()));
+        for (auto& part : e->parts) {
+            str(part.text);
+            node(part.expr.get());
+        }
+        u32(static_cast<uint32_t>(e->literalLength));
+    } else if (auto e = dynamic_cast<BooleanLiteral*>(n)) {
+        tag(Tag::BooleanLiteral);
+        u8(e->value);
+    } else if (auto e = dynamic_cast<Identifier*>(n)) {
+        tag(Tag::Identifier);
+        str(e->name);
+    } else if (auto e = dynamic_cast<BinaryOp*>(n)) {
+        tag(Tag::BinaryOp);
+        u8(static_cast<uint8_t>(e->op));
+        node(e->left.get());
+        node(e->right.get());
+    } else if (auto e = dynamic_cast<UnaryOp*>(n)) {
+        tag(Tag::UnaryOp);
+        u8(static_cast<uint8_t>(e->op));
+        node(e->operand.get());
+    } else if (auto e = dynamic_cast<FunctionCall*>(n)) {
+        tag(Tag::FunctionCall);
+        str(e->name);
+        node(e->callee.get());
+        nodes(e->args);
+    } else if (auto e = dynamic_cast<ArrayLiteral*>(n)) {
+        tag(Tag::ArrayLiteral);
+        nodes(e->elements);
+    } else if (auto e = dynamic_cast<ObjectLiteral*>(n)) {
+        tag(Tag::ObjectLiteral);
+        u32(static_cast<uint32_t>(e->fields.size()));
+        for (auto& field : e->fields) {
+            str(field.first);
+            node(field.second.get());
+        }
+    } else if (auto e = dynamic_cast<FunctionExpression*>(n)) {
+        tag(Tag::FunctionExpression);
+        params(e->params);
+        str(e->returnType);
+        node(e->body.get());
+    } else if (auto e = dynamic_cast<IndexAccess*>(n)) {
+        tag(Tag::IndexAccess);
+        node(e->object.get());
+        node(e->index.get());
+    } else if (auto e = dynamic_cast<FieldAccess*>(n)) {
+        tag(Tag::FieldAccess);
+        node(e->object.get());
+        str(e->field);
+    } else if (auto e = dynamic_cast<IndexAssignment*>(n)) {
+        tag(Tag::IndexAssignment);
+        node(e->object.get());
+        node(e->index.get());
+        node(e->value.get());
+    } else if (auto e = dynamic_cast<FieldAssignment*>(n)) {
+        tag(Tag::FieldAssignment);
+        node(e->object.get());
+        str(e->field);
+        node(e->value.get());
+    } else if (auto e = dynamic_cast<Assignment*>(n)) {
+        tag(Tag::Assignment);
+        str(e->name);
+        node(e->value.get());
+    } else if (auto e = dynamic_cast<AwaitExpression*>(n)) {
+        tag(Tag::AwaitExpression);
+        node(e->expression.get());
+    } else if (auto e = dynamic_cast<SpawnExpression*>(n)) {
+        tag(Tag::SpawnExpression);
+        node(e->call.get());
+    } else if (auto s = dynamic_cast<ExpressionStatement*>(n)) {
+        tag(Tag::ExpressionStatement);
+        node(s->expression.get());
+    } else if (auto s = dynamic_cast<Block*>(n)) {
+        tag(Tag::Block);
+        nodes(s->statements);
+    } else if (auto s = dynamic_cast<VariableDeclaration*>(n)) {
+        tag(Tag::VariableDeclaration);
+        str(s->name);
+        str(s->type);
+        u8(s->isConst);
+        node(s->initializer.get());
+    } else if (auto s = dynamic_cast<IfStatement*>(n)) {
+        tag(Tag::IfStatement);
+        node(s->condition.get());
+        node(s->thenBlock.get());
+        node(s->elseBlock.get());
+    } else if (auto s = dynamic_cast<WhileStatement*>(n)) {
+        tag(Tag::WhileStatement);
+        node(s->condition.get());
+        node(s->body.get());
+    } else if (auto s = dynamic_cast<ForStatement*>(n)) {
+        tag(Tag::ForStatement);
+        node(s->init.get());
+        node(s->condition.get());
+        node(s->update.get());
+        node(s->body.get());
+    } else if (auto s = dynamic_cast<ReturnStatement*>(n)) {
+        tag(Tag::ReturnStatement);
+        node(s->value.get());
+    } else if (auto s = dynamic_cast<FunctionDeclaration*>(n)) {
+        tag(Tag::FunctionDeclaration);
+        str(s->name);
+        params(s->params);
+        str(s->returnType);
+        node(s->body.get());
+    } else if (auto s = dynamic_cast<ProgramDeclaration*>(n)) {
+        tag(Tag::ProgramDeclaration);
+        str(s->name);
+        params(s->params);
+        node(s->body.get());
+    } else if (auto s = dynamic_cast<ImportDeclaration*>(n)) {
+        tag(Tag::ImportDeclaration);
+        str(s->path);
+        strings(s->namedImports);
+        str(s->defaultImport);
+    } else if (auto s = dynamic_cast<UseDeclaration*>(n)) {
+        tag(Tag::UseDeclaration);
+        str(s->path);
+    } else if (auto s = dynamic_cast<ExportDeclaration*>(n)) {
+        tag(Tag::ExportDeclaration);
+        node(s->declaration.get());
+        strings(s->namedExports);
+        u8(s->isDefault);
+    } else if (auto s = dynamic_cast<TypeDeclaration*>(n)) {
+        tag(Tag::TypeDeclaration);
+        str(s->name);
+        str(s->typeSpec);
+    } else if (auto s = dynamic_cast<ThrowStatement*>(n)) {
+        tag(Tag::ThrowStatement);
+        node(s->expression.get());
+    } else if (auto s = dynamic_cast<TryStatement*>(n)) {
+        tag(Tag::TryStatement);
+        node(s->tryBlock.get());
+        str(s->catchVariable);
+        node(s->catchBlock.get());
+        node(s->finallyBlock.get());
+    } else if (dynamic_cast<BreakStatement*>(n)) {
+        tag(Tag::BreakStatement);
+    } else if (dynamic_cast<ContinueStatement*>(n)) {
+        tag(Tag::ContinueStatement);
+    } else if (auto s = dynamic_cast<CaseClause*>(n)) {
+        tag(Tag::CaseClause);
+        node(s->value.get());
+        nodes(s->statements);
+        u8(s->isDefault);
+    } else if (auto s = dynamic_cast<SwitchStatement*>(n)) {
+        tag(Tag::SwitchStatement);
+        node(s->discriminant.get());
+        nodes(s->cases);
+    } else if (auto s = dynamic_cast<WhenStatement*>(n)) {
+        tag(Tag::WhenStatement);
+        node(s->condition.get());
+        node(s->body.get());
+        strings(s->dependencies);
+    } else {
+        throw std::runtime_error("module cache: node kind without an encoding");
+    }
+}
+
+// Thrown for truncated or inconsistent entries
+struct Malformed {};
+
+class Reader {
+public:
+    Reader(const char* data, size_t size) : p(data), end(data + size) {}
+
+    bool done() const { return p == end; }
+    // Unbinds the shadowable builtins the module's own declarations shadow
+    void bindBuiltins() { builtins.finish(); }
+
+    uint8_t u8() { return take<uint8_t>(); }
+    uint32_t u32() { return take<uint32_t>(); }
+    int32_t i32() { return take<int32_t>(); }
+    float f32() { return take<float>(); }
+    std::string str()
+    {
+        uint32_t size = u32();
+        if (static_cast<size_t>(end - p) < size) throw Malformed{};
+        std::string s(p, size);
+        p += size;
+        return s;
+    }
+    std::vector<std::string> strings()
+    {
+        std::vector<std::string> list(count());
+        for (auto& s : list) s = str();
+        return list;
+    }
+    std::vector<std::pair<std::string, std::string>> params()
+    {
+        std::vector<std::pair<std::string, std::string>> list(count());
+        for (auto& param : list) {
+            param.first = str();
+            param.second = str();
+        }
+        return list;
+    }
+    template <typename T>
+    std::vector<std::unique_ptr<T>> nodes()
+    {
+        std::vector<std::unique_ptr<T>> list(count());
+        for (auto& n : list) n = node<T>();
+        return list;
+    }
+
+    // The next node, which must be a T (or null)
+    template <typename T>
+    std::unique_ptr<T> node()
+    {
+        std::unique_ptr<ASTNode> n = anyNode();
+        if (!n) return nullptr;
+        T* typed = dynamic_cast<T*>(n.get());
+        if (!typed) throw Malformed{};
+        n.release();
+        return std::unique_ptr<T>(typed);
+    }
+
+private:
+    const char* p;
+    const char* end;
+    BuiltinBinder builtins;
+
+    template <typename T>
+    T take()
+    {
+        if (static_cast<size_t>(end - p) < sizeof(T)) throw Malformed{};
+        T v;
+        std::memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+    // Element counts can never exceed the bytes left, which bounds allocations
+    size_t count()
+    {
+        uint32_t n = u32();
+        if (n > static_cast<size_t>(end - p)) throw Malformed{};
+        return n;
+    }
+
+    std::unique_ptr<ASTNode> anyNode();
+};
+
+std::unique_ptr<ASTNode> Reader::anyNode()
+{
+    Tag tag = static_cast<Tag>(u8());
+    if (tag == Tag::Null) return nullptr;
+    int line = i32();
+    std::unique_ptr<ASTNode> n;
+
+    switch (tag) {
+        case Tag::IntegerLiteral:
+            n = std::make_unique<IntegerLiteral>(i32());
+            break;
+        case Tag::FloatLiteral:
+            n = std::make_unique<FloatLiteral>(f32());
+            break;
+        case Tag::StringLiteral:
+            n = std::make_unique<StringLiteral>(str());
+            break;
+        case Tag::TemplateLiteral: {
+            auto e = std::make_unique<TemplateLiteral>();
+            e->parts.resize(count());
+            for (auto& part : e->parts) {
+                part.text = str();
+                part.expr = node<Expression>();
+            }
+            e->literalLength = u32();
+            n = std::move(e);
+            break;
+        }
+        case Tag::BooleanLiteral:
+            n = std::make_unique<BooleanLiteral>(u8() != 0);
+            break;
+        case Tag::Identifier:
+            n = std::make_unique<Identifier>(str());
+            break;
+        case Tag::BinaryOp: {
+            auto op = static_cast<BinaryOperator>(u8());
+            auto left = node<Expression>();
+            n = std::make_unique<BinaryOp>(std::move(left), op, node<Expression>());
+            break;
+        }
+        case Tag::UnaryOp: {
+            auto op = static_cast<UnaryOperator>(u8());
+            n = std::make_unique<UnaryOp>(op, node<Expression>());
+            break;
+        }
+        case Tag::FunctionCall: {
+            std::string name = str();
+            auto callee = node<Expression>();
+            auto e = callee ? std::make_unique<FunctionCall>(std::move(callee)) : std::make_unique<FunctionCall>(name);
+            e->name = name;
+            e->args = nodes<Expression>();
+            // Bound again, as the parser does, against the builtins registered now
+            if (auto id = dynamic_cast<Identifier*>(e->callee.get())) {
+                builtins.bind(e.get(), id->name);
+            }
+            n = std::move(e);
+            break;
+        }
+        case Tag::ArrayLiteral: {
+            auto e = std::make_unique<ArrayLiteral>();
+            e->elements = nodes<Expression>();
+            n = std::move(e);
+            break;
+        }
+        case Tag::ObjectLiteral: {
+            auto e = std::make_unique<ObjectLiteral>();
+            e->fields.resize(count());
+            for (auto& field : e->fields) {
+                field.first = str();
+                field.second = node<Expression>();
+            }
+            n = std::move(e);
+            break;
+        }
+        case Tag::FunctionExpression: {
+            auto params = this->params();
+            std::string returnType = str();
+            auto e = std::make_unique<FunctionExpression>(returnType, node<Block>());
+            e->params = std::move(params);
+            for (auto& param : e->params) e->paramTypes.push_back(TypeDescriptor::get(param.second));
+            n = std::move(e);
+            break;
+        }
+        case Tag::IndexAccess: {
+            auto object = node<Expression>();
+            n = std::make_unique<IndexAccess>(std::move(object), node<Expression>());
+            break;
+        }
+        case Tag::FieldAccess: {
+            auto object = node<Expression>();
+            n = std::make_unique<FieldAccess>(std::move(object), str());
+            break;
+        }
+        case Tag::IndexAssignment: {
+            auto object = node<Expression>();
+            auto index = node<Expression>();
+            n = std::make_unique<IndexAssignment>(std::move(object), std::move(index), node<Expression>());
+            break;
+        }
+        case Tag::FieldAssignment: {
+            auto object = node<Expression>();
+            std::string field = str();
+            n = std::make_unique<FieldAssignment>(std::move(object), field, node<Expression>());
+            break;
+        }
+        case Tag::Assignment: {
+            std::string name = str();
+            n = std::make_unique<Assignment>(name, node<Expression>());
+            break;
+        }
+        case Tag::AwaitExpression:
+            n = std::make_unique<AwaitExpression>(node<Expression>());
+            break;
+        case Tag::SpawnExpression:
+            n = std::make_unique<SpawnExpression>(node<FunctionCall>());
+            break;
+        case Tag::ExpressionStatement:
+            n = std::make_unique<ExpressionStatement>(node<Expression>());
+            break;
+        case Tag::Block: {
+            auto s = std::make_unique<Block>();
+            s->statements = nodes<ASTNode>();
+            n = std::move(s);
+            break;
+        }
+        case Tag::VariableDeclaration: {
+            std::string name = str();
+            std::string type = str();
+            bool isConst = u8() != 0;
+            auto s = std::make_unique<VariableDeclaration>(name, type, node<Expression>());
+            s->isConst = isConst;
+            n = std::move(s);
+            break;
+        }
+        case Tag::IfStatement: {
+            auto condition = node<Expression>();
+            auto thenBlock = node<Block>();
+            n = std::make_unique<IfStatement>(std::move(condition), std::move(thenBlock), node<Block>());
+            break;
+        }
+        case Tag::WhileStatement: {
+            auto condition = node<Expression>();
+            n = std::make_unique<WhileStatement>(std::move(condition), node<Block>());
+            break;
+        }
+        case Tag::ForStatement: {
+            auto init = node<ASTNode>();
+            auto condition = node<Expression>();
+            auto update = node<Expression>();
+            n = std::make_unique<ForStatement>(std::move(init), std::move(condition), std::move(update), node<Block>());
+            break;
+        }
+        case Tag::ReturnStatement:
+            n = std::make_unique<ReturnStatement>(node<Expression>());
+            break;
+        case Tag::FunctionDeclaration: {
+            std::string name = str();
+            auto params = this->params();
+            std::string returnType = str();
+            builtins.declare(name);
+            auto s = std::make_unique<FunctionDeclaration>(name, returnType, node<Block>());
+            s->params = std::move(params);
+            for (auto& param : s->params) s->paramTypes.push_back(TypeDescriptor::get(param.second));
+            n = std::move(s);
+            break;
+        }
+        case Tag::ProgramDeclaration: {
+            std::string name = str();
+            auto params = this->params();
+            builtins.declare(name);
+            auto s = std::make_unique<ProgramDeclaration>(name, node<Block>());
+            s->params = std::move(params);
+            for (auto& param : s->params) s->paramTypes.push_back(TypeDescriptor::get(param.second));
+            n = std::move(s);
+            break;
+        }
+        case Tag::ImportDeclaration: {
+            auto s = std::make_unique<ImportDeclaration>(str());
+            s->namedImports = strings();
+            s->defaultImport = str();
+            for (const auto& name : s->namedImports) builtins.declare(name);
+            if (!s->defaultImport.empty()) builtins.declare(s->defaultImport);
+            n = std::move(s);
+            break;
+        }
+        case Tag::UseDeclaration:
+            n = std::make_unique<UseDeclaration>(str());
+            break;
+        case Tag::ExportDeclaration: {
+            auto declaration = node<ASTNode>();
+            auto named = strings();
+            bool isDefault = u8() != 0;
+            auto s = declaration ? std::make_unique<ExportDeclaration>(std::move(declaration), isDefault)
+                                 : std::make_unique<ExportDeclaration>(named);
+            s->namedExports = std::move(named);
+            s->isDefault = isDefault;
+            n = std::move(s);
+            break;
+        }
+        case Tag::TypeDeclaration: {
+            std::string name = str();
+            n = std::make_unique<TypeDeclaration>(name, str());
+            break;
+        }
+        case Tag::ThrowStatement:
+            n = std::make_unique<ThrowStatement>(node<Expression>());
+            break;
+        case Tag::TryStatement: {
+            auto tryBlock = node<Block>();
+            std::string catchVariable = str();
+            auto catchBlock = node<Block>();
+            n = std::make_unique<TryStatement>(std::move(tryBlock), catchVariable, std::move(catchBlock), node<Block>());
+            break;
+        }
+        case Tag::BreakStatement:
+            n = std::make_unique<BreakStatement>();
+            break;
+        case Tag::ContinueStatement:
+            n = std::make_unique<ContinueStatement>();
+            break;
+        case Tag::CaseClause: {
+            auto value = node<Expression>();
+            auto statements = nodes<ASTNode>();
+            auto s = std::make_unique<CaseClause>(std::move(value), u8() != 0);
+            s->statements = std::move(statements);
+            n = std::move(s);
+            break;
+        }
+        case Tag::SwitchStatement: {
+            auto s = std::make_unique<SwitchStatement>(node<Expression>());
+            s->cases = nodes<CaseClause>();
+            n = std::move(s);
+            break;
+        }
+        case Tag::WhenStatement: {
+            auto condition = node<Expression>();
+            auto body = node<Block>();
+            n = std::make_unique<WhenStatement>(std::move(condition), std::move(body), strings());
+            break;
+        }
+        default:
+            throw Malformed{};
+    }
+    n->line = line;
+    return n;
+}
+
+// A file's bytes, mapped where possible
+class FileBytes {
+public:
+    explicit FileBytes(const std::string& path)
+    {
+#ifdef AXO_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                mappedData = static_cast<const char*>(mapped);
+                mappedSize = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (file) buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+#endif
+    }
+    ~FileBytes()
+    {
+#ifdef AXO_HAVE_MMAP
+        if (mappedData) munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+    }
+    FileBytes(const FileBytes&) = delete;
+    FileBytes& operator=(const FileBytes&) = delete;
+
+    const char* data() const { return mappedData ? mappedData : buffer.data(); }
+    size_t size() const { return mappedData ? mappedSize : buffer.size(); }
+
+private:
+    const char* mappedData = nullptr;
+    size_t mappedSize = 0;
+    std::vector<char> buffer;
+};
+
+int64_t modificationTime(const std::string& path)
+{
+    return static_cast<int64_t>(fs::last_write_time(path).time_since_epoch().count());
+}
+
+std::string readSource(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open import file: " + path);
+    }
+    std::string source(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&source[0], static_cast<std::streamsize>(source.size()));
+    source.resize(static_cast<size_t>(file.gcount()));
+    return source;
+}
+
+} // namespace
+
+ModuleCache::ModuleCache(std::string directory) : dir(std::move(directory))
+{
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+}
+
+std::string ModuleCache::entryPath(const std::string& path) const
+{
+    std::string absolute = fs::absolute(path).lexically_normal().string();
+    return (fs::path(dir) / (llvm::utohexstr(hash(absolute), /*LowerCase=*/true) + ".axom")).string();
+}
+
+uint64_t ModuleCache::hash(const std::string& text)
+{
+    return llvm::xxHash64(text);
+}
+
+ModuleCache::Module ModuleCache::load(const std::string& path)
+{
+    std::error_code ec;
+    int64_t mtime = modificationTime(path);
+    uint64_t size = fs::file_size(path, ec);
+    std::string entry = entryPath(path);
+
+    Module module;
+    std::string source;
+    bool sourceRead = false;
+    bool restamp = false;
+    Header stamped;
+    {
+        FileBytes bytes(entry);
+        Header header;
+        if (bytes.size() >= sizeof kMagic + sizeof header && std::memcmp(bytes.data(), kMagic, sizeof kMagic) == 0) {
+            std::memcpy(&header, bytes.data() + sizeof kMagic, sizeof header);
+            bool fresh = header.version == kFormatVersion && header.mtime == mtime && header.size == size;
+            if (!fresh && header.version == kFormatVersion) {
+                // Touched but maybe not changed: compare the contents
+                source = readSource(path);
+                sourceRead = true;
+                fresh = hash(source) == header.hash;
+                restamp = fresh;
+            }
+            size_t offset = sizeof kMagic + sizeof header;
+            llvm::StringRef body(bytes.data() + offset, bytes.size() - offset);
+            if (fresh && llvm::xxHash64(body) == header.bodyHash) {
+                module.program = decode(body.data(), body.size());
+                module.sourceHash = header.hash;
+                stamped = header;
+            }
+        }
+    }
+    if (module.program) {
+        if (restamp) {
+            // Same contents under a new time: record it so the next run skips the hash
+            Header header = stamped;
+            header.mtime = mtime;
+            header.size = size;
+            std::fstream out(entry, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp(sizeof kMagic);
+            out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        }
+        return module;
+    }
+
+    if (!sourceRead) source = readSource(path);
+    module.sourceHash = hash(source);
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    module.program = parser.parse();
+
+    // Written to a temporary name and renamed, so a concurrent run never
+    // maps a half-written entry
+    std::string body = encode(*module.program);
+    Header header{kFormatVersion, mtime, size, module.sourceHash, llvm::xxHash64(body)};
+    std::string encoded(kMagic, sizeof kMagic);
+    encoded.append(reinterpret_cast<const char*>(&header), sizeof header);
+    encoded += body;
+    std::string temporary = entry + ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+        if (!out) {
+            fs::remove(temporary, ec);
+            return module;
+        }
+    }
+    fs::rename(temporary, entry, ec);
+    if (ec) fs::remove(temporary, ec);
+    return module;
+}
+
+std::string ModuleCache::encode(Program& program)
+{
+    Writer writer;
+    writer.nodes(program.declarations);
+    return std::move(writer.out);
+}
+
+std::unique_ptr<Program> ModuleCache::decode(const char* data, size_t size)
+{
+    auto program = std::make_unique<Program>();
+    ArenaScope arena(program->arena.get());
+    try {
+        Reader reader(data, size);
+        program->declarations = reader.nodes<ASTNode>();
+        if (!reader.done()) return nullptr;
+        reader.bindBuiltins();
+    } catch (const Malformed&) {
+        return nullptr;
+    }
+    return program;
+}
@@ -0,0 +1,895 @@
+#include "include/optimizer.h"
+#include "include/builtins.h"
+#include "include/interpreter.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <unordered_set>
+
+namespace {
+
+// Calls f(ASTNode*) for every child of `node` that is present
+template <typename F>
+void eachChild(ASTNode* node, F f)
+{
+    auto visit = [&](ASTNode* child) {
+        if (child) f(child);
+    };
+    if (auto program = dynamic_cast<Program*>(node)) {
+        for (auto& decl : program->declarations) visit(decl.get());
+    } else if (auto tmpl = dynamic_cast<TemplateLiteral*>(node)) {
+        for (auto& part : tmpl->parts) visit(part.expr.get());
+    } else if (auto bin = dynamic_cast<BinaryOp*>(node)) {
+        visit(bin->left.get());
+        visit(bin->right.get());
+    } else if (auto un = dynamic_cast<UnaryOp*>(node)) {
+        visit(un->operand.get());
+    } else if (auto call = dynamic_cast<FunctionCall*>(node)) {
+        visit(call->callee.get());
+        for (auto& arg : call->args) visit(arg.get());
+    } else if (auto arr = dynamic_cast<ArrayLiteral*>(node)) {
+        for (auto& e : arr->elements) visit(e.get());
+    } else if (auto obj = dynamic_cast<ObjectLiteral*>(node)) {
+        for (auto& field : obj->fields) visit(field.second.get());
+    } else if (auto fn = dynamic_cast<FunctionExpression*>(node)) {
+        visit(fn->body.get());
+    } else if (auto idx = dynamic_cast<IndexAccess*>(node)) {
+        visit(idx->object.get());
+        visit(idx->index.get());
+    } else if (auto field = dynamic_cast<FieldAccess*>(node)) {
+        visit(field->object.get());
+    } else if (auto assign = dynamic_cast<IndexAssignment*>(node)) {
+        visit(assign->object.get());
+        visit(assign->index.get());
+        visit(assign->value.get());
+    } else if (auto assign = dynamic_cast<FieldAssignment*>(node)) {
+        visit(assign->object.get());
+        visit(assign->value.get());
+    } else if (auto assign = dynamic_cast<Assignment*>(node)) {
+        visit(assign->value.get());
+    } else if (auto await = dynamic_cast<AwaitExpression*>(node)) {
+        visit(await->expression.get());
+    } else if (auto spawn = dynamic_cast<SpawnExpression*>(node)) {
+        visit(spawn->call.get());
+    } else if (auto stmt = dynamic_cast<ExpressionStatement*>(node)) {
+        visit(stmt->expression.get());
+    } else if (auto block = dynamic_cast<Block*>(node)) {
+        for (auto& s : block->statements) visit(s.get());
+    } else if (auto decl = dynamic_cast<VariableDeclaration*>(node)) {
+        visit(decl->initializer.get());
+    } else if (auto stmt = dynamic_cast<IfStatement*>(node)) {
+        visit(stmt->condition.get());
+        visit(stmt->thenBlock.get());
+        visit(stmt->elseBlock.get());
+    } else if (auto stmt = dynamic_cast<WhileStatement*>(node)) {
+        visit(stmt->condition.get());
+        visit(stmt->body.get());
+    } else if (auto stmt = dynamic_cast<ForStatement*>(node)) {
+        visit(stmt->init.get());
+        visit(stmt->condition.get());
+        visit(stmt->update.get());
+        visit(stmt->body.get());
+    } else if (auto stmt = dynamic_cast<ReturnStatement*>(node)) {
+        visit(stmt->value.get());
+    } else if (auto fn = dynamic_cast<FunctionDeclaration*>(node)) {
+        visit(fn->body.get());
+    } else if (auto prog = dynamic_cast<ProgramDeclaration*>(node)) {
+        visit(prog->body.get());
+    } else if (auto exp = dynamic_cast<ExportDeclaration*>(node)) {
+        visit(exp->declaration.get());
+    } else if (auto stmt = dynamic_cast<ThrowStatement*>(node)) {
+        visit(stmt->expression.get());
+    } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+        visit(stmt->tryBlock.get());
+        visit(stmt->catchBlock.get());
+        visit(stmt->finallyBlock.get());
+    } else if (auto clause = dynamic_cast<CaseClause*>(node)) {
+        visit(clause->value.get());
+        for (auto& s : clause->statements) visit(s.get());
+    } else if (auto stmt = dynamic_cast<SwitchStatement*>(node)) {
+        visit(stmt->discriminant.get());
+        for (auto& clause : stmt->cases) visit(clause.get());
+    } else if (auto stmt = dynamic_cast<WhenStatement*>(node)) {
+        visit(stmt->condition.get());
+        visit(stmt->body.get());
+    }
+}
+
+bool isLiteral(const Expression* expr)
+{
+    return dynamic_cast<const IntegerLiteral*>(expr) || dynamic_cast<const FloatLiteral*>(expr) ||
+           dynamic_cast<const StringLiteral*>(expr) || dynamic_cast<const BooleanLiteral*>(expr);
+}
+
+// The value of a node isLiteral() accepted
+Value literalValue(const Expression* expr)
+{
+    if (auto e = dynamic_cast<const IntegerLiteral*>(expr)) return e->value;
+    if (auto e = dynamic_cast<const FloatLiteral*>(expr)) return e->value;
+    if (auto e = dynamic_cast<const BooleanLiteral*>(expr)) return e->value;
+    return static_cast<const StringLiteral*>(expr)->value;
+}
+
+// A literal for an int, float, bool or string; null for any other value
+std::unique_ptr<Expression> makeLiteral(const Value& value)
+{
+    if (auto v = std::get_if<int>(&value)) return std::make_unique<IntegerLiteral>(*v);
+    if (auto v = std::get_if<float>(&value)) return std::make_unique<FloatLiteral>(*v);
+    if (auto v = std::get_if<bool>(&value)) return std::make_unique<BooleanLiteral>(*v);
+    if (auto v = std::get_if<std::string>(&value)) return std::make_unique<StringLiteral>(*v);
+    return nullptr;
+}
+
+// Whether `literal` holds exactly what a variable of type `type` would store
+bool literalOfType(const Expression* literal, const std::string& type)
+{
+    return (type == "int" && dynamic_cast<const IntegerLiteral*>(literal)) ||
+           (type == "float" && dynamic_cast<const FloatLiteral*>(literal)) ||
+           (type == "string" && dynamic_cast<const StringLiteral*>(literal)) ||
+           (type == "bool" && dynamic_cast<const BooleanLiteral*>(literal));
+}
+
+// Statements after these in the same list never run
+bool endsStatements(const ASTNode* node)
+{
+    return dynamic_cast<const ReturnStatement*>(node) || dynamic_cast<const BreakStatement*>(node) ||
+           dynamic_cast<const ContinueStatement*>(node) || dynamic_cast<const ThrowStatement*>(node);
+}
+
+bool isEmptyBlock(const ASTNode* node)
+{
+    auto block = dynamic_cast<const Block*>(node);
+    return block && block->statements.empty();
+}
+
+// Builtins that run no script code and change neither the length of what
+// they are given nor any variable
+bool keepsLengths(const NativeFunction* builtin)
+{
+    static const std::unordered_set<std::string> names = {
+        "print", "len", "toString", "substr", "toUpper", "toLower", "indexOf", "contains",
+        "sqrt", "pow", "abs", "floor", "ceil", "round", "min", "max", "sin", "cos", "tan",
+        "log", "log10", "exp", "asin", "acos", "atan", "atan2", "clamp", "lerp",
+        "sum", "dot", "slice", "join", "find", "includes", "trim", "startsWith", "endsWith",
+        "repeat", "charAt", "charCodeAt", "toInt", "toFloat", "toBool", "keys", "hasKey",
+    };
+    return builtin && !builtin->takesArrayVariable && names.count(builtin->name);
+}
+
+// The identifier `expr` takes the length of, if it is len(identifier)
+Identifier* lengthOf(Expression* expr)
+{
+    auto call = dynamic_cast<FunctionCall*>(expr);
+    if (!call || !call->builtin || call->builtin->name != "len" || call->args.size() != 1) {
+        return nullptr;
+    }
+    return dynamic_cast<Identifier*>(call->args[0].get());
+}
+
+class SourceWriter {
+public:
+    explicit SourceWriter(std::ostream& out) : out(out) {}
+
+    void statement(ASTNode* node)
+    {
+        indent();
+        if (auto block = dynamic_cast<Block*>(node)) {
+            body(block);
+            out << '\n';
+            return;
+        }
+        if (auto decl = dynamic_cast<VariableDeclaration*>(node)) {
+            declaration(decl);
+            out << ";\n";
+        } else if (auto stmt = dynamic_cast<ExpressionStatement*>(node)) {
+            expression(stmt->expression.get());
+            out << ";\n";
+        } else if (auto stmt = dynamic_cast<IfStatement*>(node)) {
+            out << "if (";
+            expression(stmt->condition.get());
+            out << ") ";
+            body(stmt->thenBlock.get());
+            if (stmt->elseBlock) {
+                out << " else ";
+                body(stmt->elseBlock.get());
+            }
+            out << '\n';
+        } else if (auto stmt = dynamic_cast<WhileStatement*>(node)) {
+            out << "while (";
+            expression(stmt->condition.get());
+            out << ") ";
+            body(stmt->body.get());
+            out << '\n';
+        } else if (auto stmt = dynamic_cast<ForStatement*>(node)) {
+            out << "for (";
+            if (auto decl = dynamic_cast<VariableDeclaration*>(stmt->init.get())) {
+                declaration(decl);
+            } else if (auto init = dynamic_cast<Expression*>(stmt->init.get())) {
+                expression(init);
+            }
+            out << "; ";
+            expression(stmt->condition.get());
+            out << "; ";
+            expression(stmt->update.get());
+            out << ") ";
+            body(stmt->body.get());
+            out << '\n';
+        } else if (auto stmt = dynamic_cast<ReturnStatement*>(node)) {
+            out << "return";
+            if (stmt->value) {
+                out << ' ';
+                expression(stmt->value.get());
+            }
+            out << ";\n";
+        } else if (auto fn = dynamic_cast<FunctionDeclaration*>(node)) {
+            out << "func " << fn->name;
+            params(fn->params);
+            out << " -> " << fn->returnType << ' ';
+            body(fn->body.get());
+            out << '\n';
+        } else if (auto prog = dynamic_cast<ProgramDeclaration*>(node)) {
+            out << "program " << prog->name;
+            params(prog->params);
+            out << ' ';
+            body(prog->body.get());
+            out << '\n';
+        } else if (auto import = dynamic_cast<ImportDeclaration*>(node)) {
+            out << "import ";
+            if (!import->defaultImport.empty() || !import->namedImports.empty()) {
+                out << import->defaultImport;
+                if (!import->defaultImport.empty() && !import->namedImports.empty()) out << ", ";
+                if (!import->namedImports.empty()) out << '{' << list(import->namedImports) << '}';
+                out << " from ";
+            }
+            quoted(import->path);
+            out << ";\n";
+        } else if (auto use = dynamic_cast<UseDeclaration*>(node)) {
+            out << "use ";
+            quoted(use->path);
+            out << ";\n";
+        } else if (auto exp = dynamic_cast<ExportDeclaration*>(node)) {
+            if (!exp->declaration) {
+                out << "export {" << list(exp->namedExports) << "};\n";
+                return;
+            }
+            out << (exp->isDefault ? "export default " : "export ");
+            std::ostringstream inner;
+            SourceWriter(inner).statement(exp->declaration.get());
+            out << inner.str().substr(0, inner.str().size() - 1);  // without its newline
+            out << '\n';
+        } else if (auto type = dynamic_cast<TypeDeclaration*>(node)) {
+            out << "type " << type->name << " = " << type->typeSpec << ";\n";
+        } else if (auto stmt = dynamic_cast<ThrowStatement*>(node)) {
+            out << "throw ";
+            expression(stmt->expression.get());
+            out << ";\n";
+        } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+            out << "try ";
+            body(stmt->tryBlock.get());
+            if (stmt->catchBlock) {
+                out << " catch (" << stmt->catchVariable << ") ";
+                body(stmt->catchBlock.get());
+            }
+            if (stmt->finallyBlock) {
+                out << " finally ";
+                body(stmt->finallyBlock.get());
+            }
+            out << '\n';
+        } else if (dynamic_cast<BreakStatement*>(node)) {
+            out << "break;\n";
+        } else if (dynamic_cast<ContinueStatement*>(node)) {
+            out << "continue;\n";
+        } else if (auto stmt = dynamic_cast<SwitchStatement*>(node)) {
+            out << "switch (";
+            expression(stmt->discriminant.get());
+            out << ") {\n";
+            for (auto& clause : stmt->cases) {
+                indent();
+                if (clause->isDefault) {
+                    out << "default:\n";
+                } else {
+                    out << "case ";
+                    expression(clause->value.get());
+                    out << ":\n";
+                }
+                depth += 2;
+                for (auto& s : clause->statements) statement(s.get());
+                depth -= 2;
+            }
+            indent();
+            out << "}\n";
+        } else if (auto stmt = dynamic_cast<WhenStatement*>(node)) {
+            out << "when (";
+            expression(stmt->condition.get());
+            if (!stmt->dependencies.empty() && !stmt->inferred) {
+                out << ", [" << list(stmt->dependencies) << ']';
+            }
+            out << ") ";
+            body(stmt->body.get());
+            out << '\n';
+        } else if (auto expr = dynamic_cast<Expression*>(node)) {
+            expression(expr);
+            out << ";\n";
+        }
+    }
+
+    void expression(Expression* expr)
+    {
+        if (auto e = dynamic_cast<IntegerLiteral*>(expr)) {
+            out << e->value;
+        } else if (auto e = dynamic_cast<FloatLiteral*>(expr)) {
+            if (!std::isfinite(e->value)) {
+                // Folded from a division; there is no literal for these
+                out << (std::isnan(e->value) ? "(0.0 / 0.0)" : e->value > 0 ? "(1.0 / 0.0)" : "(-1.0 / 0.0)");
+                return;
+            }
+            std::ostringstream text;
+            text << std::setprecision(9) << e->value;
+            std::string s = text.str();
+            if (s.find_first_of(".eni") == std::string::npos) s += ".0";  // keep it a float
+            out << s;
+        } else if (auto e = dynamic_cast<StringLiteral*>(expr)) {
+            quoted(e->value);
+        } else if (auto e = dynamic_cast<TemplateLiteral*>(expr)) {
+            out << '"';
+            for (auto& part : e->parts) {
+                if (part.expr) {
+                    out << "${";
+                    expression(part.expr.get());
+                    out << '}';
+                } else {
+                    escaped(part.text);
+                }
+            }
+            out << '"';
+        } else if (auto e = dynamic_cast<BooleanLiteral*>(expr)) {
+            out << (e->value ? "true" : "false");
+        } else if (auto e = dynamic_cast<Identifier*>(expr)) {
+            out << variable(e->name);
+        } else if (auto e = dynamic_cast<BinaryOp*>(expr)) {
+            operand(e->left.get());
+            out << ' ' << binaryOpToString(e->op) << ' ';
+            operand(e->right.get());
+        } else if (auto e = dynamic_cast<UnaryOp*>(expr)) {
+            out << (e->op == UnaryOperator::TYPEOF ? "typeof " : unaryOpToString(e->op));
+            operand(e->operand.get());
+        } else if (auto e = dynamic_cast<FunctionCall*>(expr)) {
+            if (e->callee) {
+                operand(e->callee.get());
+            } else {
+                out << e->name;
+            }
+            out << '(';
+            for (size_t i = 0; i < e->args.size(); ++i) {
+                if (i) out << ", ";
+                expression(e->args[i].get());
+            }
+            out << ')';
+        } else if (auto e = dynamic_cast<ArrayLiteral*>(expr)) {
+            out << '[';
+            for (size_t i = 0; i < e->elements.size(); ++i) {
+                if (i) out << ", ";
+                expression(e->elements[i].get());
+            }
+            out << ']';
+        } else if (auto e = dynamic_cast<ObjectLiteral*>(expr)) {
+            out << '{';
+            for (size_t i = 0; i < e->fields.size(); ++i) {
+                if (i) out << ", ";
+                out << e->fields[i].first << ": ";
+                expression(e->fields[i].second.get());
+            }
+            out << '}';
+        } else if (auto e = dynamic_cast<FunctionExpression*>(expr)) {
+            out << "func";
+            params(e->params);
+            out << " -> " << e->returnType << ' ';
+            body(e->body.get());
+        } else if (auto e = dynamic_cast<IndexAccess*>(expr)) {
+            operand(e->object.get());
+            out << '[';
+            expression(e->index.get());
+            out << ']';
+        } else if (auto e = dynamic_cast<FieldAccess*>(expr)) {
+            operand(e->object.get());
+            out << '.' << e->field;
+        } else if (auto e = dynamic_cast<IndexAssignment*>(expr)) {
+            operand(e->object.get());
+            out << '[';
+            expression(e->index.get());
+            out << "] = ";
+            expression(e->value.get());
+        } else if (auto e = dynamic_cast<FieldAssignment*>(expr)) {
+            operand(e->object.get());
+            out << '.' << e->field << " = ";
+            expression(e->value.get());
+        } else if (auto e = dynamic_cast<Assignment*>(expr)) {
+            out << e->name << " = ";
+            expression(e->value.get());
+        } else if (auto e = dynamic_cast<AwaitExpression*>(expr)) {
+            out << "await ";
+            operand(e->expression.get());
+        } else if (auto e = dynamic_cast<SpawnExpression*>(expr)) {
+            out << "spawn ";
+            expression(e->call.get());
+        }
+    }
+
+private:
+    std::ostream& out;
+    int depth = 0;
+
+    void indent() { out << std::string(depth, ' '); }
+
+    // Hoisted lengths are named len(x), which no script can declare; they are
+    // written as __len_x so the dump parses
+    static std::string variable(const std::string& name)
+    {
+        if (name.rfind("len(", 0) == 0 && name.back() == ')') {
+            return "__len_" + name.substr(4, name.size() - 5);
+        }
+        return name;
+    }
+
+    // `expr` where it binds tighter than any operator
+    void operand(Expression* expr)
+    {
+        bool wrap = dynamic_cast<BinaryOp*>(expr) || dynamic_cast<UnaryOp*>(expr) ||
+                    dynamic_cast<Assignment*>(expr) || dynamic_cast<IndexAssignment*>(expr) ||
+                    dynamic_cast<FieldAssignment*>(expr) || dynamic_cast<AwaitExpression*>(expr) ||
+                    dynamic_cast<SpawnExpression*>(expr);
+        if (wrap) out << '(';
+        expression(expr);
+        if (wrap) out << ')';
+    }
+
+    void body(Block* block)
+    {
+        out << "{\n";
+        depth += 4;
+        for (auto& s : block->statements) statement(s.get());
+        depth -= 4;
+        indent();
+        out << '}';
+    }
+
+    void declaration(VariableDeclaration* decl)
+    {
+        out << (decl->isConst ? "const " : "var ") << variable(decl->name) << ": " << decl->type;
+        if (decl->initializer) {
+            out << " = ";
+            expression(decl->initializer.get());
+        }
+    }
+
+    void params(const std::vector<std::pair<std::string, std::string>>& params)
+    {
+        out << '(';
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i) out << ", ";
+            out << params[i].first << ": " << params[i].second;
+        }
+        out << ')';
+    }
+
+    static std::string list(const std::vector<std::string>& names)
+    {
+        std::string result;
+        for (auto& name : names) {
+            if (!result.empty()) result += ", ";
+            result += name;
+        }
+        return result;
+    }
+
+    void quoted(const std::string& text)
+    {
+        out << '"';
+        escaped(text);
+        out << '"';
+    }
+
+    void escaped(const std::string& text)
+    {
+        for (char c : text) {
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                case '\r': out << "\\r"; break;
+                default: out << c;
+            }
+        }
+    }
+};
+
+} // namespace
+
+void Optimizer::optimize(Program* program)
+{
+    if (level <= program->optimized) return;
+    program->optimized = level;
+    // Replacements are allocated like the parsed nodes, so they are freed the same way
+    ArenaScope arena(program->arena.get());
+
+    names.clear();
+    seesEverything = true;
+    hasWhen = false;
+    constants.clear();
+    constantOrder.clear();
+    if (level >= 2) {
+        gather(program);
+    }
+    rewriteStatements(program->declarations);
+}
+
+void Optimizer::print(Program* program, std::ostream& out)
+{
+    SourceWriter writer(out);
+    for (auto& decl : program->declarations) {
+        writer.statement(decl.get());
+    }
+}
+
+// Counts the declarations and finds the writes of every name in the program
+void Optimizer::gather(ASTNode* node)
+{
+    auto declared = [this](const std::string& name, const std::string& type) {
+        Name& info = names[name];
+        info.declarations++;
+        info.type = type;
+    };
+    auto parameters = [&](const std::vector<std::pair<std::string, std::string>>& params) {
+        for (auto& param : params) declared(param.first, param.second);
+    };
+
+    if (auto decl = dynamic_cast<VariableDeclaration*>(node)) {
+        declared(decl->name, decl->type);
+    } else if (auto fn = dynamic_cast<FunctionDeclaration*>(node)) {
+        declared(fn->name, "function");
+        parameters(fn->params);
+    } else if (auto fn = dynamic_cast<FunctionExpression*>(node)) {
+        parameters(fn->params);
+    } else if (auto prog = dynamic_cast<ProgramDeclaration*>(node)) {
+        declared(prog->name, "program");
+        parameters(prog->params);
+    } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+        if (!stmt->catchVariable.empty()) declared(stmt->catchVariable, "any");
+    } else if (auto assign = dynamic_cast<Assignment*>(node)) {
+        names[assign->name].assigned = true;
+    } else if (auto assign = dynamic_cast<IndexAssignment*>(node)) {
+        if (auto id = dynamic_cast<Identifier*>(assign->object.get())) names[id->name].assigned = true;
+    } else if (auto assign = dynamic_cast<FieldAssignment*>(node)) {
+        if (auto id = dynamic_cast<Identifier*>(assign->object.get())) names[id->name].assigned = true;
+    } else if (auto call = dynamic_cast<FunctionCall*>(node)) {
+        // push, pop and sort write the variable they are given
+        if (call->builtin && call->builtin->takesArrayVariable && !call->args.empty()) {
+            if (auto id = dynamic_cast<Identifier*>(call->args[0].get())) names[id->name].assigned = true;
+        }
+    } else if (dynamic_cast<ImportDeclaration*>(node) || dynamic_cast<UseDeclaration*>(node)) {
+        seesEverything = false;
+    } else if (dynamic_cast<WhenStatement*>(node)) {
+        hasWhen = true;
+    }
+    eachChild(node, [this](ASTNode* child) { gather(child); });
+}
+
+// Reads of a const declared once, never written and initialized to a literal
+// of its own type can only ever see that literal
+void Optimizer::declare(VariableDeclaration* decl)
+{
+    if (level < 2 || !seesEverything || !decl->isConst || !literalOfType(decl->initializer.get(), decl->type)) {
+        return;
+    }
+    auto it = names.find(decl->name);
+    if (it == names.end() || it->second.declarations != 1 || it->second.assigned) {
+        return;
+    }
+    constants[decl->name] = literalValue(decl->initializer.get());
+    constantOrder.push_back(decl->name);
+}
+
+void Optimizer::forgetSince(size_t mark)
+{
+    for (size_t i = mark; i < constantOrder.size(); ++i) {
+        constants.erase(constantOrder[i]);
+    }
+    constantOrder.resize(mark);
+}
+
+void Optimizer::rewriteStatements(std::vector<std::unique_ptr<ASTNode>>& statements)
+{
+    for (size_t i = 0; i < statements.size(); ++i) {
+        rewrite(statements[i]);
+        if (endsStatements(statements[i].get())) {
+            statements.erase(statements.begin() + i + 1, statements.end());
+            break;
+        }
+    }
+    // Untaken branches and loops that never run were left as empty blocks
+    statements.erase(std::remove_if(statements.begin(), statements.end(),
+                                    [](const std::unique_ptr<ASTNode>& s) { return isEmptyBlock(s.get()); }),
+                     statements.end());
+}
+
+void Optimizer::rewriteBlock(Block* block)
+{
+    if (!block) return;
+    size_t mark = constantOrder.size();
+    rewriteStatements(block->statements);
+    forgetSince(mark);
+}
+
+// Function, program and when bodies run later, from wherever they are called
+// or triggered, so the consts around them may not be defined yet there
+void Optimizer::rewriteFunction(Block* body)
+{
+    auto outerConstants = std::move(constants);
+    auto outerOrder = std::move(constantOrder);
+    constants.clear();
+    constantOrder.clear();
+    rewriteBlock(body);
+    constants = std::move(outerConstants);
+    constantOrder = std::move(outerOrder);
+}
+
+void Optimizer::rewrite(std::unique_ptr<ASTNode>& node)
+{
+    ASTNode* n = node.get();
+    if (!n) return;
+
+    if (auto stmt = dynamic_cast<ExpressionStatement*>(n)) {
+        rewrite(stmt->expression);
+    } else if (auto decl = dynamic_cast<VariableDeclaration*>(n)) {
+        rewrite(decl->initializer);
+        declare(decl);
+    } else if (auto block = dynamic_cast<Block*>(n)) {
+        rewriteBlock(block);
+    } else if (auto stmt = dynamic_cast<IfStatement*>(n)) {
+        rewrite(stmt->condition);
+        rewriteBlock(stmt->thenBlock.get());
+        rewriteBlock(stmt->elseBlock.get());
+        if (isLiteral(stmt->condition.get())) {
+            bool taken = interp.isTruthy(literalValue(stmt->condition.get()));
+            std::unique_ptr<Block> branch = std::move(taken ? stmt->thenBlock : stmt->elseBlock);
+            node = branch ? std::move(branch) : std::make_unique<Block>();
+        }
+    } else if (auto stmt = dynamic_cast<WhileStatement*>(n)) {
+        rewrite(stmt->condition);
+        if (isLiteral(stmt->condition.get()) && !interp.isTruthy(literalValue(stmt->condition.get()))) {
+            node = std::make_unique<Block>();
+            return;
+        }
+        rewriteBlock(stmt->body.get());
+    } else if (auto stmt = dynamic_cast<ForStatement*>(n)) {
+        size_t mark = constantOrder.size();
+        if (dynamic_cast<Expression*>(stmt->init.get())) {
+            std::unique_ptr<Expression> init(static_cast<Expression*>(stmt->init.release()));
+            rewrite(init);
+            stmt->init = std::move(init);
+        } else {
+            rewrite(stmt->init);
+        }
+        rewrite(stmt->condition);
+        rewrite(stmt->update);
+        rewriteBlock(stmt->body.get());
+        forgetSince(mark);
+        hoistLength(node);
+    } else if (auto stmt = dynamic_cast<ReturnStatement*>(n)) {
+        rewrite(stmt->value);
+    } else if (auto stmt = dynamic_cast<ThrowStatement*>(n)) {
+        rewrite(stmt->expression);
+    } else if (auto fn = dynamic_cast<FunctionDeclaration*>(n)) {
+        rewriteFunction(fn->body.get());
+    } else if (auto prog = dynamic_cast<ProgramDeclaration*>(n)) {
+        rewriteFunction(prog->body.get());
+    } else if (auto exp = dynamic_cast<ExportDeclaration*>(n)) {
+        rewrite(exp->declaration);
+    } else if (auto stmt = dynamic_cast<TryStatement*>(n)) {
+        rewriteBlock(stmt->tryBlock.get());
+        rewriteBlock(stmt->catchBlock.get());
+        rewriteBlock(stmt->finallyBlock.get());
+    } else if (auto stmt = dynamic_cast<SwitchStatement*>(n)) {
+        rewrite(stmt->discriminant);
+        for (auto& clause : stmt->cases) {
+            rewrite(clause->value);
+            // A case's declarations only exist if it ran, so they stay
+            // within it here even though they outlive it at run time
+            size_t mark = constantOrder.size();
+            rewriteStatements(clause->statements);
+            forgetSince(mark);
+        }
+    } else if (auto stmt = dynamic_cast<WhenStatement*>(n)) {
+        auto outerConstants = std::move(constants);
+        auto outerOrder = std::move(constantOrder);
+        constants.clear();
+        constantOrder.clear();
+        rewrite(stmt->condition);
+        rewriteBlock(stmt->body.get());
+        constants = std::move(outerConstants);
+        constantOrder = std::move(outerOrder);
+    }
+    // Imports, use, type declarations, break and continue have nothing to rewrite
+}
+
+void Optimizer::rewrite(std::unique_ptr<Expression>& expr)
+{
+    Expression* e = expr.get();
+    if (!e) return;
+
+    if (auto id = dynamic_cast<Identifier*>(e)) {
+        auto it = constants.find(id->name);
+        if (it != constants.end()) {
+            expr = makeLiteral(it->second);
+        }
+    } else if (auto bin = dynamic_cast<BinaryOp*>(e)) {
+        rewrite(bin->left);
+        rewrite(bin->right);
+        Value result;
+        if (isLiteral(bin->left.get()) && isLiteral(bin->right.get()) &&
+            fold(bin->op, literalValue(bin->left.get()), literalValue(bin->right.get()), result)) {
+            expr = makeLiteral(result);
+        }
+    } else if (auto un = dynamic_cast<UnaryOp*>(e)) {
+        // typeof on a variable reports its declared type, not its value's
+        if (un->op != UnaryOperator::TYPEOF || !dynamic_cast<Identifier*>(un->operand.get())) {
+            rewrite(un->operand);
+        }
+        if (isLiteral(un->operand.get())) {
+            try {
+                expr = makeLiteral(interp.performUnaryOp(un->op, literalValue(un->operand.get())));
+            } catch (const std::exception&) {
+                // e.g. negating a string: fails when it runs
+            }
+        }
+    } else if (auto tmpl = dynamic_cast<TemplateLiteral*>(e)) {
+        rewriteTemplate(tmpl);
+        if (tmpl->parts.size() == 1 && !tmpl->parts[0].expr) {
+            expr = std::make_unique<StringLiteral>(tmpl->parts[0].text);
+        } else if (tmpl->parts.empty()) {
+            expr = std::make_unique<StringLiteral>("");
+        }
+    } else if (auto call = dynamic_cast<FunctionCall*>(e)) {
+        // A callee named directly is found among the functions, not the variables
+        if (!dynamic_cast<Identifier*>(call->callee.get())) {
+            rewrite(call->callee);
+        }
+        for (size_t i = 0; i < call->args.size(); ++i) {
+            bool arrayVariable = i == 0 && call->builtin && call->builtin->takesArrayVariable &&
+                                 dynamic_cast<Identifier*>(call->args[0].get());
+            if (!arrayVariable) rewrite(call->args[i]);
+        }
+    } else if (auto arr = dynamic_cast<ArrayLiteral*>(e)) {
+        for (auto& element : arr->elements) rewrite(element);
+    } else if (auto obj = dynamic_cast<ObjectLiteral*>(e)) {
+        for (auto& field : obj->fields) rewrite(field.second);
+    } else if (auto fn = dynamic_cast<FunctionExpression*>(e)) {
+        rewriteFunction(fn->body.get());
+    } else if (auto idx = dynamic_cast<IndexAccess*>(e)) {
+        rewrite(idx->object);
+        rewrite(idx->index);
+    } else if (auto field = dynamic_cast<FieldAccess*>(e)) {
+        rewrite(field->object);
+    } else if (auto assign = dynamic_cast<IndexAssignment*>(e)) {
+        if (!dynamic_cast<Identifier*>(assign->object.get())) rewrite(assign->object);
+        rewrite(assign->index);
+        rewrite(assign->value);
+    } else if (auto assign = dynamic_cast<FieldAssignment*>(e)) {
+        if (!dynamic_cast<Identifier*>(assign->object.get())) rewrite(assign->object);
+        rewrite(assign->value);
+    } else if (auto assign = dynamic_cast<Assignment*>(e)) {
+        rewrite(assign->value);
+    } else if (auto await = dynamic_cast<AwaitExpression*>(e)) {
+        rewrite(await->expression);
+    } else if (auto spawn = dynamic_cast<SpawnExpression*>(e)) {
+        for (auto& arg : spawn->call->args) rewrite(arg);
+    }
+}
+
+// Interpolations that fold to literals become text, joined to the text around them
+void Optimizer::rewriteTemplate(TemplateLiteral* tmpl)
+{
+    std::vector<TemplateLiteral::Part> parts;
+    tmpl->literalLength = 0;
+    for (auto& part : tmpl->parts) {
+        if (part.expr) {
+            rewrite(part.expr);
+            if (isLiteral(part.expr.get())) {
+                Value value = literalValue(part.expr.get());
+                auto str = std::get_if<std::string>(&value);
+                part.text = str ? *str : interp.valueToString(value);
+                part.expr.reset();
+            }
+        }
+        if (!part.expr) {
+            tmpl->literalLength += part.text.size();
+            if (!parts.empty() && !parts.back().expr) {
+                parts.back().text += part.text;
+                continue;
+            }
+        }
+        parts.push_back(std::move(part));
+    }
+    tmpl->parts = std::move(parts);
+}
+
+bool Optimizer::fold(BinaryOperator op, const Value& left, const Value& right, Value& result)
+{
+    if (op == BinaryOperator::ASSIGN) return false;
+    // Division by zero and the like throw; they are left to do so at run time
+    try {
+        result = interp.performBinaryOp(left, op, right);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// `for (...; i < len(x); ...)` becomes `{ var len(x): int = len(x); for (...; i < len(x); ...) }`,
+// where the new name cannot clash with any a script can write, when nothing
+// run between the first test and the last can change the length of x
+void Optimizer::hoistLength(std::unique_ptr<ASTNode>& node)
+{
+    auto loop = static_cast<ForStatement*>(node.get());
+    auto condition = dynamic_cast<BinaryOp*>(loop->condition.get());
+    if (level < 2 || !seesEverything || hasWhen || !condition) return;
+
+    std::unique_ptr<Expression>& call = lengthOf(condition->right.get()) ? condition->right : condition->left;
+    Identifier* target = lengthOf(call.get());
+    if (!target) return;
+
+    // Taking the length first must not change which of the initializer and
+    // the length fails first
+    if (auto decl = dynamic_cast<VariableDeclaration*>(loop->init.get())) {
+        if (decl->initializer && !literalOfType(decl->initializer.get(), decl->type)) return;
+    } else if (auto assign = dynamic_cast<Assignment*>(loop->init.get())) {
+        if (!isLiteral(assign->value.get())) return;
+    } else if (loop->init) {
+        return;
+    }
+
+    // Element and field assignments add fields to objects, but cannot resize
+    // a string or an array
+    auto it = names.find(target->name);
+    bool resizable = it == names.end() || it->second.declarations != 1 ||
+                     (it->second.type != "string" && it->second.type.rfind('[', 0) != 0);
+    for (ASTNode* part : {loop->init.get(), static_cast<ASTNode*>(loop->condition.get()),
+                          static_cast<ASTNode*>(loop->update.get()), static_cast<ASTNode*>(loop->body.get())}) {
+        if (part && mayChangeLength(part, target->name, resizable)) return;
+    }
+
+    std::string name = "len(" + target->name + ")";
+    auto decl = std::make_unique<VariableDeclaration>(name, "int", std::move(call));
+    call = std::make_unique<Identifier>(name);
+    auto block = std::make_unique<Block>();
+    block->statements.push_back(std::move(decl));
+    block->statements.push_back(std::move(node));
+    node = std::move(block);
+}
+
+bool Optimizer::mayChangeLength(ASTNode* node, const std::string& name, bool resizable)
+{
+    if (auto assign = dynamic_cast<Assignment*>(node)) {
+        if (assign->name == name) return true;
+    } else if (auto decl = dynamic_cast<VariableDeclaration*>(node)) {
+        if (decl->name == name) return true;  // the condition would see it instead
+    } else if (auto fn = dynamic_cast<FunctionDeclaration*>(node)) {
+        if (fn->name == name) return true;
+    } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+        if (stmt->catchVariable == name) return true;
+    } else if (auto call = dynamic_cast<FunctionCall*>(node)) {
+        if (!keepsLengths(call->builtin)) return true;
+    } else if (dynamic_cast<IndexAssignment*>(node) || dynamic_cast<FieldAssignment*>(node)) {
+        if (resizable) return true;
+    } else if (dynamic_cast<AwaitExpression*>(node) || dynamic_cast<SpawnExpression*>(node)) {
+        return true;
+    }
+    bool changes = false;
+    eachChild(node, [&](ASTNode* child) {
+        changes = changes || mayChangeLength(child, name, resizable);
+    });
+    return changes;
+}
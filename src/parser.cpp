@@ -1,4 +1,6 @@
 #include "../include/parser.h"
+#include "../include/builtins.h"
+#include "../include/lexer.h"
 #include <string>
 
 Parser::Parser(const std::vector<Token>& tokens)
@@ -6,6 +8,7 @@ Parser::Parser(const std::vector<Token>& tokens)
 
 std::unique_ptr<Program> Parser::parse() {
     auto program = std::make_unique<Program>();
+    ArenaScope arena(program->arena.get());
     
     while (!isAtEnd()) {
         try {
@@ -17,25 +20,40 @@ std::unique_ptr<Program> Parser::parse() {
             throw e;
         }
     }
+    builtins.finish();
     
     return program;
 }
 
-Token Parser::peek() const {
+// Parameter types are compiled once here rather than on every call
+static std::vector<const TypeDescriptor*> compileParamTypes(
+    const std::vector<std::pair<std::string, std::string>>& params) {
+    std::vector<const TypeDescriptor*> types;
+    types.reserve(params.size());
+    for (auto& param : params) {
+        types.push_back(TypeDescriptor::get(param.second));
+    }
+    return types;
+}
+
+// Stands in for the tokens before the first and past the last one
+static const Token endOfInput(TokenType::EOF_TOKEN, "", 0, 0);
+
+const Token& Parser::peek() const {
     if (current >= tokens.size()) {
-        return Token(TokenType::EOF_TOKEN, "", 0, 0);
+        return endOfInput;
     }
     return tokens[current];
 }
 
-Token Parser::previous() const {
+const Token& Parser::previous() const {
     if (current == 0) {
-        return Token(TokenType::EOF_TOKEN, "", 0, 0);
+        return endOfInput;
     }
     return tokens[current - 1];
 }
 
-Token Parser::advance() {
+const Token& Parser::advance() {
     if (!isAtEnd()) current++;
     return previous();
 }
@@ -45,7 +63,7 @@ bool Parser::check(TokenType type) const {
     return peek().type == type;
 }
 
-bool Parser::match(const std::vector<TokenType>& types) {
+bool Parser::match(std::initializer_list<TokenType> types) {
     for (TokenType type : types) {
         if (check(type)) {
             advance();
@@ -55,7 +73,7 @@ bool Parser::match(const std::vector<TokenType>& types) {
     return false;
 }
 
-Token Parser::consume(TokenType type, const std::string& message) {
+const Token& Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
     // Include location information in the message so it's visible even
     // if the exception is handled as a generic std::exception later.
@@ -105,48 +123,50 @@ std::unique_ptr<ASTNode> Parser::parseImportDeclaration() {
     
     if (check(TokenType::STRING)) {
         // Simple import: import "path";
-        Token pathTok = advance();
+        const Token& pathTok = advance();
         importDecl->path = pathTok.value;
     } else if (check(TokenType::LBRACE)) {
         // Named imports: import {x, y} from "path";
         advance(); // consume {
         do {
-            Token name = consume(TokenType::IDENTIFIER, "Expected import name");
-            importDecl->namedImports.push_back(name.value);
+            const Token& name = consume(TokenType::IDENTIFIER, "Expected import name");
+            importDecl->namedImports.push_back(name.text());
         } while (match({TokenType::COMMA}));
         consume(TokenType::RBRACE, "Expected '}' after named imports");
-        Token fromToken = consume(TokenType::IDENTIFIER, "Expected 'from'");
+        const Token& fromToken = consume(TokenType::IDENTIFIER, "Expected 'from'");
         if (fromToken.value != "from") {
-            throw ParseError("Expected 'from' keyword, got '" + fromToken.value + "'", fromToken);
+            throw ParseError("Expected 'from' keyword, got '" + fromToken.text() + "'", fromToken);
         }
-        Token pathTok = consume(TokenType::STRING, "Expected string path after 'from'");
+        const Token& pathTok = consume(TokenType::STRING, "Expected string path after 'from'");
         importDecl->path = pathTok.value;
     } else if (check(TokenType::IDENTIFIER)) {
         // Default or mixed import
-        Token defaultName = advance();
+        const Token& defaultName = advance();
         importDecl->defaultImport = defaultName.value;
         
         if (match({TokenType::COMMA})) {
             // Mixed import: import x, {y, z} from "path";
             consume(TokenType::LBRACE, "Expected '{' after comma in mixed import");
             do {
-                Token name = consume(TokenType::IDENTIFIER, "Expected import name");
-                importDecl->namedImports.push_back(name.value);
+                const Token& name = consume(TokenType::IDENTIFIER, "Expected import name");
+                importDecl->namedImports.push_back(name.text());
             } while (match({TokenType::COMMA}));
             consume(TokenType::RBRACE, "Expected '}' after named imports");
         }
         
-        Token fromToken2 = consume(TokenType::IDENTIFIER, "Expected 'from'");
+        const Token& fromToken2 = consume(TokenType::IDENTIFIER, "Expected 'from'");
         if (fromToken2.value != "from") {
-            throw ParseError("Expected 'from' keyword, got '" + fromToken2.value + "'", fromToken2);
+            throw ParseError("Expected 'from' keyword, got '" + fromToken2.text() + "'", fromToken2);
         }
-        Token pathTok = consume(TokenType::STRING, "Expected string path after 'from'");
+        const Token& pathTok = consume(TokenType::STRING, "Expected string path after 'from'");
         importDecl->path = pathTok.value;
     } else {
         throw ParseError("Expected import pattern", peek());
     }
     
     consume(TokenType::SEMICOLON, "Expected ';' after import");
+    for (const auto& name : importDecl->namedImports) builtins.declare(name);
+    if (!importDecl->defaultImport.empty()) builtins.declare(importDecl->defaultImport);
     return importDecl;
 }
 
@@ -154,8 +174,8 @@ std::unique_ptr<ASTNode> Parser::parseUseDeclaration() {
     consume(TokenType::KW_USE, "Expected 'use'");
     
     // Use statements only support simple path imports: use "path";
-    Token pathTok = consume(TokenType::STRING, "Expected string path after 'use'");
-    auto useDecl = std::make_unique<UseDeclaration>(pathTok.value);
+    const Token& pathTok = consume(TokenType::STRING, "Expected string path after 'use'");
+    auto useDecl = std::make_unique<UseDeclaration>(pathTok.text());
     
     consume(TokenType::SEMICOLON, "Expected ';' after use");
     return useDecl;
@@ -180,8 +200,8 @@ std::unique_ptr<ASTNode> Parser::parseExportDeclaration() {
         advance(); // consume {
         std::vector<std::string> exports;
         do {
-            Token name = consume(TokenType::IDENTIFIER, "Expected export name");
-            exports.push_back(name.value);
+            const Token& name = consume(TokenType::IDENTIFIER, "Expected export name");
+            exports.push_back(name.text());
         } while (match({TokenType::COMMA}));
         consume(TokenType::RBRACE, "Expected '}' after export names");
         consume(TokenType::SEMICOLON, "Expected ';' after export");
@@ -195,14 +215,14 @@ std::unique_ptr<ASTNode> Parser::parseExportDeclaration() {
 
 std::unique_ptr<TypeDeclaration> Parser::parseTypeDeclaration() {
     consume(TokenType::IDENTIFIER, "Expected 'type'"); // Should be 'type' identifier
-    Token name = consume(TokenType::IDENTIFIER, "Expected type name");
+    const Token& name = consume(TokenType::IDENTIFIER, "Expected type name");
     consume(TokenType::ASSIGN, "Expected '=' after type name");
     
     // Parse the type specification - this can be complex
     std::string typeSpec = parseComplexTypeSpec();
     
     consume(TokenType::SEMICOLON, "Expected ';' after type declaration");
-    return std::make_unique<TypeDeclaration>(name.value, typeSpec);
+    return std::make_unique<TypeDeclaration>(name.text(), typeSpec);
 }
 
 std::string Parser::parseComplexTypeSpec() {
@@ -216,7 +236,7 @@ std::string Parser::parseComplexTypeSpec() {
         
         if (!check(TokenType::RBRACE)) {
             do {
-                Token fieldName = consume(TokenType::IDENTIFIER, "Expected field name");
+                const Token& fieldName = consume(TokenType::IDENTIFIER, "Expected field name");
                 consume(TokenType::COLON, "Expected ':' after field name");
                 
                 // Parse field type - could be simple type, array type, object type, or union type
@@ -239,7 +259,7 @@ std::string Parser::parseComplexTypeSpec() {
                     }
                 }
                 
-                result += fieldName.value + ":" + fieldType;
+                result += fieldName.text() + ":" + fieldType;
                 
                 if (check(TokenType::COMMA)) {
                     result += ",";
@@ -314,16 +334,16 @@ std::string Parser::parseComplexTypeSpec() {
 std::string Parser::parseSimpleTypeSpec() {
     if (check(TokenType::STRING)) {
         // String literal type
-        Token str = advance();
-        return "\"" + str.value + "\"";
+        const Token& str = advance();
+        return "\"" + str.text() + "\"";
     } else if (check(TokenType::INTEGER)) {
         // Integer literal type
-        Token num = advance();
-        return num.value;
+        const Token& num = advance();
+        return num.text();
     } else if (check(TokenType::KW_TRUE) || check(TokenType::KW_FALSE)) {
         // Boolean literal type
-        Token bool_val = advance();
-        return bool_val.value;
+        const Token& bool_val = advance();
+        return bool_val.text();
     } else if (check(TokenType::KW_INT)) {
         advance();
         return "int";
@@ -347,23 +367,23 @@ std::string Parser::parseSimpleTypeSpec() {
         return "void";
     } else if (check(TokenType::IDENTIFIER)) {
         // Custom type reference
-        Token type = advance();
-        return type.value;
+        const Token& type = advance();
+        return type.text();
     } else {
         throw ParseError("Expected type specification", peek());
     }
 }
 
 std::unique_ptr<FunctionDeclaration> Parser::parseFunctionDeclaration() {
-    consume(TokenType::KW_FUNC, "Expected 'func'");
-    Token name = consume(TokenType::IDENTIFIER, "Expected function name");
+    int line = consume(TokenType::KW_FUNC, "Expected 'func'").line;
+    const Token& name = consume(TokenType::IDENTIFIER, "Expected function name");
     consume(TokenType::LPAREN, "Expected '(' after function name");
     
     // Parse parameters
     std::vector<std::pair<std::string, std::string>> params;
     if (!check(TokenType::RPAREN)) {
         do {
-            Token paramName = consume(TokenType::IDENTIFIER, "Expected parameter name");
+            const Token& paramName = consume(TokenType::IDENTIFIER, "Expected parameter name");
             consume(TokenType::COLON, "Expected ':' after parameter name");
             
             // Type can be keyword, identifier, function type, or array type
@@ -415,10 +435,10 @@ std::unique_ptr<FunctionDeclaration> Parser::parseFunctionDeclaration() {
                     } else {
                         moreType = consume(TokenType::IDENTIFIER, "Expected type after '|'");
                     }
-                    paramTypeStr += "|" + moreType.value;
+                    paramTypeStr += "|" + moreType.text();
                 }
             }
-            params.push_back({paramName.value, paramTypeStr});
+            params.push_back({paramName.text(), paramTypeStr});
         } while (match({TokenType::COMMA}));
     }
     
@@ -454,21 +474,24 @@ std::unique_ptr<FunctionDeclaration> Parser::parseFunctionDeclaration() {
     
     auto body = parseBlock();
     
-    auto func = std::make_unique<FunctionDeclaration>(name.value, returnTypeStr, std::move(body));
+    builtins.declare(name.text());
+    auto func = std::make_unique<FunctionDeclaration>(name.text(), returnTypeStr, std::move(body));
     func->params = params;
+    func->paramTypes = compileParamTypes(params);
+    func->line = line;
     return func;
 }
 
 std::unique_ptr<ProgramDeclaration> Parser::parseProgramDeclaration() {
-    consume(TokenType::KW_PROGRAM, "Expected 'program'");
-    Token name = consume(TokenType::IDENTIFIER, "Expected program name");
+    int line = consume(TokenType::KW_PROGRAM, "Expected 'program'").line;
+    const Token& name = consume(TokenType::IDENTIFIER, "Expected program name");
     consume(TokenType::LPAREN, "Expected '(' after program name");
     
     // Parse parameters (optional)
     std::vector<std::pair<std::string, std::string>> params;
     if (!check(TokenType::RPAREN)) {
         do {
-            Token paramName = consume(TokenType::IDENTIFIER, "Expected parameter name");
+            const Token& paramName = consume(TokenType::IDENTIFIER, "Expected parameter name");
             consume(TokenType::COLON, "Expected ':' after parameter name");
             
             Token paramType;
@@ -485,15 +508,18 @@ std::unique_ptr<ProgramDeclaration> Parser::parseProgramDeclaration() {
             } else {
                 paramType = consume(TokenType::IDENTIFIER, "Expected parameter type");
             }
-            params.push_back({paramName.value, paramType.value});
+            params.push_back({paramName.text(), paramType.text()});
         } while (match({TokenType::COMMA}));
     }
     
     consume(TokenType::RPAREN, "Expected ')' after parameters");
     auto body = parseBlock();
     
-    auto program = std::make_unique<ProgramDeclaration>(name.value, std::move(body));
+    builtins.declare(name.text());
+    auto program = std::make_unique<ProgramDeclaration>(name.text(), std::move(body));
     program->params = params;
+    program->paramTypes = compileParamTypes(params);
+    program->line = line;
     return program;
 }
 
@@ -558,17 +584,19 @@ std::unique_ptr<Statement> Parser::parseIfStatement() {
 }
 
 std::unique_ptr<Statement> Parser::parseWhileStatement() {
-    consume(TokenType::KW_WHILE, "Expected 'while'");
+    int line = consume(TokenType::KW_WHILE, "Expected 'while'").line;
     consume(TokenType::LPAREN, "Expected '(' after 'while'");
     auto condition = parseExpression();
     consume(TokenType::RPAREN, "Expected ')' after condition");
     
     auto body = parseBlock();
-    return std::make_unique<WhileStatement>(std::move(condition), std::move(body));
+    auto loop = std::make_unique<WhileStatement>(std::move(condition), std::move(body));
+    loop->line = line;
+    return loop;
 }
 
 std::unique_ptr<Statement> Parser::parseForStatement() {
-    consume(TokenType::KW_FOR, "Expected 'for'");
+    int line = consume(TokenType::KW_FOR, "Expected 'for'").line;
     consume(TokenType::LPAREN, "Expected '(' after 'for'");
     
     std::unique_ptr<ASTNode> init;
@@ -576,7 +604,7 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
         // Variable declaration but don't consume the semicolon yet
         consume(TokenType::KW_VAR, "Expected 'var'");
         
-        Token name = consume(TokenType::IDENTIFIER, "Expected variable name");
+        const Token& name = consume(TokenType::IDENTIFIER, "Expected variable name");
         consume(TokenType::COLON, "Expected ':' after variable name");
         
         Token type;
@@ -599,7 +627,7 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
             initializer = parseExpression();
         }
         
-        init = std::make_unique<VariableDeclaration>(name.value, type.value, std::move(initializer));
+        init = std::make_unique<VariableDeclaration>(name.text(), type.text(), std::move(initializer));
     } else if (!check(TokenType::SEMICOLON)) {
         auto expr = parseExpression();
         init = std::move(expr);
@@ -614,8 +642,10 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
     
     auto body = parseBlock();
     
-    return std::make_unique<ForStatement>(std::move(init), std::move(condition), 
-                                          std::move(update), std::move(body));
+    auto loop = std::make_unique<ForStatement>(std::move(init), std::move(condition), 
+                                               std::move(update), std::move(body));
+    loop->line = line;
+    return loop;
 }
 
 std::unique_ptr<Statement> Parser::parseReturnStatement() {
@@ -710,8 +740,8 @@ std::unique_ptr<Statement> Parser::parseWhenStatement() {
         consume(TokenType::LBRACKET, "Expected '[' for dependencies");
         if (!check(TokenType::RBRACKET)) {
             do {
-                Token depToken = consume(TokenType::IDENTIFIER, "Expected variable name in dependencies");
-                dependencies.push_back(depToken.value);
+                const Token& depToken = consume(TokenType::IDENTIFIER, "Expected variable name in dependencies");
+                dependencies.push_back(depToken.text());
             } while (match({TokenType::COMMA}));
         }
         consume(TokenType::RBRACKET, "Expected ']' after dependencies");
@@ -732,7 +762,7 @@ std::unique_ptr<Statement> Parser::parseTryStatement() {
     
     if (match({TokenType::KW_CATCH})) {
         consume(TokenType::LPAREN, "Expected '(' after 'catch'");
-        Token varToken = consume(TokenType::IDENTIFIER, "Expected variable name in catch");
+        const Token& varToken = consume(TokenType::IDENTIFIER, "Expected variable name in catch");
         catchVariable = varToken.value;
         consume(TokenType::RPAREN, "Expected ')' after catch variable");
         catchBlock = parseBlock();
@@ -752,7 +782,7 @@ std::unique_ptr<Statement> Parser::parseVariableDeclaration() {
         consume(TokenType::KW_VAR, "Expected 'var' or 'const'");
     }
     
-    Token name = consume(TokenType::IDENTIFIER, "Expected variable name");
+    const Token& name = consume(TokenType::IDENTIFIER, "Expected variable name");
     consume(TokenType::COLON, "Expected ':' after variable name");
     
     // Type can be a keyword, identifier, array type [base_type], or function type (params)->return
@@ -770,7 +800,7 @@ std::unique_ptr<Statement> Parser::parseVariableDeclaration() {
         } catch (...) {
             // Not a function type, backtrack
             current = savedPos;
-            Token type = consume(TokenType::IDENTIFIER, "Expected variable type");
+            const Token& type = consume(TokenType::IDENTIFIER, "Expected variable type");
             typeStr = type.value;
         }
     } else if (check(TokenType::LBRACKET)) {
@@ -808,7 +838,9 @@ std::unique_ptr<Statement> Parser::parseVariableDeclaration() {
     
     consume(TokenType::SEMICOLON, "Expected ';' after variable declaration");
     
-    return std::make_unique<VariableDeclaration>(name.value, typeStr, std::move(initializer));
+    auto decl = std::make_unique<VariableDeclaration>(name.text(), typeStr, std::move(initializer));
+    decl->isConst = isConst;
+    return decl;
 }
 
 std::unique_ptr<Expression> Parser::parseExpression() {
@@ -946,6 +978,16 @@ std::unique_ptr<Expression> Parser::parseUnary() {
         auto expr = parseUnary();
         return std::make_unique<AwaitExpression>(std::move(expr));
     }
+
+    if (match({TokenType::KW_SPAWN})) {
+        const Token& keyword = previous();
+        auto expr = parsePostfix();
+        if (!dynamic_cast<FunctionCall*>(expr.get())) {
+            throw ParseError("Expected a program call after 'spawn'", keyword);
+        }
+        std::unique_ptr<FunctionCall> call(static_cast<FunctionCall*>(expr.release()));
+        return std::make_unique<SpawnExpression>(std::move(call));
+    }
     
     return parsePostfix();
 }
@@ -959,6 +1001,9 @@ std::unique_ptr<Expression> Parser::parsePostfix() {
             // named functions and function variables
             auto callee = std::move(expr);
             auto call = std::make_unique<FunctionCall>(std::move(callee));
+            if (auto id = dynamic_cast<Identifier*>(call->callee.get())) {
+                builtins.bind(call.get(), id->name);
+            }
             if (!check(TokenType::RPAREN)) {
                 do {
                     call->args.push_back(parseExpression());
@@ -973,8 +1018,8 @@ std::unique_ptr<Expression> Parser::parsePostfix() {
             expr = std::make_unique<IndexAccess>(std::move(expr), std::move(index));
         } else if (match({TokenType::DOT})) {
             // Field access
-            Token field = consume(TokenType::IDENTIFIER, "Expected field name after '.'");
-            expr = std::make_unique<FieldAccess>(std::move(expr), field.value);
+            const Token& field = consume(TokenType::IDENTIFIER, "Expected field name after '.'");
+            expr = std::make_unique<FieldAccess>(std::move(expr), field.text());
         } else {
             break;
         }
@@ -992,13 +1037,17 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
         return std::make_unique<BooleanLiteral>(false);
     }
     if (match({TokenType::INTEGER})) {
-        return std::make_unique<IntegerLiteral>(std::stoi(previous().value));
+        return std::make_unique<IntegerLiteral>(std::stoi(previous().text()));
     }
     if (match({TokenType::FLOAT})) {
-        return std::make_unique<FloatLiteral>(std::stof(previous().value));
+        return std::make_unique<FloatLiteral>(std::stof(previous().text()));
     }
     if (match({TokenType::STRING, TokenType::TEMPLATE_STRING})) {
-        return std::make_unique<StringLiteral>(previous().value);
+        std::string value = previous().text();
+        if (value.find("${") != std::string::npos) {
+            return parseTemplate(value);
+        }
+        return std::make_unique<StringLiteral>(value);
     }
     if (match({TokenType::LBRACKET})) {
         // Array literal: [1, 2, 3]
@@ -1016,10 +1065,10 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
         auto objLit = std::make_unique<ObjectLiteral>();
         if (!check(TokenType::RBRACE)) {
             do {
-                Token keyToken = consume(TokenType::IDENTIFIER, "Expected property name");
+                const Token& keyToken = consume(TokenType::IDENTIFIER, "Expected property name");
                 consume(TokenType::COLON, "Expected ':' after property name");
                 auto value = parseExpression();
-                objLit->fields.push_back({keyToken.value, std::move(value)});
+                objLit->fields.push_back({keyToken.text(), std::move(value)});
             } while (match({TokenType::COMMA}));
         }
         consume(TokenType::RBRACE, "Expected '}' after object fields");
@@ -1027,13 +1076,14 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
     }
     if (match({TokenType::KW_FUNC})) {
         // Inline function expression: func() -> returnType { body }
+        int line = previous().line;
         consume(TokenType::LPAREN, "Expected '(' after 'func'");
 
         // Parse parameters
         std::vector<std::pair<std::string, std::string>> params;
         if (!check(TokenType::RPAREN)) {
             do {
-                Token paramName = consume(TokenType::IDENTIFIER, "Expected parameter name");
+                const Token& paramName = consume(TokenType::IDENTIFIER, "Expected parameter name");
                 consume(TokenType::COLON, "Expected ':' after parameter name");
 
                 // Type can be keyword, identifier, function type, or array type
@@ -1058,6 +1108,7 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
                     } else {
                         baseType = consume(TokenType::IDENTIFIER, "Expected array type");
                     }
+                    std::string elementType = baseType.text();
                     // Support union types inside arrays: [string|int]
                     while (match({TokenType::PIPE})) {
                         Token moreType;
@@ -1074,10 +1125,10 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
                         } else {
                             moreType = consume(TokenType::IDENTIFIER, "Expected array element type after '|'");
                         }
-                        baseType.value += "|" + moreType.value;
+                        elementType += "|" + moreType.text();
                     }
                     consume(TokenType::RBRACKET, "Expected ']'");
-                    paramTypeStr = "[" + baseType.value + "]";
+                    paramTypeStr = "[" + elementType + "]";
                 } else {
                     // Regular type
                     Token paramType;
@@ -1115,10 +1166,10 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
                         } else {
                             moreType = consume(TokenType::IDENTIFIER, "Expected type after '|'");
                         }
-                        paramTypeStr += "|" + moreType.value;
+                        paramTypeStr += "|" + moreType.text();
                     }
                 }
-                params.push_back({paramName.value, paramTypeStr});
+                params.push_back({paramName.text(), paramTypeStr});
             } while (match({TokenType::COMMA}));
         }
 
@@ -1154,10 +1205,12 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
         // Create a FunctionExpression
         auto funcExpr = std::make_unique<FunctionExpression>(returnTypeStr, std::move(body));
         funcExpr->params = params;
+        funcExpr->paramTypes = compileParamTypes(params);
+        funcExpr->line = line;
         return funcExpr;
     }
     if (match({TokenType::IDENTIFIER})) {
-        return std::make_unique<Identifier>(previous().value);
+        return std::make_unique<Identifier>(previous().text());
     }
     if (match({TokenType::LPAREN})) {
         auto expr = parseExpression();
@@ -1165,7 +1218,7 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
         return expr;
     }
     
-    throw ParseError("Unexpected token: " + peek().value, peek());
+    throw ParseError("Unexpected token: " + peek().text(), peek());
 }
 
 std::string Parser::parseFunctionType() {
@@ -1205,6 +1258,7 @@ std::string Parser::parseFunctionType() {
                 } else {
                     baseType = consume(TokenType::IDENTIFIER, "Expected array type");
                 }
+                std::string elementType = baseType.text();
                 // Support union types inside arrays in function signatures: [string|int]
                 while (match({TokenType::PIPE})) {
                     Token moreType;
@@ -1221,10 +1275,10 @@ std::string Parser::parseFunctionType() {
                     } else {
                         moreType = consume(TokenType::IDENTIFIER, "Expected array element type after '|'");
                     }
-                    baseType.value += "|" + moreType.value;
+                    elementType += "|" + moreType.text();
                 }
                 consume(TokenType::RBRACKET, "Expected ']'");
-                paramTypes += "[" + baseType.value + "]";
+                paramTypes += "[" + elementType + "]";
             } else {
                 paramType = consume(TokenType::IDENTIFIER, "Expected parameter type");
             }
@@ -1255,7 +1309,7 @@ std::string Parser::parseFunctionType() {
         returnType = consume(TokenType::IDENTIFIER, "Expected return type");
     }
     
-    return "(" + paramTypes + ")->" + returnType.value;
+    return "(" + paramTypes + ")->" + returnType.text();
 }
 
 std::string Parser::parseArrayType() {
@@ -1303,10 +1357,72 @@ std::string Parser::parseArrayType() {
             } else {
                 moreType = consume(TokenType::IDENTIFIER, "Expected array element type after '|'");
             }
-            elementType += "|" + moreType.value;
+            elementType += "|" + moreType.text();
         }
     }
     
     consume(TokenType::RBRACKET, "Expected ']' after array type");
     return "[" + elementType + "]"; 
 }
+
+// Splits a string at its ${...} interpolations and parses each one. An
+// unclosed interpolation, or one that does not parse, stays literal text.
+std::unique_ptr<Expression> Parser::parseTemplate(const std::string& value) {
+    auto tmpl = std::make_unique<TemplateLiteral>();
+    std::string literal;
+    auto flushLiteral = [&]() {
+        if (!literal.empty()) {
+            tmpl->literalLength += literal.size();
+            tmpl->parts.push_back({std::move(literal), nullptr});
+            literal.clear();
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < value.size()) {
+        size_t start = value.find("${", pos);
+        if (start == std::string::npos) {
+            literal += value.substr(pos);
+            break;
+        }
+        literal += value.substr(pos, start - pos);
+
+        // Find matching closing brace
+        size_t end = start + 2;
+        int braceCount = 1;
+        while (end < value.size() && braceCount > 0) {
+            if (value[end] == '{') braceCount++;
+            else if (value[end] == '}') braceCount--;
+            end++;
+        }
+        if (braceCount != 0) {
+            literal += value.substr(start);
+            break;
+        }
+
+        std::string source = value.substr(start + 2, end - start - 3);
+        std::unique_ptr<Expression> expr;
+        try {
+            Lexer exprLexer(source);
+            auto exprTokens = exprLexer.tokenize();
+            Parser exprParser(exprTokens);
+            expr = exprParser.parseExpression();
+            builtins.adopt(exprParser.builtins);
+        } catch (...) {
+            expr = nullptr;
+        }
+        if (expr) {
+            flushLiteral();
+            tmpl->parts.push_back({std::move(source), std::move(expr)});
+        } else {
+            literal += "${" + source + "}";
+        }
+        pos = end;
+    }
+
+    if (tmpl->parts.empty()) {
+        return std::make_unique<StringLiteral>(literal);  // nothing to interpolate after all
+    }
+    flushLiteral();
+    return tmpl;
+}
@@ -0,0 +1,144 @@
+#include "include/profiler.h"
+#include <algorithm>
+#include <cstdio>
+
+Profiler::Profiler()
+{
+    functions.push_back(FunctionStats{"<main>", 0});
+    functions[0].calls = 1;
+    functions[0].active = 1;
+    nodes.push_back(StackNode{0, {}, {}, 0});
+    frames.push_back(Frame{0, Clock::now()});
+}
+
+void Profiler::enter(const ASTNode* node, const std::string& name, int line)
+{
+    auto it = functionIndex.find(node);
+    if (it == functionIndex.end()) {
+        it = functionIndex.emplace(node, functions.size()).first;
+        functions.push_back(FunctionStats{name, line});
+    }
+    size_t function = it->second;
+    functions[function].calls++;
+    functions[function].active++;
+
+    size_t parent = frames.back().node;
+    auto child = nodes[parent].children.find(function);
+    size_t index;
+    if (child != nodes[parent].children.end()) {
+        index = child->second;
+    } else {
+        index = nodes.size();
+        nodes[parent].children.emplace(function, index);
+        nodes.push_back(StackNode{function, {}, {}, parent});
+    }
+    frames.push_back(Frame{index, Clock::now()});
+}
+
+void Profiler::leave()
+{
+    if (frames.size() <= 1) return;  // the top-level frame only closes in stop()
+    Frame frame = frames.back();
+    frames.pop_back();
+
+    Clock::duration inclusive = Clock::now() - frame.start;
+    Clock::duration self = inclusive - frame.children;
+    StackNode& node = nodes[frame.node];
+    node.self += self;
+    FunctionStats& stats = functions[node.function];
+    stats.exclusive += self;
+    if (--stats.active == 0) {
+        stats.inclusive += inclusive;
+    }
+    frames.back().children += inclusive;
+}
+
+void Profiler::loop(const ASTNode* node, const char* kind, int line, uint64_t iterations, bool native)
+{
+    auto it = loops.find(node);
+    if (it == loops.end()) {
+        it = loops.emplace(node, LoopStats{kind, line}).first;
+    }
+    it->second.entries++;
+    it->second.iterations += iterations;
+    if (native) it->second.native++;
+}
+
+void Profiler::stop()
+{
+    // Frames left open by an error are closed with the time they had so far
+    while (frames.size() > 1) {
+        leave();
+    }
+    if (frames.empty()) return;
+    Frame frame = frames.back();
+    frames.pop_back();
+    Clock::duration inclusive = Clock::now() - frame.start;
+    nodes[0].self += inclusive - frame.children;
+    functions[0].exclusive += inclusive - frame.children;
+    functions[0].inclusive += inclusive;
+    functions[0].active = 0;
+}
+
+std::string Profiler::label(size_t function) const
+{
+    const FunctionStats& stats = functions[function];
+    if (stats.line <= 0) return stats.name;
+    return stats.name + ":" + std::to_string(stats.line);
+}
+
+void Profiler::writeCollapsed(std::ostream& out) const
+{
+    // Nodes are created after their parent, so one forward pass builds every path
+    std::vector<std::string> paths(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const StackNode& node = nodes[i];
+        paths[i] = i == 0 ? label(0) : paths[node.parent] + ";" + label(node.function);
+        long long micros = std::chrono::duration_cast<std::chrono::microseconds>(node.self).count();
+        if (micros > 0) {
+            out << paths[i] << " " << micros << "\n";
+        }
+    }
+}
+
+void Profiler::writeSummary(std::ostream& out, size_t top) const
+{
+    auto ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    char line[256];
+
+    std::vector<size_t> order(functions.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return functions[a].exclusive > functions[b].exclusive;
+    });
+    double total = ms(functions[0].inclusive);
+
+    out << "Profile: " << functions.size() - 1 << " functions, " << loops.size() << " loops, "
+        << total << " ms total\n";
+    std::snprintf(line, sizeof(line), "%12s %12s %12s %7s  %s\n", "calls", "incl ms", "excl ms", "excl%", "function");
+    out << line;
+    for (size_t i = 0; i < order.size() && i < top; ++i) {
+        const FunctionStats& f = functions[order[i]];
+        double share = total > 0 ? 100.0 * ms(f.exclusive) / total : 0.0;
+        std::snprintf(line, sizeof(line), "%12llu %12.3f %12.3f %6.1f%%  %s\n", (unsigned long long)f.calls,
+                      ms(f.inclusive), ms(f.exclusive), share, label(order[i]).c_str());
+        out << line;
+    }
+
+    if (loops.empty()) return;
+    std::vector<const LoopStats*> hot;
+    for (auto& entry : loops) hot.push_back(&entry.second);
+    std::sort(hot.begin(), hot.end(), [](const LoopStats* a, const LoopStats* b) {
+        if (a->iterations != b->iterations) return a->iterations > b->iterations;
+        return a->line < b->line;
+    });
+    out << "\n";
+    std::snprintf(line, sizeof(line), "%12s %12s %12s  %s\n", "entries", "iterations", "jit", "loop");
+    out << line;
+    for (size_t i = 0; i < hot.size() && i < top; ++i) {
+        std::snprintf(line, sizeof(line), "%12llu %12llu %12llu  %s:%d\n", (unsigned long long)hot[i]->entries,
+                      (unsigned long long)hot[i]->iterations, (unsigned long long)hot[i]->native, hot[i]->kind,
+                      hot[i]->line);
+        out << line;
+    }
+}
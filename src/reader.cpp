@@ -0,0 +1,119 @@
+#include "include/reader.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AXO_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Pages behind the read position are given back in steps of this size
+constexpr size_t kReleaseStep = size_t(16) << 20;
+
+void stripCarriageReturn(std::string& line)
+{
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+}
+
+} // namespace
+
+FileReader::FileReader(const std::string& path) : filePath(path)
+{
+#ifdef AXO_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file for reading: " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data = static_cast<const char*>(mapped);
+            size = static_cast<size_t>(info.st_size);
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+    if (data) return;
+#endif
+    stream.open(path, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        throw std::runtime_error("Could not open file for reading: " + path);
+    }
+}
+
+FileReader::~FileReader()
+{
+    unmap();
+}
+
+bool FileReader::readLine(std::string& line)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (data) {
+        if (position >= size) return false;
+        const char* start = data + position;
+        const char* end = static_cast<const char*>(std::memchr(start, '\n', size - position));
+        size_t length = end ? static_cast<size_t>(end - start) : size - position;
+        line.assign(start, length);
+        position += length + (end ? 1 : 0);
+        stripCarriageReturn(line);
+        releaseConsumed();
+        return true;
+    }
+    if (!stream.is_open() || !std::getline(stream, line)) return false;
+    stripCarriageReturn(line);
+    return true;
+}
+
+std::string FileReader::readChunk(size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (data) {
+        size_t length = std::min(maxBytes, size - position);
+        std::string chunk(data + position, length);
+        position += length;
+        releaseConsumed();
+        return chunk;
+    }
+    std::string chunk;
+    if (!stream.is_open()) return chunk;
+    chunk.resize(maxBytes);
+    stream.read(&chunk[0], static_cast<std::streamsize>(maxBytes));
+    chunk.resize(static_cast<size_t>(stream.gcount()));
+    return chunk;
+}
+
+void FileReader::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    unmap();
+    if (stream.is_open()) stream.close();
+}
+
+void FileReader::releaseConsumed()
+{
+#ifdef AXO_HAVE_MMAP
+    if (position - released < kReleaseStep) return;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t upTo = position / page * page;
+    madvise(const_cast<char*>(data) + released, upTo - released, MADV_DONTNEED);
+    released = upTo;
+#endif
+}
+
+void FileReader::unmap()
+{
+#ifdef AXO_HAVE_MMAP
+    if (data) munmap(const_cast<char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    position = 0;
+}
@@ -0,0 +1,393 @@
+#include "include/resolver.h"
+#include <algorithm>
+#include <filesystem>
+
+void Resolver::resolve(Program* program)
+{
+    imported.clear();
+    collectImports(program, imported);
+
+    // Top-level declarations stay in the name-indexed global scope: imports and
+    // later REPL inputs add to it in an order no single pass can know.
+    scopes.clear();
+    unbound.clear();
+    captures = nullptr;
+    holds = false;
+    collectCaseDeclarations(program, unbound);
+    for (auto& decl : program->declarations) {
+        resolveNode(decl.get());
+    }
+}
+
+void Resolver::resolveNode(ASTNode* node)
+{
+    if (!node) return;
+
+    if (auto expr = dynamic_cast<Expression*>(node)) {
+        resolveExpression(expr);
+    } else if (auto stmt = dynamic_cast<ExpressionStatement*>(node)) {
+        resolveExpression(stmt->expression.get());
+    } else if (auto decl = dynamic_cast<VariableDeclaration*>(node)) {
+        // The initializer is evaluated before the name exists
+        resolveExpression(decl->initializer.get());
+        decl->slot = declare(decl->name);
+    } else if (auto block = dynamic_cast<Block*>(node)) {
+        resolveBlock(block);
+    } else if (auto stmt = dynamic_cast<IfStatement*>(node)) {
+        resolveExpression(stmt->condition.get());
+        resolveBlock(stmt->thenBlock.get());
+        resolveBlock(stmt->elseBlock.get());
+    } else if (auto stmt = dynamic_cast<WhileStatement*>(node)) {
+        holds = true;
+        resolveExpression(stmt->condition.get());
+        resolveBlock(stmt->body.get());
+    } else if (auto stmt = dynamic_cast<ForStatement*>(node)) {
+        holds = true;
+        pushScope(&stmt->numSlots);
+        resolveNode(stmt->init.get());
+        resolveExpression(stmt->condition.get());
+        resolveExpression(stmt->update.get());
+        resolveBlock(stmt->body.get());
+        popScope();
+    } else if (auto stmt = dynamic_cast<ReturnStatement*>(node)) {
+        resolveExpression(stmt->value.get());
+    } else if (auto fn = dynamic_cast<FunctionDeclaration*>(node)) {
+        fn->slot = declare(fn->name);
+        resolveFunction(fn->params, fn->body.get(), fn->captures);
+    } else if (auto prog = dynamic_cast<ProgramDeclaration*>(node)) {
+        resolveFunction(prog->params, prog->body.get(), prog->captures);
+    } else if (auto exp = dynamic_cast<ExportDeclaration*>(node)) {
+        resolveNode(exp->declaration.get());
+    } else if (auto stmt = dynamic_cast<ThrowStatement*>(node)) {
+        resolveExpression(stmt->expression.get());
+    } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+        resolveBlock(stmt->tryBlock.get());
+        if (stmt->catchBlock) {
+            pushScope(nullptr);
+            if (!stmt->catchVariable.empty()) {
+                declare(stmt->catchVariable);
+            }
+            resolveBlock(stmt->catchBlock.get());
+            popScope();
+        }
+        resolveBlock(stmt->finallyBlock.get());
+    } else if (auto stmt = dynamic_cast<SwitchStatement*>(node)) {
+        resolveExpression(stmt->discriminant.get());
+        for (auto& clause : stmt->cases) {
+            resolveExpression(clause->value.get());
+            for (auto& s : clause->statements) {
+                resolveNode(s.get());
+            }
+        }
+    } else if (auto stmt = dynamic_cast<WhenStatement*>(node)) {
+        holds = true;
+        // The condition and body run later, from whatever scope triggers them
+        std::vector<Scope> savedScopes;
+        savedScopes.swap(scopes);
+        std::unordered_set<std::string> savedUnbound;
+        savedUnbound.swap(unbound);
+        collectCaseDeclarations(stmt->body.get(), unbound);
+        resolveExpression(stmt->condition.get());
+        resolveBlock(stmt->body.get());
+        scopes.swap(savedScopes);
+        unbound.swap(savedUnbound);
+        if (stmt->dependencies.empty() && !stmt->inferred) {
+            stmt->inferred = true;
+            stmt->polled = !collectReads(stmt->condition.get(), stmt->dependencies);
+        }
+    } else if (dynamic_cast<ImportDeclaration*>(node) || dynamic_cast<UseDeclaration*>(node)) {
+        if (captures) captures->imports = true;
+    }
+    // Type declarations, break and continue have nothing to bind
+}
+
+void Resolver::resolveExpression(Expression* expr)
+{
+    if (!expr) return;
+
+    if (auto id = dynamic_cast<Identifier*>(expr)) {
+        if (!bind(id->name, id->depth, id->slot)) capture(id->name);
+    } else if (auto assign = dynamic_cast<Assignment*>(expr)) {
+        resolveExpression(assign->value.get());
+        if (!bind(assign->name, assign->depth, assign->slot)) capture(assign->name);
+    } else if (auto tmpl = dynamic_cast<TemplateLiteral*>(expr)) {
+        for (auto& part : tmpl->parts) {
+            resolveExpression(part.expr.get());
+        }
+    } else if (auto bin = dynamic_cast<BinaryOp*>(expr)) {
+        resolveExpression(bin->left.get());
+        resolveExpression(bin->right.get());
+    } else if (auto un = dynamic_cast<UnaryOp*>(expr)) {
+        resolveExpression(un->operand.get());
+    } else if (auto call = dynamic_cast<FunctionCall*>(expr)) {
+        resolveExpression(call->callee.get());
+        for (auto& arg : call->args) {
+            resolveExpression(arg.get());
+        }
+    } else if (auto arr = dynamic_cast<ArrayLiteral*>(expr)) {
+        for (auto& e : arr->elements) {
+            resolveExpression(e.get());
+        }
+    } else if (auto obj = dynamic_cast<ObjectLiteral*>(expr)) {
+        for (auto& field : obj->fields) {
+            resolveExpression(field.second.get());
+        }
+    } else if (auto fn = dynamic_cast<FunctionExpression*>(expr)) {
+        resolveFunction(fn->params, fn->body.get(), fn->captures);
+    } else if (auto idx = dynamic_cast<IndexAccess*>(expr)) {
+        resolveExpression(idx->object.get());
+        resolveExpression(idx->index.get());
+    } else if (auto field = dynamic_cast<FieldAccess*>(expr)) {
+        resolveExpression(field->object.get());
+    } else if (auto assign = dynamic_cast<IndexAssignment*>(expr)) {
+        resolveExpression(assign->object.get());
+        resolveExpression(assign->index.get());
+        resolveExpression(assign->value.get());
+    } else if (auto assign = dynamic_cast<FieldAssignment*>(expr)) {
+        resolveExpression(assign->object.get());
+        resolveExpression(assign->value.get());
+    } else if (auto await = dynamic_cast<AwaitExpression*>(expr)) {
+        resolveExpression(await->expression.get());
+    } else if (auto spawn = dynamic_cast<SpawnExpression*>(expr)) {
+        resolveExpression(spawn->call.get());
+    }
+}
+
+void Resolver::resolveBlock(Block* block)
+{
+    if (!block) return;
+    pushScope(&block->numSlots);
+    for (auto& stmt : block->statements) {
+        resolveNode(stmt.get());
+    }
+    popScope();
+}
+
+void Resolver::resolveFunction(const std::vector<std::pair<std::string, std::string>>& params, Block* body,
+                               Captures& captured)
+{
+    holds = true;
+    // A function body only sees its own scopes; everything else is found by
+    // name at runtime, where the caller's locals are visible too
+    std::vector<Scope> savedScopes;
+    savedScopes.swap(scopes);
+    std::unordered_set<std::string> savedUnbound;
+    savedUnbound.swap(unbound);
+    collectCaseDeclarations(body, unbound);
+    Captures* outer = captures;
+    captured = Captures();
+    captures = &captured;
+
+    // Parameters occupy slots 0..n-1 of the scope pushed for the call
+    pushScope(nullptr);
+    for (auto& param : params) {
+        int slot = scopes.back().count++;
+        scopes.back().slots[param.first] = slot;
+    }
+    resolveBlock(body);
+    popScope();
+
+    scopes.swap(savedScopes);
+    unbound.swap(savedUnbound);
+    std::sort(captured.names.begin(), captured.names.end());
+    captured.names.erase(std::unique(captured.names.begin(), captured.names.end()), captured.names.end());
+    // A nested function may run while this one is on the stack, and then
+    // reaches what this one does
+    captures = outer;
+    if (outer) {
+        outer->names.insert(outer->names.end(), captured.names.begin(), captured.names.end());
+        outer->imports = outer->imports || captured.imports;
+    }
+}
+
+void Resolver::pushScope(int* numSlots, int count)
+{
+    scopes.push_back(Scope{{}, numSlots, count});
+    if (numSlots) *numSlots = count;
+}
+
+void Resolver::popScope()
+{
+    scopes.pop_back();
+}
+
+int Resolver::declare(const std::string& name)
+{
+    if (scopes.empty() || unbound.count(name) || imported.count(name)) {
+        return -1;
+    }
+    Scope& scope = scopes.back();
+    auto it = scope.slots.find(name);
+    if (it != scope.slots.end()) {
+        return it->second;  // redeclaring reuses the slot, as define() overwrites by name
+    }
+    int slot = scope.count++;
+    scope.slots[name] = slot;
+    if (scope.numSlots) *scope.numSlots = scope.count;
+    return slot;
+}
+
+bool Resolver::bind(const std::string& name, int& depth, int& slot) const
+{
+    depth = -1;
+    slot = -1;
+    if (unbound.count(name) || imported.count(name)) {
+        return false;
+    }
+    for (size_t i = scopes.size(); i-- > 0;) {
+        auto it = scopes[i].slots.find(name);
+        if (it != scopes[i].slots.end()) {
+            depth = (int)(scopes.size() - 1 - i);
+            slot = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Resolver::capture(const std::string& name)
+{
+    if (captures) captures->names.push_back(name);
+}
+
+void Resolver::collectImports(ASTNode* node, std::unordered_set<std::string>& names)
+{
+    if (auto program = dynamic_cast<Program*>(node)) {
+        for (auto& decl : program->declarations) {
+            collectImports(decl.get(), names);
+        }
+    } else if (auto import = dynamic_cast<ImportDeclaration*>(node)) {
+        if (!import->defaultImport.empty()) names.insert(import->defaultImport);
+        for (auto& name : import->namedImports) names.insert(name);
+        // JSON imports define a variable named after the file
+        names.insert(std::filesystem::path(import->path).stem().string());
+    } else if (auto block = dynamic_cast<Block*>(node)) {
+        for (auto& stmt : block->statements) {
+            collectImports(stmt.get(), names);
+        }
+    } else if (auto fn = dynamic_cast<FunctionDeclaration*>(node)) {
+        collectImports(fn->body.get(), names);
+    } else if (auto prog = dynamic_cast<ProgramDeclaration*>(node)) {
+        collectImports(prog->body.get(), names);
+    } else if (auto stmt = dynamic_cast<IfStatement*>(node)) {
+        collectImports(stmt->thenBlock.get(), names);
+        collectImports(stmt->elseBlock.get(), names);
+    } else if (auto stmt = dynamic_cast<WhileStatement*>(node)) {
+        collectImports(stmt->body.get(), names);
+    } else if (auto stmt = dynamic_cast<ForStatement*>(node)) {
+        collectImports(stmt->body.get(), names);
+    } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+        collectImports(stmt->tryBlock.get(), names);
+        collectImports(stmt->catchBlock.get(), names);
+        collectImports(stmt->finallyBlock.get(), names);
+    } else if (auto stmt = dynamic_cast<SwitchStatement*>(node)) {
+        for (auto& clause : stmt->cases) {
+            for (auto& s : clause->statements) {
+                collectImports(s.get(), names);
+            }
+        }
+    } else if (auto stmt = dynamic_cast<WhenStatement*>(node)) {
+        collectImports(stmt->body.get(), names);
+    }
+}
+
+// Names declared directly in a case clause land in the enclosing scope only if
+// that case runs, so references to them cannot be bound to a fixed slot.
+void Resolver::collectCaseDeclarations(ASTNode* node, std::unordered_set<std::string>& names)
+{
+    if (auto program = dynamic_cast<Program*>(node)) {
+        for (auto& decl : program->declarations) {
+            collectCaseDeclarations(decl.get(), names);
+        }
+    } else if (auto block = dynamic_cast<Block*>(node)) {
+        for (auto& stmt : block->statements) {
+            collectCaseDeclarations(stmt.get(), names);
+        }
+    } else if (auto stmt = dynamic_cast<IfStatement*>(node)) {
+        collectCaseDeclarations(stmt->thenBlock.get(), names);
+        collectCaseDeclarations(stmt->elseBlock.get(), names);
+    } else if (auto stmt = dynamic_cast<WhileStatement*>(node)) {
+        collectCaseDeclarations(stmt->body.get(), names);
+    } else if (auto stmt = dynamic_cast<ForStatement*>(node)) {
+        collectCaseDeclarations(stmt->body.get(), names);
+    } else if (auto stmt = dynamic_cast<TryStatement*>(node)) {
+        collectCaseDeclarations(stmt->tryBlock.get(), names);
+        collectCaseDeclarations(stmt->catchBlock.get(), names);
+        collectCaseDeclarations(stmt->finallyBlock.get(), names);
+    } else if (auto stmt = dynamic_cast<SwitchStatement*>(node)) {
+        for (auto& clause : stmt->cases) {
+            for (auto& s : clause->statements) {
+                if (auto decl = dynamic_cast<VariableDeclaration*>(s.get())) {
+                    names.insert(decl->name);
+                } else if (auto fn = dynamic_cast<FunctionDeclaration*>(s.get())) {
+                    names.insert(fn->name);
+                } else {
+                    collectCaseDeclarations(s.get(), names);
+                }
+            }
+        }
+    }
+    // Function bodies and when blocks are collected when they are resolved
+}
+
+// Adds the variable names `expr` reads to `names`, once each. Returns false
+// if it calls a user function, awaits or spawns, since that code may read
+// anything.
+bool Resolver::collectReads(Expression* expr, std::vector<std::string>& names)
+{
+    if (!expr) return true;
+
+    if (auto id = dynamic_cast<Identifier*>(expr)) {
+        if (std::find(names.begin(), names.end(), id->name) == names.end()) {
+            names.push_back(id->name);
+        }
+        return true;
+    } else if (auto assign = dynamic_cast<Assignment*>(expr)) {
+        return collectReads(assign->value.get(), names);
+    } else if (auto tmpl = dynamic_cast<TemplateLiteral*>(expr)) {
+        bool pure = true;
+        for (auto& part : tmpl->parts) {
+            pure = collectReads(part.expr.get(), names) && pure;
+        }
+        return pure;
+    } else if (auto bin = dynamic_cast<BinaryOp*>(expr)) {
+        bool pure = collectReads(bin->left.get(), names);
+        return collectReads(bin->right.get(), names) && pure;
+    } else if (auto un = dynamic_cast<UnaryOp*>(expr)) {
+        return collectReads(un->operand.get(), names);
+    } else if (auto call = dynamic_cast<FunctionCall*>(expr)) {
+        bool pure = call->builtin != nullptr;
+        for (auto& arg : call->args) {
+            pure = collectReads(arg.get(), names) && pure;
+        }
+        return pure;
+    } else if (auto arr = dynamic_cast<ArrayLiteral*>(expr)) {
+        bool pure = true;
+        for (auto& e : arr->elements) {
+            pure = collectReads(e.get(), names) && pure;
+        }
+        return pure;
+    } else if (auto obj = dynamic_cast<ObjectLiteral*>(expr)) {
+        bool pure = true;
+        for (auto& field : obj->fields) {
+            pure = collectReads(field.second.get(), names) && pure;
+        }
+        return pure;
+    } else if (auto idx = dynamic_cast<IndexAccess*>(expr)) {
+        bool pure = collectReads(idx->object.get(), names);
+        return collectReads(idx->index.get(), names) && pure;
+    } else if (auto field = dynamic_cast<FieldAccess*>(expr)) {
+        return collectReads(field->object.get(), names);
+    } else if (auto assign = dynamic_cast<IndexAssignment*>(expr)) {
+        bool pure = collectReads(assign->object.get(), names);
+        pure = collectReads(assign->index.get(), names) && pure;
+        return collectReads(assign->value.get(), names) && pure;
+    } else if (auto assign = dynamic_cast<FieldAssignment*>(expr)) {
+        bool pure = collectReads(assign->object.get(), names);
+        return collectReads(assign->value.get(), names) && pure;
+    } else if (dynamic_cast<AwaitExpression*>(expr) || dynamic_cast<SpawnExpression*>(expr)) {
+        return false;
+    }
+    // Literals read nothing; a function expression only reads when called
+    return true;
+}
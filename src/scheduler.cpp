@@ -0,0 +1,171 @@
+#include "include/scheduler.h"
+
+namespace {
+
+// The pool and deque of the worker running on this thread, if any
+thread_local TaskPool* workerPool = nullptr;
+thread_local size_t workerIndex = 0;
+
+} // namespace
+
+TaskPool::TaskPool(unsigned workers)
+{
+    if (workers == 0) workers = 1;
+    for (unsigned i = 0; i < workers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < workers; ++i) {
+        threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    stopping = true;
+    wake.notify_all();
+    sparesDone.wait(lock, [this] { return spares == 0; });
+    lock.unlock();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+TaskPool& TaskPool::shared()
+{
+    static TaskPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+void TaskPool::submit(Job job)
+{
+    size_t index = workerPool == this ? workerIndex : nextQueue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        // Counted before it can be taken, so take() never drops the count below zero
+        queued++;
+        queues[index]->jobs.push_back(std::move(job));
+    }
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    if (idle > 0) {
+        wake.notify_one();
+    } else {
+        startSpareIfNeeded();
+    }
+}
+
+bool TaskPool::take(size_t first, Job& job)
+{
+    {
+        Queue& own = *queues[first];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& victim = *queues[(first + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::startSpareIfNeeded()
+{
+    if (queued == 0 || running() >= size()) return;
+    spares++;
+    std::thread([this] { spareLoop(); }).detach();
+}
+
+void TaskPool::workerLoop(size_t index)
+{
+    workerPool = this;
+    workerIndex = index;
+    while (true) {
+        Job job;
+        if (take(index, job)) {
+            job();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping && queued == 0) return;
+        idle++;
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        idle--;
+    }
+}
+
+void TaskPool::spareLoop()
+{
+    workerPool = this;
+    workerIndex = nextQueue++ % queues.size();
+    while (true) {
+        Job job;
+        {
+            // Retire as soon as the blocked threads it stood in for are back
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            if (running() > size()) break;
+        }
+        if (!take(workerIndex, job)) break;
+        job();
+    }
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    spares--;
+    sparesDone.notify_all();
+}
+
+TaskPool::Blocking::Blocking() : pool(workerPool)
+{
+    if (!pool) return;
+    std::lock_guard<std::mutex> lock(pool->sleepMutex);
+    pool->blocked++;
+    pool->startSpareIfNeeded();
+}
+
+TaskPool::Blocking::~Blocking()
+{
+    if (!pool) return;
+    std::lock_guard<std::mutex> lock(pool->sleepMutex);
+    pool->blocked--;
+}
+
+void ProgramTask::finish(Value value)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = std::move(value);
+        finished.store(true, std::memory_order_release);
+    }
+    finishedChanged.notify_all();
+}
+
+void ProgramTask::fail(std::exception_ptr exception)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = exception;
+        finished.store(true, std::memory_order_release);
+    }
+    finishedChanged.notify_all();
+}
+
+Value ProgramTask::wait()
+{
+    if (!done()) {
+        TaskPool::Blocking blocking;
+        std::unique_lock<std::mutex> lock(mutex);
+        finishedChanged.wait(lock, [this] { return done(); });
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error) std::rethrow_exception(error);
+    return result;
+}
@@ -0,0 +1,123 @@
+#include "include/session.h"
+#include "include/lexer.h"
+#include "include/optimizer.h"
+#include "include/parser.h"
+#include "include/resolver.h"
+#include <algorithm>
+#include <stdexcept>
+
+extern thread_local Interpreter* currentInterpreter;
+
+namespace {
+
+// Named types resolve against the interpreter running on this thread, which
+// is the session's while it runs, whichever thread the host calls from
+class Running {
+public:
+    explicit Running(Interpreter& interp) : outer(currentInterpreter) { currentInterpreter = &interp; }
+    ~Running() { currentInterpreter = outer; }
+    Running(const Running&) = delete;
+    Running& operator=(const Running&) = delete;
+
+private:
+    Interpreter* outer;
+};
+
+} // namespace
+
+Program* Session::compile(const std::string& source)
+{
+    auto it = fragments.find(source);
+    if (it != fragments.end()) {
+        if (it->second.names == definedNames()) {
+            return it->second.program.get();
+        }
+        if (it->second.holdsCode) {
+            replaced.push_back(std::move(it->second.program));
+        } else {
+            plainFragments--;
+        }
+        fragments.erase(it);
+    }
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    for (const auto& entry : interp.functions) parser.declareFunction(entry.first);
+    for (const auto& entry : interp.programs) parser.declareFunction(entry.first);
+    auto program = parser.parse();
+    interp.preloadImports(program.get());
+    // Functions compiled from earlier fragments may write any global, so
+    // consts cannot be propagated (level 2) across fragments
+    Optimizer(interp, std::min(interp.optimizationLevel, 1)).optimize(program.get());
+    Resolver resolver;
+    resolver.resolve(program.get());
+    Program* compiled = program.get();
+    if (!resolver.holdsCode()) {
+        if (plainFragments == kMaxPlainFragments) {
+            for (auto entry = fragments.begin(); entry != fragments.end();) {
+                entry = entry->second.holdsCode ? std::next(entry) : fragments.erase(entry);
+            }
+            plainFragments = 0;
+        }
+        plainFragments++;
+    }
+    fragments.emplace(source, Fragment{std::move(program), definedNames(), resolver.holdsCode()});
+    return compiled;
+}
+
+Value Session::eval(const std::string& source)
+{
+    Program* program = compile(source);
+    Running running(interp);
+    Value result = 0;
+    auto& decls = program->declarations;
+    for (size_t i = 0; i < decls.size(); ++i) {
+        auto stmt = dynamic_cast<ExpressionStatement*>(decls[i].get());
+        if (stmt && i + 1 == decls.size()) {
+            result = interp.evaluate(stmt->expression.get());
+        } else if (decls[i]->acceptExec(&interp) != Completion::Normal) {
+            break;  // a top-level return, break or continue ends the fragment
+        }
+        if (interp.whensDue()) {
+            interp.runPendingWhens();
+        }
+        if (Heap::due()) {
+            Heap::collect();
+        }
+    }
+    return result;
+}
+
+void Session::define(const std::string& name, const Value& value, const std::string& type)
+{
+    Running running(interp);
+    interp.environment.define(name, Variable(value, type));
+    interp.notifyDefined(name);
+}
+
+Value Session::get(const std::string& name)
+{
+    return interp.environment.get(name).value;
+}
+
+Value Session::call(const std::string& name, std::vector<Value> args)
+{
+    Running running(interp);
+    auto fn = interp.functions.find(name);
+    if (fn != interp.functions.end()) {
+        return interp.callFunction(fn->second, std::move(args));
+    }
+    Value callee = interp.environment.get(name).value;
+    if (auto decl = std::get_if<FunctionDeclaration*>(&callee)) {
+        return interp.callFunction(*decl, std::move(args));
+    }
+    if (auto expr = std::get_if<FunctionExpression*>(&callee)) {
+        return interp.callFunction(*expr, std::move(args));
+    }
+    throw std::runtime_error("Not a function: " + name);
+}
+
+std::string Session::format(const Value& value)
+{
+    return interp.valueToString(value);
+}
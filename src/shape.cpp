@@ -0,0 +1,78 @@
+#include "include/shape.h"
+
+namespace {
+
+// Shapes with up to this many fields find one by comparing names, which is
+// quicker than hashing at these sizes
+constexpr size_t kLinearFields = 8;
+
+std::atomic<uint32_t> nextId{1};  // 0 marks an empty cache entry
+
+} // namespace
+
+const Shape* Shape::empty()
+{
+    static Shape* root = [] {
+        auto shape = new Shape;
+        shape->shapeId = nextId++;
+        return shape;
+    }();
+    return root;
+}
+
+const Shape* Shape::with(const std::string& name) const
+{
+    if (fieldNames.size() >= kMaxFields) return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = children.find(name);
+    if (found != children.end()) return found->second.get();
+    if (children.size() >= kMaxChildren) return nullptr;
+
+    std::unique_ptr<Shape> child(new Shape);
+    child->shapeId = nextId++;
+    child->fieldNames = fieldNames;
+    child->fieldNames.push_back(name);
+    if (child->fieldNames.size() > kLinearFields) {
+        for (size_t i = 0; i < child->fieldNames.size(); ++i) {
+            child->index.emplace(child->fieldNames[i], static_cast<uint32_t>(i));
+        }
+    }
+    const Shape* result = child.get();
+    children.emplace(name, std::move(child));
+    return result;
+}
+
+const Shape* Shape::withAll(const std::vector<std::string>& names) const
+{
+    const Shape* shape = this;
+    for (const auto& name : names) {
+        if (shape->slotOf(name) >= 0) continue;
+        shape = shape->with(name);
+        if (!shape) return nullptr;
+    }
+    return shape;
+}
+
+int Shape::slotOf(const std::string& name) const
+{
+    if (fieldNames.size() <= kLinearFields) {
+        for (size_t i = 0; i < fieldNames.size(); ++i) {
+            if (fieldNames[i] == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+    auto found = index.find(name);
+    return found != index.end() ? static_cast<int>(found->second) : -1;
+}
+
+int FieldCache::miss(const Shape* shape, const std::string& name) const
+{
+    int slot = shape->slotOf(name);
+    if (slot < 0) return slot;
+    uint64_t entry = static_cast<uint64_t>(shape->id()) << 32 | static_cast<uint32_t>(slot);
+    for (auto& e : entries) {
+        uint64_t expected = 0;
+        if (e.compare_exchange_strong(expected, entry, std::memory_order_relaxed) || expected == entry) break;
+    }
+    return slot;
+}
@@ -0,0 +1,803 @@
+#include "include/simd.h"
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AXO_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define AXO_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr size_t kLanes = 8;  // float reductions always add in this many lanes
+
+// Combines the lanes of a float reduction; the same tree for every kernel set
+float reduceLanes(const float lane[kLanes])
+{
+    return ((lane[0] + lane[1]) + (lane[2] + lane[3])) + ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+}
+
+// Wrapping int arithmetic without undefined behavior
+int wrapAdd(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+int wrapMul(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+int wrapAbs(int a) { return a < 0 ? static_cast<int>(0u - static_cast<uint32_t>(a)) : a; }
+
+// Out of range and NaN give INT_MIN, as the x86 conversion does
+int floorToInt(float x)
+{
+    float f = std::floor(x);
+    if (!(f >= -2147483648.0f && f < 2147483648.0f)) return INT_MIN;
+    return static_cast<int>(f);
+}
+
+// ---- Scalar ----------------------------------------------------------------
+
+int sumIntScalar(const int* a, size_t n)
+{
+    int total = 0;
+    for (size_t i = 0; i < n; ++i) total = wrapAdd(total, a[i]);
+    return total;
+}
+
+float sumFloatScalar(const float* a, size_t n)
+{
+    float lane[kLanes] = {};
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        for (size_t j = 0; j < kLanes; ++j) lane[j] += a[i + j];
+    }
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i];
+    return total;
+}
+
+int minIntScalar(const int* a, size_t n)
+{
+    int m = a[0];
+    for (size_t i = 1; i < n; ++i) m = a[i] < m ? a[i] : m;
+    return m;
+}
+
+int maxIntScalar(const int* a, size_t n)
+{
+    int m = a[0];
+    for (size_t i = 1; i < n; ++i) m = a[i] > m ? a[i] : m;
+    return m;
+}
+
+float minFloatScalar(const float* a, size_t n)
+{
+    float m = a[0];
+    for (size_t i = 1; i < n; ++i) m = a[i] < m ? a[i] : m;
+    return m;
+}
+
+float maxFloatScalar(const float* a, size_t n)
+{
+    float m = a[0];
+    for (size_t i = 1; i < n; ++i) m = a[i] > m ? a[i] : m;
+    return m;
+}
+
+int dotIntScalar(const int* a, const int* b, size_t n)
+{
+    int total = 0;
+    for (size_t i = 0; i < n; ++i) total = wrapAdd(total, wrapMul(a[i], b[i]));
+    return total;
+}
+
+float dotFloatScalar(const float* a, const float* b, size_t n)
+{
+    float lane[kLanes] = {};
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        for (size_t j = 0; j < kLanes; ++j) lane[j] += a[i + j] * b[i + j];
+    }
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i] * b[i];
+    return total;
+}
+
+void addIntScalar(const int* a, const int* b, int* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = wrapAdd(a[i], b[i]);
+}
+
+void addFloatScalar(const float* a, const float* b, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] + b[i];
+}
+
+void mulIntScalar(const int* a, const int* b, int* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = wrapMul(a[i], b[i]);
+}
+
+void mulFloatScalar(const float* a, const float* b, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] * b[i];
+}
+
+void scaleIntScalar(const int* a, int k, int* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = wrapMul(a[i], k);
+}
+
+void scaleFloatScalar(const float* a, float k, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] * k;
+}
+
+void sqrtFloatScalar(const float* a, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = std::sqrt(a[i]);
+}
+
+void absIntScalar(const int* a, int* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = wrapAbs(a[i]);
+}
+
+void absFloatScalar(const float* a, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = std::fabs(a[i]);
+}
+
+void floorFloatScalar(const float* a, int* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = floorToInt(a[i]);
+}
+
+const VectorKernels scalarKernels = {
+    "scalar",
+    sumIntScalar, sumFloatScalar, minIntScalar, maxIntScalar, minFloatScalar, maxFloatScalar,
+    dotIntScalar, dotFloatScalar,
+    addIntScalar, addFloatScalar, mulIntScalar, mulFloatScalar, scaleIntScalar, scaleFloatScalar,
+    sqrtFloatScalar, absIntScalar, absFloatScalar, floorFloatScalar,
+};
+
+#if AXO_SIMD_X86
+
+// ---- AVX2: 8 lanes ---------------------------------------------------------
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 int sumIntAvx2(const int* a, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+    }
+    alignas(32) int lane[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane), acc);
+    int total = sumIntScalar(lane, 8);
+    for (; i < n; ++i) total = wrapAdd(total, a[i]);
+    return total;
+}
+
+AVX2 float sumFloatAvx2(const float* a, size_t n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+    alignas(32) float lane[8];
+    _mm256_store_ps(lane, acc);
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i];
+    return total;
+}
+
+AVX2 int minIntAvx2(const int* a, size_t n)
+{
+    if (n < 8) return minIntScalar(a, n);
+    __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_min_epi32(m, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+    alignas(32) int lane[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane), m);
+    int result = minIntScalar(lane, 8);
+    for (; i < n; ++i) result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+AVX2 int maxIntAvx2(const int* a, size_t n)
+{
+    if (n < 8) return maxIntScalar(a, n);
+    __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_max_epi32(m, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+    alignas(32) int lane[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane), m);
+    int result = maxIntScalar(lane, 8);
+    for (; i < n; ++i) result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+AVX2 float minFloatAvx2(const float* a, size_t n)
+{
+    if (n < 8) return minFloatScalar(a, n);
+    __m256 m = _mm256_loadu_ps(a);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_min_ps(_mm256_loadu_ps(a + i), m);
+    alignas(32) float lane[8];
+    _mm256_store_ps(lane, m);
+    float result = minFloatScalar(lane, 8);
+    for (; i < n; ++i) result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+AVX2 float maxFloatAvx2(const float* a, size_t n)
+{
+    if (n < 8) return maxFloatScalar(a, n);
+    __m256 m = _mm256_loadu_ps(a);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_max_ps(_mm256_loadu_ps(a + i), m);
+    alignas(32) float lane[8];
+    _mm256_store_ps(lane, m);
+    float result = maxFloatScalar(lane, 8);
+    for (; i < n; ++i) result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+AVX2 int dotIntAvx2(const int* a, const int* b, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+    }
+    alignas(32) int lane[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane), acc);
+    int total = sumIntScalar(lane, 8);
+    for (; i < n; ++i) total = wrapAdd(total, wrapMul(a[i], b[i]));
+    return total;
+}
+
+AVX2 float dotFloatAvx2(const float* a, const float* b, size_t n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    alignas(32) float lane[8];
+    _mm256_store_ps(lane, acc);
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i] * b[i];
+    return total;
+}
+
+AVX2 void addIntAvx2(const int* a, const int* b, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi32(x, y));
+    }
+    addIntScalar(a + i, b + i, out + i, n - i);
+}
+
+AVX2 void addFloatAvx2(const float* a, const float* b, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    addFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+AVX2 void mulIntAvx2(const int* a, const int* b, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_mullo_epi32(x, y));
+    }
+    mulIntScalar(a + i, b + i, out + i, n - i);
+}
+
+AVX2 void mulFloatAvx2(const float* a, const float* b, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    mulFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+AVX2 void scaleIntAvx2(const int* a, int k, int* out, size_t n)
+{
+    __m256i factor = _mm256_set1_epi32(k);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_mullo_epi32(x, factor));
+    }
+    scaleIntScalar(a + i, k, out + i, n - i);
+}
+
+AVX2 void scaleFloatAvx2(const float* a, float k, float* out, size_t n)
+{
+    __m256 factor = _mm256_set1_ps(k);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), factor));
+    scaleFloatScalar(a + i, k, out + i, n - i);
+}
+
+AVX2 void sqrtFloatAvx2(const float* a, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_loadu_ps(a + i)));
+    sqrtFloatScalar(a + i, out + i, n - i);
+}
+
+AVX2 void absIntAvx2(const int* a, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_abs_epi32(x));
+    }
+    absIntScalar(a + i, out + i, n - i);
+}
+
+AVX2 void absFloatAvx2(const float* a, float* out, size_t n)
+{
+    __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(out + i, _mm256_and_ps(_mm256_loadu_ps(a + i), mask));
+    absFloatScalar(a + i, out + i, n - i);
+}
+
+AVX2 void floorFloatAvx2(const float* a, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_loadu_ps(a + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+    }
+    floorFloatScalar(a + i, out + i, n - i);
+}
+
+const VectorKernels avx2Kernels = {
+    "avx2",
+    sumIntAvx2, sumFloatAvx2, minIntAvx2, maxIntAvx2, minFloatAvx2, maxFloatAvx2,
+    dotIntAvx2, dotFloatAvx2,
+    addIntAvx2, addFloatAvx2, mulIntAvx2, mulFloatAvx2, scaleIntAvx2, scaleFloatAvx2,
+    sqrtFloatAvx2, absIntAvx2, absFloatAvx2, floorFloatAvx2,
+};
+
+// ---- SSE4.1: 4 lanes, two registers for the 8 float lanes -------------------
+
+#define SSE41 __attribute__((target("sse4.1")))
+
+SSE41 int sumIntSse41(const int* a, size_t n)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    alignas(16) int lane[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane), acc);
+    int total = sumIntScalar(lane, 4);
+    for (; i < n; ++i) total = wrapAdd(total, a[i]);
+    return total;
+}
+
+SSE41 float sumFloatSse41(const float* a, size_t n)
+{
+    __m128 lo = _mm_setzero_ps();
+    __m128 hi = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        lo = _mm_add_ps(lo, _mm_loadu_ps(a + i));
+        hi = _mm_add_ps(hi, _mm_loadu_ps(a + i + 4));
+    }
+    alignas(16) float lane[8];
+    _mm_store_ps(lane, lo);
+    _mm_store_ps(lane + 4, hi);
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i];
+    return total;
+}
+
+SSE41 int minIntSse41(const int* a, size_t n)
+{
+    if (n < 4) return minIntScalar(a, n);
+    __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm_min_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    alignas(16) int lane[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane), m);
+    int result = minIntScalar(lane, 4);
+    for (; i < n; ++i) result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+SSE41 int maxIntSse41(const int* a, size_t n)
+{
+    if (n < 4) return maxIntScalar(a, n);
+    __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm_max_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    alignas(16) int lane[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane), m);
+    int result = maxIntScalar(lane, 4);
+    for (; i < n; ++i) result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+SSE41 float minFloatSse41(const float* a, size_t n)
+{
+    if (n < 4) return minFloatScalar(a, n);
+    __m128 m = _mm_loadu_ps(a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm_min_ps(_mm_loadu_ps(a + i), m);
+    alignas(16) float lane[4];
+    _mm_store_ps(lane, m);
+    float result = minFloatScalar(lane, 4);
+    for (; i < n; ++i) result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+SSE41 float maxFloatSse41(const float* a, size_t n)
+{
+    if (n < 4) return maxFloatScalar(a, n);
+    __m128 m = _mm_loadu_ps(a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm_max_ps(_mm_loadu_ps(a + i), m);
+    alignas(16) float lane[4];
+    _mm_store_ps(lane, m);
+    float result = maxFloatScalar(lane, 4);
+    for (; i < n; ++i) result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+SSE41 int dotIntSse41(const int* a, const int* b, size_t n)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi32(acc, _mm_mullo_epi32(x, y));
+    }
+    alignas(16) int lane[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane), acc);
+    int total = sumIntScalar(lane, 4);
+    for (; i < n; ++i) total = wrapAdd(total, wrapMul(a[i], b[i]));
+    return total;
+}
+
+SSE41 float dotFloatSse41(const float* a, const float* b, size_t n)
+{
+    __m128 lo = _mm_setzero_ps();
+    __m128 hi = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    alignas(16) float lane[8];
+    _mm_store_ps(lane, lo);
+    _mm_store_ps(lane + 4, hi);
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i] * b[i];
+    return total;
+}
+
+SSE41 void addIntSse41(const int* a, const int* b, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(x, y));
+    }
+    addIntScalar(a + i, b + i, out + i, n - i);
+}
+
+SSE41 void addFloatSse41(const float* a, const float* b, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    addFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+SSE41 void mulIntSse41(const int* a, const int* b, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_mullo_epi32(x, y));
+    }
+    mulIntScalar(a + i, b + i, out + i, n - i);
+}
+
+SSE41 void mulFloatSse41(const float* a, const float* b, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    mulFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+SSE41 void scaleIntSse41(const int* a, int k, int* out, size_t n)
+{
+    __m128i factor = _mm_set1_epi32(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_mullo_epi32(x, factor));
+    }
+    scaleIntScalar(a + i, k, out + i, n - i);
+}
+
+SSE41 void scaleFloatSse41(const float* a, float k, float* out, size_t n)
+{
+    __m128 factor = _mm_set1_ps(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), factor));
+    scaleFloatScalar(a + i, k, out + i, n - i);
+}
+
+SSE41 void sqrtFloatSse41(const float* a, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_loadu_ps(a + i)));
+    sqrtFloatScalar(a + i, out + i, n - i);
+}
+
+SSE41 void absIntSse41(const int* a, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_abs_epi32(x));
+    }
+    absIntScalar(a + i, out + i, n - i);
+}
+
+SSE41 void absFloatSse41(const float* a, float* out, size_t n)
+{
+    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(out + i, _mm_and_ps(_mm_loadu_ps(a + i), mask));
+    absFloatScalar(a + i, out + i, n - i);
+}
+
+SSE41 void floorFloatSse41(const float* a, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_cvttps_epi32(_mm_floor_ps(_mm_loadu_ps(a + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+    }
+    floorFloatScalar(a + i, out + i, n - i);
+}
+
+const VectorKernels sse41Kernels = {
+    "sse4.1",
+    sumIntSse41, sumFloatSse41, minIntSse41, maxIntSse41, minFloatSse41, maxFloatSse41,
+    dotIntSse41, dotFloatSse41,
+    addIntSse41, addFloatSse41, mulIntSse41, mulFloatSse41, scaleIntSse41, scaleFloatSse41,
+    sqrtFloatSse41, absIntSse41, absFloatSse41, floorFloatSse41,
+};
+
+#endif // AXO_SIMD_X86
+
+#if AXO_SIMD_NEON
+
+// ---- NEON: 4 lanes, two registers for the 8 float lanes ---------------------
+
+int sumIntNeon(const int* a, size_t n)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) acc = vaddq_s32(acc, vld1q_s32(a + i));
+    int lane[4];
+    vst1q_s32(lane, acc);
+    int total = sumIntScalar(lane, 4);
+    for (; i < n; ++i) total = wrapAdd(total, a[i]);
+    return total;
+}
+
+float sumFloatNeon(const float* a, size_t n)
+{
+    float32x4_t lo = vdupq_n_f32(0.0f);
+    float32x4_t hi = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        lo = vaddq_f32(lo, vld1q_f32(a + i));
+        hi = vaddq_f32(hi, vld1q_f32(a + i + 4));
+    }
+    float lane[8];
+    vst1q_f32(lane, lo);
+    vst1q_f32(lane + 4, hi);
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i];
+    return total;
+}
+
+int minIntNeon(const int* a, size_t n)
+{
+    if (n < 4) return minIntScalar(a, n);
+    int32x4_t m = vld1q_s32(a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = vminq_s32(m, vld1q_s32(a + i));
+    int result = vminvq_s32(m);
+    for (; i < n; ++i) result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+int maxIntNeon(const int* a, size_t n)
+{
+    if (n < 4) return maxIntScalar(a, n);
+    int32x4_t m = vld1q_s32(a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = vmaxq_s32(m, vld1q_s32(a + i));
+    int result = vmaxvq_s32(m);
+    for (; i < n; ++i) result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+float minFloatNeon(const float* a, size_t n)
+{
+    if (n < 4) return minFloatScalar(a, n);
+    float32x4_t m = vld1q_f32(a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = vminq_f32(m, vld1q_f32(a + i));
+    float result = vminvq_f32(m);
+    for (; i < n; ++i) result = a[i] < result ? a[i] : result;
+    return result;
+}
+
+float maxFloatNeon(const float* a, size_t n)
+{
+    if (n < 4) return maxFloatScalar(a, n);
+    float32x4_t m = vld1q_f32(a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = vmaxq_f32(m, vld1q_f32(a + i));
+    float result = vmaxvq_f32(m);
+    for (; i < n; ++i) result = a[i] > result ? a[i] : result;
+    return result;
+}
+
+int dotIntNeon(const int* a, const int* b, size_t n)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) acc = vaddq_s32(acc, vmulq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    int lane[4];
+    vst1q_s32(lane, acc);
+    int total = sumIntScalar(lane, 4);
+    for (; i < n; ++i) total = wrapAdd(total, wrapMul(a[i], b[i]));
+    return total;
+}
+
+float dotFloatNeon(const float* a, const float* b, size_t n)
+{
+    float32x4_t lo = vdupq_n_f32(0.0f);
+    float32x4_t hi = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        lo = vaddq_f32(lo, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+        hi = vaddq_f32(hi, vmulq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4)));
+    }
+    float lane[8];
+    vst1q_f32(lane, lo);
+    vst1q_f32(lane + 4, hi);
+    float total = reduceLanes(lane);
+    for (; i < n; ++i) total += a[i] * b[i];
+    return total;
+}
+
+void addIntNeon(const int* a, const int* b, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_s32(out + i, vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    addIntScalar(a + i, b + i, out + i, n - i);
+}
+
+void addFloatNeon(const float* a, const float* b, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_f32(out + i, vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+    addFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+void mulIntNeon(const int* a, const int* b, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_s32(out + i, vmulq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    mulIntScalar(a + i, b + i, out + i, n - i);
+}
+
+void mulFloatNeon(const float* a, const float* b, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_f32(out + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+    mulFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+void scaleIntNeon(const int* a, int k, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_s32(out + i, vmulq_n_s32(vld1q_s32(a + i), k));
+    scaleIntScalar(a + i, k, out + i, n - i);
+}
+
+void scaleFloatNeon(const float* a, float k, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(a + i), k));
+    scaleFloatScalar(a + i, k, out + i, n - i);
+}
+
+void sqrtFloatNeon(const float* a, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_f32(out + i, vsqrtq_f32(vld1q_f32(a + i)));
+    sqrtFloatScalar(a + i, out + i, n - i);
+}
+
+void absIntNeon(const int* a, int* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_s32(out + i, vabsq_s32(vld1q_s32(a + i)));
+    absIntScalar(a + i, out + i, n - i);
+}
+
+void absFloatNeon(const float* a, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_f32(out + i, vabsq_f32(vld1q_f32(a + i)));
+    absFloatScalar(a + i, out + i, n - i);
+}
+
+void floorFloatNeon(const float* a, int* out, size_t n)
+{
+    // NEON saturates out-of-range conversions; map them to INT_MIN like x86
+    const float32x4_t low = vdupq_n_f32(-2147483648.0f);
+    const float32x4_t high = vdupq_n_f32(2147483648.0f);
+    const int32x4_t indefinite = vdupq_n_s32(INT_MIN);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t f = vrndmq_f32(vld1q_f32(a + i));
+        uint32x4_t inRange = vandq_u32(vcgeq_f32(f, low), vcltq_f32(f, high));
+        vst1q_s32(out + i, vbslq_s32(inRange, vcvtq_s32_f32(f), indefinite));
+    }
+    floorFloatScalar(a + i, out + i, n - i);
+}
+
+const VectorKernels neonKernels = {
+    "neon",
+    sumIntNeon, sumFloatNeon, minIntNeon, maxIntNeon, minFloatNeon, maxFloatNeon,
+    dotIntNeon, dotFloatNeon,
+    addIntNeon, addFloatNeon, mulIntNeon, mulFloatNeon, scaleIntNeon, scaleFloatNeon,
+    sqrtFloatNeon, absIntNeon, absFloatNeon, floorFloatNeon,
+};
+
+#endif // AXO_SIMD_NEON
+
+const VectorKernels& selectKernels()
+{
+#if AXO_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return avx2Kernels;
+    if (__builtin_cpu_supports("sse4.1")) return sse41Kernels;
+#elif AXO_SIMD_NEON
+    return neonKernels;
+#endif
+    return scalarKernels;
+}
+
+} // namespace
+
+const VectorKernels& vectorKernels()
+{
+    static const VectorKernels& kernels = selectKernels();
+    return kernels;
+}
@@ -6,6 +6,7 @@ std::string Token::toString() const {
         case TokenType::INTEGER: typeStr = "INTEGER"; break;
         case TokenType::FLOAT: typeStr = "FLOAT"; break;
         case TokenType::STRING: typeStr = "STRING"; break;
+        case TokenType::TEMPLATE_STRING: typeStr = "TEMPLATE_STRING"; break;
         case TokenType::IDENTIFIER: typeStr = "IDENTIFIER"; break;
         case TokenType::KW_INT: typeStr = "KW_INT"; break;
         case TokenType::KW_FLOAT: typeStr = "KW_FLOAT"; break;
@@ -21,8 +22,27 @@ std::string Token::toString() const {
         case TokenType::KW_FUNC: typeStr = "KW_FUNC"; break;
         case TokenType::KW_VAR: typeStr = "KW_VAR"; break;
         case TokenType::KW_CONST: typeStr = "KW_CONST"; break;
+        case TokenType::KW_IMPORT: typeStr = "KW_IMPORT"; break;
+        case TokenType::KW_USE: typeStr = "KW_USE"; break;
+        case TokenType::KW_EXPORT: typeStr = "KW_EXPORT"; break;
+        case TokenType::KW_OBJECT: typeStr = "KW_OBJECT"; break;
         case TokenType::KW_TRUE: typeStr = "KW_TRUE"; break;
         case TokenType::KW_FALSE: typeStr = "KW_FALSE"; break;
+        case TokenType::KW_PROGRAM: typeStr = "KW_PROGRAM"; break;
+        case TokenType::KW_AWAIT: typeStr = "KW_AWAIT"; break;
+        case TokenType::KW_SPAWN: typeStr = "KW_SPAWN"; break;
+        case TokenType::KW_TYPE: typeStr = "KW_TYPE"; break;
+        case TokenType::KW_TYPEOF: typeStr = "KW_TYPEOF"; break;
+        case TokenType::KW_TRY: typeStr = "KW_TRY"; break;
+        case TokenType::KW_CATCH: typeStr = "KW_CATCH"; break;
+        case TokenType::KW_FINALLY: typeStr = "KW_FINALLY"; break;
+        case TokenType::KW_THROW: typeStr = "KW_THROW"; break;
+        case TokenType::KW_BREAK: typeStr = "KW_BREAK"; break;
+        case TokenType::KW_CONTINUE: typeStr = "KW_CONTINUE"; break;
+        case TokenType::KW_SWITCH: typeStr = "KW_SWITCH"; break;
+        case TokenType::KW_CASE: typeStr = "KW_CASE"; break;
+        case TokenType::KW_DEFAULT: typeStr = "KW_DEFAULT"; break;
+        case TokenType::KW_WHEN: typeStr = "KW_WHEN"; break;
         case TokenType::PLUS: typeStr = "PLUS"; break;
         case TokenType::MINUS: typeStr = "MINUS"; break;
         case TokenType::STAR: typeStr = "STAR"; break;
@@ -54,5 +74,5 @@ std::string Token::toString() const {
         case TokenType::NEWLINE: typeStr = "NEWLINE"; break;
         case TokenType::UNKNOWN: typeStr = "UNKNOWN"; break;
     }
-    return typeStr + "(" + value + ")";
+    return typeStr + "(" + std::string(value) + ")";
 }
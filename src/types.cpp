@@ -0,0 +1,248 @@
+#include "include/types.h"
+#include "include/interpreter.h"
+#include <cctype>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Named types are looked up in the running interpreter's `type` declarations
+extern thread_local Interpreter* currentInterpreter;
+
+namespace {
+
+std::string trim(const std::string &s)
+{
+    size_t a = s.find_first_not_of(" \t\n\r");
+    if (a == std::string::npos) return "";
+    size_t b = s.find_last_not_of(" \t\n\r");
+    return s.substr(a, b - a + 1);
+}
+
+bool isIdentifier(const std::string &s)
+{
+    if (s.empty() || !(std::isalpha((unsigned char)s[0]) || s[0] == '_')) return false;
+    for (char c : s) {
+        if (!(std::isalnum((unsigned char)c) || c == '_')) return false;
+    }
+    return true;
+}
+
+// Compiling a spec interns the specs inside it, so the lock has to be reentrant
+std::recursive_mutex internMutex;
+std::unordered_map<std::string, std::unique_ptr<TypeDescriptor>> interned;
+
+} // namespace
+
+const TypeDescriptor *TypeDescriptor::get(const std::string &spec)
+{
+    std::lock_guard<std::recursive_mutex> lock(internMutex);
+    auto it = interned.find(spec);
+    if (it != interned.end()) {
+        return it->second.get();
+    }
+    auto descriptor = std::make_unique<TypeDescriptor>();
+    descriptor->spec = spec;
+    descriptor->compile();
+    return interned.emplace(spec, std::move(descriptor)).first->second.get();
+}
+
+const TypeDescriptor *TypeDescriptor::defaultType()
+{
+    static const TypeDescriptor *type = get("int");
+    return type;
+}
+
+// Recognizes the same forms, in the same order, as the string-based check did
+void TypeDescriptor::compile()
+{
+    checkOnAssign = !spec.empty() &&
+                    (spec.find('|') != std::string::npos || spec.find('[') != std::string::npos || spec == "any");
+
+    std::string t = trim(spec);
+    if (t.empty()) return;
+
+    if (t.size() >= 2 && t.front() == '[' && t.back() == ']') {
+        std::string inner = t.substr(1, t.size() - 2);
+        element = get(inner);
+        if (inner.find(',') == std::string::npos) {
+            kind = Kind::Array;
+            if (element->kind == Kind::Int) unboxed = ArrayValue::Storage::Int;
+            else if (element->kind == Kind::Float) unboxed = ArrayValue::Storage::Float;
+            else if (element->kind == Kind::Bool) unboxed = ArrayValue::Storage::Bool;
+            return;
+        }
+        kind = Kind::Tuple;
+        size_t start = 0;
+        for (size_t i = 0; i <= inner.size(); ++i) {
+            if (i == inner.size() || inner[i] == ',') {
+                members.push_back(get(trim(inner.substr(start, i - start))));
+                start = i + 1;
+            }
+        }
+        return;
+    }
+
+    if (t.size() >= 2 && t.front() == '{' && t.back() == '}') {
+        kind = Kind::Record;
+        std::string inner = t.substr(1, t.size() - 2);
+        size_t pos = 0;
+        while (pos < inner.size()) {
+            while (pos < inner.size() && (inner[pos] == ' ' || inner[pos] == '\t' || inner[pos] == '\n')) pos++;
+            if (pos >= inner.size()) break;
+
+            size_t colonPos = inner.find(':', pos);
+            if (colonPos == std::string::npos) break;
+            std::string fieldName = trim(inner.substr(pos, colonPos - pos));
+
+            // The field type ends at the next comma outside nested braces and brackets
+            size_t typeStart = colonPos + 1;
+            size_t typeEnd = typeStart;
+            int braceCount = 0;
+            int bracketCount = 0;
+            while (typeEnd < inner.size()) {
+                char c = inner[typeEnd];
+                if (c == '{') braceCount++;
+                else if (c == '}') braceCount--;
+                else if (c == '[') bracketCount++;
+                else if (c == ']') bracketCount--;
+                else if (c == ',' && braceCount == 0 && bracketCount == 0) break;
+                typeEnd++;
+            }
+            fields.push_back(fieldName);
+            members.push_back(get(trim(inner.substr(typeStart, typeEnd - typeStart))));
+            pos = typeEnd + 1;
+        }
+        // Objects built with these fields in this order share this shape
+        shape = Shape::empty()->withAll(fields);
+        if (shape && shape->size() != fields.size()) shape = nullptr;
+        return;
+    }
+
+    if (t.find('|') != std::string::npos) {
+        kind = Kind::Union;
+        size_t start = 0;
+        for (size_t i = 0; i <= t.size(); ++i) {
+            if (i == t.size() || t[i] == '|') {
+                members.push_back(get(trim(t.substr(start, i - start))));
+                start = i + 1;
+            }
+        }
+        return;
+    }
+
+    if (t.size() >= 2 && t.front() == '"' && t.back() == '"') {
+        kind = Kind::StringLiteral;
+        text = t.substr(1, t.size() - 2);
+        return;
+    }
+
+    if (t.find_first_not_of("0123456789-") == std::string::npos && t != "-") {
+        try {
+            number = std::stoi(t);
+            kind = Kind::IntLiteral;
+            return;
+        } catch (...) {
+            // Not a valid integer literal; matches nothing
+        }
+    }
+
+    if (t == "true") { kind = Kind::True; return; }
+    if (t == "false") { kind = Kind::False; return; }
+    if (t == "any") { kind = Kind::Any; return; }
+    if (t == "int") { kind = Kind::Int; valueIndex = static_cast<int>(Value(0).index()); return; }
+    if (t == "float") { kind = Kind::Float; valueIndex = static_cast<int>(Value(0.0f).index()); return; }
+    if (t == "string") { kind = Kind::String; valueIndex = static_cast<int>(Value(std::string()).index()); return; }
+    if (t == "bool") { kind = Kind::Bool; valueIndex = static_cast<int>(Value(false).index()); return; }
+    if (t == "object") { kind = Kind::Object; return; }
+    if (t == "task") { kind = Kind::Task; return; }
+    if (t == "channel") { kind = Kind::Channel; return; }
+    if (t == "reader") { kind = Kind::Reader; return; }
+    if (t == "func" || t.rfind("(", 0) == 0) { kind = Kind::Function; return; }
+
+    if (isIdentifier(t)) {
+        kind = Kind::Named;
+        text = t;
+    }
+}
+
+bool TypeDescriptor::matches(const Value &v) const
+{
+    switch (kind) {
+        case Kind::Int:
+        case Kind::Float:
+        case Kind::String:
+        case Kind::Bool:
+            return static_cast<int>(v.index()) == valueIndex;
+        case Kind::Object:
+            return std::holds_alternative<std::shared_ptr<ObjectValue>>(v);
+        case Kind::Function:
+            return std::holds_alternative<FunctionDeclaration*>(v) || std::holds_alternative<FunctionExpression*>(v);
+        case Kind::Task:
+            return std::holds_alternative<std::shared_ptr<ProgramTask>>(v);
+        case Kind::Channel:
+            return std::holds_alternative<std::shared_ptr<Channel>>(v);
+        case Kind::Reader:
+            return std::holds_alternative<std::shared_ptr<FileReader>>(v);
+        case Kind::Any:
+            return true;
+        case Kind::Array: {
+            auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&v);
+            if (!arr) return false;
+            if (unboxed != ArrayValue::Storage::Boxed && (*arr)->storage() == unboxed) {
+                return true;  // the storage already guarantees the element type
+            }
+            return (*arr)->each([this](const Value &elem) { return element->matches(elem); });
+        }
+        case Kind::Tuple: {
+            auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&v);
+            if (!arr || (*arr)->size() != members.size()) return false;
+            for (size_t i = 0; i < members.size(); ++i) {
+                if (!members[i]->matches((*arr)->at(i))) return false;
+            }
+            return true;
+        }
+        case Kind::Record: {
+            auto obj = std::get_if<std::shared_ptr<ObjectValue>>(&v);
+            if (!obj) return false;
+            if (shape && (*obj)->shape() == shape) {
+                // Built in the declared order: field i is in slot i
+                auto& values = (*obj)->values();
+                for (size_t i = 0; i < members.size(); ++i) {
+                    if (!members[i]->matches(values[i])) return false;
+                }
+                return true;
+            }
+            for (size_t i = 0; i < fields.size(); ++i) {
+                const Value* field = (*obj)->find(fields[i]);
+                if (!field || !members[i]->matches(*field)) return false;
+            }
+            return true;
+        }
+        case Kind::Union:
+            for (auto member : members) {
+                if (member->matches(v)) return true;
+            }
+            return false;
+        case Kind::StringLiteral: {
+            auto s = std::get_if<std::string>(&v);
+            return s && *s == text;
+        }
+        case Kind::IntLiteral: {
+            auto i = std::get_if<int>(&v);
+            return i && *i == number;
+        }
+        case Kind::True:
+        case Kind::False: {
+            auto b = std::get_if<bool>(&v);
+            return b && *b == (kind == Kind::True);
+        }
+        case Kind::Named: {
+            if (!currentInterpreter) return false;
+            auto it = currentInterpreter->typeRegistry.find(text);
+            return it != currentInterpreter->typeRegistry.end() && it->second->matches(v);
+        }
+        case Kind::Never:
+            return false;
+    }
+    return false;
+}
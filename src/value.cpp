@@ -0,0 +1,179 @@
+#include "include/value.h"
+#include <algorithm>
+
+std::shared_ptr<ArrayValue> ArrayValue::ofInts(std::vector<int> elems)
+{
+    auto arr = std::make_shared<ArrayValue>();
+    arr->kind = Storage::Int;
+    arr->ints = std::move(elems);
+    return arr;
+}
+
+std::shared_ptr<ArrayValue> ArrayValue::ofFloats(std::vector<float> elems)
+{
+    auto arr = std::make_shared<ArrayValue>();
+    arr->kind = Storage::Float;
+    arr->floats = std::move(elems);
+    return arr;
+}
+
+Value ArrayValue::pop()
+{
+    Value last = at(size() - 1);
+    switch (kind) {
+        case Storage::Int: ints.pop_back(); break;
+        case Storage::Float: floats.pop_back(); break;
+        case Storage::Bool: bools.pop_back(); break;
+        default: values.pop_back(); break;
+    }
+    return last;
+}
+
+void ArrayValue::reserve(size_t n)
+{
+    switch (kind) {
+        case Storage::Int: ints.reserve(n); break;
+        case Storage::Float: floats.reserve(n); break;
+        case Storage::Bool: bools.reserve(n); break;
+        default: values.reserve(n); break;
+    }
+}
+
+void ArrayValue::clear()
+{
+    ints.clear();
+    floats.clear();
+    bools.clear();
+    values.clear();
+}
+
+std::shared_ptr<ArrayValue> ArrayValue::slice(size_t begin, size_t end) const
+{
+    auto result = std::make_shared<ArrayValue>();
+    result->kind = kind;
+    end = std::min(end, size());
+    if (begin >= end) return result;
+    switch (kind) {
+        case Storage::Int: result->ints.assign(ints.begin() + begin, ints.begin() + end); break;
+        case Storage::Float: result->floats.assign(floats.begin() + begin, floats.begin() + end); break;
+        case Storage::Bool: result->bools.assign(bools.begin() + begin, bools.begin() + end); break;
+        default: result->values.assign(values.begin() + begin, values.begin() + end); break;
+    }
+    return result;
+}
+
+bool ArrayValue::unbox(Storage storage)
+{
+    if (storage == kind) return true;
+    if (kind != Storage::Boxed) return false;  // typed storage only goes back to boxed
+    switch (storage) {
+        case Storage::Int:
+            for (const Value& v : values) if (!std::holds_alternative<int>(v)) return false;
+            ints.reserve(values.size());
+            for (const Value& v : values) ints.push_back(std::get<int>(v));
+            break;
+        case Storage::Float:
+            for (const Value& v : values) if (!std::holds_alternative<float>(v)) return false;
+            floats.reserve(values.size());
+            for (const Value& v : values) floats.push_back(std::get<float>(v));
+            break;
+        case Storage::Bool:
+            for (const Value& v : values) if (!std::holds_alternative<bool>(v)) return false;
+            bools.reserve(values.size());
+            for (const Value& v : values) bools.push_back(std::get<bool>(v));
+            break;
+        default:
+            return false;
+    }
+    kind = storage;
+    values = std::vector<Value>();
+    return true;
+}
+
+std::vector<Value>& ArrayValue::boxed()
+{
+    box();
+    return values;
+}
+
+void ArrayValue::box()
+{
+    if (kind == Storage::Boxed) return;
+    std::vector<Value> out;
+    out.reserve(size());
+    each([&out](const Value& v) {
+        out.push_back(v);
+        return true;
+    });
+    ints = std::vector<int>();
+    floats = std::vector<float>();
+    bools = std::vector<char>();
+    values = std::move(out);
+    kind = Storage::Boxed;
+}
+
+ObjectValue::ObjectValue(const ObjectValue& other)
+    : HeapObject(other), std::enable_shared_from_this<ObjectValue>(), layout(other.layout),
+      own(other.own ? std::make_unique<Index>(*other.own) : nullptr), slots(other.slots)
+{
+}
+
+int ObjectValue::slotOf(const std::string& name) const
+{
+    if (layout) return layout->slotOf(name);
+    auto found = own->slots.find(name);
+    return found != own->slots.end() ? static_cast<int>(found->second) : -1;
+}
+
+void ObjectValue::add(const std::string& name, Value v)
+{
+    if (layout) {
+        if (const Shape* next = layout->with(name)) {
+            layout = next;
+            slots.push_back(std::move(v));
+            return;
+        }
+        own = std::make_unique<Index>();
+        own->names = layout->names();
+        for (size_t i = 0; i < own->names.size(); ++i) {
+            own->slots.emplace(own->names[i], static_cast<uint32_t>(i));
+        }
+        layout = nullptr;
+    }
+    own->slots.emplace(name, static_cast<uint32_t>(slots.size()));
+    own->names.push_back(name);
+    slots.push_back(std::move(v));
+}
+
+void ObjectValue::clear()
+{
+    layout = Shape::empty();
+    own.reset();
+    slots.clear();
+}
+
+Value ValueCopier::copy(const Value& v)
+{
+    if (auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&v)) {
+        auto seen = copies.find(arr->get());
+        if (seen != copies.end()) return seen->second;
+        auto result = std::make_shared<ArrayValue>(**arr);
+        copies.emplace(arr->get(), result);
+        if (result->storage() == ArrayValue::Storage::Boxed) {
+            for (Value& elem : result->boxed()) elem = copy(elem);
+        }
+        return result;
+    }
+    if (auto obj = std::get_if<std::shared_ptr<ObjectValue>>(&v)) {
+        auto seen = copies.find(obj->get());
+        if (seen != copies.end()) return seen->second;
+        auto result = std::make_shared<ObjectValue>(**obj);
+        copies.emplace(obj->get(), result);
+        for (Value& field : result->values()) field = copy(field);
+        return result;
+    }
+    if (std::holds_alternative<FunctionDeclaration*>(v) || std::holds_alternative<FunctionExpression*>(v)) {
+        functions.push_back(v);
+    }
+    return v;
+}
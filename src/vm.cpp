@@ -0,0 +1,631 @@
+#include "include/vm.h"
+#include "include/interpreter.h"
+#include "include/builtins.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+// GCC and Clang support "labels as values"; use a threaded dispatch table
+// there and a plain switch everywhere else.
+#if defined(__GNUC__) || defined(__clang__)
+#define AXO_COMPUTED_GOTO 1
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+namespace {
+
+const size_t kInitialStack = 4096;
+const size_t kMaxFrames = 200000;
+
+const std::string kNoName;
+
+// Copies a value, handling ints, floats and bools inline: std::variant's own
+// assignment goes through a table of functions even for those
+inline void assign(Value& to, const Value& from) {
+    switch (from.index()) {
+        case 0: to = *std::get_if<int>(&from); break;
+        case 1: to = *std::get_if<float>(&from); break;
+        case 3: to = *std::get_if<bool>(&from); break;
+        default: to = from; break;
+    }
+}
+
+inline void take(Value& to, Value& from) {
+    switch (from.index()) {
+        case 0: to = *std::get_if<int>(&from); break;
+        case 1: to = *std::get_if<float>(&from); break;
+        case 3: to = *std::get_if<bool>(&from); break;
+        default: to = std::move(from); break;
+    }
+}
+
+} // namespace
+
+VM::VM(Interpreter& host) : host(host) {}
+
+void VM::ensureStack(size_t needed) {
+    if (needed <= stack.size()) return;
+    size_t size = stack.size() * 2;
+    if (size < needed) size = needed;
+    stack.resize(size);
+}
+
+void VM::execute(const BytecodeProgram& prog) {
+    program = &prog;
+    globals.assign(prog.globalNames.size(), Value());
+    globalTypes.assign(prog.globalNames.size(), nullptr);
+    globalState.assign(prog.globalNames.size(), 0);
+    functionTable.assign(prog.functionNames.size(), nullptr);
+
+    const FunctionProto* main = prog.protos[0].get();
+    stack.assign(kInitialStack, Value());
+    ensureStack(main->numSlots + main->maxStack + 1);
+    frames.clear();
+    frames.push_back({main, main->code.data(), 0, 0});
+    handlers.clear();
+    spOffset = main->numSlots;
+
+    for (;;) {
+        try {
+            run();
+            return;
+        } catch (...) {
+            // A template interpolation that fails renders as its source text
+            if (handlers.empty()) throw;
+            Handler h = handlers.back();
+            handlers.pop_back();
+            frames.resize(h.frameDepth);
+            frames.back().ip = h.target;
+            spOffset = h.sp;
+        }
+    }
+}
+
+void VM::run() {
+    Frame* frame;
+    const Instruction* ip;
+    const Instruction* ins;
+    const Instruction* code;
+    const Value* consts;
+    Value* base;
+    Value* sp;
+
+#define LOAD_FRAME()                                  \
+    do {                                              \
+        frame = &frames.back();                       \
+        ip = frame->ip;                               \
+        code = frame->proto->code.data();             \
+        consts = frame->proto->constants.data();      \
+        base = stack.data() + frame->base;            \
+    } while (0)
+
+    LOAD_FRAME();
+    sp = stack.data() + spOffset;
+
+#ifdef AXO_COMPUTED_GOTO
+    static const void* dispatch[] = {
+        &&L_CONST, &&L_POP, &&L_LOAD_LOCAL, &&L_STORE_LOCAL, &&L_DEFINE_LOCAL,
+        &&L_LOAD_GLOBAL, &&L_STORE_GLOBAL, &&L_DEFINE_GLOBAL, &&L_TYPEOF_LOCAL, &&L_TYPEOF_GLOBAL,
+        &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_MOD,
+        &&L_EQ, &&L_NE, &&L_LT, &&L_GT, &&L_LE, &&L_GE,
+        &&L_ADD_CONST, &&L_SUB_CONST, &&L_MUL_CONST, &&L_DIV_CONST, &&L_MOD_CONST,
+        &&L_EQ_CONST, &&L_NE_CONST, &&L_LT_CONST, &&L_GT_CONST, &&L_LE_CONST, &&L_GE_CONST,
+        &&L_AND, &&L_OR,
+        &&L_NEG, &&L_NOT, &&L_TYPEOF,
+        &&L_JUMP, &&L_JUMP_IF_FALSE,
+        &&L_JUMP_IF_NOT_EQ, &&L_JUMP_IF_NOT_NE, &&L_JUMP_IF_NOT_LT, &&L_JUMP_IF_NOT_GT,
+        &&L_JUMP_IF_NOT_LE, &&L_JUMP_IF_NOT_GE,
+        &&L_JUMP_IF_NOT_EQ_CONST, &&L_JUMP_IF_NOT_NE_CONST, &&L_JUMP_IF_NOT_LT_CONST,
+        &&L_JUMP_IF_NOT_GT_CONST, &&L_JUMP_IF_NOT_LE_CONST, &&L_JUMP_IF_NOT_GE_CONST,
+        &&L_MAKE_ARRAY, &&L_MAKE_OBJECT,
+        &&L_GET_INDEX, &&L_SET_INDEX, &&L_GET_FIELD, &&L_SET_FIELD,
+        &&L_CALL, &&L_CALL_FUNC, &&L_CALL_BUILTIN,
+        &&L_DEFINE_FUNC, &&L_DEFINE_TYPE, &&L_CONCAT,
+        &&L_PUSH_HANDLER, &&L_POP_HANDLER,
+        &&L_RETURN, &&L_HALT,
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == static_cast<size_t>(OpCode::HALT) + 1,
+                  "dispatch table out of sync with OpCode");
+#define VM_CASE(name) L_##name:
+#define VM_NEXT()                                     \
+    do {                                              \
+        ins = ip++;                                   \
+        goto *dispatch[static_cast<int>(ins->op)];    \
+    } while (0)
+    VM_NEXT();
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_NEXT() continue
+    for (;;) {
+        ins = ip++;
+        switch (ins->op) {
+#endif
+
+    // Enter a compiled function whose arguments are the top argc stack values
+#define VM_ENTER(callee, argc, returnSlot)                                          \
+    do {                                                                            \
+        if ((argc) != (callee)->numParams)                                          \
+            throw std::runtime_error("Function argument count mismatch");           \
+        if (frames.size() >= kMaxFrames)                                            \
+            throw std::runtime_error("Stack overflow: too many nested calls");      \
+        size_t newBase = static_cast<size_t>(sp - stack.data()) - (argc);           \
+        frame->ip = ip;                                                             \
+        ensureStack(newBase + (callee)->numSlots + (callee)->maxStack + 1);         \
+        frames.push_back({(callee), (callee)->code.data(), newBase, (returnSlot)}); \
+        LOAD_FRAME();                                                               \
+        sp = base + (callee)->numSlots;                                             \
+    } while (0)
+
+    // int/int and float/float stay inline; anything else uses the interpreter's
+    // rules. The right operand is popped, or is a constant (pops = 0).
+#define VM_ARITH(name, op, binop, right, pops)                                      \
+    VM_CASE(name) {                                                                 \
+        Value& l = sp[-1 - (pops)];                                                 \
+        const Value& r = (right);                                                   \
+        if (l.index() == 0 && r.index() == 0) {                                     \
+            l = *std::get_if<int>(&l) op *std::get_if<int>(&r);                     \
+        } else if (l.index() == 1 && r.index() == 1) {                              \
+            l = *std::get_if<float>(&l) op *std::get_if<float>(&r);                 \
+        } else {                                                                    \
+            l = host.performBinaryOp(l, BinaryOperator::binop, r);                  \
+        }                                                                           \
+        sp -= (pops);                                                               \
+        VM_NEXT();                                                                  \
+    }
+
+    VM_CASE(CONST) {
+        assign(*sp++, consts[ins->a]);
+        VM_NEXT();
+    }
+    VM_CASE(POP) {
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_LOCAL) {
+        assign(*sp++, base[ins->a]);
+        VM_NEXT();
+    }
+    VM_CASE(STORE_LOCAL) {
+        if (ins->b >= 0) {
+            const VarInfo& info = program->varInfos[ins->b];
+            if (!info.type->matches(sp[-1])) {
+                throw std::runtime_error("Type error: cannot assign value to variable '" + info.name +
+                                         "' of type '" + info.type->spec + "'");
+            }
+            info.type->adopt(sp[-1]);
+        }
+        assign(base[ins->a], sp[-1]);
+        sp -= ins->c;
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_LOCAL) {
+        --sp;
+        if (ins->b >= 0) {
+            const VarInfo& info = program->varInfos[ins->b];
+            if (!info.type->matches(*sp)) {
+                host.checkInitializerType(info.name, info.type, *sp);
+            }
+            info.type->adopt(*sp);
+        }
+        base[ins->a] = std::move(*sp);
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_GLOBAL) {
+        if (!globalState[ins->a]) {
+            throw std::runtime_error("Undefined variable: " + program->globalNames[ins->a]);
+        }
+        assign(*sp++, globals[ins->a]);
+        VM_NEXT();
+    }
+    VM_CASE(STORE_GLOBAL) {
+        unsigned char state = globalState[ins->a];
+        if (!state) {
+            throw std::runtime_error("Undefined variable: " + program->globalNames[ins->a]);
+        }
+        if (state == 2) {
+            if (!globalTypes[ins->a]->matches(sp[-1])) {
+                throw std::runtime_error("Type error: cannot assign value to variable '" + program->globalNames[ins->a] +
+                                         "' of type '" + globalTypes[ins->a]->spec + "'");
+            }
+            globalTypes[ins->a]->adopt(sp[-1]);
+        }
+        assign(globals[ins->a], sp[-1]);
+        sp -= ins->c;
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_GLOBAL) {
+        --sp;
+        const VarInfo& info = program->varInfos[ins->b];
+        if (ins->c && !info.type->matches(*sp)) {
+            host.checkInitializerType(info.name, info.type, *sp);
+        }
+        info.type->adopt(*sp);
+        globals[ins->a] = std::move(*sp);
+        globalTypes[ins->a] = info.type;
+        globalState[ins->a] = info.type->checkOnAssign ? 2 : 1;
+        VM_NEXT();
+    }
+    VM_CASE(TYPEOF_LOCAL) {
+        Value type = host.getTypeOfValue(base[ins->a], program->varInfos[ins->b].type->spec);
+        *sp++ = std::move(type);
+        VM_NEXT();
+    }
+    VM_CASE(TYPEOF_GLOBAL) {
+        if (!globalState[ins->a]) {
+            throw std::runtime_error("Undefined variable: " + program->globalNames[ins->a]);
+        }
+        Value type = host.getTypeOfValue(globals[ins->a], globalTypes[ins->a]->spec);
+        *sp++ = std::move(type);
+        VM_NEXT();
+    }
+
+    VM_ARITH(ADD, +, ADD, sp[-1], 1)
+    VM_ARITH(SUB, -, SUBTRACT, sp[-1], 1)
+    VM_ARITH(MUL, *, MULTIPLY, sp[-1], 1)
+    VM_ARITH(EQ, ==, EQUAL, sp[-1], 1)
+    VM_ARITH(NE, !=, NOT_EQUAL, sp[-1], 1)
+    VM_ARITH(LT, <, LESS, sp[-1], 1)
+    VM_ARITH(GT, >, GREATER, sp[-1], 1)
+    VM_ARITH(LE, <=, LESS_EQUAL, sp[-1], 1)
+    VM_ARITH(GE, >=, GREATER_EQUAL, sp[-1], 1)
+    VM_ARITH(ADD_CONST, +, ADD, consts[ins->a], 0)
+    VM_ARITH(SUB_CONST, -, SUBTRACT, consts[ins->a], 0)
+    VM_ARITH(MUL_CONST, *, MULTIPLY, consts[ins->a], 0)
+    VM_ARITH(EQ_CONST, ==, EQUAL, consts[ins->a], 0)
+    VM_ARITH(NE_CONST, !=, NOT_EQUAL, consts[ins->a], 0)
+    VM_ARITH(LT_CONST, <, LESS, consts[ins->a], 0)
+    VM_ARITH(GT_CONST, >, GREATER, consts[ins->a], 0)
+    VM_ARITH(LE_CONST, <=, LESS_EQUAL, consts[ins->a], 0)
+    VM_ARITH(GE_CONST, >=, GREATER_EQUAL, consts[ins->a], 0)
+
+    // Divisors of 0 and -1 go to the interpreter's rules, which throw rather
+    // than trap (INT_MIN / -1 overflows)
+#define VM_DIV(name, right, pops)                                                   \
+    VM_CASE(name) {                                                                 \
+        Value& l = sp[-1 - (pops)];                                                 \
+        const Value& r = (right);                                                   \
+        int d;                                                                      \
+        if (l.index() == 0 && r.index() == 0 &&                                     \
+            (d = *std::get_if<int>(&r)) != 0 && d != -1) {                          \
+            l = *std::get_if<int>(&l) / d;                                          \
+        } else if (l.index() == 1 && r.index() == 1) {                              \
+            l = *std::get_if<float>(&l) / *std::get_if<float>(&r);                  \
+        } else {                                                                    \
+            l = host.performBinaryOp(l, BinaryOperator::DIVIDE, r);                 \
+        }                                                                           \
+        sp -= (pops);                                                               \
+        VM_NEXT();                                                                  \
+    }
+#define VM_MOD(name, right, pops)                                                   \
+    VM_CASE(name) {                                                                 \
+        Value& l = sp[-1 - (pops)];                                                 \
+        const Value& r = (right);                                                   \
+        int d;                                                                      \
+        if (l.index() == 0 && r.index() == 0 &&                                     \
+            (d = *std::get_if<int>(&r)) != 0 && d != -1) {                          \
+            l = *std::get_if<int>(&l) % d;                                          \
+        } else {                                                                    \
+            l = host.performBinaryOp(l, BinaryOperator::MODULO, r);                 \
+        }                                                                           \
+        sp -= (pops);                                                               \
+        VM_NEXT();                                                                  \
+    }
+
+    VM_DIV(DIV, sp[-1], 1)
+    VM_DIV(DIV_CONST, consts[ins->a], 0)
+    VM_MOD(MOD, sp[-1], 1)
+    VM_MOD(MOD_CONST, consts[ins->a], 0)
+    VM_CASE(AND) {
+        sp[-2] = host.isTruthy(sp[-2]) && host.isTruthy(sp[-1]);
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(OR) {
+        sp[-2] = host.isTruthy(sp[-2]) || host.isTruthy(sp[-1]);
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(NEG) {
+        if (sp[-1].index() == 0) {
+            sp[-1] = -std::get<int>(sp[-1]);
+        } else {
+            sp[-1] = host.performUnaryOp(UnaryOperator::NEGATE, sp[-1]);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(NOT) {
+        sp[-1] = !host.isTruthy(sp[-1]);
+        VM_NEXT();
+    }
+    VM_CASE(TYPEOF) {
+        sp[-1] = host.getTypeOfValue(sp[-1]);
+        VM_NEXT();
+    }
+
+    VM_CASE(JUMP) {
+        ip = code + ins->a;
+        if (Heap::due()) {
+            // Loops jump back here. Slots above the top still hold what
+            // returned frames left there, which would keep it alive.
+            std::fill(sp, stack.data() + stack.size(), Value());
+            Heap::collect();
+        }
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_FALSE) {
+        --sp;
+        bool truthy = sp->index() == 3 ? std::get<bool>(*sp) : host.isTruthy(*sp);
+        if (!truthy) {
+            ip = code + ins->a;
+        }
+        VM_NEXT();
+    }
+
+#define VM_CMP_JUMP(name, op, binop, right, pops)                                   \
+    VM_CASE(name) {                                                                 \
+        const Value& l = sp[-1 - (pops)];                                           \
+        const Value& r = (right);                                                   \
+        bool holds;                                                                 \
+        if (l.index() == 0 && r.index() == 0) {                                     \
+            holds = *std::get_if<int>(&l) op *std::get_if<int>(&r);                 \
+        } else if (l.index() == 1 && r.index() == 1) {                              \
+            holds = *std::get_if<float>(&l) op *std::get_if<float>(&r);             \
+        } else {                                                                    \
+            holds = host.isTruthy(host.performBinaryOp(l, BinaryOperator::binop, r)); \
+        }                                                                           \
+        sp -= 1 + (pops);                                                           \
+        if (!holds) {                                                               \
+            ip = code + ins->a;                                                     \
+        }                                                                           \
+        VM_NEXT();                                                                  \
+    }
+
+    VM_CMP_JUMP(JUMP_IF_NOT_EQ, ==, EQUAL, sp[-1], 1)
+    VM_CMP_JUMP(JUMP_IF_NOT_NE, !=, NOT_EQUAL, sp[-1], 1)
+    VM_CMP_JUMP(JUMP_IF_NOT_LT, <, LESS, sp[-1], 1)
+    VM_CMP_JUMP(JUMP_IF_NOT_GT, >, GREATER, sp[-1], 1)
+    VM_CMP_JUMP(JUMP_IF_NOT_LE, <=, LESS_EQUAL, sp[-1], 1)
+    VM_CMP_JUMP(JUMP_IF_NOT_GE, >=, GREATER_EQUAL, sp[-1], 1)
+    VM_CMP_JUMP(JUMP_IF_NOT_EQ_CONST, ==, EQUAL, consts[ins->b], 0)
+    VM_CMP_JUMP(JUMP_IF_NOT_NE_CONST, !=, NOT_EQUAL, consts[ins->b], 0)
+    VM_CMP_JUMP(JUMP_IF_NOT_LT_CONST, <, LESS, consts[ins->b], 0)
+    VM_CMP_JUMP(JUMP_IF_NOT_GT_CONST, >, GREATER, consts[ins->b], 0)
+    VM_CMP_JUMP(JUMP_IF_NOT_LE_CONST, <=, LESS_EQUAL, consts[ins->b], 0)
+    VM_CMP_JUMP(JUMP_IF_NOT_GE_CONST, >=, GREATER_EQUAL, consts[ins->b], 0)
+
+    VM_CASE(MAKE_ARRAY) {
+        auto arr = std::make_shared<ArrayValue>();
+        arr->reserve(ins->a);
+        for (Value* v = sp - ins->a; v != sp; ++v) {
+            arr->push(std::move(*v));
+        }
+        sp -= ins->a;
+        *sp++ = std::move(arr);
+        VM_NEXT();
+    }
+    VM_CASE(MAKE_OBJECT) {
+        std::shared_ptr<ObjectValue> obj;
+        Value* v = sp - ins->a;
+        if (const Shape* shape = program->keyShapes[ins->b]) {
+            obj = std::make_shared<ObjectValue>(shape, std::vector<Value>(std::make_move_iterator(v), std::make_move_iterator(sp)));
+        } else {
+            obj = std::make_shared<ObjectValue>();
+            for (const auto& key : program->keyLists[ins->b]) {
+                obj->set(key, std::move(*v++));
+            }
+        }
+        sp -= ins->a;
+        *sp++ = std::move(obj);
+        VM_NEXT();
+    }
+    VM_CASE(GET_INDEX) {
+        const Value& obj = sp[-2];
+        const Value& idx = sp[-1];
+        Value result;
+        if (auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&obj)) {
+            auto i = std::get_if<int>(&idx);
+            if (!i || *i < 0 || *i >= static_cast<int>((*arr)->size())) {
+                throw std::runtime_error("Array index out of bounds");
+            }
+            result = (*arr)->at(*i);
+        } else if (auto o = std::get_if<std::shared_ptr<ObjectValue>>(&obj)) {
+            if (const Value* found = (*o)->find(host.valueToString(idx))) {
+                result = *found;
+            } else {
+                result = std::string();
+            }
+        } else if (auto str = std::get_if<std::string>(&obj)) {
+            auto i = std::get_if<int>(&idx);
+            if (!i || *i < 0 || *i >= static_cast<int>(str->size())) {
+                throw std::runtime_error("String index out of bounds");
+            }
+            result = std::string(1, (*str)[*i]);
+        } else {
+            throw std::runtime_error("Index access requires array, object, or string");
+        }
+        --sp;
+        sp[-1] = std::move(result);
+        VM_NEXT();
+    }
+    VM_CASE(SET_INDEX) {
+        Value& obj = sp[-3];
+        Value& idx = sp[-2];
+        Value& val = sp[-1];
+        if (auto arr = std::get_if<std::shared_ptr<ArrayValue>>(&obj)) {
+            auto i = std::get_if<int>(&idx);
+            if (!i) {
+                throw std::runtime_error("Array index must be integer");
+            }
+            if (*i < 0 || *i >= static_cast<int>((*arr)->size())) {
+                throw std::runtime_error("Array index out of bounds");
+            }
+            // Enforce the element type declared on the array variable
+            if (ins->b >= 0) {
+                const VarRef& ref = program->varRefs[ins->b];
+                const TypeDescriptor* type = ref.isGlobal ? globalTypes[ref.slot] : program->varInfos[ref.info].type;
+                const std::string& name = ref.isGlobal ? program->globalNames[ref.slot] : program->varInfos[ref.info].name;
+                if (type && type->element) {
+                    if (!type->element->matches(val)) {
+                        throw std::runtime_error("Type error: cannot assign element to array '" + name +
+                                                 "' of element type '" + type->element->spec + "'");
+                    }
+                }
+            }
+            (*arr)->set(*i, std::move(val));
+        } else if (auto o = std::get_if<std::shared_ptr<ObjectValue>>(&obj)) {
+            auto key = std::get_if<std::string>(&idx);
+            if (!key) {
+                throw std::runtime_error("Object index must be string");
+            }
+            (*o)->set(*key, std::move(val));
+        } else {
+            throw std::runtime_error("Index assignment requires array or object on left side");
+        }
+        sp -= 2;
+        sp[-1] = std::string();
+        VM_NEXT();
+    }
+    VM_CASE(GET_FIELD) {
+        auto o = std::get_if<std::shared_ptr<ObjectValue>>(&sp[-1]);
+        if (!o) {
+            throw std::runtime_error("Field access requires object");
+        }
+        const std::string& field = std::get<std::string>(consts[ins->a]);
+        const Value* found = (*o)->find(field, *program->fieldCaches[ins->b]);
+        Value result = found ? *found : Value(std::string());
+        sp[-1] = std::move(result);
+        VM_NEXT();
+    }
+    VM_CASE(SET_FIELD) {
+        auto o = std::get_if<std::shared_ptr<ObjectValue>>(&sp[-2]);
+        if (!o) {
+            throw std::runtime_error("Field assignment requires object on left side");
+        }
+        (*o)->set(std::get<std::string>(consts[ins->a]), std::move(sp[-1]), *program->fieldCaches[ins->b]);
+        --sp;
+        sp[-1] = std::string();
+        VM_NEXT();
+    }
+
+    VM_CASE(CALL) {
+        size_t argc = static_cast<size_t>(ins->a);
+        const Value& calleeVal = sp[-static_cast<ptrdiff_t>(argc) - 1];
+        const ASTNode* key = nullptr;
+        if (auto decl = std::get_if<FunctionDeclaration*>(&calleeVal)) {
+            key = *decl;
+        } else if (auto expr = std::get_if<FunctionExpression*>(&calleeVal)) {
+            key = *expr;
+        }
+        auto found = key ? program->protoFor.find(key) : program->protoFor.end();
+        if (found == program->protoFor.end()) {
+            throw std::runtime_error("Callee must be a function");
+        }
+        const FunctionProto* callee = found->second;
+        size_t returnSlot = static_cast<size_t>(sp - stack.data()) - argc - 1;
+        VM_ENTER(callee, argc, returnSlot);
+        VM_NEXT();
+    }
+    VM_CASE(CALL_FUNC) {
+        const FunctionProto* callee = functionTable[ins->a];
+        if (!callee) {
+            throw std::runtime_error("Undefined function: " + program->functionNames[ins->a]);
+        }
+        size_t argc = static_cast<size_t>(ins->b);
+        size_t returnSlot = static_cast<size_t>(sp - stack.data()) - argc;
+        VM_ENTER(callee, argc, returnSlot);
+        VM_NEXT();
+    }
+    VM_CASE(CALL_BUILTIN) {
+        Value result;
+        {
+            // Scoped so the arguments are released here: leaving a block
+            // through a computed goto runs no destructors
+            const BuiltinCall& call = program->builtinCalls[ins->a];
+            std::vector<Value> args = std::move(builtinArgs);  // empty if a builtin calls back in here
+            args.assign(std::make_move_iterator(sp - call.argc), std::make_move_iterator(sp));
+            sp -= call.argc;
+            const std::string* arrayName = &kNoName;
+            const TypeDescriptor* arrayType = nullptr;
+            if (call.arrayVar >= 0) {
+                const VarRef& ref = program->varRefs[call.arrayVar];
+                if (ref.isGlobal) {
+                    arrayName = &program->globalNames[ref.slot];
+                    arrayType = globalTypes[ref.slot];
+                } else {
+                    arrayName = &program->varInfos[ref.info].name;
+                    arrayType = program->varInfos[ref.info].type;
+                }
+            }
+            result = call.fn->call(host, args, *arrayName, arrayType);
+            args.clear();
+            builtinArgs = std::move(args);
+        }
+        *sp++ = std::move(result);
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_FUNC) {
+        functionTable[ins->a] = program->protos[ins->b].get();
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_TYPE) {
+        host.typeRegistry[std::get<std::string>(consts[ins->a])] = TypeDescriptor::get(std::get<std::string>(consts[ins->b]));
+        VM_NEXT();
+    }
+    VM_CASE(CONCAT) {
+        std::string result;
+        for (Value* v = sp - ins->a; v != sp; ++v) {
+            if (auto s = std::get_if<std::string>(v)) {
+                result += *s;
+            } else {
+                result += host.valueToString(*v);
+            }
+        }
+        sp -= ins->a;
+        *sp++ = std::move(result);
+        VM_NEXT();
+    }
+    VM_CASE(PUSH_HANDLER) {
+        frame->ip = ip;
+        handlers.push_back({frames.size(), static_cast<size_t>(sp - stack.data()),
+                            frame->proto->code.data() + ins->a});
+        VM_NEXT();
+    }
+    VM_CASE(POP_HANDLER) {
+        handlers.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(RETURN) {
+        Value* result = stack.data() + frame->returnTo;
+        if (result != sp - 1) {
+            take(*result, sp[-1]);
+        }
+        // Release the frame's arrays and objects now rather than whenever
+        // the slots are next written; until then they would be kept alive
+        for (Value* slot = result + 1; slot < sp; ++slot) {
+            if (std::holds_alternative<std::shared_ptr<ArrayValue>>(*slot) ||
+                std::holds_alternative<std::shared_ptr<ObjectValue>>(*slot)) {
+                *slot = Value();
+            }
+        }
+        frames.pop_back();
+        LOAD_FRAME();
+        sp = result + 1;
+        VM_NEXT();
+    }
+    VM_CASE(HALT) {
+        return;
+    }
+
+#ifndef AXO_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef VM_CMP_JUMP
+#undef VM_MOD
+#undef VM_ARITH
+#undef VM_ENTER
+#undef VM_NEXT
+#undef VM_CASE
+#undef LOAD_FRAME
+}